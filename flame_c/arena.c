@@ -0,0 +1,81 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+struct arena_block
+{
+    arena_block_t *next;
+    size_t size, used;
+    unsigned char data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+#define _ROUND_UP(n) (((n) + ARENA_ALIGN-1) & ~(size_t)(ARENA_ALIGN-1))
+
+static arena_block_t *_new_block(size_t size)
+{
+    arena_block_t *b = malloc(sizeof(*b) + size);
+    assert(b);
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    return b;
+}
+
+arena_t *arena_create(size_t block_size)
+{
+    arena_t *a = malloc(sizeof(*a));
+    assert(a);
+    a->block_size = _ROUND_UP(block_size ? block_size : 1);
+    a->head = _new_block(a->block_size);
+    a->used = 0;
+    return a;
+}
+
+void *arena_alloc(arena_t *a, size_t size)
+{
+    size = _ROUND_UP(size ? size : 1);
+    a->used += size;
+    arena_block_t *b = a->head;
+    if (b->size - b->used >= size)
+    {
+        void *ret = b->data + b->used;
+        b->used += size;
+        return ret;
+    }
+    if (size > a->block_size / 2)
+    {
+        // a block of its own behind the head, so the head keeps filling
+        arena_block_t *big = _new_block(size);
+        big->used = size;
+        big->next = b->next;
+        b->next = big;
+        return big->data;
+    }
+    b = _new_block(a->block_size);
+    b->next = a->head;
+    a->head = b;
+    b->used = size;
+    return b->data;
+}
+
+char *arena_strndup(arena_t *a, const char *s, size_t len)
+{
+    char *ret = arena_alloc(a,len+1);
+    memcpy(ret,s,len);
+    ret[len] = '\0';
+    return ret;
+}
+
+void arena_destroy(arena_t *a)
+{
+    arena_block_t *b = a->head;
+    while (b)
+    {
+        arena_block_t *next = b->next;
+        free(b);
+        b = next;
+    }
+    free(a);
+}
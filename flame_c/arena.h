@@ -0,0 +1,34 @@
+/*
+Arena allocator
+Bump allocation from a chain of large blocks, everything is freed at once by
+arena_destroy(). Allocations are aligned to ARENA_ALIGN. Requests larger than
+the block size get a block of their own.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 16
+
+typedef struct arena_block arena_block_t;
+
+typedef struct
+{
+    arena_block_t *head; // block being filled, the others follow
+    size_t block_size;
+    size_t used; // bytes handed out, including alignment padding
+}
+arena_t;
+
+// new arena with blocks of (at least) block_size bytes
+arena_t *arena_create(size_t block_size);
+
+// uninitialized memory that lives until arena_destroy()
+void *arena_alloc(arena_t *a, size_t size);
+
+// copy of len bytes of s with a null terminator added
+char *arena_strndup(arena_t *a, const char *s, size_t len);
+
+// free all blocks and the arena itself
+void arena_destroy(arena_t *a);
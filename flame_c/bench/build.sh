@@ -0,0 +1,7 @@
+LIB=$(ls ../*.c | grep -v main_)
+gcc -g -Wall -O3 -std=gnu99 -pthread $LIB varbench.c varkern_f*.c -lm -lz -o varbench.out
+gcc -g -Wall -O3 -std=gnu99 -pthread $LIB renderbench.c -lm -lz -o renderbench.out
+gcc -g -Wall -O3 -std=gnu99 ../jrand.c ../utils.c mathbench.c -lm -o mathbench.out
+gcc -g -Wall -O3 -std=gnu99 ../arena.c ../json.c ../utils.c jsonbench.c -lm -o jsonbench.out
+gcc -g -Wall -O3 -std=gnu99 -pthread ../lzblock.c ../sparse.c ../utils.c histbench.c -lm -o histbench.out
+gcc -g -Wall -O3 -std=gnu99 -pthread ../image.c ../utils.c imagebench.c -lm -lz -o imagebench.out
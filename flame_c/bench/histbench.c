@@ -0,0 +1,200 @@
+/*
+Histogram storage benchmark.
+
+Writes and reads each raw .buf histogram as it is and as a sparse .sbuf
+(see sparse.h), with and without block compression, for each thread count,
+and checks that the sparse file decodes to the same counts. Rates are in
+MB of raw histogram per second so the formats compare directly, the files
+are in the page cache so they measure encoding more than the disk. Write
+times include sparse_write() encoding, read times sparse_open() and
+sparse_read() or a fread() of the raw file. Timings are the best of several
+repeats.
+
+Results are JSON lines with raw_bytes, bytes, ratio (bytes / raw_bytes),
+tiles (stored / total), write_mb_per_sec and read_mb_per_sec, the raw
+format has lz false and threads 1.
+
+Usage: ./histbench.out [options] <histograms.buf>
+Options:
+  -s, --size <w>x<h>  size of the histograms (required)
+  -t, --threads <n,n,..>
+                      thread counts to run (default 1)
+  -r, --repeats <n>   timed passes per file (default 5)
+  -f, --file <name>   scratch file written and read (default histbench.tmp)
+  -o, --output <file> write results as JSON lines to file (default stdout)
+*/
+
+#include <assert.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../sparse.h"
+#include "../utils.h"
+
+#define DEFAULT_REPEATS 5
+#define MAX_THREAD_COUNTS 16
+
+typedef struct
+{
+    size_t w, h;
+    uint32_t repeats;
+    const char *scratch;
+    FILE *out;
+}
+bench_t;
+
+static void report(const bench_t *b, const char *name, const char *format,
+                   bool lz, uint32_t threads, size_t bytes, uint32_t tiles,
+                   double write_sec, double read_sec)
+{
+    size_t raw = b->w*b->h*sizeof(uint32_t);
+    size_t tiles_len = ((b->w + SPARSE_TILE-1) / SPARSE_TILE)
+        * ((b->h + SPARSE_TILE-1) / SPARSE_TILE);
+    double wmbps = raw / write_sec / 1e6, rmbps = raw / read_sec / 1e6;
+    fprintf(stderr,"%-24s %-6s %3s %7u %12lu %8.4f %6u/%-6lu %10.1f "
+        "%10.1f\n",name,format,lz ? "lz" : "-",threads,bytes,
+        (double)bytes/raw,tiles,tiles_len,wmbps,rmbps);
+    fprintf(b->out,"{\"name\":\"%s\",\"format\":\"%s\",\"lz\":%s,"
+        "\"threads\":%u,\"raw_bytes\":%lu,\"bytes\":%lu,\"ratio\":%.6g,"
+        "\"tiles\":%u,\"tiles_len\":%lu,\"write_mb_per_sec\":%.6g,"
+        "\"read_mb_per_sec\":%.6g}\n",name,format,lz ? "true" : "false",
+        threads,raw,bytes,(double)bytes/raw,tiles,tiles_len,wmbps,rmbps);
+}
+
+static void run_raw(const bench_t *b, const char *name, const uint32_t *hist,
+                    uint32_t *check)
+{
+    size_t raw = b->w*b->h*sizeof(*hist);
+    double best_write = INFINITY, best_read = INFINITY;
+    for (uint32_t r = 0; r < b->repeats; ++r)
+    {
+        double t0 = wall_time();
+        FILE *f = fopen(b->scratch,"wb");
+        assert(f);
+        size_t n = fwrite(hist,raw,1,f);
+        fclose(f);
+        double t1 = wall_time();
+        f = fopen(b->scratch,"rb");
+        assert(f);
+        n += fread(check,raw,1,f);
+        fclose(f);
+        double t2 = wall_time();
+        assert(n == 2);
+        best_write = fmin(best_write,t1-t0);
+        best_read = fmin(best_read,t2-t1);
+    }
+    report(b,name,"buf",false,1,raw,0,best_write,best_read);
+}
+
+static void run_sparse(const bench_t *b, const char *name,
+                       const uint32_t *hist, uint32_t *check, bool lz,
+                       uint32_t threads)
+{
+    size_t raw = b->w*b->h*sizeof(*hist);
+    double best_write = INFINITY, best_read = INFINITY;
+    size_t bytes = 0;
+    uint32_t tiles = 0;
+    for (uint32_t r = 0; r < b->repeats; ++r)
+    {
+        double t0 = wall_time();
+        bytes = sparse_write(b->scratch,hist,b->w,b->h,lz,threads);
+        assert(bytes);
+        double t1 = wall_time();
+        sparse_file_t *f = sparse_open(b->scratch);
+        assert(f);
+        sparse_read(f,check,false,threads);
+        tiles = sparse_info(f)->tiles;
+        sparse_close(f);
+        double t2 = wall_time();
+        if (memcmp(hist,check,raw))
+        {
+            fprintf(stderr,"%s: decoded histogram differs\n",name);
+            exit(1);
+        }
+        best_write = fmin(best_write,t1-t0);
+        best_read = fmin(best_read,t2-t1);
+    }
+    report(b,name,"sbuf",lz,threads,bytes,tiles,best_write,best_read);
+}
+
+static const struct option _long_opts[] =
+{
+    {"size", required_argument, NULL, 's'},
+    {"threads", required_argument, NULL, 't'},
+    {"repeats", required_argument, NULL, 'r'},
+    {"file", required_argument, NULL, 'f'},
+    {"output", required_argument, NULL, 'o'},
+    {NULL, 0, NULL, 0}
+};
+
+int main(int argc, char **argv)
+{
+    bench_t b = {0, 0, DEFAULT_REPEATS, "histbench.tmp", stdout};
+    uint32_t thread_counts[MAX_THREAD_COUNTS] = {1};
+    size_t thread_counts_len = 1;
+    int opt;
+    while ((opt = getopt_long(argc,argv,"s:t:r:f:o:",_long_opts,NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            if (sscanf(optarg,"%lux%lu",&b.w,&b.h) != 2 || !b.w || !b.h)
+            {
+                fprintf(stderr,"bad size: %s\n",optarg);
+                return 1;
+            }
+            break;
+        case 't':
+            thread_counts_len = 0;
+            for (char *s = strtok(optarg,","); s; s = strtok(NULL,","))
+            {
+                assert(thread_counts_len < MAX_THREAD_COUNTS);
+                thread_counts[thread_counts_len] = strtoul(s,NULL,10);
+                assert(thread_counts[thread_counts_len++]);
+            }
+            break;
+        case 'r':
+            b.repeats = strtoul(optarg,NULL,10);
+            assert(b.repeats);
+            break;
+        case 'f':
+            b.scratch = optarg;
+            break;
+        case 'o':
+            b.out = fopen(optarg,"w");
+            assert(b.out);
+            break;
+        default:
+            fprintf(stderr,"usage: %s -s <w>x<h> [-t <n,n,..>] "
+                "[-r <repeats>] [-f <file>] [-o <file>] <histograms.buf>\n",
+                argv[0]);
+            return 1;
+        }
+    }
+    assert(b.w && optind < argc);
+    fprintf(stderr,"%-24s %-6s %3s %7s %12s %8s %13s %10s %10s\n","file",
+        "format","lz","threads","bytes","ratio","tiles","write MB/s",
+        "read MB/s");
+    size_t raw = b.w*b.h*sizeof(uint32_t);
+    uint32_t *check = malloc(raw);
+    assert(check);
+    for (int i = optind; i < argc; ++i)
+    {
+        size_t len;
+        const uint32_t *hist = (const uint32_t*)map_file(argv[i],&len);
+        assert(hist && len == raw);
+        run_raw(&b,argv[i],hist,check);
+        for (int lz = 0; lz < 2; ++lz)
+            for (size_t t = 0; t < thread_counts_len; ++t)
+                run_sparse(&b,argv[i],hist,check,lz,thread_counts[t]);
+        unmap_file((const char*)hist,len);
+    }
+    remove(b.scratch);
+    free(check);
+    if (b.out != stdout)
+        fclose(b.out);
+    return 0;
+}
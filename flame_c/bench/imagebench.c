@@ -0,0 +1,221 @@
+/*
+Image output benchmark.
+
+Writes a grayscale image with image.h in each format for each thread count
+and reports the encode rate and file size. The image is a histogram given
+on the command line (a raw .buf) tiled to the image size and tone mapped
+like the renderer does, or a smooth synthetic gradient, which is harder to
+compress than most flames. Rows are written one at a time as the renderer
+and the mandelbrot program do. Timings are the best of several repeats and
+include writing the file, which stays in the page cache.
+
+Results are JSON lines with format, threads, bytes and mpix_per_sec.
+
+Usage: ./imagebench.out [options] [<histogram.buf>]
+Options:
+  -s, --size <w>x<h>  image size (default 15360x8640)
+  -i, --input-size <w>x<h>
+                      size of the histogram (required with one)
+  -f, --formats <f,f,..>
+                      formats to write (default pgm,pgm16,png,png16)
+  -t, --threads <n,n,..>
+                      thread counts to run for PNG (default 1)
+  -l, --level <n>     zlib level (default IMAGE_DEFAULT_LEVEL)
+  -r, --repeats <n>   timed passes per run (default 3)
+  -o, --output <file> write results as JSON lines to file (default stdout)
+*/
+
+#include <assert.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../image.h"
+#include "../tonemap.h"
+#include "../utils.h"
+
+#define DEFAULT_REPEATS 3
+#define MAX_LIST 16
+#define SCRATCH_FILE "imagebench.tmp"
+
+// the histogram tiled to w x h and tone mapped to 8 and 16 bit levels, top
+// down, or a gradient without one
+static void make_image(const uint32_t *hist, size_t hw, size_t hh, size_t w,
+                       size_t h, uint8_t *img8, uint16_t *img16)
+{
+    uint32_t max_sample = 0;
+    for (size_t i = 0; hist && i < hw*hh; ++i)
+        if (hist[i] > max_sample)
+            max_sample = hist[i];
+    num_t log_max = SCALE(max_sample);
+    for (size_t r = 0; r < h; ++r)
+        for (size_t c = 0; c < w; ++c)
+        {
+            size_t i = r*w + c;
+            if (!hist)
+            {
+                double v = 0.5 + 0.5*sin(c*0.01)*cos(r*0.013);
+                img8[i] = v*255.0;
+                img16[i] = v*65535.0;
+                continue;
+            }
+            uint32_t n = hist[(hh-1 - r % hh)*hw + c % hw];
+            img8[i] = tonemap_gray(n,log_max);
+            img16[i] = tonemap_gray16(n,log_max);
+        }
+}
+
+static void run(const char *fmt_name, uint32_t threads, int level,
+                const void *img, size_t w, size_t h, uint32_t repeats,
+                FILE *out)
+{
+    image_format_t f;
+    bool known = image_format_from_name(fmt_name,&f);
+    assert(known);
+    f.threads = threads;
+    f.level = level;
+    size_t row = w*f.bits/8;
+    double best = INFINITY;
+    size_t bytes = 0;
+    for (uint32_t r = 0; r < repeats; ++r)
+    {
+        double t0 = wall_time();
+        image_writer_t *im = image_open(SCRATCH_FILE,&f,w,h,1);
+        assert(im);
+        for (size_t y = 0; y < h; ++y)
+            image_write_rows(im,(const uint8_t*)img + y*row,1);
+        bool ok = image_close(im);
+        assert(ok);
+        best = fmin(best,wall_time()-t0);
+        FILE *file = fopen(SCRATCH_FILE,"rb");
+        assert(file);
+        fseek(file,0,SEEK_END);
+        bytes = ftell(file);
+        fclose(file);
+    }
+    double mpix = w*h / best / 1e6;
+    fprintf(stderr,"%-8s %7u %12lu %10.4f %12.1f\n",fmt_name,threads,bytes,
+        best,mpix);
+    fprintf(out,"{\"format\":\"%s\",\"threads\":%u,\"width\":%lu,"
+        "\"height\":%lu,\"bytes\":%lu,\"sec\":%.6g,\"mpix_per_sec\":%.6g}\n",
+        fmt_name,threads,w,h,bytes,best,mpix);
+}
+
+// split a comma separated list in place, returns the number of items
+static size_t split_list(char *s, char **items)
+{
+    size_t n = 0;
+    for (char *t = strtok(s,","); t; t = strtok(NULL,","))
+    {
+        assert(n < MAX_LIST);
+        items[n++] = t;
+    }
+    return n;
+}
+
+static const struct option _long_opts[] =
+{
+    {"size", required_argument, NULL, 's'},
+    {"input-size", required_argument, NULL, 'i'},
+    {"formats", required_argument, NULL, 'f'},
+    {"threads", required_argument, NULL, 't'},
+    {"level", required_argument, NULL, 'l'},
+    {"repeats", required_argument, NULL, 'r'},
+    {"output", required_argument, NULL, 'o'},
+    {NULL, 0, NULL, 0}
+};
+
+int main(int argc, char **argv)
+{
+    size_t w = 15360, h = 8640, hw = 0, hh = 0;
+    char default_formats[] = "pgm,pgm16,png,png16", thread_one[] = "1";
+    char *formats[MAX_LIST], *threads[MAX_LIST];
+    size_t formats_len = split_list(default_formats,formats);
+    size_t threads_len = split_list(thread_one,threads);
+    int level = 0;
+    uint32_t repeats = DEFAULT_REPEATS;
+    FILE *out = stdout;
+    int opt;
+    while ((opt = getopt_long(argc,argv,"s:i:f:t:l:r:o:",_long_opts,NULL))
+        != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            if (sscanf(optarg,"%lux%lu",&w,&h) != 2 || !w || !h)
+            {
+                fprintf(stderr,"bad size: %s\n",optarg);
+                return 1;
+            }
+            break;
+        case 'i':
+            if (sscanf(optarg,"%lux%lu",&hw,&hh) != 2 || !hw || !hh)
+            {
+                fprintf(stderr,"bad size: %s\n",optarg);
+                return 1;
+            }
+            break;
+        case 'f':
+            formats_len = split_list(optarg,formats);
+            break;
+        case 't':
+            threads_len = split_list(optarg,threads);
+            break;
+        case 'l':
+            level = atoi(optarg);
+            assert(0 <= level && level <= 9);
+            break;
+        case 'r':
+            repeats = strtoul(optarg,NULL,10);
+            assert(repeats);
+            break;
+        case 'o':
+            out = fopen(optarg,"w");
+            assert(out);
+            break;
+        default:
+            fprintf(stderr,"usage: %s [-s <w>x<h>] [-i <w>x<h>] "
+                "[-f <f,f,..>] [-t <n,n,..>] [-l <level>] [-r <repeats>] "
+                "[-o <file>] [<histogram.buf>]\n",argv[0]);
+            return 1;
+        }
+    }
+    const uint32_t *hist = NULL;
+    size_t hist_len = 0;
+    if (optind < argc)
+    {
+        hist = (const uint32_t*)map_file(argv[optind],&hist_len);
+        assert(hist && hw && hist_len == hw*hh*sizeof(*hist));
+    }
+    uint8_t *img8 = malloc(w*h);
+    uint16_t *img16 = malloc(w*h*sizeof(*img16));
+    assert(img8 && img16);
+    make_image(hist,hw,hh,w,h,img8,img16);
+    fprintf(stderr,"%-8s %7s %12s %10s %12s\n","format","threads","bytes",
+        "sec","Mpix/s");
+    for (size_t i = 0; i < formats_len; ++i)
+    {
+        image_format_t f;
+        if (!image_format_from_name(formats[i],&f))
+        {
+            fprintf(stderr,"unknown image format: %s\n",formats[i]);
+            return 1;
+        }
+        const void *img = f.bits == 8 ? (void*)img8 : (void*)img16;
+        // threads only matter for PNG
+        size_t runs = f.container == IMAGE_PNG ? threads_len : 1;
+        for (size_t t = 0; t < runs; ++t)
+            run(formats[i],f.container == IMAGE_PNG
+                ? strtoul(threads[t],NULL,10) : 1,level,img,w,h,repeats,out);
+    }
+    remove(SCRATCH_FILE);
+    if (hist)
+        unmap_file((const char*)hist,hist_len);
+    free(img8);
+    free(img16);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
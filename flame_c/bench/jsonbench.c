@@ -0,0 +1,189 @@
+/*
+JSON parse benchmark.
+
+Times json_load, a walk over the document and json_destroy for each file.
+The walk looks up every object member by its key and indexes every array
+element, like the flame parser does. A top level array can be repeated up to
+a number of elements to make a large batch file out of a small one. Heap
+bytes are the allocator's count of bytes in use while the document is
+loaded. Timings are the best of several repeats.
+
+Results are JSON lines with bytes, elements, load_mb_per_sec, walk_sec,
+destroy_sec and heap_bytes.
+
+Usage: ./jsonbench.out [options] <files.json>
+Options:
+  -n, --elements <n>  repeat the elements of a top level array up to n
+                      elements (default as in the file)
+  -r, --repeats <n>   timed passes per file (default 5)
+  -o, --output <file> write results as JSON lines to file (default stdout)
+*/
+
+#include <assert.h>
+#include <getopt.h>
+#include <malloc.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../json.h"
+#include "../utils.h"
+
+#define DEFAULT_REPEATS 5
+
+// the elements of the top level array repeated up to n, as compact JSON
+static char *make_batch(const char *data, size_t n)
+{
+    json_value j = json_load(data);
+    assert(j->type == JSON_ARRAY);
+    json_array a = j->value.as_array;
+    size_t len = json_array_len(a);
+    assert(len);
+    char **dumps = malloc(len*sizeof(*dumps));
+    size_t *lens = malloc(len*sizeof(*lens));
+    assert(dumps && lens);
+    size_t total = 2;
+    for (size_t i = 0; i < len; ++i)
+    {
+        dumps[i] = json_dump(json_array_get(a,i),0);
+        lens[i] = strlen(dumps[i]);
+    }
+    for (size_t i = 0; i < n; ++i)
+        total += lens[i % len] + 1;
+    char *ret = malloc(total+1);
+    assert(ret);
+    size_t k = 0;
+    ret[k++] = '[';
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i)
+            ret[k++] = ',';
+        memcpy(ret+k,dumps[i % len],lens[i % len]);
+        k += lens[i % len];
+    }
+    ret[k++] = ']';
+    ret[k] = '\0';
+    for (size_t i = 0; i < len; ++i)
+        free(dumps[i]);
+    free(dumps);
+    free(lens);
+    json_destroy(j);
+    return ret;
+}
+
+// number of values reached
+static size_t walk(json_value v)
+{
+    size_t n = 1;
+    if (v->type == JSON_ARRAY)
+    {
+        json_array a = v->value.as_array;
+        size_t len = json_array_len(a);
+        for (size_t i = 0; i < len; ++i)
+            n += walk(json_array_get(a,i));
+    }
+    else if (v->type == JSON_OBJECT)
+    {
+        json_object o = v->value.as_object;
+        size_t len = json_object_len(o);
+        for (size_t i = 0; i < len; ++i)
+        {
+            json_value m = json_object_get(o,json_object_key_at(o,i));
+            assert(m == json_object_value_at(o,i));
+            n += walk(m);
+        }
+    }
+    return n;
+}
+
+static void run(const char *name, const char *data, uint32_t repeats,
+                FILE *out)
+{
+    size_t bytes = strlen(data);
+    double best_load = INFINITY, best_walk = INFINITY;
+    double best_destroy = INFINITY;
+    size_t values = 0, elements = 0, heap = 0;
+    for (uint32_t r = 0; r < repeats; ++r)
+    {
+        size_t heap_before = mallinfo2().uordblks;
+        double t0 = wall_time();
+        json_value j = json_load(data);
+        double t1 = wall_time();
+        values = walk(j);
+        double t2 = wall_time();
+        heap = mallinfo2().uordblks - heap_before;
+        elements = j->type == JSON_ARRAY ? json_array_len(j->value.as_array)
+            : 1;
+        json_destroy(j);
+        double t3 = wall_time();
+        best_load = fmin(best_load,t1-t0);
+        best_walk = fmin(best_walk,t2-t1);
+        best_destroy = fmin(best_destroy,t3-t2);
+    }
+    double mbps = bytes / best_load / 1e6;
+    fprintf(stderr,"%-32s %12lu %9lu %10lu %10.1f %10.4f %10.4f %12lu\n",
+        name,bytes,elements,values,mbps,best_walk,best_destroy,heap);
+    fprintf(out,"{\"name\":\"%s\",\"bytes\":%lu,\"elements\":%lu,"
+        "\"values\":%lu,\"load_mb_per_sec\":%.6g,\"walk_sec\":%.6g,"
+        "\"destroy_sec\":%.6g,\"heap_bytes\":%lu}\n",name,bytes,elements,
+        values,mbps,best_walk,best_destroy,heap);
+}
+
+static const struct option _long_opts[] =
+{
+    {"elements", required_argument, NULL, 'n'},
+    {"repeats", required_argument, NULL, 'r'},
+    {"output", required_argument, NULL, 'o'},
+    {NULL, 0, NULL, 0}
+};
+
+int main(int argc, char **argv)
+{
+    size_t elements = 0;
+    uint32_t repeats = DEFAULT_REPEATS;
+    FILE *out = stdout;
+    int opt;
+    while ((opt = getopt_long(argc,argv,"n:r:o:",_long_opts,NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            elements = strtoul(optarg,NULL,10);
+            assert(elements);
+            break;
+        case 'r':
+            repeats = strtoul(optarg,NULL,10);
+            assert(repeats);
+            break;
+        case 'o':
+            out = fopen(optarg,"w");
+            assert(out);
+            break;
+        default:
+            fprintf(stderr,"usage: %s [-n <elements>] [-r <repeats>] "
+                "[-o <file>] <files.json>\n",argv[0]);
+            return 1;
+        }
+    }
+    assert(optind < argc);
+    fprintf(stderr,"%-32s %12s %9s %10s %10s %10s %10s %12s\n","file",
+        "bytes","elements","values","load MB/s","walk sec","destroy sec",
+        "heap bytes");
+    for (int i = optind; i < argc; ++i)
+    {
+        char *data = read_text_file(argv[i]);
+        assert(data);
+        if (elements)
+        {
+            char *batch = make_batch(data,elements);
+            free(data);
+            data = batch;
+        }
+        run(argv[i],data,repeats,out);
+        free(data);
+    }
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
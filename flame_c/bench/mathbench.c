@@ -0,0 +1,418 @@
+/*
+Fast math accuracy and speed harness.
+
+Evaluates every function of fastmath.h at every tier for the scalar float
+and double versions and the vector versions on random inputs from a fixed
+seed, against libm in long double on the same (rounded) inputs. The error
+is measured like the bounds are stated: absolute for results up to 1 in
+magnitude and relative above. A tier exceeding its bound, or a non finite
+result where the reference is finite, fails the run with exit status 2.
+The exact tier is held to the precise bound.
+
+Timings are the best of several passes over the inputs in ns per element.
+
+Usage: ./mathbench.out [options]
+Options:
+  -n, --inputs <n>    number of inputs per function (default 65536)
+  -r, --repeats <n>   timed passes (default 5)
+  -f, --function <name>
+                      only run this function
+  -o, --output <file> write results as JSON lines to file (default stdout)
+*/
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../fastmath.h"
+#include "../jrand.h"
+#include "../utils.h"
+
+#define DEFAULT_INPUTS (1 << 16)
+#define DEFAULT_REPEATS 5
+#define INPUT_SEED 0x5eed
+
+static const char *const TIER_NAMES[] = {"exact","precise","fast"};
+static const double TIER_BOUNDS[] = {1e-6,1e-6,1e-3};
+
+// run a statement with the tier as the constant T so it is inlined for it
+#define TIERED(tier,stmt) \
+    switch (tier) \
+    { \
+    case MATH_EXACT: { const math_tier_t T = MATH_EXACT; stmt; } break; \
+    case MATH_PRECISE: { const math_tier_t T = MATH_PRECISE; stmt; } break; \
+    case MATH_FAST: { const math_tier_t T = MATH_FAST; stmt; } break; \
+    }
+
+// n elements of type E (scalar or vector) from a and b to o1 and o2
+typedef void (*math_run_t)(const void *a, const void *b, void *o1, void *o2,
+                            size_t n, math_tier_t tier);
+
+// runners for type E, named with S, calling the functions with suffix sfx
+#define RUNS(S,E,sfx) \
+static void _sincos_##S(const void *a, const void *b, void *o1, void *o2, \
+                        size_t n, math_tier_t tier) \
+{ \
+    const E *x = a; E *s = o1, *c = o2; (void)b; \
+    TIERED(tier,for (size_t i = 0; i < n; ++i) \
+        fm_sincos##sfx(x[i],s+i,c+i,T)); \
+} \
+static void _tan_##S(const void *a, const void *b, void *o1, void *o2, \
+                    size_t n, math_tier_t tier) \
+{ \
+    const E *x = a; E *r = o1; (void)b; (void)o2; \
+    TIERED(tier,for (size_t i = 0; i < n; ++i) r[i] = fm_tan##sfx(x[i],T)); \
+} \
+static void _atan2_##S(const void *a, const void *b, void *o1, void *o2, \
+                        size_t n, math_tier_t tier) \
+{ \
+    const E *y = a, *x = b; E *r = o1; (void)o2; \
+    TIERED(tier,for (size_t i = 0; i < n; ++i) \
+        r[i] = fm_atan2##sfx(y[i],x[i],T)); \
+} \
+static void _exp_##S(const void *a, const void *b, void *o1, void *o2, \
+                    size_t n, math_tier_t tier) \
+{ \
+    const E *x = a; E *r = o1; (void)b; (void)o2; \
+    TIERED(tier,for (size_t i = 0; i < n; ++i) r[i] = fm_exp##sfx(x[i],T)); \
+} \
+static void _log_##S(const void *a, const void *b, void *o1, void *o2, \
+                    size_t n, math_tier_t tier) \
+{ \
+    const E *x = a; E *r = o1; (void)b; (void)o2; \
+    TIERED(tier,for (size_t i = 0; i < n; ++i) r[i] = fm_log##sfx(x[i],T)); \
+} \
+static void _pow_##S(const void *a, const void *b, void *o1, void *o2, \
+                    size_t n, math_tier_t tier) \
+{ \
+    const E *x = a, *y = b; E *r = o1; (void)o2; \
+    TIERED(tier,for (size_t i = 0; i < n; ++i) \
+        r[i] = fm_pow##sfx(x[i],y[i],T)); \
+} \
+static void _sinhcosh_##S(const void *a, const void *b, void *o1, void *o2, \
+                        size_t n, math_tier_t tier) \
+{ \
+    const E *x = a; E *s = o1, *c = o2; (void)b; \
+    TIERED(tier,for (size_t i = 0; i < n; ++i) \
+        fm_sinhcosh##sfx(x[i],s+i,c+i,T)); \
+}
+
+RUNS(f32,float,f)
+RUNS(f64,double,)
+RUNS(v4f,fm_v4f,_v4f)
+RUNS(v2d,fm_v2d,_v2d)
+
+static void _hypot_f32(const void *a, const void *b, void *o1, void *o2,
+                        size_t n, math_tier_t tier)
+{
+    const float *x = a, *y = b;
+    float *r = o1;
+    (void)o2;
+    TIERED(tier,for (size_t i = 0; i < n; ++i) r[i] = fm_hypotf(x[i],y[i],T));
+}
+
+static void _hypot_f64(const void *a, const void *b, void *o1, void *o2,
+                        size_t n, math_tier_t tier)
+{
+    const double *x = a, *y = b;
+    double *r = o1;
+    (void)o2;
+    TIERED(tier,for (size_t i = 0; i < n; ++i) r[i] = fm_hypot(x[i],y[i],T));
+}
+
+// reference in long double, writes one or two results
+typedef void (*math_ref_t)(long double a, long double b, long double *r1,
+                            long double *r2);
+
+static void _ref_sincos(long double a, long double b, long double *r1,
+                        long double *r2)
+{
+    *r1 = sinl(a);
+    *r2 = cosl(a);
+}
+
+static void _ref_tan(long double a, long double b, long double *r1,
+                    long double *r2)
+{
+    *r1 = tanl(a);
+}
+
+static void _ref_atan2(long double a, long double b, long double *r1,
+                        long double *r2)
+{
+    *r1 = atan2l(a,b);
+}
+
+static void _ref_exp(long double a, long double b, long double *r1,
+                    long double *r2)
+{
+    *r1 = expl(a);
+}
+
+static void _ref_log(long double a, long double b, long double *r1,
+                    long double *r2)
+{
+    *r1 = logl(a);
+}
+
+static void _ref_pow(long double a, long double b, long double *r1,
+                    long double *r2)
+{
+    *r1 = powl(a,b);
+}
+
+static void _ref_sinhcosh(long double a, long double b, long double *r1,
+                        long double *r2)
+{
+    *r1 = sinhl(a);
+    *r2 = coshl(a);
+}
+
+static void _ref_hypot(long double a, long double b, long double *r1,
+                        long double *r2)
+{
+    *r1 = hypotl(a,b);
+}
+
+#define NUM_TYPES 4
+static const char *const TYPE_NAMES[NUM_TYPES] =
+    {"float","double","v4f","v2d"};
+static const size_t TYPE_LANES[NUM_TYPES] = {1,1,4,2};
+static const bool TYPE_FLOAT[NUM_TYPES] = {true,false,true,false};
+
+// a function with the input domain it is checked on, inputs are uniform in
+// [lo,hi] or with log2 uniform there if exp2 is set
+typedef struct
+{
+    const char *name;
+    uint32_t args, results;
+    double lo[2], hi[2];
+    bool exp2[2];
+    math_ref_t ref;
+    math_run_t run[NUM_TYPES]; // NULL where there is no version
+}
+math_func_t;
+
+static const math_func_t FUNCS[] =
+{
+    {"sincos",1,2,{-_2PI},{_2PI},{false},&_ref_sincos,
+        {&_sincos_f32,&_sincos_f64,&_sincos_v4f,&_sincos_v2d}},
+    {"sincos_wide",1,2,{-8192.0},{8192.0},{false},&_ref_sincos,
+        {&_sincos_f32,&_sincos_f64,&_sincos_v4f,&_sincos_v2d}},
+    {"tan",1,1,{-4.0*_PI},{4.0*_PI},{false},&_ref_tan,
+        {&_tan_f32,&_tan_f64,&_tan_v4f,&_tan_v2d}},
+    {"atan2",2,1,{-10.0,-10.0},{10.0,10.0},{false,false},&_ref_atan2,
+        {&_atan2_f32,&_atan2_f64,&_atan2_v4f,&_atan2_v2d}},
+    {"exp",1,1,{-80.0},{80.0},{false},&_ref_exp,
+        {&_exp_f32,&_exp_f64,&_exp_v4f,&_exp_v2d}},
+    {"log",1,1,{-60.0},{60.0},{true},&_ref_log,
+        {&_log_f32,&_log_f64,&_log_v4f,&_log_v2d}},
+    {"pow",2,1,{-10.0,-1.0},{10.0,1.0},{true,false},&_ref_pow,
+        {&_pow_f32,&_pow_f64,&_pow_v4f,&_pow_v2d}},
+    {"sinhcosh",1,2,{-20.0},{20.0},{false},&_ref_sinhcosh,
+        {&_sinhcosh_f32,&_sinhcosh_f64,&_sinhcosh_v4f,&_sinhcosh_v2d}},
+    {"hypot",2,1,{-100.0,-100.0},{100.0,100.0},{false,false},&_ref_hypot,
+        {&_hypot_f32,&_hypot_f64,NULL,NULL}},
+    {NULL}
+};
+
+typedef struct
+{
+    double ns;
+    double max_err, mean_err;
+    uint64_t nonfinite; // non finite results where the reference is finite
+}
+math_result_t;
+
+// error of a result against the reference
+static inline double _error(long double v, long double ref)
+{
+    long double d = fabsl(v - ref);
+    long double m = fabsl(ref);
+    return (double)(m > 1.0L ? d/m : d);
+}
+
+// inputs for argument k of a function, rounded to the type precision
+static void make_inputs(const math_func_t *f, uint32_t k, bool single,
+                        double *in, size_t len)
+{
+    jrand_t j;
+    jrand_init_seed(&j,INPUT_SEED+k);
+    for (size_t i = 0; i < len; ++i)
+    {
+        double x = f->lo[k] + (f->hi[k] - f->lo[k]) * jrand_next_double(&j);
+        if (f->exp2[k])
+            x = exp2(x);
+        in[i] = single ? (float)x : x;
+    }
+}
+
+// copy doubles to an array of the type
+static void *to_type(const double *in, size_t len, bool single)
+{
+    void *buf = aligned_alloc(16,len*(single ? sizeof(float)
+        : sizeof(double)));
+    assert(buf);
+    for (size_t i = 0; i < len; ++i)
+        if (single)
+            ((float*)buf)[i] = in[i];
+        else
+            ((double*)buf)[i] = in[i];
+    return buf;
+}
+
+static inline long double _element(const void *buf, size_t i, bool single)
+{
+    return single ? ((const float*)buf)[i] : ((const double*)buf)[i];
+}
+
+static void measure(const math_func_t *f, int type, math_tier_t tier,
+                    const double *in0, const double *in1, size_t len,
+                    uint32_t repeats, math_result_t *res)
+{
+    bool single = TYPE_FLOAT[type];
+    size_t esize = single ? sizeof(float) : sizeof(double);
+    void *a = to_type(in0,len,single);
+    void *b = to_type(in1,len,single);
+    void *o1 = aligned_alloc(16,len*esize);
+    void *o2 = aligned_alloc(16,len*esize);
+    assert(o1 && o2);
+    memset(o2,0,len*esize);
+    math_run_t run = f->run[type];
+    size_t n = len / TYPE_LANES[type];
+    run(a,b,o1,o2,n,tier); // also the warm up
+    double err_sum = 0.0;
+    res->max_err = 0.0;
+    res->nonfinite = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        long double r[2];
+        f->ref(in0[i],in1[i],r,r+1);
+        for (uint32_t k = 0; k < f->results; ++k)
+        {
+            long double v = _element(k ? o2 : o1,i,single);
+            if (!isfinite(r[k]))
+                continue;
+            if (!isfinite(v))
+            {
+                ++res->nonfinite;
+                continue;
+            }
+            double e = _error(v,r[k]);
+            if (e > res->max_err)
+                res->max_err = e;
+            err_sum += e;
+        }
+    }
+    res->mean_err = err_sum / (len*f->results);
+    double best = INFINITY;
+    for (uint32_t r = 0; r < repeats; ++r)
+    {
+        double start = wall_time();
+        run(a,b,o1,o2,n,tier);
+        double t = wall_time() - start;
+        if (t < best)
+            best = t;
+    }
+    res->ns = 1e9 * best / len;
+    free(a);
+    free(b);
+    free(o1);
+    free(o2);
+}
+
+static const struct option _long_opts[] =
+{
+    {"inputs", required_argument, NULL, 'n'},
+    {"repeats", required_argument, NULL, 'r'},
+    {"function", required_argument, NULL, 'f'},
+    {"output", required_argument, NULL, 'o'},
+    {NULL, 0, NULL, 0}
+};
+
+int main(int argc, char **argv)
+{
+    size_t inputs = DEFAULT_INPUTS;
+    uint32_t repeats = DEFAULT_REPEATS;
+    const char *only = NULL;
+    FILE *out = stdout;
+    int opt;
+    while ((opt = getopt_long(argc,argv,"n:r:f:o:",_long_opts,NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            inputs = strtoul(optarg,NULL,10);
+            assert(inputs);
+            break;
+        case 'r':
+            repeats = strtoul(optarg,NULL,10);
+            assert(repeats);
+            break;
+        case 'f':
+            only = optarg;
+            break;
+        case 'o':
+            out = fopen(optarg,"w");
+            assert(out);
+            break;
+        default:
+            fprintf(stderr,"usage: %s [-n <inputs>] [-r <repeats>] "
+                "[-f <function>] [-o <file>]\n",argv[0]);
+            return 1;
+        }
+    }
+    // whole vectors only
+    inputs = (inputs + 3) & ~(size_t)3;
+    double *in0 = malloc(inputs*sizeof(*in0));
+    double *in1 = malloc(inputs*sizeof(*in1));
+    assert(in0 && in1);
+    uint32_t failures = 0;
+    fprintf(stderr,"%-12s %-7s %-8s %9s %12s %12s %9s\n","function","type",
+        "tier","ns","max err","mean err","nonfinite");
+    for (const math_func_t *f = FUNCS; f->name; ++f)
+    {
+        if (only && strcmp(only,f->name))
+            continue;
+        for (int type = 0; type < NUM_TYPES; ++type)
+        {
+            if (!f->run[type])
+                continue;
+            make_inputs(f,0,TYPE_FLOAT[type],in0,inputs);
+            if (f->args > 1)
+                make_inputs(f,1,TYPE_FLOAT[type],in1,inputs);
+            else
+                memset(in1,0,inputs*sizeof(*in1));
+            for (math_tier_t tier = MATH_EXACT; tier <= MATH_FAST; ++tier)
+            {
+                math_result_t res;
+                measure(f,type,tier,in0,in1,inputs,repeats,&res);
+                bool ok = res.max_err <= TIER_BOUNDS[tier] && !res.nonfinite;
+                failures += !ok;
+                fprintf(stderr,"%-12s %-7s %-8s %9.3f %12.3e %12.3e %9lu%s\n",
+                    f->name,TYPE_NAMES[type],TIER_NAMES[tier],res.ns,
+                    res.max_err,res.mean_err,res.nonfinite,
+                    ok ? "" : " FAIL");
+                fprintf(out,"{\"function\":\"%s\",\"type\":\"%s\","
+                    "\"tier\":\"%s\",\"inputs\":%lu,\"ns\":%.6g,"
+                    "\"max_err\":%.6g,\"mean_err\":%.6g,\"nonfinite\":%lu,"
+                    "\"bound\":%g,\"ok\":%s}\n",f->name,TYPE_NAMES[type],
+                    TIER_NAMES[tier],inputs,res.ns,res.max_err,res.mean_err,
+                    res.nonfinite,TIER_BOUNDS[tier],ok ? "true" : "false");
+            }
+        }
+    }
+    if (out != stdout)
+        fclose(out);
+    free(in0);
+    free(in1);
+    if (failures)
+        fprintf(stderr,"%u over the error bound\n",failures);
+    return failures ? 2 : 0;
+}
@@ -0,0 +1,648 @@
+/*
+End to end render benchmark.
+
+Renders a corpus of flames with a fixed seed for every combination of thread
+count, backend, iteration precision and math tier and reports throughput,
+memory and time per phase. Each render runs in a forked process so peak RSS
+is measured per run (it includes the corpus loaded by the harness). Nothing
+is written besides the report.
+
+The corpus is the flame files given on the command line (JSON, flam3 /
+Apophysis XML or compiled) and, unless disabled, synthetic stress flames
+scaling the xform count, variations per xform and image size from a base
+flame.
+
+Backends:
+  walker  render_threads() with the default options
+  pool    walkers start from a shared pool of settled points
+
+Results are JSON lines with samples_per_sec, hist_bytes_per_sample (histogram
+memory over samples, all threads), miss_bytes_per_sample (cache line traffic
+from the hardware counters, null without -P), the prepass, iterate and
+reduce times and peak_rss_kb. Given a baseline (an earlier output) runs are
+matched by name, backend, threads, precision and math tier (exact if the
+baseline has none) and a drop in samples/sec beyond the tolerance is
+reported as a regression, exiting with status 2.
+
+Usage: ./renderbench.out [options] <flame files...>
+Options:
+  -t, --threads <n,n,..>
+                      thread counts to run (default 1)
+  -B, --backends <name,name,..>
+                      backends to run (default walker,pool)
+  -F, --precisions <name,name,..>
+                      iteration precisions to run, auto uses the one chosen
+                      for each flame (default float,double)
+  -M, --math <name,name,..>
+                      math tiers to run (default exact, see fastmath.h)
+  -n, --samples <n>   samples per render instead of the flame sample count
+  -z, --max-size <n>  scale down images larger than n pixels on a side,
+                      keeping the aspect ratio and density (default 2048)
+  -x, --no-synthetic  leave out the synthetic stress flames
+  -P, --perf          count hardware events for miss_bytes_per_sample
+  -N, --numa          place render threads and histograms on NUMA nodes
+  -H, --huge-pages <thp|off|explicit>
+                      backing of the thread histograms (default thp)
+  -o, --output <file> write results to file (default stdout)
+  -c, --compare <file>
+                      baseline results to compare against
+  -R, --tolerance <frac>
+                      allowed slowdown against the baseline (default 0.1)
+*/
+
+#include <assert.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../jrand.h"
+#include "../json.h"
+#include "../kernel.h"
+#include "../loader.h"
+#include "../parser.h"
+#include "../renderer.h"
+#include "../types.h"
+#include "../utils.h"
+#include "../variations.h"
+
+#define BENCH_SEED 0x5eed
+#define MAX_THREAD_COUNTS 16
+#define MAX_PRECISIONS 3
+#define MAX_MATHS 3
+#define MAX_SIZE_DEFAULT 2048
+#define TOLERANCE_DEFAULT 0.1
+
+// synthetic stress flames, one dimension scaled at a time from the base
+#define STRESS_XFORMS 4
+#define STRESS_VARS 2
+#define STRESS_SIZE 512
+#define STRESS_SAMPLES 2000000
+static const uint32_t STRESS_XFORMS_SCALE[] = {16,64};
+static const uint32_t STRESS_VARS_SCALE[] = {6,12};
+static const uint32_t STRESS_SIZE_SCALE[] = {1024,2048};
+
+#define BACKEND_WALKER 0
+#define BACKEND_POOL 1
+#define NUM_BACKENDS 2
+static const char *const BACKEND_NAMES[NUM_BACKENDS] = {"walker","pool"};
+
+// measurements of one render, sent from the forked process
+typedef struct
+{
+    uint64_t samples;
+    double seconds;
+    double time_prepass, time_iterate, time_reduce;
+    uint64_t bad_values;
+    uint64_t cache_misses;
+    bool misses_valid;
+    precision_t precision; // the one used, auto resolved
+    long peak_rss_kb;
+    bool ok;
+}
+bench_run_t;
+
+// a previous result to compare against
+typedef struct
+{
+    char *key;
+    double samples_per_sec;
+}
+baseline_t;
+
+// settings of the whole run
+static uint32_t thread_counts[MAX_THREAD_COUNTS] = {1};
+static uint32_t thread_counts_len = 1;
+static bool backends[NUM_BACKENDS] = {true,true};
+static precision_t precisions[MAX_PRECISIONS] = {PRECISION_FLOAT,
+    PRECISION_DOUBLE};
+static uint32_t precisions_len = 2;
+static math_tier_t maths[MAX_MATHS] = {MATH_EXACT};
+static uint32_t maths_len = 1;
+static uint64_t samples_override = 0;
+static size_t max_size = MAX_SIZE_DEFAULT;
+static bool perf = false;
+static bool numa = false;
+static hugepages_t hugepages = HUGEPAGES_THP;
+
+// append the flames of a list to the corpus
+static void add_flames(flame_list *corpus, flame_list f)
+{
+    flame_list *tail = corpus;
+    while (*tail)
+        tail = &(*tail)->next;
+    *tail = f;
+}
+
+static flame_list load_json(const char *data)
+{
+    json_value jsondata = json_load(data);
+    assert(jsondata);
+    flame_list flames = flames_from_json(jsondata);
+    json_destroy(jsondata);
+    return flames;
+}
+
+// the loader is returned open since compiled flames point into it
+static flame_loader_t *load_file(flame_list *corpus, const char *fname)
+{
+    flame_loader_t *l = loader_open(fname);
+    if (!l)
+    {
+        fprintf(stderr,"skipping %s: can not open it\n",fname);
+        return NULL;
+    }
+    flame_list *tail = corpus;
+    while (*tail)
+        tail = &(*tail)->next;
+    for (;;)
+    {
+        flame_list f = malloc(sizeof(*f));
+        assert(f);
+        if (!loader_next(l,&f->value))
+        {
+            free(f);
+            break;
+        }
+        f->next = NULL;
+        *tail = f;
+        tail = &f->next;
+    }
+    return l;
+}
+
+// JSON text for a random contractive flame
+static char *stress_json(jrand_t *j, const char *name, uint32_t xforms,
+                        uint32_t vars, uint32_t size)
+{
+    size_t cap = 1024 + xforms*(256 + vars*64);
+    char *s = malloc(cap);
+    assert(s);
+    size_t len = 0;
+    len += snprintf(s+len,cap-len,"[{\"name\":\"%s\",\"size_x\":%u,"
+        "\"size_y\":%u,\"samples\":%u,\"xmin\":-2.0,\"xmax\":2.0,"
+        "\"ymin\":-2.0,\"ymax\":2.0,\"xforms\":[",name,size,size,
+        STRESS_SAMPLES);
+    size_t var_count = 0;
+    while (VARIATIONS[var_count].name)
+        ++var_count;
+    for (uint32_t i = 0; i < xforms; ++i)
+    {
+        // rotation and scale with a translation inside the frame
+        double a = 2.0*M_PI*jrand_next_double(j);
+        double r = 0.3 + 0.4*jrand_next_double(j);
+        double tx = jrand_next_double(j) - 0.5;
+        double ty = jrand_next_double(j) - 0.5;
+        len += snprintf(s+len,cap-len,"%s{\"weight\":%f,\"variations\":[",
+            i ? "," : "",0.5 + jrand_next_double(j));
+        for (uint32_t k = 0; k < vars; ++k)
+            len += snprintf(s+len,cap-len,
+                "%s{\"name\":\"%s\",\"weight\":%f}",k ? "," : "",
+                VARIATIONS[jrand_next_int_mod(j,var_count)].name,1.0/vars);
+        len += snprintf(s+len,cap-len,"],\"pre_affine\":[%f,%f,%f,%f,%f,%f],"
+            "\"post_affine\":[1.0,0.0,0.0,0.0,1.0,0.0]}",r*cos(a),-r*sin(a),
+            tx,r*sin(a),r*cos(a),ty);
+        assert(len < cap);
+    }
+    len += snprintf(s+len,cap-len,"]}]");
+    assert(len < cap);
+    return s;
+}
+
+static void add_stress(flame_list *corpus, jrand_t *j, const char *name,
+                    uint32_t xforms, uint32_t vars, uint32_t size)
+{
+    char *s = stress_json(j,name,xforms,vars,size);
+    add_flames(corpus,load_json(s));
+    free(s);
+}
+
+static void add_synthetic(flame_list *corpus)
+{
+    jrand_t j;
+    jrand_init_seed(&j,BENCH_SEED);
+    char name[64];
+    add_stress(corpus,&j,"stress_base",STRESS_XFORMS,STRESS_VARS,
+        STRESS_SIZE);
+    for (size_t i = 0; i < sizeof(STRESS_XFORMS_SCALE)/sizeof(uint32_t); ++i)
+    {
+        snprintf(name,sizeof(name),"stress_xforms_%u",STRESS_XFORMS_SCALE[i]);
+        add_stress(corpus,&j,name,STRESS_XFORMS_SCALE[i],STRESS_VARS,
+            STRESS_SIZE);
+    }
+    for (size_t i = 0; i < sizeof(STRESS_VARS_SCALE)/sizeof(uint32_t); ++i)
+    {
+        snprintf(name,sizeof(name),"stress_vars_%u",STRESS_VARS_SCALE[i]);
+        add_stress(corpus,&j,name,STRESS_XFORMS,STRESS_VARS_SCALE[i],
+            STRESS_SIZE);
+    }
+    for (size_t i = 0; i < sizeof(STRESS_SIZE_SCALE)/sizeof(uint32_t); ++i)
+    {
+        snprintf(name,sizeof(name),"stress_size_%u",STRESS_SIZE_SCALE[i]);
+        add_stress(corpus,&j,name,STRESS_XFORMS,STRESS_VARS,
+            STRESS_SIZE_SCALE[i]);
+    }
+}
+
+// shrink large images keeping the aspect ratio and samples per pixel
+static void limit_size(flame_t *flame)
+{
+    size_t big = flame->size_x > flame->size_y ? flame->size_x
+        : flame->size_y;
+    if (big <= max_size)
+        return;
+    double s = (double)max_size / big;
+    size_t x = flame->size_x*s, y = flame->size_y*s;
+    x = x ? x : 1;
+    y = y ? y : 1;
+    flame->samples = flame->samples * ((double)(x*y)
+        / (flame->size_x*flame->size_y));
+    flame->size_x = x;
+    flame->size_y = y;
+}
+
+// render in this process and fill in the measurements
+static void run_render(flame_t *flame, uint32_t threads, int backend,
+                    precision_t precision, math_tier_t math,
+                    bench_run_t *run)
+{
+    if (samples_override)
+        flame->samples = samples_override;
+    size_t buf_bytes = flame->size_x*flame->size_y*sizeof(uint32_t);
+    uint32_t *buf = hist_alloc(buf_bytes,hugepages);
+    render_opts_t opts;
+    memset(&opts,0,sizeof(opts));
+    opts.threads = threads;
+    opts.settle_pool = backend == BACKEND_POOL;
+    opts.perf = perf;
+    opts.precision = precision;
+    opts.math = math;
+    opts.numa = numa;
+    opts.hugepages = hugepages;
+    jrand_t j;
+    jrand_init_seed(&j,BENCH_SEED);
+    render_result_t res;
+    render_threads(flame,buf,&j,&opts,&res);
+    run->samples = res.samples;
+    run->seconds = res.seconds;
+    run->time_prepass = res.time_prepass;
+    run->time_iterate = res.time_iterate;
+    run->time_reduce = res.time_reduce;
+    run->bad_values = res.bad_values;
+    run->precision = res.precision;
+    run->cache_misses = 0;
+    run->misses_valid = false;
+    if (perf)
+    {
+        perf_counts_t total;
+        memset(&total,0,sizeof(total));
+        for (uint32_t i = 0; i < res.threads; ++i)
+            perf_add(&total,res.perf_iterate+i);
+        run->cache_misses = total.count[2];
+        run->misses_valid = total.valid & (1u << 2);
+    }
+    run->ok = true;
+    render_result_destroy(&res);
+    hist_free(buf,buf_bytes);
+}
+
+// run a render in a child process, peak RSS comes from its resource usage
+static void run_forked(flame_t *flame, uint32_t threads, int backend,
+                    precision_t precision, math_tier_t math,
+                    bench_run_t *run)
+{
+    int fds[2];
+    int ret = pipe(fds);
+    assert(!ret);
+    fflush(NULL);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (!pid)
+    {
+        close(fds[0]);
+        // output from the renderer is not part of the report
+        freopen("/dev/null","w",stderr);
+        bench_run_t r;
+        memset(&r,0,sizeof(r));
+        run_render(flame,threads,backend,precision,math,&r);
+        ssize_t n = write(fds[1],&r,sizeof(r));
+        _exit(n == sizeof(r) ? 0 : 1);
+    }
+    close(fds[1]);
+    memset(run,0,sizeof(*run));
+    ssize_t n = read(fds[0],run,sizeof(*run));
+    close(fds[0]);
+    int status;
+    struct rusage ru;
+    wait4(pid,&status,0,&ru);
+    if (n != sizeof(*run) || !WIFEXITED(status) || WEXITSTATUS(status))
+        run->ok = false;
+    run->peak_rss_kb = ru.ru_maxrss;
+}
+
+// JSON has no infinity or NaN so write those as null
+static void _write_num(FILE *f, double n)
+{
+    if (isfinite(n))
+        fprintf(f,"%.9g",n);
+    else
+        fprintf(f,"null");
+}
+
+static void make_key(char *key, size_t len, const char *name,
+                    const char *backend, uint32_t threads,
+                    const char *precision, const char *math)
+{
+    snprintf(key,len,"%s|%s|%u|%s|%s",name,backend,threads,precision,math);
+}
+
+// read samples per second of each run from an earlier output
+static baseline_t *load_baseline(const char *fname, size_t *len)
+{
+    char *data = read_text_file(fname);
+    assert(data);
+    size_t cap = 16;
+    baseline_t *base = malloc(cap*sizeof(*base));
+    assert(base);
+    *len = 0;
+    for (char *line = strtok(data,"\n"); line; line = strtok(NULL,"\n"))
+    {
+        json_value jv = json_load(line);
+        assert(jv && jv->type == JSON_OBJECT);
+        json_object jo = jv->value.as_object;
+        json_value name = json_object_get(jo,"name");
+        json_value backend = json_object_get(jo,"backend");
+        json_value threads = json_object_get(jo,"threads");
+        json_value precision = json_object_get(jo,"precision");
+        json_value math = json_object_get(jo,"math");
+        json_value sps = json_object_get(jo,"samples_per_sec");
+        assert(name && backend && threads && precision && sps);
+        if (*len == cap)
+        {
+            cap *= 2;
+            base = realloc(base,cap*sizeof(*base));
+            assert(base);
+        }
+        char key[256];
+        make_key(key,sizeof(key),name->value.as_str,backend->value.as_str,
+            threads->value.as_int,precision->value.as_str,
+            math ? math->value.as_str : math_name(MATH_EXACT));
+        base[*len].key = strdup(key);
+        base[*len].samples_per_sec = sps->type == JSON_NUMBER_INT
+            ? sps->value.as_int
+            : sps->type == JSON_NUMBER_FLOAT ? sps->value.as_float : NAN;
+        ++*len;
+        json_destroy(jv);
+    }
+    free(data);
+    return base;
+}
+
+static const baseline_t *find_baseline(const baseline_t *base, size_t len,
+                                    const char *key)
+{
+    for (size_t i = 0; i < len; ++i)
+        if (!strcmp(base[i].key,key))
+            return base+i;
+    return NULL;
+}
+
+static const struct option _long_opts[] =
+{
+    {"threads", required_argument, NULL, 't'},
+    {"backends", required_argument, NULL, 'B'},
+    {"precisions", required_argument, NULL, 'F'},
+    {"math", required_argument, NULL, 'M'},
+    {"samples", required_argument, NULL, 'n'},
+    {"max-size", required_argument, NULL, 'z'},
+    {"no-synthetic", no_argument, NULL, 'x'},
+    {"perf", no_argument, NULL, 'P'},
+    {"numa", no_argument, NULL, 'N'},
+    {"huge-pages", required_argument, NULL, 'H'},
+    {"output", required_argument, NULL, 'o'},
+    {"compare", required_argument, NULL, 'c'},
+    {"tolerance", required_argument, NULL, 'R'},
+    {NULL, 0, NULL, 0}
+};
+
+int main(int argc, char **argv)
+{
+    bool synthetic = true;
+    FILE *out = stdout;
+    const char *compare = NULL;
+    double tolerance = TOLERANCE_DEFAULT;
+    int opt;
+    while ((opt = getopt_long(argc,argv,"t:B:F:M:n:z:xPNH:o:c:R:",
+        _long_opts,NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            thread_counts_len = 0;
+            for (char *t = strtok(optarg,","); t; t = strtok(NULL,","))
+            {
+                assert(thread_counts_len < MAX_THREAD_COUNTS);
+                thread_counts[thread_counts_len] = strtoul(t,NULL,10);
+                assert(thread_counts[thread_counts_len]);
+                ++thread_counts_len;
+            }
+            break;
+        case 'B':
+            memset(backends,0,sizeof(backends));
+            for (char *b = strtok(optarg,","); b; b = strtok(NULL,","))
+            {
+                int k = 0;
+                while (k < NUM_BACKENDS && strcmp(b,BACKEND_NAMES[k]))
+                    ++k;
+                if (k == NUM_BACKENDS)
+                {
+                    fprintf(stderr,"unknown backend: %s\n",b);
+                    return 1;
+                }
+                backends[k] = true;
+            }
+            break;
+        case 'F':
+            precisions_len = 0;
+            for (char *p = strtok(optarg,","); p; p = strtok(NULL,","))
+            {
+                assert(precisions_len < MAX_PRECISIONS);
+                if (!precision_from_name(p,precisions+precisions_len))
+                {
+                    fprintf(stderr,"unknown precision: %s\n",p);
+                    return 1;
+                }
+                ++precisions_len;
+            }
+            break;
+        case 'M':
+            maths_len = 0;
+            for (char *m = strtok(optarg,","); m; m = strtok(NULL,","))
+            {
+                assert(maths_len < MAX_MATHS);
+                if (!math_from_name(m,maths+maths_len))
+                {
+                    fprintf(stderr,"unknown math tier: %s\n",m);
+                    return 1;
+                }
+                ++maths_len;
+            }
+            break;
+        case 'n':
+            samples_override = strtoull(optarg,NULL,10);
+            assert(samples_override);
+            break;
+        case 'z':
+            max_size = strtoul(optarg,NULL,10);
+            assert(max_size);
+            break;
+        case 'x':
+            synthetic = false;
+            break;
+        case 'P':
+            perf = true;
+            break;
+        case 'N':
+            numa = true;
+            break;
+        case 'H':
+            if (!hugepages_from_name(optarg,&hugepages))
+            {
+                fprintf(stderr,"unknown huge page mode: %s\n",optarg);
+                return 1;
+            }
+            break;
+        case 'o':
+            out = fopen(optarg,"w");
+            assert(out);
+            break;
+        case 'c':
+            compare = optarg;
+            break;
+        case 'R':
+            tolerance = atof(optarg);
+            assert(tolerance >= 0.0);
+            break;
+        default:
+            fprintf(stderr,"usage: %s [-t <n,..>] [-B <backend,..>] "
+                "[-F <precision,..>] [-M <tier,..>] [-n <samples>] "
+                "[-z <size>] [-x] [-P] [-N] [-H <mode>] [-o <file>] "
+                "[-c <baseline> "
+                "[-R <frac>]] <flame files...>\n",argv[0]);
+            return 1;
+        }
+    }
+    flame_list corpus = NULL;
+    flame_loader_t **loaders = calloc(argc,sizeof(*loaders));
+    assert(loaders);
+    for (int i = optind; i < argc; ++i)
+        loaders[i] = load_file(&corpus,argv[i]);
+    if (synthetic)
+        add_synthetic(&corpus);
+    assert(corpus);
+    size_t base_len = 0;
+    baseline_t *base = compare ? load_baseline(compare,&base_len) : NULL;
+    uint32_t regressions = 0, failures = 0;
+    fprintf(stderr,"%-24s %-7s %-6s %-7s %3s %12s %9s %10s %10s\n",
+        "flame","backend","prec","math","thr","samples/sec","iter sec",
+        "rss kb","vs base");
+    for (flame_list f = corpus; f; f = f->next)
+    {
+        flame_t *flame = &f->value;
+        limit_size(flame);
+        for (int b = 0; b < NUM_BACKENDS; ++b)
+        {
+            if (!backends[b])
+                continue;
+            // every precision with every math tier
+            for (uint32_t k = 0; k < precisions_len*maths_len; ++k)
+                for (uint32_t t = 0; t < thread_counts_len; ++t)
+                {
+                    uint32_t threads = thread_counts[t];
+                    precision_t prec = precisions[k / maths_len];
+                    math_tier_t math = maths[k % maths_len];
+                    bench_run_t run;
+                    run_forked(flame,threads,b,prec,math,&run);
+                    if (!run.ok)
+                    {
+                        ++failures;
+                        fprintf(stderr,"%-24s %-7s %-6s %-7s %3u failed\n",
+                            flame->name,BACKEND_NAMES[b],
+                            precision_name(prec),math_name(math),threads);
+                        continue;
+                    }
+                    // keyed by the precision used so auto runs compare
+                    // against the explicit ones
+                    const char *precision = precision_name(run.precision);
+                    char key[256];
+                    make_key(key,sizeof(key),flame->name,BACKEND_NAMES[b],
+                        threads,precision,math_name(math));
+                    double sps = run.samples / run.seconds;
+                    const baseline_t *bl = find_baseline(base,base_len,key);
+                    double ratio = bl ? sps / bl->samples_per_sec : NAN;
+                    bool regression = bl && ratio < 1.0 - tolerance;
+                    regressions += regression;
+                    fprintf(stderr,"%-24s %-7s %-6s %-7s %3u %12.0f %9.3f "
+                        "%10ld",flame->name,BACKEND_NAMES[b],precision,
+                        math_name(math),threads,sps,run.time_iterate,
+                        run.peak_rss_kb);
+                    if (bl)
+                        fprintf(stderr," %9.3fx%s",ratio,
+                            regression ? " REGRESSION" : "");
+                    fprintf(stderr,"\n");
+                    fprintf(out,"{\"name\":\"%s\",\"backend\":\"%s\","
+                        "\"threads\":%u,\"precision\":\"%s\",\"math\":\"%s\","
+                        "\"size_x\":%lu,\"size_y\":%lu,\"xforms\":%lu,"
+                        "\"samples\":%lu,\"samples_per_sec\":",flame->name,
+                        BACKEND_NAMES[b],threads,precision,math_name(math),
+                        flame->size_x,flame->size_y,
+                        flame->xforms_len,run.samples);
+                    _write_num(out,sps);
+                    fprintf(out,",\"hist_bytes_per_sample\":");
+                    _write_num(out,(double)threads*flame->size_x*flame->size_y
+                        * sizeof(uint32_t) / run.samples);
+                    fprintf(out,",\"miss_bytes_per_sample\":");
+                    _write_num(out,run.misses_valid
+                        ? 64.0*run.cache_misses/run.samples : NAN);
+                    fprintf(out,",\"bad_values\":%lu,\"phases\":{\"prepass\":",
+                        run.bad_values);
+                    _write_num(out,run.time_prepass);
+                    fprintf(out,",\"iterate\":");
+                    _write_num(out,run.time_iterate);
+                    fprintf(out,",\"reduce\":");
+                    _write_num(out,run.time_reduce);
+                    fprintf(out,"},\"numa\":%s,\"huge_pages\":\"%s\"",
+                        numa ? "true" : "false",hugepages_name(hugepages));
+                    fprintf(out,",\"peak_rss_kb\":%ld",run.peak_rss_kb);
+                    if (bl)
+                    {
+                        fprintf(out,",\"baseline_samples_per_sec\":");
+                        _write_num(out,bl->samples_per_sec);
+                        fprintf(out,",\"regression\":%s",
+                            regression ? "true" : "false");
+                    }
+                    fprintf(out,"}\n");
+                    fflush(out);
+                }
+        }
+    }
+    if (out != stdout)
+        fclose(out);
+    for (size_t i = 0; i < base_len; ++i)
+        free(base[i].key);
+    free(base);
+    destroy_flame_list(corpus);
+    for (int i = optind; i < argc; ++i)
+        if (loaders[i])
+            loader_close(loaders[i]);
+    free(loaders);
+    if (failures)
+        fprintf(stderr,"%u runs failed\n",failures);
+    if (regressions)
+        fprintf(stderr,"%u regressions\n",regressions);
+    return regressions || failures ? 2 : 0;
+}
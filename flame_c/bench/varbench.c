@@ -0,0 +1,338 @@
+/*
+Per variation microbenchmark.
+
+Times every variation in VARIATIONS[] and measures its accuracy against a
+long double reference. Inputs are points of the attractors of the given
+flames with the pre affine transformation of a weighted random xform applied,
+so the arguments have the distribution seen while rendering. The inputs are
+drawn with a fixed seed and rounded to each precision measured, so the
+reference sees exactly the same arguments.
+
+Timings are the best of several repeats in ns per call:
+  scalar   each input depends on the previous result, like the chaos game
+  batched  independent inputs, calls may overlap in the processor
+Errors are per component, relative to the reference where its magnitude is
+above 1 and absolute below. Inputs where either result is not finite are
+only counted.
+
+Usage: ./varbench.out [options] <flames.json>
+Options:
+  -F, --precisions <float,double>
+                      precisions to measure (default both)
+  -M, --math <exact,precise,fast>
+                      math tiers to measure (default all, see fastmath.h)
+  -n, --inputs <n>    number of input points (default 65536)
+  -r, --repeats <n>   timed passes per variation (default 5)
+  -v, --variation <name>
+                      only run this variation
+  -o, --output <file> write results as JSON lines to file (default stdout)
+*/
+
+#include <assert.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../jrand.h"
+#include "../kernel.h"
+#include "../parser.h"
+#include "../renderer.h"
+#include "../types.h"
+#include "../utils.h"
+#include "../variations.h"
+#include "varkern.h"
+
+#define DEFAULT_INPUTS (1 << 16)
+#define DEFAULT_REPEATS 5
+#define INPUT_SEED 0x5eed
+
+typedef struct
+{
+    double ns_scalar, ns_batched;
+    double max_err, mean_err;
+    uint64_t nonfinite;
+}
+var_result_t;
+
+// the xforms of all flames as pre affine coefficients, 6 for each
+static double *make_pres(flame_list flames, size_t *len)
+{
+    *len = 0;
+    for (flame_list f = flames; f; f = f->next)
+        *len += f->value.xforms_len;
+    double *pres = malloc(6*(*len)*sizeof(*pres));
+    assert(pres);
+    double *p = pres;
+    for (flame_list f = flames; f; f = f->next)
+        for (size_t i = 0; i < f->value.xforms_len; ++i, p += 6)
+        {
+            affine_params *af = &f->value.xforms[i].pre_affine;
+            p[0] = af->a;
+            p[1] = af->b;
+            p[2] = af->c;
+            p[3] = af->d;
+            p[4] = af->e;
+            p[5] = af->f;
+        }
+    return pres;
+}
+
+// draw len inputs from the attractors of the flames, split evenly
+static size_t make_inputs(flame_list flames, var_input_t *in, size_t len)
+{
+    size_t flames_len = 0;
+    for (flame_list f = flames; f; f = f->next)
+        ++flames_len;
+    jrand_t j;
+    jrand_init_seed(&j,INPUT_SEED);
+    point_t *pts = malloc(len*sizeof(*pts));
+    assert(pts);
+    size_t n = 0, k = 0, xf_base = 0;
+    for (flame_list f = flames; f; f = f->next, ++k)
+    {
+        flame_t *flame = &f->value;
+        size_t want = len/flames_len + (k < len % flames_len);
+        // xform inputs, before the final xform
+        size_t got = render_orbit_points(flame,&j,pts,want,false);
+        num_t wsum = 0.0;
+        for (size_t i = 0; i < flame->xforms_len; ++i)
+            wsum += flame->xforms[i].weight;
+        for (size_t i = 0; i < got; ++i)
+        {
+            // weighted random xform, the last one if rounding runs past
+            num_t r = jrand_next_float(&j) * wsum;
+            size_t x = 0;
+            while (x+1 < flame->xforms_len && r >= flame->xforms[x].weight)
+                r -= flame->xforms[x++].weight;
+            affine_params *af = &flame->xforms[x].pre_affine;
+            in[n].x = af->a*pts[i].x + af->b*pts[i].y + af->c;
+            in[n].y = af->d*pts[i].x + af->e*pts[i].y + af->f;
+            in[n].xf = xf_base + x;
+            ++n;
+        }
+        xf_base += flame->xforms_len;
+    }
+    free(pts);
+    return n;
+}
+
+// error of a result component against the reference
+static inline double _error(long double v, long double ref)
+{
+    long double d = fabsl(v - ref);
+    long double m = fabsl(ref);
+    return (double)(m > 1.0L ? d/m : d);
+}
+
+// in and pres are already rounded to the precision of the kernel
+static void measure_accuracy(const varkern_t *kern, size_t v,
+                            const double *pres, const var_input_t *in,
+                            size_t len, var_result_t *res)
+{
+    double err_sum = 0.0;
+    size_t counted = 0;
+    res->max_err = 0.0;
+    res->nonfinite = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        const double *pre = pres+6*in[i].xf;
+        long double vx, vy, rx, ry;
+        kern->eval(v,pre,in[i].x,in[i].y,i,&vx,&vy);
+        VARKERN_LONG_DOUBLE.eval(v,pre,in[i].x,in[i].y,i,&rx,&ry);
+        if (!isfinite(vx) || !isfinite(vy) || !isfinite(rx) || !isfinite(ry))
+        {
+            ++res->nonfinite;
+            continue;
+        }
+        double e = fmax(_error(vx,rx),_error(vy,ry));
+        if (e > res->max_err)
+            res->max_err = e;
+        err_sum += e;
+        ++counted;
+    }
+    res->mean_err = counted ? err_sum/counted : 0.0;
+}
+
+static void measure_time(const varkern_t *kern, size_t v, const double *pres,
+                        size_t pres_len, const var_input_t *in, size_t len,
+                        uint32_t repeats, var_result_t *res)
+{
+    kern->time_pass(v,pres,pres_len,in,len,false); // warm up
+    double best_scalar = INFINITY, best_batched = INFINITY;
+    for (uint32_t r = 0; r < repeats; ++r)
+    {
+        double t = kern->time_pass(v,pres,pres_len,in,len,true);
+        if (t < best_scalar)
+            best_scalar = t;
+        t = kern->time_pass(v,pres,pres_len,in,len,false);
+        if (t < best_batched)
+            best_batched = t;
+    }
+    res->ns_scalar = 1e9 * best_scalar / len;
+    res->ns_batched = 1e9 * best_batched / len;
+}
+
+// JSON has no infinity or NaN so write those as null
+static void _write_num(FILE *f, double n)
+{
+    if (isfinite(n))
+        fprintf(f,"%.6g",n);
+    else
+        fprintf(f,"null");
+}
+
+// indexed by precision (float, double) and math tier
+static const varkern_t *const VARKERNS[2][3] =
+{
+    {&VARKERN_FLOAT,&VARKERN_FLOAT_PRECISE,&VARKERN_FLOAT_FAST},
+    {&VARKERN_DOUBLE,&VARKERN_DOUBLE_PRECISE,&VARKERN_DOUBLE_FAST}
+};
+
+static void write_json(FILE *f, const char *name, const varkern_t *kern,
+                    size_t inputs, const var_result_t *res)
+{
+    fprintf(f,"{\"variation\":\"%s\",\"precision\":\"%s\",\"math\":\"%s\","
+        "\"inputs\":%lu,\"ns_scalar\":",name,kern->name,
+        math_name(kern->math),inputs);
+    _write_num(f,res->ns_scalar);
+    fprintf(f,",\"ns_batched\":");
+    _write_num(f,res->ns_batched);
+    fprintf(f,",\"max_err\":");
+    _write_num(f,res->max_err);
+    fprintf(f,",\"mean_err\":");
+    _write_num(f,res->mean_err);
+    fprintf(f,",\"nonfinite\":%lu}\n",res->nonfinite);
+}
+
+static const struct option _long_opts[] =
+{
+    {"inputs", required_argument, NULL, 'n'},
+    {"repeats", required_argument, NULL, 'r'},
+    {"variation", required_argument, NULL, 'v'},
+    {"output", required_argument, NULL, 'o'},
+    {"precisions", required_argument, NULL, 'F'},
+    {"math", required_argument, NULL, 'M'},
+    {NULL, 0, NULL, 0}
+};
+
+int main(int argc, char **argv)
+{
+    size_t inputs = DEFAULT_INPUTS;
+    uint32_t repeats = DEFAULT_REPEATS;
+    const char *only = NULL;
+    FILE *out = stdout;
+    bool precisions[2] = {true,true};
+    bool tiers[3] = {true,true,true};
+    int opt;
+    while ((opt = getopt_long(argc,argv,"n:r:v:o:F:M:",_long_opts,NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            inputs = strtoul(optarg,NULL,10);
+            assert(inputs);
+            break;
+        case 'r':
+            repeats = strtoul(optarg,NULL,10);
+            assert(repeats);
+            break;
+        case 'v':
+            only = optarg;
+            break;
+        case 'o':
+            out = fopen(optarg,"w");
+            assert(out);
+            break;
+        case 'F':
+            precisions[0] = precisions[1] = false;
+            for (char *p = strtok(optarg,","); p; p = strtok(NULL,","))
+            {
+                precision_t pr;
+                if (!precision_from_name(p,&pr) || pr == PRECISION_AUTO)
+                {
+                    fprintf(stderr,"unknown precision: %s\n",p);
+                    return 1;
+                }
+                precisions[pr == PRECISION_DOUBLE] = true;
+            }
+            break;
+        case 'M':
+            memset(tiers,0,sizeof(tiers));
+            for (char *p = strtok(optarg,","); p; p = strtok(NULL,","))
+            {
+                math_tier_t m;
+                if (!math_from_name(p,&m))
+                {
+                    fprintf(stderr,"unknown math tier: %s\n",p);
+                    return 1;
+                }
+                tiers[m] = true;
+            }
+            break;
+        default:
+            fprintf(stderr,"usage: %s [-n <inputs>] [-r <repeats>] "
+                "[-v <variation>] [-o <file>] [-F <precision,..>] "
+                "[-M <tier,..>] <flames.json>\n",argv[0]);
+            return 1;
+        }
+    }
+    assert(optind < argc);
+    char *filedata = read_text_file(argv[optind]);
+    assert(filedata);
+    json_value jsondata = json_load(filedata);
+    assert(jsondata);
+    free(filedata);
+    flame_list flames = flames_from_json(jsondata);
+    json_destroy(jsondata);
+    assert(flames);
+    size_t pres_len;
+    double *pres = make_pres(flames,&pres_len);
+    var_input_t *in = malloc(inputs*sizeof(*in));
+    var_input_t *rin = malloc(inputs*sizeof(*rin));
+    double *rpres = malloc(6*pres_len*sizeof(*rpres));
+    assert(in);
+    assert(rin);
+    assert(rpres);
+    size_t len = make_inputs(flames,in,inputs);
+    assert(len);
+    fprintf(stderr,"%lu inputs\n",len);
+    for (size_t k = 0; k < 6; ++k)
+    {
+        if (!precisions[k/3] || !tiers[k%3])
+            continue;
+        const varkern_t *kern = VARKERNS[k/3][k%3];
+        for (size_t i = 0; i < len; ++i)
+        {
+            rin[i].x = kern->round(in[i].x);
+            rin[i].y = kern->round(in[i].y);
+            rin[i].xf = in[i].xf;
+        }
+        for (size_t i = 0; i < 6*pres_len; ++i)
+            rpres[i] = kern->round(pres[i]);
+        fprintf(stderr,"%-14s %10s %10s %12s %12s %9s (%s, %s)\n",
+            "variation","ns scalar","ns batch","max err","mean err",
+            "nonfinite",kern->name,math_name(kern->math));
+        for (size_t v = 0; VARIATIONS[v].name; ++v)
+        {
+            if (only && strcmp(only,VARIATIONS[v].name))
+                continue;
+            var_result_t res;
+            measure_accuracy(kern,v,rpres,rin,len,&res);
+            measure_time(kern,v,rpres,pres_len,rin,len,repeats,&res);
+            fprintf(stderr,"%-14s %10.3f %10.3f %12.3e %12.3e %9lu\n",
+                VARIATIONS[v].name,res.ns_scalar,res.ns_batched,res.max_err,
+                res.mean_err,res.nonfinite);
+            write_json(out,VARIATIONS[v].name,kern,len,&res);
+        }
+    }
+    if (out != stdout)
+        fclose(out);
+    free(in);
+    free(rin);
+    free(pres);
+    free(rpres);
+    destroy_flame_list(flames);
+    return 0;
+}
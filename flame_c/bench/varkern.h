@@ -0,0 +1,48 @@
+/*
+Variation kernels for the microbenchmark
+variations_impl.h compiled for each precision and math tier (varkern_impl.h)
+with an interface in plain doubles so the benchmark can drive all of them.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../types.h"
+
+// a pre affine transformed point and the index of its xform
+typedef struct
+{
+    double x, y;
+    uint32_t xf;
+}
+var_input_t;
+
+typedef struct
+{
+    const char *name; // of the precision
+    math_tier_t math;
+    // round to the kernel precision
+    double (*round)(double x);
+    // evaluate variation v (index into VARIATIONS) with weight 1 at the pre
+    // affine transformed point (x,y), pre holds the pre affine coefficients
+    // (a,b,c,d,e,f) of the xform and seed initializes the random state
+    void (*eval)(size_t v, const double *pre, double x, double y,
+                int64_t seed, long double *vx, long double *vy);
+    // seconds for one pass of variation v over the inputs, pres has the 6
+    // coefficients for each xform. chain makes each input depend on the
+    // previous result, otherwise they are independent.
+    double (*time_pass)(size_t v, const double *pres, size_t pres_len,
+                        const var_input_t *in, size_t len, bool chain);
+}
+varkern_t;
+
+extern const varkern_t VARKERN_FLOAT;
+extern const varkern_t VARKERN_FLOAT_PRECISE;
+extern const varkern_t VARKERN_FLOAT_FAST;
+extern const varkern_t VARKERN_DOUBLE;
+extern const varkern_t VARKERN_DOUBLE_PRECISE;
+extern const varkern_t VARKERN_DOUBLE_FAST;
+extern const varkern_t VARKERN_LONG_DOUBLE; // reference
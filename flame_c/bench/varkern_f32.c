@@ -0,0 +1,9 @@
+#define _GNU_SOURCE
+
+#define KNUM float
+#define KSINCOS sincosf
+#define KMATH MATH_EXACT
+#define VARKERN_NAME VARKERN_FLOAT
+#define VARKERN_LABEL "float"
+
+#include "varkern_impl.h"
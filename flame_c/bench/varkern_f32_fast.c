@@ -0,0 +1,10 @@
+#define _GNU_SOURCE
+
+#define KNUM float
+#define KSINCOS sincosf
+#define KMATH MATH_FAST
+#define KFM(n) fm_##n##f
+#define VARKERN_NAME VARKERN_FLOAT_FAST
+#define VARKERN_LABEL "float"
+
+#include "varkern_impl.h"
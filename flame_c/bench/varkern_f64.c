@@ -0,0 +1,9 @@
+#define _GNU_SOURCE
+
+#define KNUM double
+#define KSINCOS sincos
+#define KMATH MATH_EXACT
+#define VARKERN_NAME VARKERN_DOUBLE
+#define VARKERN_LABEL "double"
+
+#include "varkern_impl.h"
@@ -0,0 +1,10 @@
+#define _GNU_SOURCE
+
+#define KNUM double
+#define KSINCOS sincos
+#define KMATH MATH_FAST
+#define KFM(n) fm_##n
+#define VARKERN_NAME VARKERN_DOUBLE_FAST
+#define VARKERN_LABEL "double"
+
+#include "varkern_impl.h"
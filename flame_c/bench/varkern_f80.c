@@ -0,0 +1,12 @@
+// long double reference, with type generic math so every libm call in the
+// variations is done in long double as well
+#define _GNU_SOURCE
+#include <tgmath.h>
+
+#define KNUM long double
+#define KSINCOS sincosl
+#define KMATH MATH_EXACT
+#define VARKERN_NAME VARKERN_LONG_DOUBLE
+#define VARKERN_LABEL "long double"
+
+#include "varkern_impl.h"
@@ -0,0 +1,112 @@
+/*
+Variation kernel template for the microbenchmark
+Included once by each varkern_*.c, there is no include guard. The including
+file defines KNUM, KSINCOS, KMATH and KFM for the fast tiers (see
+variations_impl.h), VARKERN_NAME for the varkern_t to define and
+VARKERN_LABEL for its precision name.
+*/
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "../utils.h"
+#include "../variations_impl.h"
+#include "varkern.h"
+
+static double _round(double x)
+{
+    return (knum_t)x;
+}
+
+static void _set_pre(kxform_t *xf, const double *pre)
+{
+    xf->pre_affine.a = pre[0];
+    xf->pre_affine.b = pre[1];
+    xf->pre_affine.c = pre[2];
+    xf->pre_affine.d = pre[3];
+    xf->pre_affine.e = pre[4];
+    xf->pre_affine.f = pre[5];
+}
+
+static void _eval(size_t v, const double *pre, double x, double y,
+                int64_t seed, long double *vx, long double *vy)
+{
+    kxform_t xf = {0};
+    _set_pre(&xf,pre);
+    kstate_t S = {0};
+    S.tx = x;
+    S.ty = y;
+    S.xf = &xf;
+    jrand_init_seed(&S.rand,seed);
+    VAR_FUNCS[v](&S,1.0);
+    *vx = S.vx;
+    *vy = S.vy;
+}
+
+// keeps the results of the timed loops live
+static volatile knum_t _sink;
+
+static double _time_pass(size_t v, const double *pres, size_t pres_len,
+                        const var_input_t *in, size_t len, bool chain)
+{
+    // inputs in the kernel precision are prepared before timing
+    kxform_t *xfs = calloc(pres_len,sizeof(*xfs));
+    knum_t *xs = malloc(len*sizeof(*xs));
+    knum_t *ys = malloc(len*sizeof(*ys));
+    kxform_t **xfp = malloc(len*sizeof(*xfp));
+    assert(xfs && xs && ys && xfp);
+    for (size_t i = 0; i < pres_len; ++i)
+        _set_pre(xfs+i,pres+6*i);
+    for (size_t i = 0; i < len; ++i)
+    {
+        xs[i] = in[i].x;
+        ys[i] = in[i].y;
+        xfp[i] = xfs+in[i].xf;
+    }
+    kvar_func_t func = VAR_FUNCS[v];
+    kstate_t S;
+    jrand_init_seed(&S.rand,len);
+    S.vx = 0.0;
+    S.vy = 0.0;
+    knum_t acc = 0.0;
+    double start = wall_time();
+    if (chain)
+        for (size_t i = 0; i < len; ++i)
+        {
+            // adding a signed zero makes the input depend on the last result
+            // without changing it
+            S.tx = xs[i] + copysign(_K(0.0),S.vx);
+            S.ty = ys[i] + copysign(_K(0.0),S.vy);
+            S.xf = xfp[i];
+            S.vx = 0.0;
+            S.vy = 0.0;
+            func(&S,1.0);
+        }
+    else
+        for (size_t i = 0; i < len; ++i)
+        {
+            S.tx = xs[i];
+            S.ty = ys[i];
+            S.xf = xfp[i];
+            S.vx = 0.0;
+            S.vy = 0.0;
+            func(&S,1.0);
+            acc += S.vx;
+        }
+    double secs = wall_time() - start;
+    _sink = acc + S.vx + S.vy;
+    free(xfs);
+    free(xs);
+    free(ys);
+    free(xfp);
+    return secs;
+}
+
+const varkern_t VARKERN_NAME =
+{
+    .name = VARKERN_LABEL,
+    .math = KMATH,
+    .round = &_round,
+    .eval = &_eval,
+    .time_pass = &_time_pass
+};
@@ -0,0 +1,119 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "bounds.h"
+#include "renderer.h"
+
+// k-th smallest value, partially reorders arr (Wirth's selection)
+static num_t _select(num_t *arr, size_t len, size_t k)
+{
+    ptrdiff_t l = 0, r = len-1, kk = k;
+    while (l < r)
+    {
+        num_t x = arr[kk];
+        ptrdiff_t i = l, j = r;
+        do
+        {
+            while (arr[i] < x)
+                ++i;
+            while (x < arr[j])
+                --j;
+            if (i <= j)
+            {
+                num_t tmp = arr[i];
+                arr[i] = arr[j];
+                arr[j] = tmp;
+                ++i;
+                --j;
+            }
+        }
+        while (i <= j);
+        if (j < kk)
+            l = i;
+        if (kk < i)
+            r = j;
+    }
+    return arr[kk];
+}
+
+// fraction of points inside the rectangle
+static double _hit_rate(point_t *pts, size_t len, num_t xmin, num_t xmax,
+                        num_t ymin, num_t ymax)
+{
+    size_t hits = 0;
+    for (size_t i = 0; i < len; ++i)
+        hits += pts[i].x >= xmin && pts[i].x < xmax
+            && pts[i].y >= ymin && pts[i].y < ymax;
+    return len ? hits / (double) len : 0.0;
+}
+
+void estimate_bounds(flame_t *flame, jrand_t *jrand, size_t samples,
+                    double quantile, double margin, bounds_estimate_t *est)
+{
+    point_t *pts = malloc(samples*sizeof(*pts));
+    num_t *coord = malloc(samples*sizeof(*coord));
+    assert(pts);
+    assert(coord);
+    size_t len = render_orbit_points(flame,jrand,pts,samples,true);
+    est->points = len;
+    if (!len) // orbit never settles, keep the current rectangle
+    {
+        est->xmin = flame->xmin;
+        est->xmax = flame->xmax;
+        est->ymin = flame->ymin;
+        est->ymax = flame->ymax;
+        est->hit_rate_old = est->hit_rate_new = 0.0;
+        free(pts);
+        free(coord);
+        return;
+    }
+    size_t klo = quantile*(len-1);
+    size_t khi = (1.0-quantile)*(len-1);
+    for (size_t i = 0; i < len; ++i)
+        coord[i] = pts[i].x;
+    num_t xmin = _select(coord,len,klo);
+    num_t xmax = _select(coord,len,khi);
+    for (size_t i = 0; i < len; ++i)
+        coord[i] = pts[i].y;
+    num_t ymin = _select(coord,len,klo);
+    num_t ymax = _select(coord,len,khi);
+    // pad, avoiding a degenerate rectangle for attractors on a line
+    num_t w = xmax - xmin, h = ymax - ymin;
+    num_t pad = margin * (w > h ? w : h) + _EPS;
+    xmin -= pad; xmax += pad;
+    ymin -= pad; ymax += pad;
+    // widen the narrower axis about its center to match the image aspect
+    num_t aspect = (num_t) flame->size_x / (num_t) flame->size_y;
+    w = xmax - xmin;
+    h = ymax - ymin;
+    if (w < h*aspect)
+    {
+        num_t c = (xmin + xmax) / 2.0;
+        xmin = c - h*aspect/2.0;
+        xmax = c + h*aspect/2.0;
+    }
+    else
+    {
+        num_t c = (ymin + ymax) / 2.0;
+        ymin = c - w/aspect/2.0;
+        ymax = c + w/aspect/2.0;
+    }
+    est->xmin = xmin;
+    est->xmax = xmax;
+    est->ymin = ymin;
+    est->ymax = ymax;
+    est->hit_rate_old = _hit_rate(pts,len,flame->xmin,flame->xmax,
+        flame->ymin,flame->ymax);
+    est->hit_rate_new = _hit_rate(pts,len,xmin,xmax,ymin,ymax);
+    free(pts);
+    free(coord);
+}
+
+void apply_bounds(flame_t *flame, const bounds_estimate_t *est)
+{
+    flame->xmin = est->xmin;
+    flame->xmax = est->xmax;
+    flame->ymin = est->ymin;
+    flame->ymax = est->ymax;
+}
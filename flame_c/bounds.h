@@ -0,0 +1,29 @@
+/*
+Bounds estimation
+A short pre-pass samples the plotted points of the orbit (after the final
+xform) and picks a rectangle from quantiles of them, so the sample budget
+is not wasted on points outside the frame.
+*/
+
+#pragma once
+
+#include "types.h"
+
+// estimated bounds and the fraction of pre-pass points inside the rectangles
+typedef struct
+{
+    num_t xmin, xmax, ymin, ymax; // suggested rectangle
+    double hit_rate_old; // fraction in the flame's current rectangle
+    double hit_rate_new; // fraction in the suggested rectangle
+    size_t points; // number of points sampled
+}
+bounds_estimate_t;
+
+// samples points and takes the [quantile,1-quantile] range on each axis,
+// pads it by margin (a fraction of the width) and widens one axis so the
+// rectangle has the same aspect ratio as the image
+void estimate_bounds(flame_t *flame, jrand_t *jrand, size_t samples,
+                    double quantile, double margin, bounds_estimate_t *est);
+
+// set the flame rectangle to the estimate
+void apply_bounds(flame_t *flame, const bounds_estimate_t *est);
@@ -0,0 +1,316 @@
+/*
+Fast math
+Polynomial approximations of the transcendental functions used by the
+variations, with an accuracy tier (math_tier_t) as the last argument of
+each function:
+  MATH_EXACT    calls libm
+  MATH_PRECISE  error below 1e-6
+  MATH_FAST     error below 1e-3
+The error is absolute for results up to 1 in magnitude and relative above.
+bench/mathbench.c checks these bounds over the ranges below. The tier is
+meant to be a constant so only its code is left after inlining.
+
+Scalar versions are named like libm (fm_sinf, fm_sin), vector versions for
+4 floats and 2 doubles (GCC vector extensions, SSE2 sized) have the suffix
+_v4f and _v2d. They share the code in fastmath_impl.h.
+
+Ranges with the bounded error:
+  sin cos tan   |x| < 2^13 (float) or 2^30 (double), beyond that the
+                argument reduction loses accuracy
+  atan2         everywhere, atan2(0,0) = 0
+  exp           everywhere, arguments are clamped so the result is finite
+                and normal
+  log           positive normal x
+  pow           positive normal x, y*log(x) inside the range of exp(), the
+                scalar versions call libm for other x. there is no vector
+                pow for x <= 0.
+  sinhcosh      as exp, sinh(x) is only accurate in absolute terms near 0
+  hypot         sqrt(x*x+y*y), scalar only, without the overflow handling
+*/
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "types.h"
+
+typedef float fm_v4f __attribute__((vector_size(16)));
+typedef int32_t fm_v4i __attribute__((vector_size(16)));
+typedef double fm_v2d __attribute__((vector_size(16)));
+typedef int64_t fm_v2i __attribute__((vector_size(16)));
+
+#define _FM_CAT(a,b) a##b
+#define _FM_CAT2(a,b) _FM_CAT(a,b)
+
+static inline int32_t _fm_bits32(float x)
+{
+    int32_t i;
+    memcpy(&i,&x,sizeof(i));
+    return i;
+}
+
+static inline float _fm_float32(int32_t i)
+{
+    float x;
+    memcpy(&x,&i,sizeof(x));
+    return x;
+}
+
+static inline int64_t _fm_bits64(double x)
+{
+    int64_t i;
+    memcpy(&i,&x,sizeof(i));
+    return i;
+}
+
+static inline double _fm_float64(int64_t i)
+{
+    double x;
+    memcpy(&x,&i,sizeof(x));
+    return x;
+}
+
+// per precision constants
+#define FM_F32_MANT_BITS 23
+#define FM_F32_MANT_MASK 0x7fffff
+#define FM_F32_EXP_BIAS 127
+#define FM_F32_ROUND_MAGIC 12582912.0
+#define FM_F32_PIO2_1 1.5703125
+#define FM_F32_PIO2_2 4.837512969970703125e-4
+#define FM_F32_PIO2_3 7.54978995489188216e-8
+#define FM_F32_LN2_HI 0.693359375
+#define FM_F32_LN2_LO -2.12194440e-4
+#define FM_F32_EXP_LO -87.0
+#define FM_F32_EXP_HI 88.0
+
+#define FM_F64_MANT_BITS 52
+#define FM_F64_MANT_MASK 0xfffffffffffffLL
+#define FM_F64_EXP_BIAS 1023
+#define FM_F64_ROUND_MAGIC 6755399441055744.0
+#define FM_F64_PIO2_1 1.57079625129699707031
+#define FM_F64_PIO2_2 7.54978941586159635335e-8
+#define FM_F64_PIO2_3 5.39030285815811905290e-15
+#define FM_F64_LN2_HI 6.93147180369123816490e-01
+#define FM_F64_LN2_LO 1.90821492927058770002e-10
+#define FM_F64_EXP_LO -708.0
+#define FM_F64_EXP_HI 709.0
+
+// definitions shared by the scalar instantiations, selecting with masks
+// instead of branches which mispredict on the quadrants and octants
+#define FM_SEL(m,a,b) FM_AS_T((-(FM_I)(m) & FM_AS_INT(a)) \
+    | (~-(FM_I)(m) & FM_AS_INT(b)))
+#define FM_SELI(m,a,b) ((-(FM_I)(m) & (a)) | (~-(FM_I)(m) & (b)))
+#define FM_MAP1(f,x) f(x)
+#define FM_MAP2(f,x,y) f(x,y)
+
+// float
+#define FM_T float
+#define FM_S float
+#define FM_I int32_t
+#define FM_NAME(n) _FM_CAT2(n,f)
+#define FM_LIBM(n) n##f
+#define FM_AS_INT(x) _fm_bits32(x)
+#define FM_AS_T(i) _fm_float32(i)
+#define FM_TO_T(i) ((float)(i))
+#define FM_ABS(x) fabsf(x)
+#define FM_COPYSIGN(x,y) copysignf(x,y)
+#define FM_MANT_BITS FM_F32_MANT_BITS
+#define FM_MANT_MASK FM_F32_MANT_MASK
+#define FM_EXP_BIAS FM_F32_EXP_BIAS
+#define FM_ROUND_MAGIC FM_F32_ROUND_MAGIC
+#define FM_PIO2_1 FM_F32_PIO2_1
+#define FM_PIO2_2 FM_F32_PIO2_2
+#define FM_PIO2_3 FM_F32_PIO2_3
+#define FM_LN2_HI FM_F32_LN2_HI
+#define FM_LN2_LO FM_F32_LN2_LO
+#define FM_EXP_LO FM_F32_EXP_LO
+#define FM_EXP_HI FM_F32_EXP_HI
+#include "fastmath_impl.h"
+#undef FM_T
+#undef FM_S
+#undef FM_I
+#undef FM_NAME
+#undef FM_LIBM
+#undef FM_AS_INT
+#undef FM_AS_T
+#undef FM_TO_T
+#undef FM_ABS
+#undef FM_COPYSIGN
+
+// double, keeps the precision constants for the double vectors
+#define FM_T double
+#define FM_S double
+#define FM_I int64_t
+#define FM_NAME(n) n
+#define FM_LIBM(n) n
+#define FM_AS_INT(x) _fm_bits64(x)
+#define FM_AS_T(i) _fm_float64(i)
+#define FM_TO_T(i) ((double)(i))
+#define FM_ABS(x) fabs(x)
+#define FM_COPYSIGN(x,y) copysign(x,y)
+#undef FM_MANT_BITS
+#undef FM_MANT_MASK
+#undef FM_EXP_BIAS
+#undef FM_ROUND_MAGIC
+#undef FM_PIO2_1
+#undef FM_PIO2_2
+#undef FM_PIO2_3
+#undef FM_LN2_HI
+#undef FM_LN2_LO
+#undef FM_EXP_LO
+#undef FM_EXP_HI
+#define FM_MANT_BITS FM_F64_MANT_BITS
+#define FM_MANT_MASK FM_F64_MANT_MASK
+#define FM_EXP_BIAS FM_F64_EXP_BIAS
+#define FM_ROUND_MAGIC FM_F64_ROUND_MAGIC
+#define FM_PIO2_1 FM_F64_PIO2_1
+#define FM_PIO2_2 FM_F64_PIO2_2
+#define FM_PIO2_3 FM_F64_PIO2_3
+#define FM_LN2_HI FM_F64_LN2_HI
+#define FM_LN2_LO FM_F64_LN2_LO
+#define FM_EXP_LO FM_F64_EXP_LO
+#define FM_EXP_HI FM_F64_EXP_HI
+#include "fastmath_impl.h"
+#undef FM_T
+#undef FM_S
+#undef FM_I
+#undef FM_NAME
+#undef FM_LIBM
+#undef FM_AS_INT
+#undef FM_AS_T
+#undef FM_TO_T
+#undef FM_ABS
+#undef FM_COPYSIGN
+#undef FM_SEL
+#undef FM_SELI
+#undef FM_MAP1
+#undef FM_MAP2
+
+// definitions shared by the vector instantiations, comparisons give masks
+#define FM_SEL(m,a,b) FM_AS_T(((FM_I)(m) & FM_AS_INT(a)) \
+    | (~(FM_I)(m) & FM_AS_INT(b)))
+#define FM_SELI(m,a,b) (((FM_I)(m) & (a)) | (~(FM_I)(m) & (b)))
+#define FM_AS_INT(x) ((FM_I)(x))
+#define FM_AS_T(i) ((FM_T)(i))
+#define FM_TO_T(i) __builtin_convertvector(i,FM_T)
+#define FM_ABS(x) FM_AS_T(FM_AS_INT(x) & ~FM_AS_INT(-FM_V(0.0)))
+#define FM_COPYSIGN(x,y) FM_AS_T((FM_AS_INT(x) & ~FM_AS_INT(-FM_V(0.0))) \
+    | (FM_AS_INT(y) & FM_AS_INT(-FM_V(0.0))))
+#define FM_MAP1(f,x) ({ FM_T _r; \
+    for (int _i = 0; _i < FM_LANES; ++_i) { _r[_i] = f(x[_i]); } _r; })
+#define FM_MAP2(f,x,y) ({ FM_T _r; \
+    for (int _i = 0; _i < FM_LANES; ++_i) { _r[_i] = f(x[_i],y[_i]); } _r; })
+
+// 2 doubles
+#define FM_T fm_v2d
+#define FM_S double
+#define FM_I fm_v2i
+#define FM_LANES 2
+#define FM_NAME(n) _FM_CAT2(n,_v2d)
+#define FM_LIBM(n) n
+#include "fastmath_impl.h"
+#undef FM_T
+#undef FM_S
+#undef FM_I
+#undef FM_LANES
+#undef FM_NAME
+#undef FM_LIBM
+
+// 4 floats
+#undef FM_MANT_BITS
+#undef FM_MANT_MASK
+#undef FM_EXP_BIAS
+#undef FM_ROUND_MAGIC
+#undef FM_PIO2_1
+#undef FM_PIO2_2
+#undef FM_PIO2_3
+#undef FM_LN2_HI
+#undef FM_LN2_LO
+#undef FM_EXP_LO
+#undef FM_EXP_HI
+#define FM_MANT_BITS FM_F32_MANT_BITS
+#define FM_MANT_MASK FM_F32_MANT_MASK
+#define FM_EXP_BIAS FM_F32_EXP_BIAS
+#define FM_ROUND_MAGIC FM_F32_ROUND_MAGIC
+#define FM_PIO2_1 FM_F32_PIO2_1
+#define FM_PIO2_2 FM_F32_PIO2_2
+#define FM_PIO2_3 FM_F32_PIO2_3
+#define FM_LN2_HI FM_F32_LN2_HI
+#define FM_LN2_LO FM_F32_LN2_LO
+#define FM_EXP_LO FM_F32_EXP_LO
+#define FM_EXP_HI FM_F32_EXP_HI
+#define FM_T fm_v4f
+#define FM_S float
+#define FM_I fm_v4i
+#define FM_LANES 4
+#define FM_NAME(n) _FM_CAT2(n,_v4f)
+#define FM_LIBM(n) n##f
+#include "fastmath_impl.h"
+#undef FM_T
+#undef FM_S
+#undef FM_I
+#undef FM_LANES
+#undef FM_NAME
+#undef FM_LIBM
+#undef FM_SEL
+#undef FM_SELI
+#undef FM_AS_INT
+#undef FM_AS_T
+#undef FM_TO_T
+#undef FM_ABS
+#undef FM_COPYSIGN
+#undef FM_MAP1
+#undef FM_MAP2
+#undef FM_MANT_BITS
+#undef FM_MANT_MASK
+#undef FM_EXP_BIAS
+#undef FM_ROUND_MAGIC
+#undef FM_PIO2_1
+#undef FM_PIO2_2
+#undef FM_PIO2_3
+#undef FM_LN2_HI
+#undef FM_LN2_LO
+#undef FM_EXP_LO
+#undef FM_EXP_HI
+
+// scalar functions with no vector version
+
+static inline __attribute__((always_inline))
+float fm_hypotf(float x, float y, math_tier_t tier)
+{
+    return tier == MATH_EXACT ? hypotf(x,y) : sqrtf(x*x + y*y);
+}
+
+static inline __attribute__((always_inline))
+double fm_hypot(double x, double y, math_tier_t tier)
+{
+    return tier == MATH_EXACT ? hypot(x,y) : sqrt(x*x + y*y);
+}
+
+static inline __attribute__((always_inline))
+float fm_powf(float x, float y, math_tier_t tier)
+{
+    return tier == MATH_EXACT || !(x > 0.0f) ? powf(x,y)
+        : _fm_pow_posf(x,y,tier);
+}
+
+static inline __attribute__((always_inline))
+double fm_pow(double x, double y, math_tier_t tier)
+{
+    return tier == MATH_EXACT || !(x > 0.0) ? pow(x,y)
+        : _fm_pow_pos(x,y,tier);
+}
+
+static inline __attribute__((always_inline))
+fm_v4f fm_pow_v4f(fm_v4f x, fm_v4f y, math_tier_t tier)
+{
+    return _fm_pow_pos_v4f(x,y,tier);
+}
+
+static inline __attribute__((always_inline))
+fm_v2d fm_pow_v2d(fm_v2d x, fm_v2d y, math_tier_t tier)
+{
+    return _fm_pow_pos_v2d(x,y,tier);
+}
@@ -0,0 +1,252 @@
+/*
+Fast math template
+Included by fastmath.h once for each scalar and vector type, there is no
+include guard. The including file defines
+  FM_T            floating point type (scalar or vector)
+  FM_S            its scalar element type
+  FM_I            signed integer type of the same width (and lanes)
+  FM_NAME(f)      public name of function f for this type
+  FM_LIBM(f)      libm function f for FM_S
+  FM_AS_INT(x)    bits of x as FM_I
+  FM_AS_T(i)      FM_I bits as FM_T
+  FM_TO_T(i)      FM_I values converted to FM_T
+  FM_SEL(m,a,b)   a where the mask or condition m is set, b elsewhere
+  FM_SELI(m,a,b)  the same for FM_I
+  FM_ABS(x)       absolute value
+  FM_COPYSIGN(x,y)
+  FM_MAP1(f,x)    apply the scalar function f to each element
+  FM_MAP2(f,x,y)
+and the precision dependent constants
+  FM_MANT_BITS    mantissa bits
+  FM_MANT_MASK    mask of the mantissa bits
+  FM_EXP_BIAS     exponent bias
+  FM_ROUND_MAGIC  1.5*2^FM_MANT_BITS, adding it rounds to an integer
+  FM_PIO2_1..3    pi/2 split so k*FM_PIO2_1 and k*FM_PIO2_2 are exact
+  FM_LN2_HI/LO    ln(2) split the same way
+  FM_EXP_LO/HI    range of exp() arguments kept finite and normal
+Comparisons must give a condition FM_SEL accepts, which they do for both
+scalars and GCC vectors.
+*/
+
+// constants as FM_S and as FM_T
+#define FM_C(c) ((FM_S)(c))
+#define FM_V(c) ((FM_T){0} + FM_C(c))
+
+// coefficients fitted for minimax error on the reduced ranges
+// sin(r) = r + r^3 P(r^2), |r| <= pi/4
+#define FM_SIN_FAST(r2) (FM_C(-0.1666283380605654) \
+    + (r2)*FM_C(0.0081529923262335137))
+#define FM_SIN_PRECISE(r2) (FM_C(-0.16666650669291608) \
+    + (r2)*(FM_C(0.0083319786630572656) \
+    + (r2)*FM_C(-0.0001949563622815441)))
+// cos(r) = 1 + r^2 P(r^2), |r| <= pi/4
+#define FM_COS_FAST(r2) (FM_C(-0.49977630709329246) \
+    + (r2)*FM_C(0.040488935878993472))
+#define FM_COS_PRECISE(r2) (FM_C(-0.49999894781411169) \
+    + (r2)*(FM_C(0.041656294580514668) \
+    + (r2)*FM_C(-0.0013597823135002246)))
+// atan(a) = a + a^3 P(a^2), 0 <= a <= 1
+#define FM_ATAN_FAST(a2) (FM_C(-0.3316852832156959) \
+    + (a2)*(FM_C(0.18449096905734191) \
+    + (a2)*(FM_C(-0.090450586870022789) \
+    + (a2)*FM_C(0.023060272480903199))))
+#define FM_ATAN_PRECISE(a2) (FM_C(-0.3333298705923653) \
+    + (a2)*(FM_C(0.19990396620617701) \
+    + (a2)*(FM_C(-0.14185975254834257) \
+    + (a2)*(FM_C(0.10573931909236144) \
+    + (a2)*(FM_C(-0.073667057345926906) \
+    + (a2)*(FM_C(0.04112185575892352) \
+    + (a2)*(FM_C(-0.015132533772515191) \
+    + (a2)*FM_C(0.0026222439506912703))))))))
+// exp(r) = 1 + r + r^2 P(r), |r| <= ln(2)/2
+#define FM_EXP_FAST(r) (FM_C(0.50394102920443684) \
+    + (r)*FM_C(0.16662811081167303))
+#define FM_EXP_PRECISE(r) (FM_C(0.49999231790406834) \
+    + (r)*(FM_C(0.16667114464880631) \
+    + (r)*(FM_C(0.041890113275519787) \
+    + (r)*FM_C(0.00831252494583095))))
+// log((1+s)/(1-s)) = 2s + s^3 P(s^2), |s| <= 3 - 2 sqrt(2)
+#define FM_LOG_FAST(s2) FM_V(0.67710285987782581)
+#define FM_LOG_PRECISE(s2) (FM_C(0.6665342763051868) \
+    + (s2)*FM_C(0.41287472305122519))
+
+// nearest integer to x, also returned in *k
+static inline FM_T FM_NAME(_fm_round)(FM_T x, FM_I *k)
+{
+    FM_T y = x + FM_C(FM_ROUND_MAGIC);
+    *k = FM_AS_INT(y) - FM_AS_INT(FM_V(FM_ROUND_MAGIC));
+    return y - FM_C(FM_ROUND_MAGIC);
+}
+
+// x - k*pi/2 for the nearest k, so the result is within [-pi/4,pi/4]
+static inline FM_T FM_NAME(_fm_reduce_pio2)(FM_T x, FM_I *k)
+{
+    FM_T kf = FM_NAME(_fm_round)(x * FM_C(_2_PI),k);
+    return ((x - kf*FM_C(FM_PIO2_1)) - kf*FM_C(FM_PIO2_2))
+        - kf*FM_C(FM_PIO2_3);
+}
+
+// sine and cosine of the reduced argument
+static inline void FM_NAME(_fm_sincos_poly)(FM_T r, FM_T *s, FM_T *c,
+                                            math_tier_t tier)
+{
+    FM_T r2 = r*r;
+    if (tier == MATH_FAST)
+    {
+        *s = r + r*r2*FM_SIN_FAST(r2);
+        *c = FM_C(1.0) + r2*FM_COS_FAST(r2);
+    }
+    else
+    {
+        *s = r + r*r2*FM_SIN_PRECISE(r2);
+        *c = FM_C(1.0) + r2*FM_COS_PRECISE(r2);
+    }
+}
+
+static inline __attribute__((always_inline))
+void FM_NAME(fm_sincos)(FM_T x, FM_T *s, FM_T *c, math_tier_t tier)
+{
+    if (tier == MATH_EXACT)
+    {
+        *s = FM_MAP1(FM_LIBM(sin),x);
+        *c = FM_MAP1(FM_LIBM(cos),x);
+        return;
+    }
+    FM_I k;
+    FM_T rs, rc;
+    FM_NAME(_fm_sincos_poly)(FM_NAME(_fm_reduce_pio2)(x,&k),&rs,&rc,tier);
+    // the quadrant swaps sine and cosine and flips their signs
+    FM_T ss = FM_SEL((k & 1) != 0,rc,rs);
+    FM_T cc = FM_SEL((k & 1) != 0,rs,rc);
+    *s = FM_SEL((k & 2) != 0,-ss,ss);
+    *c = FM_SEL(((k + 1) & 2) != 0,-cc,cc);
+}
+
+static inline __attribute__((always_inline))
+FM_T FM_NAME(fm_sin)(FM_T x, math_tier_t tier)
+{
+    if (tier == MATH_EXACT)
+        return FM_MAP1(FM_LIBM(sin),x);
+    FM_T s, c;
+    FM_NAME(fm_sincos)(x,&s,&c,tier);
+    return s;
+}
+
+static inline __attribute__((always_inline))
+FM_T FM_NAME(fm_cos)(FM_T x, math_tier_t tier)
+{
+    if (tier == MATH_EXACT)
+        return FM_MAP1(FM_LIBM(cos),x);
+    FM_T s, c;
+    FM_NAME(fm_sincos)(x,&s,&c,tier);
+    return c;
+}
+
+// tan(r) in the even quadrants and -cot(r) in the odd ones, so the error
+// stays relative up to the poles
+static inline __attribute__((always_inline))
+FM_T FM_NAME(fm_tan)(FM_T x, math_tier_t tier)
+{
+    if (tier == MATH_EXACT)
+        return FM_MAP1(FM_LIBM(tan),x);
+    FM_I k;
+    FM_T s, c;
+    FM_NAME(_fm_sincos_poly)(FM_NAME(_fm_reduce_pio2)(x,&k),&s,&c,tier);
+    FM_I odd = (k & 1) != 0;
+    return FM_SEL(odd,-c,s) / FM_SEL(odd,s,c);
+}
+
+static inline __attribute__((always_inline))
+FM_T FM_NAME(fm_atan2)(FM_T y, FM_T x, math_tier_t tier)
+{
+    if (tier == MATH_EXACT)
+        return FM_MAP2(FM_LIBM(atan2),y,x);
+    FM_T ax = FM_ABS(x);
+    FM_T ay = FM_ABS(y);
+    FM_I steep = ay > ax;
+    FM_T mn = FM_SEL(steep,ax,ay);
+    FM_T mx = FM_SEL(steep,ay,ax);
+    // 0/0 at the origin, where the angle is 0
+    FM_T a = FM_SEL(mx > FM_C(0.0),mn / mx,FM_V(0.0));
+    FM_T a2 = a*a;
+    FM_T r = tier == MATH_FAST ? a + a*a2*FM_ATAN_FAST(a2)
+        : a + a*a2*FM_ATAN_PRECISE(a2);
+    r = FM_SEL(steep,FM_C(_PI_2) - r,r);
+    r = FM_SEL(x < FM_C(0.0),FM_C(_PI) - r,r);
+    return FM_COPYSIGN(r,y);
+}
+
+// arguments are clamped to FM_EXP_LO/HI so the result is always finite
+static inline __attribute__((always_inline))
+FM_T FM_NAME(fm_exp)(FM_T x, math_tier_t tier)
+{
+    if (tier == MATH_EXACT)
+        return FM_MAP1(FM_LIBM(exp),x);
+    x = FM_SEL(x > FM_C(FM_EXP_HI),FM_V(FM_EXP_HI),x);
+    x = FM_SEL(x < FM_C(FM_EXP_LO),FM_V(FM_EXP_LO),x);
+    FM_I k;
+    FM_T kf = FM_NAME(_fm_round)(x * FM_C(1.4426950408889634074),&k);
+    FM_T r = (x - kf*FM_C(FM_LN2_HI)) - kf*FM_C(FM_LN2_LO);
+    FM_T p = tier == MATH_FAST ? FM_EXP_FAST(r) : FM_EXP_PRECISE(r);
+    p = FM_C(1.0) + r + r*r*p;
+    // 2^k built from the exponent bits
+    return p * FM_AS_T((k + FM_EXP_BIAS) << FM_MANT_BITS);
+}
+
+// only for positive normal x
+static inline __attribute__((always_inline))
+FM_T FM_NAME(fm_log)(FM_T x, math_tier_t tier)
+{
+    if (tier == MATH_EXACT)
+        return FM_MAP1(FM_LIBM(log),x);
+    // x = m*2^e with m in [sqrt(1/2),sqrt(2))
+    FM_I i = FM_AS_INT(x);
+    FM_I e = (i >> FM_MANT_BITS) - FM_EXP_BIAS;
+    FM_T m = FM_AS_T((i & FM_MANT_MASK) | FM_AS_INT(FM_V(1.0)));
+    FM_I big = m > FM_C(_SQRT2);
+    m = FM_SEL(big,m*FM_C(0.5),m);
+    e = FM_SELI(big,e + 1,e);
+    FM_T s = (m - FM_C(1.0)) / (m + FM_C(1.0));
+    FM_T s2 = s*s;
+    FM_T p = tier == MATH_FAST ? FM_LOG_FAST(s2) : FM_LOG_PRECISE(s2);
+    FM_T ef = FM_TO_T(e);
+    return ef*FM_C(FM_LN2_HI) + (FM_C(2.0)*s + s*s2*p + ef*FM_C(FM_LN2_LO));
+}
+
+// exp(y*log(x)), only for positive x, see fm_pow() for the scalar version
+static inline __attribute__((always_inline))
+FM_T FM_NAME(_fm_pow_pos)(FM_T x, FM_T y, math_tier_t tier)
+{
+    if (tier == MATH_EXACT)
+        return FM_MAP2(FM_LIBM(pow),x,y);
+    return FM_NAME(fm_exp)(y*FM_NAME(fm_log)(x,tier),tier);
+}
+
+// both from one exp()
+static inline __attribute__((always_inline))
+void FM_NAME(fm_sinhcosh)(FM_T x, FM_T *s, FM_T *c, math_tier_t tier)
+{
+    if (tier == MATH_EXACT)
+    {
+        *s = FM_MAP1(FM_LIBM(sinh),x);
+        *c = FM_MAP1(FM_LIBM(cosh),x);
+        return;
+    }
+    FM_T e = FM_NAME(fm_exp)(x,tier);
+    FM_T ie = FM_C(1.0) / e;
+    *s = FM_C(0.5)*(e - ie);
+    *c = FM_C(0.5)*(e + ie);
+}
+
+#undef FM_C
+#undef FM_V
+#undef FM_SIN_FAST
+#undef FM_SIN_PRECISE
+#undef FM_COS_FAST
+#undef FM_COS_PRECISE
+#undef FM_ATAN_FAST
+#undef FM_ATAN_PRECISE
+#undef FM_EXP_FAST
+#undef FM_EXP_PRECISE
+#undef FM_LOG_FAST
+#undef FM_LOG_PRECISE
@@ -0,0 +1,190 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flamebin.h"
+#include "variations.h"
+
+// records and the parts in them start at multiples of this
+#define _ALIGN 16
+#define _ALIGNED(n) (((n) + _ALIGN-1) & ~(size_t)(_ALIGN-1))
+
+#define _FNV_OFFSET 0xcbf29ce484222325ull
+#define _FNV_PRIME 0x100000001b3ull
+
+// before the data of each record
+typedef struct
+{
+    uint64_t size; // bytes of data after this, a multiple of _ALIGN
+    uint64_t checksum; // of those bytes, offsets not yet turned to pointers
+}
+_record_t;
+
+// wrapper for fprintf(stderr,..)
+static void _write_error(const char *f, ...)
+{
+    va_list args;
+    va_start(args,f);
+    vfprintf(stderr,f,args);
+    va_end(args);
+}
+
+// FNV-1a over 64 bit words, len is a multiple of 8
+static uint64_t _checksum(const char *data, size_t len)
+{
+    uint64_t h = _FNV_OFFSET;
+    for (size_t i = 0; i < len; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w,data+i,8);
+        h = (h ^ w) * _FNV_PRIME;
+    }
+    return h;
+}
+
+// identifies the variation table the ids of a file index
+static uint64_t _variations_hash()
+{
+    uint64_t h = _FNV_OFFSET;
+    for (size_t k = 0; VARIATIONS[k].name; ++k)
+    {
+        for (const char *c = VARIATIONS[k].name; *c; ++c)
+            h = (h ^ (unsigned char)*c) * _FNV_PRIME;
+        h = (h ^ VARIATIONS[k].flags) * _FNV_PRIME;
+    }
+    return h;
+}
+
+static flamebin_header_t _header(uint64_t count)
+{
+    flamebin_header_t h;
+    memset(&h,0,sizeof(h));
+    memcpy(h.magic,FLAMEBIN_MAGIC,sizeof(h.magic));
+    h.version = FLAMEBIN_VERSION;
+    h.num_size = sizeof(num_t);
+    h.xform_size = sizeof(xform_t);
+    h.flame_size = sizeof(flame_t);
+    h.variations = _variations_hash();
+    h.count = count;
+    return h;
+}
+
+bool flamebin_is(const char *data, size_t len)
+{
+    return len >= sizeof(flamebin_header_t)
+        && !memcmp(data,FLAMEBIN_MAGIC,strlen(FLAMEBIN_MAGIC));
+}
+
+size_t flamebin_open(const char *data, size_t len)
+{
+    assert(flamebin_is(data,len));
+    flamebin_header_t h;
+    memcpy(&h,data,sizeof(h));
+    flamebin_header_t want = _header(h.count);
+    if (memcmp(&h,&want,sizeof(h)))
+        _write_error("compiled flame file is from a different build, "
+            "compile it again\n");
+    assert(!memcmp(&h,&want,sizeof(h)));
+    return _ALIGNED(sizeof(h));
+}
+
+// pointer stored as an offset from base, NULL stays NULL
+static inline void *_reloc(char *base, const void *off)
+{
+    return off ? base + (uintptr_t)off : NULL;
+}
+
+bool flamebin_next(char *data, size_t len, size_t *pos, flame_t *flame)
+{
+    if (*pos == len)
+        return false;
+    assert(*pos + sizeof(_record_t) <= len);
+    _record_t rec;
+    memcpy(&rec,data+*pos,sizeof(rec));
+    char *base = data + *pos + sizeof(rec);
+    if (rec.size > len - *pos - sizeof(rec)
+        || rec.checksum != _checksum(base,rec.size))
+    {
+        _write_error("compiled flame file is corrupt at byte %lu\n",*pos);
+        assert(0);
+    }
+    *pos += sizeof(rec) + rec.size;
+    memcpy(flame,base,sizeof(*flame));
+    flame->name = _reloc(base,flame->name);
+    flame->xforms = _reloc(base,flame->xforms);
+    flame->final_xform = _reloc(base,flame->final_xform);
+    flame->palette = _reloc(base,flame->palette);
+    flame->block = _reloc(base,flame->block);
+    flame->mapped = true;
+    size_t n = flame->xforms_len + (flame->final_xform != NULL);
+    for (size_t i = 0; i < n; ++i)
+    {
+        xform_t *xf = flame->xforms+i;
+        xf->var_ids = _reloc(base,xf->var_ids);
+        xf->varw = _reloc(base,xf->varw);
+    }
+    return true;
+}
+
+void flamebin_start(FILE *f)
+{
+    char pad[_ALIGNED(sizeof(flamebin_header_t))];
+    memset(pad,0,sizeof(pad));
+    flamebin_header_t h = _header(0);
+    memcpy(pad,&h,sizeof(h));
+    size_t w = fwrite(pad,1,sizeof(pad),f);
+    assert(w == sizeof(pad));
+}
+
+// offset in the record of a pointer into the flame's block
+static inline void *_offset(const flame_t *flame, const void *p)
+{
+    if (!p)
+        return NULL;
+    return (void*)(uintptr_t)((const char*)p - (const char*)flame->block
+        + _ALIGNED(sizeof(flame_t)));
+}
+
+void flamebin_write(FILE *f, const flame_t *flame)
+{
+    assert(flame->block);
+    size_t head = _ALIGNED(sizeof(flame_t));
+    size_t size = head + _ALIGNED(flame->block_size);
+    char *buf = calloc(1,size);
+    assert(buf);
+    flame_t *bf = (flame_t*)buf;
+    *bf = *flame;
+    bf->name = _offset(flame,flame->name);
+    bf->xforms = _offset(flame,flame->xforms);
+    bf->final_xform = _offset(flame,flame->final_xform);
+    bf->palette = _offset(flame,flame->palette);
+    bf->block = _offset(flame,flame->block);
+    bf->mapped = false;
+    memcpy(buf+head,flame->block,flame->block_size);
+    xform_t *bxf = (xform_t*)(buf + (uintptr_t)bf->xforms);
+    size_t n = flame->xforms_len + (flame->final_xform != NULL);
+    for (size_t i = 0; i < n; ++i)
+    {
+        bxf[i].var_ids = _offset(flame,bxf[i].var_ids);
+        bxf[i].varw = _offset(flame,bxf[i].varw);
+    }
+
+    _record_t rec = {size, _checksum(buf,size)};
+    size_t w = fwrite(&rec,sizeof(rec),1,f);
+    w += fwrite(buf,size,1,f);
+    assert(w == 2);
+    free(buf);
+}
+
+void flamebin_finish(FILE *f, uint64_t count)
+{
+    flamebin_header_t h = _header(count);
+    int r = fseek(f,0,SEEK_SET);
+    assert(!r);
+    size_t w = fwrite(&h,sizeof(h),1,f);
+    assert(w == 1);
+    r = fseek(f,0,SEEK_END);
+    assert(!r);
+}
@@ -0,0 +1,58 @@
+/*
+Compiled flame files
+Flames already parsed and optimized, stored as the flame_t structures the
+renderer uses so a worker can map the file and render from it with no
+parsing or allocation. Each flame is one record: the flame_t followed by
+its packed block (see pack_flame()), with pointers stored as offsets from
+the start of the record and a checksum over the whole record. Reading a
+flame checks the checksum and turns the offsets into pointers in place, so
+the mapping must be private and writable.
+
+Variation ids index VARIATIONS and the structures are stored as they are
+in memory, so a file is only read by a build with the same variation table,
+num_t and structure layout (checked against the header).
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "types.h"
+
+#define FLAMEBIN_MAGIC "FLAMEBIN"
+#define FLAMEBIN_VERSION 2
+
+typedef struct
+{
+    char magic[8]; // FLAMEBIN_MAGIC, without the null
+    uint32_t version;
+    uint32_t num_size; // sizeof(num_t)
+    uint32_t xform_size; // sizeof(xform_t)
+    uint32_t flame_size; // sizeof(flame_t)
+    uint64_t variations; // hash of the variation names in id order
+    uint64_t count; // number of flames
+}
+flamebin_header_t;
+
+// whether data starts like a compiled flame file (only the magic)
+bool flamebin_is(const char *data, size_t len);
+
+// offset of the first record, asserts the header matches this build
+size_t flamebin_open(const char *data, size_t len);
+
+// read the record at *pos into flame and move *pos past it, false at the
+// end. flame points into data afterwards and is marked as mapped (it is
+// not freed by destroy_flame()), data must stay mapped while it is in use
+bool flamebin_next(char *data, size_t len, size_t *pos, flame_t *flame);
+
+// write the header, the flame count is filled in by flamebin_finish()
+void flamebin_start(FILE *f);
+
+// append a flame as a record
+void flamebin_write(FILE *f, const flame_t *flame);
+
+// write the final flame count into the header, f must be seekable
+void flamebin_finish(FILE *f, uint64_t count);
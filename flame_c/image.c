@@ -0,0 +1,517 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "image.h"
+
+#define _FREE 0
+#define _QUEUED 1
+#define _DONE 2
+
+// rows deflated together, row 0 of raw is the row before the block (zeros
+// for the first block) so the first row can be filtered
+typedef struct
+{
+    int state;
+    size_t rows;
+    bool last; // ends the stream
+    uint8_t *raw; // big endian samples
+    uint8_t *filt; // filter type and filtered bytes of each row
+    size_t filt_len;
+    uint32_t adler; // of filt
+    uint8_t *out;
+    size_t out_len, out_cap;
+}
+_block_t;
+
+// deflate state of a thread compressing blocks
+typedef struct
+{
+    image_writer_t *im;
+    pthread_t thread;
+    z_stream z;
+    uint8_t *cand; // filtered rows of the 4 filters other than none
+}
+_worker_t;
+
+struct image_writer
+{
+    FILE *f;
+    bool error;
+    image_format_t format;
+    size_t w, h;
+    uint32_t channels;
+    size_t row_bytes; // samples of a row in bytes
+    size_t bpp; // bytes per pixel, the distance filters look back
+    size_t rows_in; // given so far
+    uint8_t *row_buf; // PNM 16 bit rows in big endian
+    // PNG blocks, a ring of blocks_len blocks
+    size_t block_rows;
+    _block_t *blocks;
+    size_t blocks_len;
+    size_t submitted, written, next_job; // counts of blocks
+    bool filling; // the block after the submitted ones has rows
+    uint32_t adler; // of the blocks written
+    _worker_t inline_worker; // compresses when there are no threads
+    _worker_t *workers;
+    uint32_t workers_len;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond_job; // signaled when a block is queued
+    pthread_cond_t cond_done; // signaled when a block is compressed
+};
+
+// wrapper for fprintf(stderr,..)
+static void _write_error(const char *f, ...)
+{
+    va_list args;
+    va_start(args,f);
+    vfprintf(stderr,f,args);
+    va_end(args);
+}
+
+static void _write(image_writer_t *im, const void *data, size_t len)
+{
+    if (len && fwrite(data,len,1,im->f) != 1)
+        im->error = true;
+}
+
+static void _put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void _png_chunk(image_writer_t *im, const char *type,
+                       const uint8_t *data, size_t len)
+{
+    assert(len < (1u << 31));
+    uint8_t head[8];
+    _put32(head,len);
+    memcpy(head+4,type,4);
+    uint32_t crc = crc32(crc32(0,NULL,0),head+4,4);
+    // a NULL buffer would reset the crc
+    if (len)
+        crc = crc32(crc,data,len);
+    uint8_t tail[4];
+    _put32(tail,crc);
+    _write(im,head,8);
+    _write(im,data,len);
+    _write(im,tail,4);
+}
+
+// copy n samples in native order to dst as big endian bytes
+static void _copy_samples(uint8_t *dst, const void *src, size_t n,
+                          uint32_t bits)
+{
+    if (bits == 8)
+    {
+        memcpy(dst,src,n);
+        return;
+    }
+    const uint16_t *s = src;
+    for (size_t i = 0; i < n; ++i)
+    {
+        dst[2*i] = s[i] >> 8;
+        dst[2*i+1] = s[i];
+    }
+}
+
+static inline uint8_t _paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+    int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2*c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// sum of the filtered bytes as signed differences
+static uint64_t _cost(const uint8_t *v, size_t n)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; ++i)
+        sum += abs((int8_t)v[i]);
+    return sum;
+}
+
+// filter cur (n bytes) with the filter giving the smallest sum of absolute
+// differences, out is the filter type followed by n bytes. each filter is
+// a separate loop over the row so the compiler vectorizes them
+static void _filter_row(const uint8_t *prev, const uint8_t *cur, size_t n,
+                        size_t bpp, uint8_t *cand, uint8_t *out)
+{
+    uint8_t *sub = cand, *up = cand+n, *avg = cand+2*n, *pae = cand+3*n;
+    size_t k = bpp < n ? bpp : n;
+    // the first pixel has no left neighbor
+    for (size_t i = 0; i < k; ++i)
+    {
+        sub[i] = cur[i];
+        avg[i] = cur[i] - (prev[i] >> 1);
+        pae[i] = cur[i] - prev[i];
+    }
+    for (size_t i = k; i < n; ++i)
+        sub[i] = cur[i] - cur[i-bpp];
+    for (size_t i = 0; i < n; ++i)
+        up[i] = cur[i] - prev[i];
+    for (size_t i = k; i < n; ++i)
+        avg[i] = cur[i] - ((cur[i-bpp] + prev[i]) >> 1);
+    for (size_t i = k; i < n; ++i)
+        pae[i] = cur[i] - _paeth(cur[i-bpp],prev[i],prev[i-bpp]);
+    uint8_t best = 0;
+    uint64_t best_cost = _cost(cur,n);
+    for (uint8_t t = 1; t < 5; ++t)
+    {
+        uint64_t cost = _cost(cand+(t-1)*n,n);
+        if (cost < best_cost)
+        {
+            best = t;
+            best_cost = cost;
+        }
+    }
+    out[0] = best;
+    memcpy(out+1,best ? cand+(best-1)*n : cur,n);
+}
+
+// filter and deflate a block
+static void _compress_block(image_writer_t *im, _worker_t *wk, _block_t *b)
+{
+    size_t n = im->row_bytes;
+    for (size_t r = 0; r < b->rows; ++r)
+        _filter_row(b->raw + r*n,b->raw + (r+1)*n,n,im->bpp,wk->cand,
+            b->filt + r*(n+1));
+    b->filt_len = b->rows*(n+1);
+    b->adler = adler32(adler32(0,NULL,0),b->filt,b->filt_len);
+    int ret = deflateReset(&wk->z);
+    assert(ret == Z_OK);
+    // a sync flush adds an empty stored block
+    size_t cap = deflateBound(&wk->z,b->filt_len) + 16;
+    if (b->out_cap < cap)
+    {
+        free(b->out);
+        b->out = malloc(cap);
+        assert(b->out);
+        b->out_cap = cap;
+    }
+    wk->z.next_in = b->filt;
+    wk->z.avail_in = b->filt_len;
+    wk->z.next_out = b->out;
+    wk->z.avail_out = b->out_cap;
+    ret = deflate(&wk->z,b->last ? Z_FINISH : Z_SYNC_FLUSH);
+    assert(ret == (b->last ? Z_STREAM_END : Z_OK));
+    assert(!wk->z.avail_in && wk->z.avail_out);
+    b->out_len = b->out_cap - wk->z.avail_out;
+}
+
+static void _worker_init(_worker_t *wk, image_writer_t *im)
+{
+    wk->im = im;
+    memset(&wk->z,0,sizeof(wk->z));
+    int level = im->format.level ? im->format.level : IMAGE_DEFAULT_LEVEL;
+    // raw deflate, the zlib header and checksum are written around blocks
+    int ret = deflateInit2(&wk->z,level,Z_DEFLATED,-15,8,
+        Z_DEFAULT_STRATEGY);
+    assert(ret == Z_OK);
+    wk->cand = malloc(4*im->row_bytes);
+    assert(wk->cand);
+}
+
+static void _worker_destroy(_worker_t *wk)
+{
+    deflateEnd(&wk->z);
+    free(wk->cand);
+}
+
+// compresses queued blocks in order until stopped
+static void *_worker_thread(void *arg)
+{
+    _worker_t *wk = arg;
+    image_writer_t *im = wk->im;
+    pthread_mutex_lock(&im->lock);
+    for (;;)
+    {
+        while (im->next_job == im->submitted && !im->stop)
+            pthread_cond_wait(&im->cond_job,&im->lock);
+        if (im->next_job == im->submitted)
+            break;
+        _block_t *b = im->blocks + im->next_job++ % im->blocks_len;
+        pthread_mutex_unlock(&im->lock);
+        _compress_block(im,wk,b);
+        pthread_mutex_lock(&im->lock);
+        b->state = _DONE;
+        pthread_cond_broadcast(&im->cond_done);
+    }
+    pthread_mutex_unlock(&im->lock);
+    return NULL;
+}
+
+// write the oldest block if it is compressed or wait is set, false if
+// there was nothing written
+static bool _write_next(image_writer_t *im, bool wait)
+{
+    if (im->written == im->submitted)
+        return false;
+    _block_t *b = im->blocks + im->written % im->blocks_len;
+    if (im->workers_len)
+    {
+        pthread_mutex_lock(&im->lock);
+        while (wait && b->state != _DONE)
+            pthread_cond_wait(&im->cond_done,&im->lock);
+        bool done = b->state == _DONE;
+        pthread_mutex_unlock(&im->lock);
+        if (!done)
+            return false;
+    }
+    _png_chunk(im,"IDAT",b->out,b->out_len);
+    im->adler = adler32_combine(im->adler,b->adler,b->filt_len);
+    b->state = _FREE;
+    ++im->written;
+    return true;
+}
+
+// the block being filled, taking the next one of the ring if there is none
+static _block_t *_current(image_writer_t *im)
+{
+    _block_t *b = im->blocks + im->submitted % im->blocks_len;
+    if (im->filling)
+        return b;
+    while (im->submitted - im->written == im->blocks_len)
+        _write_next(im,true);
+    size_t n = im->row_bytes;
+    if (im->submitted)
+    {
+        const _block_t *p = im->blocks
+            + (im->submitted-1) % im->blocks_len;
+        memmove(b->raw,p->raw + p->rows*n,n);
+    }
+    else
+        memset(b->raw,0,n);
+    b->rows = 0;
+    im->filling = true;
+    return b;
+}
+
+static void _submit(image_writer_t *im, _block_t *b)
+{
+    b->last = im->rows_in == im->h;
+    im->filling = false;
+    if (!im->workers_len)
+    {
+        _compress_block(im,&im->inline_worker,b);
+        b->state = _DONE;
+        ++im->submitted;
+        _write_next(im,true);
+        return;
+    }
+    pthread_mutex_lock(&im->lock);
+    b->state = _QUEUED;
+    ++im->submitted;
+    pthread_cond_signal(&im->cond_job);
+    pthread_mutex_unlock(&im->lock);
+    while (_write_next(im,false));
+}
+
+static void _png_open(image_writer_t *im)
+{
+    static const uint8_t sig[8] = {137, 'P', 'N', 'G', '\r', '\n', 26,
+        '\n'};
+    _write(im,sig,sizeof(sig));
+    uint8_t ihdr[13];
+    _put32(ihdr,im->w);
+    _put32(ihdr+4,im->h);
+    ihdr[8] = im->format.bits;
+    ihdr[9] = im->channels == 3 ? 2 : 0; // color type RGB or gray
+    ihdr[10] = ihdr[11] = ihdr[12] = 0; // deflate, filters, no interlace
+    _png_chunk(im,"IHDR",ihdr,sizeof(ihdr));
+    // zlib header, 32K window
+    static const uint8_t zhead[2] = {0x78, 0x9c};
+    _png_chunk(im,"IDAT",zhead,sizeof(zhead));
+    im->adler = adler32(0,NULL,0);
+
+    im->block_rows = IMAGE_BLOCK_BYTES / im->row_bytes;
+    im->block_rows = im->block_rows ? im->block_rows : 1;
+    im->workers_len = im->format.threads > 1 ? im->format.threads : 0;
+    im->blocks_len = im->workers_len ? 2*im->workers_len : 1;
+    im->blocks = calloc(im->blocks_len,sizeof(*im->blocks));
+    assert(im->blocks);
+    for (size_t i = 0; i < im->blocks_len; ++i)
+    {
+        _block_t *b = im->blocks + i;
+        b->raw = malloc((im->block_rows+1)*im->row_bytes);
+        b->filt = malloc(im->block_rows*(im->row_bytes+1));
+        assert(b->raw && b->filt);
+    }
+    if (!im->workers_len)
+    {
+        _worker_init(&im->inline_worker,im);
+        return;
+    }
+    pthread_mutex_init(&im->lock,NULL);
+    pthread_cond_init(&im->cond_job,NULL);
+    pthread_cond_init(&im->cond_done,NULL);
+    im->workers = malloc(im->workers_len*sizeof(*im->workers));
+    assert(im->workers);
+    for (uint32_t i = 0; i < im->workers_len; ++i)
+    {
+        _worker_init(im->workers+i,im);
+        int ret = pthread_create(&im->workers[i].thread,NULL,
+            &_worker_thread,im->workers+i);
+        assert(!ret);
+    }
+}
+
+static void _png_close(image_writer_t *im)
+{
+    while (_write_next(im,true));
+    uint8_t tail[4];
+    _put32(tail,im->adler);
+    _png_chunk(im,"IDAT",tail,sizeof(tail));
+    _png_chunk(im,"IEND",NULL,0);
+    if (im->workers_len)
+    {
+        pthread_mutex_lock(&im->lock);
+        im->stop = true;
+        pthread_cond_broadcast(&im->cond_job);
+        pthread_mutex_unlock(&im->lock);
+        for (uint32_t i = 0; i < im->workers_len; ++i)
+        {
+            pthread_join(im->workers[i].thread,NULL);
+            _worker_destroy(im->workers+i);
+        }
+        free(im->workers);
+        pthread_mutex_destroy(&im->lock);
+        pthread_cond_destroy(&im->cond_job);
+        pthread_cond_destroy(&im->cond_done);
+    }
+    else
+        _worker_destroy(&im->inline_worker);
+    for (size_t i = 0; i < im->blocks_len; ++i)
+    {
+        free(im->blocks[i].raw);
+        free(im->blocks[i].filt);
+        free(im->blocks[i].out);
+    }
+    free(im->blocks);
+}
+
+bool image_format_from_name(const char *name, image_format_t *f)
+{
+    static const struct
+    {
+        const char *name;
+        image_container_t container;
+        uint32_t bits;
+    }
+    names[] =
+    {
+        {"pgm", IMAGE_PNM, 8}, {"ppm", IMAGE_PNM, 8},
+        {"pgm16", IMAGE_PNM, 16}, {"ppm16", IMAGE_PNM, 16},
+        {"png", IMAGE_PNG, 8}, {"png16", IMAGE_PNG, 16}
+    };
+    for (size_t i = 0; i < sizeof(names)/sizeof(*names); ++i)
+        if (!strcmp(name,names[i].name))
+        {
+            f->container = names[i].container;
+            f->bits = names[i].bits;
+            return true;
+        }
+    return false;
+}
+
+const char *image_extension(const image_format_t *f, uint32_t channels)
+{
+    if (f->container == IMAGE_PNG)
+        return ".png";
+    return channels == 3 ? ".ppm" : ".pgm";
+}
+
+image_writer_t *image_open(const char *fname, const image_format_t *f,
+                           size_t w, size_t h, uint32_t channels)
+{
+    assert(w && h && w < (1u << 31) && h < (1u << 31));
+    assert(channels == 1 || channels == 3);
+    assert(f->bits == 8 || f->bits == 16);
+    FILE *file = strcmp(fname,"-") ? fopen(fname,"wb") : stdout;
+    if (!file)
+    {
+        _write_error("can not open %s\n",fname);
+        return NULL;
+    }
+    image_writer_t *im = calloc(1,sizeof(*im));
+    assert(im);
+    im->f = file;
+    im->format = *f;
+    im->w = w;
+    im->h = h;
+    im->channels = channels;
+    im->bpp = channels*f->bits/8;
+    im->row_bytes = w*im->bpp;
+    if (f->container == IMAGE_PNG)
+    {
+        _png_open(im);
+        return im;
+    }
+    fprintf(file,"P%c\n%lu %lu\n%u\n",channels == 3 ? '6' : '5',w,h,
+        f->bits == 16 ? 65535 : 255);
+    if (f->bits == 16)
+    {
+        im->row_buf = malloc(im->row_bytes);
+        assert(im->row_buf);
+    }
+    return im;
+}
+
+void image_write_rows(image_writer_t *im, const void *rows, size_t n)
+{
+    assert(im->rows_in + n <= im->h);
+    size_t samples = im->w*im->channels;
+    size_t in_bytes = samples*im->format.bits/8;
+    const uint8_t *src = rows;
+    if (im->format.container == IMAGE_PNM)
+    {
+        im->rows_in += n;
+        if (im->format.bits == 8)
+        {
+            _write(im,src,n*in_bytes);
+            return;
+        }
+        for (; n--; src += in_bytes)
+        {
+            _copy_samples(im->row_buf,src,samples,16);
+            _write(im,im->row_buf,im->row_bytes);
+        }
+        return;
+    }
+    while (n)
+    {
+        _block_t *b = _current(im);
+        size_t k = im->block_rows - b->rows;
+        k = k < n ? k : n;
+        for (size_t r = 0; r < k; ++r, src += in_bytes)
+            _copy_samples(b->raw + (b->rows+1+r)*im->row_bytes,src,
+                samples,im->format.bits);
+        b->rows += k;
+        im->rows_in += k;
+        n -= k;
+        if (b->rows == im->block_rows || im->rows_in == im->h)
+            _submit(im,b);
+    }
+}
+
+bool image_close(image_writer_t *im)
+{
+    assert(im->rows_in == im->h);
+    if (im->format.container == IMAGE_PNG)
+        _png_close(im);
+    free(im->row_buf);
+    if (im->f == stdout)
+        im->error |= fflush(im->f) != 0;
+    else
+        im->error |= fclose(im->f) != 0;
+    bool ok = !im->error;
+    free(im);
+    return ok;
+}
@@ -0,0 +1,73 @@
+/*
+Image output
+Streaming writer for 8 and 16 bit grayscale or RGB images as binary PGM/PPM
+(P5/P6) or PNG, shared by the flame renderer and the mandelbrot program.
+Rows are given top down as they are produced, 16 bit samples in native
+byte order (both formats store them big endian), and only a bounded number
+of rows is held in memory.
+
+PNG rows are filtered (the filter of each row chosen by the smallest sum
+of absolute differences, as libpng does) and deflated with zlib in blocks
+of rows by a pool of threads. Each block is a raw deflate stream ended with
+a sync flush, so the blocks joined in order are one stream and their
+Adler-32 checksums are combined, the same way pigz compresses in parallel.
+Blocks are not primed with the end of the block before them, which costs
+little for blocks of IMAGE_BLOCK_BYTES.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// raw bytes of rows deflated as one block
+#define IMAGE_BLOCK_BYTES (1 << 20)
+
+// zlib level used when the format does not set one
+#define IMAGE_DEFAULT_LEVEL 3
+
+typedef enum
+{
+    IMAGE_PNM,
+    IMAGE_PNG
+}
+image_container_t;
+
+typedef struct
+{
+    image_container_t container;
+    uint32_t bits; // per sample, 8 or 16
+    uint32_t threads; // deflating PNG blocks, 0 or 1 in the calling thread
+    int level; // zlib level 1-9, 0 for IMAGE_DEFAULT_LEVEL
+}
+image_format_t;
+
+typedef struct image_writer image_writer_t;
+
+// parse a format name (pgm, pgm16, png or png16, ppm names are the same as
+// pgm), other fields are left as they are, false if unknown
+bool image_format_from_name(const char *name, image_format_t *f);
+
+// file extension with the dot for images of the format with channels
+const char *image_extension(const image_format_t *f, uint32_t channels);
+
+// open fname (- for stdout) for a w x h image of 1 (gray) or 3 (RGB)
+// channels, NULL if it can not be opened
+image_writer_t *image_open(const char *fname, const image_format_t *f,
+                           size_t w, size_t h, uint32_t channels);
+
+// append n rows of w*channels samples each, uint8_t or uint16_t by bits
+void image_write_rows(image_writer_t *im, const void *rows, size_t n);
+
+// wait for the remaining blocks and finish the file, all rows must have
+// been written, false if writing failed
+bool image_close(image_writer_t *im);
+
+#ifdef __cplusplus
+}
+#endif
@@ -83,7 +83,7 @@ int32_t jrand_next_int_mod(jrand_t *j, int32_t b)
     int32_t r = _jrand_next(j,31);
     int32_t m = b - 1;
     if ((b & m) == 0) // b is a power of 2
-        return (b * r) >> 31;
+        return ((int64_t) b * r) >> 31;
     int32_t u = r;
     r = u % b;
     while (u - r + m < 0)
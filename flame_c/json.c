@@ -1,14 +1,45 @@
 #include <assert.h>
 #include <math.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "json.h"
 
 // uses asserts for parsing, fails if there is an error
-// uses inefficient linked lists to implement arrays and objects
+// a document is built in one arena, arrays and objects are gathered on
+// stacks while parsing and copied into the arena when they close
+
+// a document, the root value is the one handed out
+typedef struct
+{
+    arena_t *arena;
+    struct json_value root;
+}
+_jdoc_t;
+
+// parser state besides the input position
+typedef struct
+{
+    arena_t *arena;
+    struct json_value *vals; // elements of the open arrays
+    size_t vals_len, vals_cap;
+    json_member *mems; // members of the open objects
+    size_t mems_len, mems_cap;
+}
+_jstate_t;
+
+// FNV-1a
+static uint32_t _hash_key(const char *s)
+{
+    uint32_t h = 2166136261u;
+    for (; *s; ++s)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
 
 // wrapper for fprintf(stderr,..)
 static void _write_error(const char *f, ...)
@@ -103,8 +134,8 @@ static size_t _process_string(const char *data, size_t *i, char *dest)
     }
 }
 
-// return newly allocated string, NULL for error
-static char *_read_string(const char *data, size_t *i)
+// return string allocated in the arena, NULL for error
+static char *_read_string(const char *data, size_t *i, _jstate_t *st)
 {
     assert(data[*i] == '"');
     ++(*i);
@@ -112,8 +143,7 @@ static char *_read_string(const char *data, size_t *i)
     size_t length = _process_string(data,&j,NULL);
     if (length == -1)
         return NULL;
-    char *ret = malloc(length+1);
-    assert(ret);
+    char *ret = arena_alloc(st->arena,length+1);
     ret[length] = '\0';
     _process_string(data,i,ret);
     return ret;
@@ -179,53 +209,53 @@ static int _read_number(const char *data, size_t *i, _jnum_t *ret)
         while (_IS_DIGIT(data[*i]))
             ++(*i);
     }
-    // i should point to first char after the number
-    char *tmp = malloc(*i-start+1);
+    // i should point to first char after the number, copy it so the
+    // conversion stops there, on the stack unless it is very long
+    char buf[64];
+    size_t len = *i-start;
+    char *tmp = len < sizeof(buf) ? buf : malloc(len+1);
     assert(tmp);
-    tmp[*i-start] = '\0';
-    memcpy(tmp,data+start,*i-start);
+    tmp[len] = '\0';
+    memcpy(tmp,data+start,len);
     if (is_float)
         ret->as_float = atof(tmp);
     else
         ret->as_int = atoll(tmp);
-    free(tmp);
+    if (tmp != buf)
+        free(tmp);
     return is_float;
 }
 
-static json_value _read_value(const char *data, size_t *i);
+static void _read_value(const char *data, size_t *i, _jstate_t *st,
+                        json_value ret);
 
-static json_object _read_object(const char *data, size_t *i)
+static json_object _read_object(const char *data, size_t *i, _jstate_t *st)
 {
     assert(data[*i] == '{');
     ++(*i);
     _skip_whitespace(data,i);
-    json_object head = NULL;
-    json_object tail = NULL;
+    size_t base = st->mems_len;
     for (;;)
     {
         if (data[*i] == '}')
             break;
-        if (!head)
-        {
-            head = malloc(sizeof(*head));
-            assert(head);
-            tail = head;
-        }
-        else
-        {
-            tail->next = malloc(sizeof(*head));
-            assert(tail->next);
-            tail = tail->next;
-        }
-        tail->next = NULL;
+        json_member m;
         _skip_whitespace(data,i);
-        char *s = _read_string(data,i);
-        assert(s);
-        tail->key = s;
+        m.key = _read_string(data,i,st);
+        assert(m.key);
+        m.hash = _hash_key(m.key);
         _skip_whitespace(data,i);
         assert(data[*i] == ':');
         ++(*i);
-        tail->value = _read_value(data,i);
+        // nested values use the stack above base and leave it as it was
+        _read_value(data,i,st,&m.value);
+        if (st->mems_len == st->mems_cap)
+        {
+            st->mems_cap = st->mems_cap ? 2*st->mems_cap : 64;
+            st->mems = realloc(st->mems,st->mems_cap*sizeof(*st->mems));
+            assert(st->mems);
+        }
+        st->mems[st->mems_len++] = m;
         if (data[*i] == ',')
             ++(*i);
         else
@@ -235,34 +265,60 @@ static json_object _read_object(const char *data, size_t *i)
         }
     }
     ++(*i);
-    return head;
+    size_t len = st->mems_len - base;
+    st->mems_len = base;
+    if (!len)
+        return NULL;
+    // index at most half full
+    size_t slots = 4;
+    while (slots < 2*len)
+        slots *= 2;
+    json_object ret = arena_alloc(st->arena,sizeof(*ret)
+        + len*sizeof(ret->members[0]) + slots*sizeof(ret->index[0]));
+    ret->len = len;
+    ret->index_mask = slots-1;
+    ret->index = (uint32_t*)(ret->members+len);
+    memcpy(ret->members,st->mems+base,len*sizeof(ret->members[0]));
+    memset(ret->index,0,slots*sizeof(ret->index[0]));
+    for (size_t k = 0; k < len; ++k)
+    {
+        json_member *m = ret->members+k;
+        size_t j = m->hash & ret->index_mask;
+        bool dup = false;
+        for (; ret->index[j]; j = (j+1) & ret->index_mask)
+        {
+            json_member *o = ret->members+ret->index[j]-1;
+            if (o->hash == m->hash && !strcmp(o->key,m->key))
+            {
+                dup = true; // the first one is found, like a linear scan
+                break;
+            }
+        }
+        if (!dup)
+            ret->index[j] = k+1;
+    }
+    return ret;
 }
 
-static json_array _read_array(const char *data, size_t *i)
+static json_array _read_array(const char *data, size_t *i, _jstate_t *st)
 {
     assert(data[*i] == '[');
     ++(*i);
     _skip_whitespace(data,i);
-    json_array head = NULL;
-    json_array tail = NULL;
+    size_t base = st->vals_len;
     for (;;)
     {
         if (data[*i] == ']')
             break;
-        if (!head)
-        {
-            head = malloc(sizeof(*head));
-            assert(head);
-            tail = head;
-        }
-        else
+        struct json_value v;
+        _read_value(data,i,st,&v);
+        if (st->vals_len == st->vals_cap)
         {
-            tail->next = malloc(sizeof(*head));
-            assert(tail->next);
-            tail = tail->next;
+            st->vals_cap = st->vals_cap ? 2*st->vals_cap : 256;
+            st->vals = realloc(st->vals,st->vals_cap*sizeof(*st->vals));
+            assert(st->vals);
         }
-        tail->next = NULL;
-        tail->value = _read_value(data,i);
+        st->vals[st->vals_len++] = v;
         if (data[*i] == ',')
             ++(*i);
         else
@@ -272,18 +328,25 @@ static json_array _read_array(const char *data, size_t *i)
         }
     }
     ++(*i);
-    return head;
+    size_t len = st->vals_len - base;
+    st->vals_len = base;
+    if (!len)
+        return NULL;
+    json_array ret = arena_alloc(st->arena,sizeof(*ret)
+        + len*sizeof(ret->values[0]));
+    ret->len = len;
+    memcpy(ret->values,st->vals+base,len*sizeof(ret->values[0]));
+    return ret;
 }
 
-static json_value _read_value(const char *data, size_t *i)
+static void _read_value(const char *data, size_t *i, _jstate_t *st,
+                        json_value ret)
 {
     _skip_whitespace(data,i);
-    json_value ret = malloc(sizeof(*ret));
-    assert(ret);
     if (data[*i] == '"')
     {
         ret->type = JSON_STRING;
-        ret->value.as_str = _read_string(data,i);
+        ret->value.as_str = _read_string(data,i,st);
     }
     else if (data[*i] == '.' || _IS_SIGN(data[*i]) || _IS_DIGIT(data[*i])
         || data[*i] == 'N' || data[*i] == 'I')
@@ -305,12 +368,12 @@ static json_value _read_value(const char *data, size_t *i)
     else if (data[*i] == '{')
     {
         ret->type = JSON_OBJECT;
-        ret->value.as_object = _read_object(data,i);
+        ret->value.as_object = _read_object(data,i,st);
     }
     else if (data[*i] == '[')
     {
         ret->type = JSON_ARRAY;
-        ret->value.as_array = _read_array(data,i);
+        ret->value.as_array = _read_array(data,i,st);
     }
     else if (data[*i] == 'f')
     {
@@ -339,17 +402,34 @@ static json_value _read_value(const char *data, size_t *i)
         assert(data[*i] == 'l'); ++(*i);
         ret->type = JSON_NULL;
     }
+    else
+    {
+        _write_error("json: unexpected character: %c\n",data[*i]);
+        assert(0);
+    }
     _skip_whitespace(data,i);
-    return ret;
 }
 
-// creates a JSON object (newly allocated) from a string
+// arena blocks, the DOM of a flame file takes one to three times its text
+#define _ARENA_BLOCK_MIN (4*1024)
+#define _ARENA_BLOCK_MAX (16*1024*1024)
+
+// creates a JSON object (in a new arena) from a string
 json_value json_load(const char *data)
 {
+    size_t len = 2*strlen(data);
+    size_t block = len < _ARENA_BLOCK_MIN ? _ARENA_BLOCK_MIN
+        : len > _ARENA_BLOCK_MAX ? _ARENA_BLOCK_MAX : len;
+    _jstate_t st = {0};
+    st.arena = arena_create(block);
+    _jdoc_t *doc = arena_alloc(st.arena,sizeof(*doc));
+    doc->arena = st.arena;
     size_t i = 0;
-    json_value ret = _read_value(data,&i);
+    _read_value(data,&i,&st,&doc->root);
     assert(!data[i]);
-    return ret;
+    free(st.vals);
+    free(st.mems);
+    return &doc->root;
 }
 
 static void _dump_chars(char *buf, size_t *i, char ch, size_t count)
@@ -429,28 +509,21 @@ static void _json_dump_helper(json_value data, uint32_t depth,
             _dump_string(buf,i,"{}");
             break;
         }
-        json_object optr = data->value.as_object;
+        json_object obj = data->value.as_object;
         _dump_string(buf,i,"{");
-        if (indent)
-            _dump_string(buf,i,"\n");
-        _dump_spaces(buf,i,depth+indent);
-        _json_dump_str(buf,i,optr->key);
-        _dump_string(buf,i,":");
-        if (indent)
-            _dump_spaces(buf,i,1);
-        _json_dump_helper(optr->value,depth+indent,indent,buf,i);
-        while (optr->next)
+        for (size_t k = 0; k < obj->len; ++k)
         {
-            optr = optr->next;
-            _dump_string(buf,i,",");
+            if (k)
+                _dump_string(buf,i,",");
             if (indent)
                 _dump_string(buf,i,"\n");
             _dump_spaces(buf,i,depth+indent);
-            _json_dump_str(buf,i,optr->key);
+            _json_dump_str(buf,i,obj->members[k].key);
             _dump_string(buf,i,":");
             if (indent)
                 _dump_spaces(buf,i,1);
-            _json_dump_helper(optr->value,depth+indent,indent,buf,i);
+            _json_dump_helper(&obj->members[k].value,depth+indent,indent,
+                buf,i);
         }
         if (indent)
             _dump_string(buf,i,"\n");
@@ -463,20 +536,16 @@ static void _json_dump_helper(json_value data, uint32_t depth,
             _dump_string(buf,i,"[]");
             break;
         }
-        json_array aptr = data->value.as_array;
+        json_array arr = data->value.as_array;
         _dump_string(buf,i,"[");
-        if (indent)
-            _dump_string(buf,i,"\n");
-        _dump_spaces(buf,i,depth+indent);
-        _json_dump_helper(aptr->value,depth+indent,indent,buf,i);
-        while (aptr->next)
+        for (size_t k = 0; k < arr->len; ++k)
         {
-            aptr = aptr->next;
-            _dump_string(buf,i,",");
+            if (k)
+                _dump_string(buf,i,",");
             if (indent)
                 _dump_string(buf,i,"\n");
             _dump_spaces(buf,i,depth+indent);
-            _json_dump_helper(aptr->value,depth+indent,indent,buf,i);
+            _json_dump_helper(&arr->values[k],depth+indent,indent,buf,i);
         }
         if (indent)
             _dump_string(buf,i,"\n");
@@ -512,71 +581,30 @@ char *json_dump(json_value data, uint32_t indent)
     return ret;
 }
 
-// free all the dynamically allocated memory associated with a JSON value
+// free a document returned by json_load(), its whole arena at once
 void json_destroy(json_value json)
 {
-    if (json->type == JSON_STRING)
-        free(json->value.as_str);
-    else if (json->type == JSON_OBJECT)
-    {
-        json_object ptr = json->value.as_object;
-        while (ptr)
-        {
-            json_object ptr_old = ptr;
-            free(ptr->key);
-            json_destroy(ptr->value);
-            ptr = ptr->next;
-            free(ptr_old);
-        }
-    }
-    else if (json->type == JSON_ARRAY)
-    {
-        json_array ptr = json->value.as_array;
-        while (ptr)
-        {
-            json_array ptr_old = ptr;
-            json_destroy(ptr->value);
-            ptr = ptr->next;
-            free(ptr_old);
-        }
-    }
-    free(json);
+    _jdoc_t *doc = (_jdoc_t*)((char*)json - offsetof(_jdoc_t,root));
+    assert(&doc->root == json);
+    arena_destroy(doc->arena);
 }
 
 size_t json_array_len(json_array array)
 {
-    size_t ret = 0;
-    while (array)
-    {
-        array = array->next;
-        ++ret;
-    }
-    return ret;
+    return array ? array->len : 0;
 }
 
 size_t json_object_len(json_object object)
 {
-    size_t ret = 0;
-    while (object)
-    {
-        object = object->next;
-        ++ret;
-    }
-    return ret;
+    return object ? object->len : 0;
 }
 
 // index an array, return NULL if out of bounds
 json_value json_array_get(json_array array, size_t index)
 {
-    if (!array)
+    if (!array || index >= array->len)
         return NULL;
-    while (index--)
-    {
-        if (!array->next)
-            return NULL;
-        array = array->next;
-    }
-    return array->value;
+    return array->values+index;
 }
 
 // get the value corresponding to a key, return NULL if not exist
@@ -584,15 +612,33 @@ json_value json_object_get(json_object object, const char *key)
 {
     if (!object)
         return NULL;
-    while (object)
+    uint32_t h = _hash_key(key);
+    for (size_t j = h & object->index_mask; object->index[j];
+        j = (j+1) & object->index_mask)
     {
-        if (!strcmp(key,object->key))
-            return object->value;
-        object = object->next;
+        json_member *m = object->members+object->index[j]-1;
+        if (m->hash == h && !strcmp(key,m->key))
+            return &m->value;
     }
     return NULL;
 }
 
+// key of the member at a position in document order, NULL if out of bounds
+const char *json_object_key_at(json_object object, size_t index)
+{
+    if (!object || index >= object->len)
+        return NULL;
+    return object->members[index].key;
+}
+
+// value of the member at a position in document order
+json_value json_object_value_at(json_object object, size_t index)
+{
+    if (!object || index >= object->len)
+        return NULL;
+    return &object->members[index].value;
+}
+
 // some code that was used for testing
 #if 0
 char *read_file(const char *fname)
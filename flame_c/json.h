@@ -1,12 +1,16 @@
 /*
 JSON
 The number type is split into integer and floating point
-The object and array types are represented as linked lists
+Arrays and objects are contiguous, an object keeps its members in document
+order with a hash index over the keys. A loaded document lives in one arena
+that json_destroy() frees at once, so only the value returned by json_load()
+can be destroyed. Empty arrays and objects are NULL.
 */
 
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef int64_t json_int;
@@ -44,19 +48,30 @@ struct json_value
     value;
 };
 
-// key,value object map as a linked list of (k,v) pairs
-struct json_object
+// key,value pair of an object
+typedef struct
 {
     char *key;
-    json_value value;
-    json_object next;
+    uint32_t hash;
+    struct json_value value;
+}
+json_member;
+
+// members in document order, index holds member positions + 1 (0 is empty)
+// in a table of index_mask+1 slots, probed linearly from the key hash
+struct json_object
+{
+    size_t len;
+    size_t index_mask;
+    uint32_t *index;
+    json_member members[];
 };
 
-// value array as a linked list
+// values in order
 struct json_array
 {
-    json_value value;
-    json_array next;
+    size_t len;
+    struct json_value values[];
 };
 
 json_value json_load(const char *data);
@@ -72,3 +87,7 @@ size_t json_object_len(json_object object);
 json_value json_array_get(json_array array, size_t index);
 
 json_value json_object_get(json_object object, const char *key);
+
+const char *json_object_key_at(json_object object, size_t index);
+
+json_value json_object_value_at(json_object object, size_t index);
@@ -0,0 +1,75 @@
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "kernel.h"
+#include "types.h"
+
+// single precision is used when a pixel spans at least this many float
+// steps at the largest coordinate of the frame, so rounding stays far below
+// the pixel size. deep zooms fall below this and get double precision.
+#define PRECISION_MARGIN 256.0
+
+static const char *const PRECISION_NAMES[] = {"auto","float","double"};
+static const char *const MATH_NAMES[] = {"exact","precise","fast"};
+
+// indexed by precision (float, double) and math tier
+static const kernel_t *const KERNELS[2][3] =
+{
+    {&KERNEL_FLOAT,&KERNEL_FLOAT_PRECISE,&KERNEL_FLOAT_FAST},
+    {&KERNEL_DOUBLE,&KERNEL_DOUBLE_PRECISE,&KERNEL_DOUBLE_FAST}
+};
+
+precision_t kernel_precision(const flame_t *flame, precision_t override)
+{
+    if (override != PRECISION_AUTO)
+        return override;
+    if (flame->precision != PRECISION_AUTO)
+        return flame->precision;
+    num_t pixel = fmin((flame->xmax - flame->xmin) / flame->size_x,
+        (flame->ymax - flame->ymin) / flame->size_y);
+    num_t mag = fmax(fmax(fabs(flame->xmin),fabs(flame->xmax)),
+        fmax(fabs(flame->ymin),fabs(flame->ymax)));
+    // float step at the magnitude of the coordinates, at least at 1 since
+    // the attractor usually reaches that far regardless of the frame
+    num_t step = fmax(mag,1.0) * _EMACH32;
+    return pixel >= PRECISION_MARGIN*step ? PRECISION_FLOAT : PRECISION_DOUBLE;
+}
+
+const kernel_t *kernel_get(precision_t precision, math_tier_t math)
+{
+    assert(precision != PRECISION_AUTO);
+    return KERNELS[precision == PRECISION_DOUBLE][math];
+}
+
+const char *precision_name(precision_t precision)
+{
+    return PRECISION_NAMES[precision];
+}
+
+bool precision_from_name(const char *name, precision_t *precision)
+{
+    for (int i = 0; i < 3; ++i)
+        if (!strcmp(name,PRECISION_NAMES[i]))
+        {
+            *precision = i;
+            return true;
+        }
+    return false;
+}
+
+const char *math_name(math_tier_t math)
+{
+    return MATH_NAMES[math];
+}
+
+bool math_from_name(const char *name, math_tier_t *math)
+{
+    for (int i = 0; i < 3; ++i)
+        if (!strcmp(name,MATH_NAMES[i]))
+        {
+            *math = i;
+            return true;
+        }
+    return false;
+}
@@ -0,0 +1,100 @@
+/*
+Iteration kernels
+The chaos game walker is compiled once for each precision from kernel_impl.h
+(kernel_f32.c and kernel_f64.c) so the precision can be chosen per flame.
+A kernel converts the flame to its precision when a walker is set up. Each
+precision is also compiled with the fast math tiers (see fastmath.h).
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "jrand.h"
+#include "orbit.h"
+#include "renderer.h"
+#include "types.h"
+
+// iterations from the start that are not plotted for the IFS to "settle"
+// the papers suggest using 20 for this value
+#define SETTLE_ITERS 50
+
+// points already on the attractor, shared read only by all walkers
+typedef struct
+{
+    point_t *pts;
+    size_t len;
+}
+settle_pool_t;
+
+typedef struct kernel_t kernel_t;
+
+// one chaos game walker, each render thread runs its own
+typedef struct
+{
+    const kernel_t *kernel;
+    void *kstate; // iteration state in the kernel precision
+    flame_t *flame;
+    settle_pool_t *pool; // starting points, NULL to settle from random points
+    uint32_t *histogram;
+    uint64_t samples; // iterations counted against the sample budget
+    uint64_t bad_value_count;
+    uint64_t settles; // number of (re)starts
+    uint64_t settle_iters; // unplotted iterations done for (re)starts
+    bool stats_on; // collect stats, selects the walker loop
+    uint32_t stats_mask; // sample iterations where counter & mask == 0
+    uint32_t stats_counter;
+    render_stats_t stats;
+    // recording (see orbit.h), the plotted points and their xform indices
+    // are also stored in rec, which the caller empties before it can hold
+    // no more than the samples of the next run. rec is NULL to not record
+    orbit_writer_t *record;
+    point_t *rec;
+    uint8_t *rec_xf;
+    size_t rec_len;
+    void *rec_scratch; // for orbit_write()
+}
+walker_t;
+
+struct kernel_t
+{
+    precision_t precision;
+    math_tier_t math;
+    // set up the iteration state of a walker (all other fields set) using
+    // jrand for its random numbers, then settle it
+    void (*init)(walker_t *w, jrand_t *jrand);
+    void (*destroy)(walker_t *w);
+    // run for the given number of samples, plotting to the histogram
+    void (*run)(walker_t *w, uint64_t samples);
+    // fill pts with consecutive points of the orbit instead of plotting,
+    // after the final xform as they are plotted if plotted is set, returns
+    // the number stored (see render_orbit_points())
+    size_t (*orbit)(walker_t *w, point_t *pts, size_t len, bool plotted);
+};
+
+extern const kernel_t KERNEL_FLOAT;
+extern const kernel_t KERNEL_FLOAT_PRECISE;
+extern const kernel_t KERNEL_FLOAT_FAST;
+extern const kernel_t KERNEL_DOUBLE;
+extern const kernel_t KERNEL_DOUBLE_PRECISE;
+extern const kernel_t KERNEL_DOUBLE_FAST;
+
+// precision to iterate the flame with, override if it is not auto, then the
+// precision set for the flame, otherwise chosen from the bounds and size
+precision_t kernel_precision(const flame_t *flame, precision_t override);
+
+// kernel for a precision other than auto and a math tier
+const kernel_t *kernel_get(precision_t precision, math_tier_t math);
+
+// name of a precision, "auto" "float" or "double"
+const char *precision_name(precision_t precision);
+
+// parse a precision name, returns false if it is not one
+bool precision_from_name(const char *name, precision_t *precision);
+
+// name of a math tier, "exact" "precise" or "fast"
+const char *math_name(math_tier_t math);
+
+// parse a math tier name, returns false if it is not one
+bool math_from_name(const char *name, math_tier_t *math);
@@ -0,0 +1,10 @@
+// iteration kernel in single precision
+#define _GNU_SOURCE
+
+#define KNUM float
+#define KSINCOS sincosf
+#define KERNEL_NAME KERNEL_FLOAT
+#define KPRECISION PRECISION_FLOAT
+#define KMATH MATH_EXACT
+
+#include "kernel_impl.h"
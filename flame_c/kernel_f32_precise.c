@@ -0,0 +1,11 @@
+// iteration kernel in single precision with precise fast math
+#define _GNU_SOURCE
+
+#define KNUM float
+#define KSINCOS sincosf
+#define KERNEL_NAME KERNEL_FLOAT_PRECISE
+#define KPRECISION PRECISION_FLOAT
+#define KMATH MATH_PRECISE
+#define KFM(n) fm_##n##f
+
+#include "kernel_impl.h"
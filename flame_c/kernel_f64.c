@@ -0,0 +1,10 @@
+// iteration kernel in double precision
+#define _GNU_SOURCE
+
+#define KNUM double
+#define KSINCOS sincos
+#define KERNEL_NAME KERNEL_DOUBLE
+#define KPRECISION PRECISION_DOUBLE
+#define KMATH MATH_EXACT
+
+#include "kernel_impl.h"
@@ -0,0 +1,11 @@
+// iteration kernel in double precision with fast math
+#define _GNU_SOURCE
+
+#define KNUM double
+#define KSINCOS sincos
+#define KERNEL_NAME KERNEL_DOUBLE_FAST
+#define KPRECISION PRECISION_DOUBLE
+#define KMATH MATH_FAST
+#define KFM(n) fm_##n
+
+#include "kernel_impl.h"
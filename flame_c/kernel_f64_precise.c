@@ -0,0 +1,11 @@
+// iteration kernel in double precision with precise fast math
+#define _GNU_SOURCE
+
+#define KNUM double
+#define KSINCOS sincos
+#define KERNEL_NAME KERNEL_DOUBLE_PRECISE
+#define KPRECISION PRECISION_DOUBLE
+#define KMATH MATH_PRECISE
+#define KFM(n) fm_##n
+
+#include "kernel_impl.h"
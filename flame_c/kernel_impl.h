@@ -0,0 +1,440 @@
+/*
+Iteration kernel template
+Included once by each kernel source file, there is no include guard. The
+including file defines
+  KNUM         floating point type of the kernel
+  KSINCOS      sincos function for KNUM
+  KERNEL_NAME  name of the kernel_t to define
+  KPRECISION   its precision_t
+  KMATH        its math_tier_t, with KFM for the fast tiers (see
+               variations_impl.h)
+*/
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "jrand.h"
+#include "kernel.h"
+#include "symmetry.h"
+#include "types.h"
+#include "variations_impl.h"
+
+// whether to run the post affine transform
+// this may make sense to disable when it is not used
+//#define DISABLE_POST_AFFINE
+
+// absolute value of numbers to trigger bad value (non contractive system)
+#define BAD_VALUE_THRESHOLD 1e10
+
+// force equal probability selection for all xforms, regardless of input
+//#define FORCE_EQUAL_XFORM_SELECTION
+
+// the walker and its arrays are one block aligned to cache lines
+#define KBLOCK_ALIGN 64
+#define KBLOCK_SIZE(n) (((n) + KBLOCK_ALIGN-1) & ~(size_t)(KBLOCK_ALIGN-1))
+
+// walker state in the kernel precision, with its own copy of the flame
+// followed by the arrays in the order an iteration reads them (cw, xforms,
+// vars, varw, sym)
+typedef struct
+{
+    kxform_t *xforms;
+    uint32_t xforms_len;
+    kxform_t *final; // after the xforms in the array, NULL if none
+    kvar_func_t *vars; // variations of all xforms
+    knum_t *varw;
+    knum_t *cw; // cumulative weights for xform selection
+    kaffine_t *sym; // symmetry group of the flame, the identity first
+    uint32_t sym_len;
+    knum_t xmin, xmax, ymin, ymax; // rectangle to render
+    knum_t xmul, ymul; // scale from flame coordinates to histogram bins
+    size_t size_x, size_y;
+    jrand_t jrand; // RNG for xform selection
+    kstate_t state;
+}
+kwalker_t;
+
+// check for NaN and very large/small values
+// TODO make this faster by checking only for +-inf and NaN
+static inline bool bad_value(knum_t n)
+{
+    return (fabs(n) > BAD_VALUE_THRESHOLD) || isnan(n);
+}
+
+// random point in [-s,s]x[-s,s]
+static inline void _biunit_rand(knum_t s, jrand_t *j, knum_t *x, knum_t *y)
+{
+    *x = s*(jrand_next_float(j)*2.0 - 1.0);
+    *y = s*(jrand_next_float(j)*2.0 - 1.0);
+}
+
+// (x,y) -> (*xn,*yn)
+static inline void _apply_affine(kaffine_t *af, knum_t *xn, knum_t *yn,
+                                knum_t x, knum_t y)
+{
+    *xn = af->a*x + af->b*y + af->c;
+    *yn = af->d*x + af->e*y + af->f;
+}
+
+// transforms the state with a chosen xform
+static inline void _apply_xform_basic(kstate_t *state, kxform_t *xf)
+{
+    // transform point
+    _apply_affine(&(xf->pre_affine),&(state->tx),&(state->ty),
+                    state->x,state->y);
+    state->vx = 0.0;
+    state->vy = 0.0;
+    state->xf = xf;
+    for (uint32_t i = 0; i < xf->var_len; ++i) // sum variations
+        (xf->vars[i])(state,xf->varw[i]);
+    // update point
+#ifndef DISABLE_POST_AFFINE
+    _apply_affine(&(xf->post_affine),&(state->x),&(state->y),
+                    state->vx,state->vy);
+#else
+    state->x = state->vx;
+    state->y = state->vy;
+#endif
+}
+
+// randomly select flame based on cumulative weights
+// TODO support doing this with binary search for better efficiency
+static inline uint32_t _pick_xform(knum_t *cw, jrand_t *jrand, uint32_t xflen)
+{
+#ifndef FORCE_EQUAL_XFORM_SELECTION
+    uint32_t ret = 0;
+    knum_t rand = jrand_next_float(jrand);
+    while (cw[ret] < rand)
+        ++ret;
+    return ret;
+#else
+    return jrand_next_int_mod(jrand,xflen);
+#endif
+}
+
+static void _convert_affine(kaffine_t *dest, const affine_params *src)
+{
+    dest->a = src->a;
+    dest->b = src->b;
+    dest->c = src->c;
+    dest->d = src->d;
+    dest->e = src->e;
+    dest->f = src->f;
+}
+
+// copy an xform, its variations go to the walker's arrays from index *k
+static void _convert_xform(kwalker_t *kw, kxform_t *kxf, const xform_t *xf,
+                            size_t *k)
+{
+    kxf->vars = kw->vars+*k;
+    kxf->varw = kw->varw+*k;
+    kxf->var_len = xf->var_len;
+    for (uint32_t j = 0; j < xf->var_len; ++j, ++*k)
+    {
+        kw->vars[*k] = VAR_FUNCS[xf->var_ids[j]];
+        kw->varw[*k] = xf->varw[j];
+    }
+    _convert_affine(&kxf->pre_affine,&xf->pre_affine);
+    _convert_affine(&kxf->post_affine,&xf->post_affine);
+    kxf->var_params = xf->var_params;
+}
+
+// a walker with a copy of the flame in the kernel precision, in one block
+// freed with the walker. the cumulative weights are normalized here so the
+// flame itself is not changed
+static kwalker_t *_convert_flame(const flame_t *flame)
+{
+    bool final = flame->final_xform != NULL;
+    size_t var_total = final ? flame->final_xform->var_len : 0;
+    for (size_t i = 0; i < flame->xforms_len; ++i)
+        var_total += flame->xforms[i].var_len;
+    size_t cw_off = KBLOCK_SIZE(sizeof(kwalker_t));
+    size_t xforms_off = cw_off
+        + KBLOCK_SIZE(flame->xforms_len*sizeof(knum_t));
+    size_t vars_off = xforms_off
+        + KBLOCK_SIZE((flame->xforms_len+final)*sizeof(kxform_t));
+    size_t varw_off = vars_off + var_total*sizeof(kvar_func_t);
+    size_t sym_off = KBLOCK_SIZE(varw_off + var_total*sizeof(knum_t));
+    uint32_t sym_len = symmetry_order(flame->symmetry);
+    size_t size = KBLOCK_SIZE(sym_off + sym_len*sizeof(kaffine_t));
+    char *block = aligned_alloc(KBLOCK_ALIGN,size);
+    assert(block);
+    kwalker_t *kw = (kwalker_t*)block;
+    kw->xforms_len = flame->xforms_len;
+    kw->xforms = (kxform_t*)(block+xforms_off);
+    kw->vars = (kvar_func_t*)(block+vars_off);
+    kw->varw = (knum_t*)(block+varw_off);
+    kw->sym = (kaffine_t*)(block+sym_off);
+    kw->sym_len = sym_len;
+    affine_params sym[2*SYMMETRY_MAX];
+    symmetry_group(flame->symmetry,sym);
+    for (uint32_t i = 0; i < sym_len; ++i)
+        _convert_affine(kw->sym+i,sym+i);
+    kw->cw = NULL;
+#ifndef FORCE_EQUAL_XFORM_SELECTION
+    kw->cw = (knum_t*)(block+cw_off);
+    num_t wsum = 0.0;
+    for (size_t i = 0; i < flame->xforms_len; ++i)
+        wsum += flame->xforms[i].weight;
+    num_t s = 0.0;
+    for (size_t i = 0; i < flame->xforms_len; ++i)
+    {
+        s += flame->xforms[i].weight;
+        kw->cw[i] = s / wsum;
+    }
+    kw->cw[flame->xforms_len-1] = 1.0; // to correct for rounding error
+#endif
+    size_t k = 0;
+    for (size_t i = 0; i < flame->xforms_len; ++i)
+        _convert_xform(kw,kw->xforms+i,flame->xforms+i,&k);
+    kw->final = NULL;
+    if (final)
+    {
+        kw->final = kw->xforms+flame->xforms_len;
+        _convert_xform(kw,kw->final,flame->final_xform,&k);
+    }
+    kw->xmin = flame->xmin;
+    kw->xmax = flame->xmax;
+    kw->ymin = flame->ymin;
+    kw->ymax = flame->ymax;
+    kw->xmul = (knum_t) flame->size_x / (knum_t)(flame->xmax - flame->xmin);
+    kw->ymul = (knum_t) flame->size_y / (knum_t)(flame->ymax - flame->ymin);
+    kw->size_x = flame->size_x;
+    kw->size_y = flame->size_y;
+    return kw;
+}
+
+// (re)start the walker, either from a pool point or from a random point
+// followed by iterations that are not plotted. returns the iterations done.
+static uint32_t _walker_settle(walker_t *w)
+{
+    kwalker_t *kw = w->kstate;
+    ++w->settles;
+    if (w->pool)
+    {
+        point_t p = w->pool->pts[jrand_next_int_mod(&kw->jrand,w->pool->len)];
+        kw->state.x = p.x;
+        kw->state.y = p.y;
+        return 0;
+    }
+    _biunit_rand(1.0,&kw->jrand,&(kw->state.x),&(kw->state.y));
+    for (uint32_t i = 0; i < SETTLE_ITERS; ++i)
+        _apply_xform_basic(&kw->state,kw->xforms
+            +_pick_xform(kw->cw,&kw->jrand,kw->xforms_len));
+    w->settle_iters += SETTLE_ITERS;
+    return SETTLE_ITERS;
+}
+
+static void _walker_init(walker_t *w, jrand_t *jrand)
+{
+    kwalker_t *kw = _convert_flame(w->flame);
+    kw->jrand = *jrand;
+    kw->state.rand = *jrand;
+    w->kstate = kw;
+    _walker_settle(w);
+}
+
+static void _walker_destroy(walker_t *w)
+{
+    free(w->kstate);
+    w->kstate = NULL;
+}
+
+// plot a point of the orbit reached with xform xf_i. the final xform moves
+// the plotted point only, the orbit goes on from the point before it. a bad
+// final value is never in frame.
+static inline __attribute__((always_inline))
+void _plot_point(walker_t *w, knum_t px, knum_t py, uint32_t xf_i,
+                 const bool stats, const bool record)
+{
+    kwalker_t *kw = w->kstate;
+    kstate_t *state = &kw->state;
+    if (kw->final)
+    {
+        knum_t x = state->x, y = state->y;
+        state->x = px;
+        state->y = py;
+        _apply_xform_basic(state,kw->final);
+        px = state->x;
+        py = state->y;
+        state->x = x;
+        state->y = y;
+    }
+    bool in_frame = px >= kw->xmin && px < kw->xmax
+        && py >= kw->ymin && py < kw->ymax;
+    if (stats && !(++w->stats_counter & w->stats_mask))
+    {
+        render_stats_t *st = &w->stats;
+        ++st->sampled;
+        st->in_frame += in_frame;
+        ++st->xfdist[xf_i];
+        st->xmin = fmin(st->xmin,px);
+        st->xmax = fmax(st->xmax,px);
+        st->ymin = fmin(st->ymin,py);
+        st->ymax = fmax(st->ymax,py);
+    }
+    if (record)
+    {
+        w->rec[w->rec_len].x = px;
+        w->rec[w->rec_len].y = py;
+        w->rec_xf[w->rec_len++] = xf_i;
+    }
+    if (!in_frame)
+        return;
+    uint32_t x = (px - kw->xmin) * kw->xmul;
+    uint32_t y = (py - kw->ymin) * kw->ymul;
+    // a point just inside the upper bounds can round to the next pixel
+    x = x < kw->size_x ? x : kw->size_x-1;
+    y = y < kw->size_y ? y : kw->size_y-1;
+    ++w->histogram[(kw->size_x*y)+x];
+}
+
+// run the walker for the given number of samples. the stats, record and
+// sym arguments are constants at each call site so the compiler makes a
+// copy of the loop for each with the code of the others removed entirely.
+// with sym each iteration plots the images of the point under the symmetry
+// group, as many as the samples left allow, starting with a random one the
+// orbit goes on from (see symmetry.h)
+static inline __attribute__((always_inline))
+void _walker_run_impl(walker_t *w, uint64_t samples, const bool stats,
+                      const bool record, const bool sym)
+{
+    kwalker_t *kw = w->kstate;
+    kstate_t *state = &kw->state;
+    w->samples += samples;
+    while (samples)
+    {
+        uint32_t xf_i = _pick_xform(kw->cw,&kw->jrand,kw->xforms_len);
+        _apply_xform_basic(state,kw->xforms+xf_i);
+        if (bad_value(state->x) || bad_value(state->y))
+        {
+            ++w->bad_value_count;
+            if (stats && w->stats.bad_len < RENDER_STATS_BAD_MAX)
+            {
+                w->stats.bad[w->stats.bad_len].x = state->x;
+                w->stats.bad[w->stats.bad_len++].y = state->y;
+            }
+            // get the new point to settle before adding to histogram again
+            // count re-settling against sample count so rendering does not
+            // hang when rendering a system reaching bad values frequently
+            uint32_t iters = _walker_settle(w) + 1;
+            if (samples >= iters)
+                samples -= iters;
+            else
+                samples = 0;
+            continue;
+        }
+        if (!sym)
+        {
+            _plot_point(w,state->x,state->y,xf_i,stats,record);
+            --samples;
+            continue;
+        }
+        uint32_t n = samples < kw->sym_len ? samples : kw->sym_len;
+        samples -= n;
+        uint32_t g = jrand_next_int_mod(&kw->jrand,kw->sym_len);
+        knum_t x = state->x, y = state->y;
+        _apply_affine(kw->sym+g,&state->x,&state->y,x,y);
+        _plot_point(w,state->x,state->y,xf_i,stats,record);
+        while (--n)
+        {
+            g = g+1 < kw->sym_len ? g+1 : 0;
+            knum_t gx, gy;
+            _apply_affine(kw->sym+g,&gx,&gy,x,y);
+            _plot_point(w,gx,gy,xf_i,stats,record);
+        }
+    }
+}
+
+static void _walker_run_fast(walker_t *w, uint64_t samples)
+{
+    if (((kwalker_t*)w->kstate)->sym_len > 1)
+        _walker_run_impl(w,samples,false,false,true);
+    else
+        _walker_run_impl(w,samples,false,false,false);
+}
+
+static void _walker_run_stats(walker_t *w, uint64_t samples)
+{
+    if (((kwalker_t*)w->kstate)->sym_len > 1)
+        _walker_run_impl(w,samples,true,false,true);
+    else
+        _walker_run_impl(w,samples,true,false,false);
+}
+
+// recording is slow anyway, the symmetry is not a separate copy
+static void _walker_run_record(walker_t *w, uint64_t samples)
+{
+    bool sym = ((kwalker_t*)w->kstate)->sym_len > 1;
+    if (w->stats_on)
+        _walker_run_impl(w,samples,true,true,sym);
+    else
+        _walker_run_impl(w,samples,false,true,sym);
+}
+
+static void _walker_run(walker_t *w, uint64_t samples)
+{
+    if (w->rec)
+        _walker_run_record(w,samples);
+    else if (w->stats_on)
+        _walker_run_stats(w,samples);
+    else
+        _walker_run_fast(w,samples);
+}
+
+static size_t _walker_orbit(walker_t *w, point_t *pts, size_t len,
+                            bool plotted)
+{
+    kwalker_t *kw = w->kstate;
+    size_t i = 0, bad = 0;
+    while (i < len && bad <= len)
+    {
+        _apply_xform_basic(&kw->state,
+            kw->xforms+_pick_xform(kw->cw,&kw->jrand,kw->xforms_len));
+        if (bad_value(kw->state.x) || bad_value(kw->state.y))
+        {
+            ++bad;
+            _walker_settle(w);
+            continue;
+        }
+        // go on from a random image under the symmetry group, so the
+        // points are those of the orbit the renderer plots
+        if (kw->sym_len > 1)
+        {
+            knum_t x = kw->state.x, y = kw->state.y;
+            _apply_affine(kw->sym+jrand_next_int_mod(&kw->jrand,kw->sym_len),
+                &kw->state.x,&kw->state.y,x,y);
+        }
+        knum_t x = kw->state.x, y = kw->state.y;
+        if (plotted && kw->final)
+        {
+            _apply_xform_basic(&kw->state,kw->final);
+            knum_t fx = kw->state.x, fy = kw->state.y;
+            kw->state.x = x;
+            kw->state.y = y;
+            // never plotted, but the orbit goes on
+            if (bad_value(fx) || bad_value(fy))
+            {
+                ++bad;
+                continue;
+            }
+            x = fx;
+            y = fy;
+        }
+        pts[i].x = x;
+        pts[i].y = y;
+        ++i;
+    }
+    return i;
+}
+
+const kernel_t KERNEL_NAME =
+{
+    .precision = KPRECISION,
+    .math = KMATH,
+    .init = &_walker_init,
+    .destroy = &_walker_destroy,
+    .run = &_walker_run,
+    .orbit = &_walker_orbit
+};
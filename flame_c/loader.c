@@ -0,0 +1,294 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "flamebin.h"
+#include "json.h"
+#include "loader.h"
+#include "parser.h"
+#include "utils.h"
+#include "xmlflame.h"
+
+// stdin is read in chunks of this size
+#define _READ_CHUNK (1 << 16)
+// mapped pages behind the current flame are given back in steps of this
+#define _RELEASE_STEP (1 << 24)
+
+struct flame_loader
+{
+    const char *map; // mapped file, NULL for stdin
+    size_t map_len;
+    size_t released; // mapped bytes given back
+    char *buf; // window over stdin
+    size_t cap;
+    const char *data; // input window, the whole file if mapped
+    size_t len;
+    size_t pos; // next byte to scan
+    size_t mark; // start of the flame being scanned, kept in the window
+    bool started, done, eof;
+    bool xml; // flam3 XML, read whole and parsed in place
+    bool bin; // compiled, read whole and used in place (see flamebin.h)
+    char *elem; // null terminated copy of one flame
+    size_t elem_cap;
+    size_t count;
+};
+
+// wrapper for fprintf(stderr,..)
+static void _write_error(const char *f, ...)
+{
+    va_list args;
+    va_start(args,f);
+    vfprintf(stderr,f,args);
+    va_end(args);
+}
+
+static int _peek_nonspace(flame_loader_t *l);
+static bool _fill(flame_loader_t *l);
+
+// XML when the first thing in the input is a tag, compiled when it starts
+// with the magic, stdin is then read to the end since the flames are parsed
+// or used in place
+static void _detect_format(flame_loader_t *l)
+{
+    l->xml = _peek_nonspace(l) == '<';
+    while (l->len < sizeof(flamebin_header_t) && _fill(l))
+        ;
+    l->bin = flamebin_is(l->data,l->len);
+    if (l->xml || l->bin)
+        while (_fill(l))
+            ;
+    if (!l->bin)
+        return;
+    // the offsets in the records are turned into pointers in place
+    if (l->map)
+    {
+        int r = mprotect((void*)l->map,l->map_len,PROT_READ|PROT_WRITE);
+        assert(!r);
+    }
+    l->pos = flamebin_open(l->data,l->len);
+}
+
+flame_loader_t *loader_open(const char *fname)
+{
+    flame_loader_t *l = calloc(1,sizeof(*l));
+    assert(l);
+    if (!strcmp(fname,"-"))
+    {
+        l->cap = _READ_CHUNK;
+        l->buf = malloc(l->cap);
+        assert(l->buf);
+        l->data = l->buf;
+        _detect_format(l);
+        return l;
+    }
+    l->map = map_file(fname,&l->map_len);
+    if (!l->map)
+    {
+        free(l);
+        return NULL;
+    }
+    madvise((void*)l->map,l->map_len,MADV_SEQUENTIAL);
+    l->data = l->map;
+    l->len = l->map_len;
+    _detect_format(l);
+    return l;
+}
+
+// read more of stdin into the window, dropping what is before the mark
+static bool _fill(flame_loader_t *l)
+{
+    if (l->map || l->eof)
+        return false;
+    memmove(l->buf,l->buf+l->mark,l->len-l->mark);
+    l->len -= l->mark;
+    l->pos -= l->mark;
+    l->mark = 0;
+    if (l->cap - l->len < _READ_CHUNK)
+    {
+        l->cap *= 2;
+        l->buf = realloc(l->buf,l->cap);
+        assert(l->buf);
+        l->data = l->buf;
+    }
+    ssize_t n = read(STDIN_FILENO,l->buf+l->len,l->cap-l->len);
+    if (n <= 0)
+    {
+        l->eof = true;
+        return false;
+    }
+    l->len += n;
+    return true;
+}
+
+// next byte, -1 at the end of the input
+static inline int _getc(flame_loader_t *l)
+{
+    if (l->pos == l->len && !_fill(l))
+        return -1;
+    return (unsigned char)l->data[l->pos++];
+}
+
+// next non whitespace byte without consuming it, -1 at the end
+static int _peek_nonspace(flame_loader_t *l)
+{
+    for (;;)
+    {
+        int c = _getc(l);
+        switch (c)
+        {
+        case ' ':
+        case '\n':
+        case '\r':
+        case '\t':
+            break;
+        case -1:
+            return c;
+        default:
+            --l->pos;
+            return c;
+        }
+    }
+}
+
+// move past the object or array starting at pos
+static void _skip_value(flame_loader_t *l)
+{
+    uint32_t depth = 0;
+    bool in_str = false;
+    for (;;)
+    {
+        int c = _getc(l);
+        if (c < 0)
+        {
+            _write_error("flame file ends inside a flame\n");
+            assert(0);
+        }
+        if (in_str)
+        {
+            if (c == '\\')
+                c = _getc(l);
+            else if (c == '"')
+                in_str = false;
+        }
+        else if (c == '"')
+            in_str = true;
+        else if (c == '{' || c == '[')
+            ++depth;
+        else if ((c == '}' || c == ']') && --depth == 0)
+            return;
+    }
+}
+
+// let the kernel drop the mapped pages of flames already parsed
+static void _release(flame_loader_t *l)
+{
+    if (!l->map || l->mark - l->released < _RELEASE_STEP)
+        return;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t upto = l->mark & ~(page-1);
+    madvise((void*)(l->map+l->released),upto-l->released,MADV_DONTNEED);
+    l->released = upto;
+}
+
+// the next genome of an XML file
+static bool _next_xml(flame_loader_t *l, flame_t *flame)
+{
+    const char *pos = l->data+l->pos;
+    if (!xml_next_flame(&pos,l->data+l->len,l->count,flame))
+    {
+        l->done = true;
+        _write_error("parsed %lu flames\n",l->count);
+        return false;
+    }
+    l->pos = l->mark = pos - l->data;
+    _release(l);
+    ++l->count;
+    return true;
+}
+
+// the next record of a compiled file, its pages are not released since
+// the flame points into them
+static bool _next_bin(flame_loader_t *l, flame_t *flame)
+{
+    if (!flamebin_next((char*)l->data,l->len,&l->pos,flame))
+    {
+        l->done = true;
+        _write_error("mapped %lu flames\n",l->count);
+        return false;
+    }
+    ++l->count;
+    return true;
+}
+
+bool loader_next(flame_loader_t *l, flame_t *flame)
+{
+    if (l->done)
+        return false;
+    if (l->xml)
+        return _next_xml(l,flame);
+    if (l->bin)
+        return _next_bin(l,flame);
+    int c = _peek_nonspace(l);
+    if (!l->started)
+    {
+        if (c != '[')
+            _write_error("flame file is not an array of flames\n");
+        assert(c == '[');
+        ++l->pos;
+        l->started = true;
+        c = _peek_nonspace(l);
+    }
+    else if (c == ',')
+    {
+        ++l->pos;
+        c = _peek_nonspace(l);
+        assert(c != ']');
+    }
+    if (c == ']')
+    {
+        ++l->pos;
+        assert(_peek_nonspace(l) < 0);
+        l->done = true;
+        _write_error("parsed %lu flames\n",l->count);
+        return false;
+    }
+    if (c != '{')
+        _write_error("expected a flame object in the flame file\n");
+    assert(c == '{');
+    l->mark = l->pos;
+    _skip_value(l);
+    size_t len = l->pos - l->mark;
+    if (len+1 > l->elem_cap)
+    {
+        l->elem_cap = 2*(len+1);
+        l->elem = realloc(l->elem,l->elem_cap);
+        assert(l->elem);
+    }
+    memcpy(l->elem,l->data+l->mark,len);
+    l->elem[len] = '\0';
+    l->mark = l->pos;
+    json_value jflame = json_load(l->elem);
+    flame_from_json(jflame->value.as_object,flame);
+    json_destroy(jflame);
+    _release(l);
+    ++l->count;
+    return true;
+}
+
+size_t loader_count(const flame_loader_t *l)
+{
+    return l->count;
+}
+
+void loader_close(flame_loader_t *l)
+{
+    if (l->map)
+        unmap_file(l->map,l->map_len);
+    free(l->buf);
+    free(l->elem);
+    free(l);
+}
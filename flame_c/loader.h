@@ -0,0 +1,31 @@
+/*
+Streaming flame loader
+Reads the flames of a batch file one at a time, from a mapped file or from
+stdin, so rendering can start as soon as the first flame is parsed and
+memory does not grow with the number of flames. The top level JSON array is
+scanned for the extent of each element, which is then parsed on its own.
+Files starting with a tag are flam3 / Apophysis XML (see xmlflame.h), and
+compiled flame files (see flamebin.h) are used in place, their flames
+point into the loader's memory and are only valid until loader_close().
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "types.h"
+
+typedef struct flame_loader flame_loader_t;
+
+// open a flame file, - for stdin, NULL if the file can not be opened
+flame_loader_t *loader_open(const char *fname);
+
+// read the next flame into newly allocated memory (see destroy_flame()),
+// false after the last one
+bool loader_next(flame_loader_t *l, flame_t *flame);
+
+// number of flames read so far
+size_t loader_count(const flame_loader_t *l);
+
+void loader_close(flame_loader_t *l);
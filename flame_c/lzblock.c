@@ -0,0 +1,146 @@
+#include <string.h>
+
+#include "lzblock.h"
+
+#define _MIN_MATCH 4
+#define _MAX_OFFSET 65535
+#define _HASH_BITS 12
+
+static inline uint32_t _read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v,p,sizeof(v));
+    return v;
+}
+
+static inline uint32_t _hash(uint32_t v)
+{
+    return (v*2654435761u) >> (32 - _HASH_BITS);
+}
+
+// length bytes after a nibble of 15, false if they do not fit
+static bool _put_len(uint8_t **d, const uint8_t *end, size_t n)
+{
+    for (; n >= 255; n -= 255)
+    {
+        if (*d == end)
+            return false;
+        *(*d)++ = 255;
+    }
+    if (*d == end)
+        return false;
+    *(*d)++ = (uint8_t)n;
+    return true;
+}
+
+// add n from the length bytes to *len, false if they run past the end
+static bool _get_len(const uint8_t **s, const uint8_t *end, size_t *len)
+{
+    uint8_t b;
+    do
+    {
+        if (*s == end)
+            return false;
+        b = *(*s)++;
+        *len += b;
+    }
+    while (b == 255);
+    return true;
+}
+
+// one sequence, match is 0 for the last one (literals only)
+static bool _put_seq(uint8_t **d, const uint8_t *end, const uint8_t *lit,
+                     size_t lits, size_t offset, size_t match)
+{
+    if (*d == end)
+        return false;
+    uint8_t *token = (*d)++;
+    size_t ml = match ? match - _MIN_MATCH : 0;
+    *token = (lits < 15 ? lits : 15) << 4 | (ml < 15 ? ml : 15);
+    if (lits >= 15 && !_put_len(d,end,lits-15))
+        return false;
+    if ((size_t)(end - *d) < lits)
+        return false;
+    memcpy(*d,lit,lits);
+    *d += lits;
+    if (!match)
+        return true;
+    if (end - *d < 2)
+        return false;
+    *(*d)++ = (uint8_t)offset;
+    *(*d)++ = (uint8_t)(offset >> 8);
+    return ml < 15 || _put_len(d,end,ml-15);
+}
+
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap)
+{
+    // positions + 1 of the last 4 bytes with each hash, 0 for none
+    uint32_t table[1 << _HASH_BITS];
+    memset(table,0,sizeof(table));
+    uint8_t *d = dst;
+    const uint8_t *end = dst + cap;
+    size_t anchor = 0, i = 0;
+    while (i + _MIN_MATCH <= len)
+    {
+        uint32_t v = _read32(src+i);
+        uint32_t h = _hash(v);
+        size_t cand = table[h];
+        table[h] = i+1;
+        if (!cand || i+1 - cand > _MAX_OFFSET || _read32(src+cand-1) != v)
+        {
+            ++i;
+            continue;
+        }
+        --cand;
+        size_t m = _MIN_MATCH;
+        while (i+m < len && src[cand+m] == src[i+m])
+            ++m;
+        if (!_put_seq(&d,end,src+anchor,i-anchor,i-cand,m))
+            return 0;
+        i += m;
+        anchor = i;
+    }
+    if (!_put_seq(&d,end,src+anchor,len-anchor,0,0))
+        return 0;
+    return d - dst;
+}
+
+bool lz_decompress(const uint8_t *src, size_t len, uint8_t *dst,
+                   size_t out_len)
+{
+    const uint8_t *s = src, *se = src + len;
+    uint8_t *d = dst, *de = dst + out_len;
+    while (s < se)
+    {
+        uint8_t token = *(s++);
+        size_t lits = token >> 4;
+        if (lits == 15 && !_get_len(&s,se,&lits))
+            return false;
+        if (lits > (size_t)(se - s) || lits > (size_t)(de - d))
+            return false;
+        memcpy(d,s,lits);
+        d += lits;
+        s += lits;
+        if (s == se)
+            break;
+        if (se - s < 2)
+            return false;
+        size_t off = s[0] | (size_t)s[1] << 8;
+        s += 2;
+        size_t m = token & 15;
+        if (m == 15 && !_get_len(&s,se,&m))
+            return false;
+        m += _MIN_MATCH;
+        if (!off || off > (size_t)(d - dst) || m > (size_t)(de - d))
+            return false;
+        // the match may overlap what it writes
+        const uint8_t *from = d - off;
+        if (off >= m)
+            memcpy(d,from,m);
+        else
+            for (size_t k = 0; k < m; ++k)
+                d[k] = from[k];
+        d += m;
+    }
+    return d == de;
+}
@@ -0,0 +1,25 @@
+/*
+LZ block compression
+A small byte oriented LZ77 codec for independent blocks, in the layout of
+the LZ4 block format: each sequence is a token (literal count in the high
+nibble, match length - 4 in the low one, 15 meaning more length bytes
+follow), the literals and a 16 bit offset, the last sequence has literals
+only. Matches are found greedily with a hash table of 4 byte prefixes.
+Decoding is a copy loop with no entropy coding, so it is fast enough to
+not matter next to reading the data.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// compress src into dst, returns the compressed size or 0 if it would not
+// fit in cap bytes (so cap < len asks for a smaller result only)
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+// decompress src into exactly out_len bytes of dst, false if src is not a
+// valid block of that size
+bool lz_decompress(const uint8_t *src, size_t len, uint8_t *dst,
+                   size_t out_len);
@@ -2,79 +2,374 @@
 Flame fractal renderer.
 
 <In progress>
-Usage: ./a.out [-r <seed>]
+Usage: ./a.out [options] <flames.json>
+Flames are read and rendered one at a time, - reads them from stdin. The
+file may also be flam3 / Apophysis XML or compiled (see tools/flamec.c).
+Options:
+  -p, --pipeline <n>  tone map and write output on a background thread while
+                      the next flame renders, using n buffer slots (n >= 2
+                      to overlap, 0 for no background thread, the default)
+  -t, --threads <n>   number of render threads (default 1)
+  -T, --time-budget <sec>
+                      render each flame for a fixed wall clock time instead
+                      of its sample count, the sample count is chosen from
+                      the rate measured during a short warm up
+  -a, --adaptive <noise>
+                      stop early once the relative noise estimated from
+                      two half histograms (about 1/sqrt(hits per pixel)) is
+                      at most this for 95% of the image intensity, or keep
+                      going until it is
+  -A, --adaptive-max <mult>
+                      limit adaptive rendering to mult times the sample
+                      count (default 4)
+  -b, --bounds <suggest|apply>
+                      run a short pre-pass to estimate the attractor bounds
+                      from quantiles and report them with the projected
+                      fraction of samples in the frame, apply also renders
+                      with them (aspect ratio is preserved)
+  -s, --settle-pool   start walkers and restart them after bad values from
+                      a shared pool of points already on the attractor
+  -S, --stats <file>  collect render statistics and write a JSON report to
+                      file (- for stdout), one line per flame
+  -k, --stats-shift <k>
+                      sample statistics every 2^k iterations (default 10)
+  -P, --perf          count hardware events (cycles, instructions, cache,
+                      dTLB and branch misses) with perf_event_open for each
+                      phase and render thread, reported on stderr and in
+                      the statistics report
+  -F, --precision <auto|float|double>
+                      iterate every flame in this precision, by default the
+                      flame's "precision" is used and if that is auto (or not
+                      set) double is only used when a pixel is too small for
+                      float steps at the coordinates of the frame
+  -M, --math <exact|precise|fast>
+                      accuracy of sin, cos, atan2, exp, pow... in the
+                      variations: libm (default), error below 1e-6 or error
+                      below 1e-3, see fastmath.h
+  -N, --numa          pin render threads to the NUMA nodes in blocks, each
+                      thread histogram is placed on its node and the
+                      reduce is split between the threads
+  -H, --huge-pages <thp|off|explicit>
+                      backing of the histograms: transparent huge pages
+                      (default), normal pages or explicit huge pages from
+                      the hugetlb pool, see numa.h
+  -G, --poster <n>    render images larger than n x n pixels in tiles of at
+                      most that size, each with the full sample count, so
+                      memory stays bounded for any resolution (see poster.h,
+                      no time budget, adaptive rendering, statistics,
+                      hardware counters or previews)
+  -L, --levels <n>    also write n smaller images, each half the size of
+                      the one before, as <name>-<w>x<h>.pgm and .buf, summed
+                      from the full histogram (see pyramid.h)
+  -V, --preview <sec> while a flame renders, write the image so far to
+                      <name>.preview.pgm every sec seconds, replacing the
+                      file atomically so a viewer never sees it half written
+  -R, --record        record the plotted points to <name>.orbit, which
+                      tools/rebin.c bins into any rectangle and size
+                      without iterating again (see orbit.h)
+  -Z, --sparse        write the histograms as <name>.sbuf instead of .buf,
+                      tiled with empty tiles left out and the others delta
+                      coded and compressed (see sparse.h), read by
+                      tools/histmerge.c and tools/retone.c
+  -I, --image <pgm|pgm16|png|png16>
+                      image format, 16 bit levels keep smooth gradients from
+                      banding and PNG rows are deflated in parallel by as
+                      many threads as render (see image.h, default pgm)
+  -Y, --detect-symmetry
+                      replace xforms that are rotations or reflections about
+                      the origin (as Apophysis adds for symmetry) with the
+                      symmetry group they generate, plotting each point under
+                      all of its elements. the attractor is the same but its
+                      density becomes exactly symmetric (see symmetry.h)
 */
 
 #include <assert.h>
+#include <getopt.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
+#include "bounds.h"
+#include "image.h"
 #include "jrand.h"
+#include "kernel.h"
+#include "loader.h"
+#include "orbit.h"
 #include "parser.h"
+#include "perfctr.h"
+#include "pipeline.h"
+#include "poster.h"
+#include "pyramid.h"
 #include "renderer.h"
+#include "sparse.h"
+#include "stats.h"
+#include "symmetry.h"
+#include "tonemap.h"
 #include "types.h"
 #include "utils.h"
 #include "variations.h"
 
-static inline num_t _scale_linear(uint32_t n)
+// render settings from the command line
+static render_opts_t render_opts;
+
+// bounds estimation pre-pass
+#define BOUNDS_NONE 0
+#define BOUNDS_SUGGEST 1
+#define BOUNDS_APPLY 2
+static int bounds_mode = BOUNDS_NONE;
+
+// tile size for poster rendering, 0 to render every image at once
+static size_t poster_tile = 0;
+
+// number of smaller images written from the histogram pyramid
+static uint32_t pyramid_levels = 0;
+
+// record the plotted points of each flame
+static bool record_orbits = false;
+
+// write sparse .sbuf histograms instead of raw .buf
+static bool sparse_hist = false;
+
+// format of the images written
+static image_format_t image_format = {IMAGE_PNM, 8, 1, 0};
+
+// replace rotation and reflection xforms with the symmetry they generate
+static bool detect_symmetry = false;
+
+// JSON lines statistics report, NULL if not enabled
+static FILE *stats_file = NULL;
+
+// orbit points sampled for the bounds estimate
+#define BOUNDS_SAMPLES (1 << 18)
+
+// fraction of points allowed outside the rectangle on each side of each axis
+#define BOUNDS_QUANTILE 0.001
+
+// padding around the quantile range as a fraction of its size
+#define BOUNDS_MARGIN 0.02
+
+// replace the rotation and reflection xforms of the flame with its symmetry
+static void symmetry_flame(flame_t *flame)
 {
-    return (num_t)n;
+    size_t removed = symmetry_detect(flame);
+    if (removed)
+        fprintf(stderr,"  symmetry: %lu xforms replaced by symmetry %d\n",
+            removed,flame->symmetry);
 }
 
-static inline num_t _scale_log(uint32_t n)
+// estimate bounds for the flame, report them and apply them if enabled
+static void bounds_flame(flame_t *flame, jrand_t *j)
 {
-    return log((num_t)(n+1));
+    bounds_estimate_t est;
+    estimate_bounds(flame,j,BOUNDS_SAMPLES,BOUNDS_QUANTILE,BOUNDS_MARGIN,
+        &est);
+    fprintf(stderr,"  bounds: %lu points, suggest xmin %f xmax %f "
+        "ymin %f ymax %f\n",est.points,est.xmin,est.xmax,est.ymin,est.ymax);
+    fprintf(stderr,"  bounds: projected in frame %f%% now, %f%% suggested\n",
+        100.0*est.hit_rate_old,100.0*est.hit_rate_new);
+    if (bounds_mode == BOUNDS_APPLY)
+    {
+        apply_bounds(flame,&est);
+        fprintf(stderr,"  bounds: applied\n");
+    }
 }
 
-static inline num_t _scale_loglog(uint32_t n)
+// print event counts of a phase, with derived ratios if available, name is
+// the flame name or NULL to indent the line under the render report
+static void report_perf(const char *name, const char *phase,
+                        const perf_counts_t *pc)
 {
-    return log(_scale_log(n)+1.0);
+    if (name)
+        fprintf(stderr,"%s: perf %s:",name,phase);
+    else
+        fprintf(stderr,"  perf %s:",phase);
+    if (!pc->valid)
+    {
+        fprintf(stderr," no counters available\n");
+        return;
+    }
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+        if (pc->valid & (1u << i))
+            fprintf(stderr," %s %lu",PERF_EVENT_NAMES[i],pc->count[i]);
+    if ((pc->valid & 3) == 3 && pc->count[0])
+        fprintf(stderr," (%f IPC)",pc->count[1]/(double)pc->count[0]);
+    fprintf(stderr,"\n");
 }
 
-static inline num_t _scale_logpow(uint32_t n, num_t p)
+// report the per thread phases and their total
+static void report_perf_threads(const char *phase, const perf_counts_t *pc,
+                                uint32_t threads)
 {
-    return pow(_scale_log(n),p);
+    perf_counts_t total;
+    memset(&total,0,sizeof(total));
+    char name[32];
+    for (uint32_t i = 0; i < threads; ++i)
+    {
+        if (threads > 1)
+        {
+            snprintf(name,sizeof(name),"%s[%u]",phase,i);
+            report_perf(NULL,name,pc+i);
+        }
+        perf_add(&total,pc+i);
+    }
+    report_perf(NULL,phase,&total);
 }
 
-static inline num_t _scale_pow(uint32_t n, num_t p)
+// given a flame, write the histogram (buf) and render information (res)
+void render_flame(flame_t *flame, uint32_t *buf, render_result_t *res)
 {
-    return pow(_scale_linear(n),p);
+    fprintf(stderr,"rendering flame: %s\n",flame->name);
+    jrand_t j;
+    jrand_init(&j);
+    double b_start = wall_time();
+    if (bounds_mode != BOUNDS_NONE)
+        bounds_flame(flame,&j);
+    double b_secs = wall_time() - b_start;
+    if (record_orbits)
+    {
+        char *fname = malloc(strlen(flame->name)+7);
+        assert(fname);
+        sprintf(fname,"%s.orbit",flame->name);
+        render_opts.record = orbit_create(fname,flame);
+        assert(render_opts.record);
+        free(fname);
+    }
+    if (flame->symmetry)
+        fprintf(stderr,"  symmetry %d, %u samples per iteration\n",
+            flame->symmetry,symmetry_order(flame->symmetry));
+    fprintf(stderr,"  starting...\n");
+    // with NUMA placement the reduce overwrites it, untouched pages are
+    // then placed by the threads that reduce them
+    if (!render_opts.numa || render_opts.threads < 2)
+        memset(buf,0,flame->size_x*flame->size_y*sizeof(*buf));
+    render_threads(flame,buf,&j,&render_opts,res);
+    res->time_prepass += b_secs;
+    if (render_opts.record)
+    {
+        orbit_close(render_opts.record);
+        render_opts.record = NULL;
+    }
+    fprintf(stderr,"  done (%f sec, %s precision, %s math)\n",res->seconds,
+        precision_name(res->precision),math_name(res->math));
+    fprintf(stderr,"  %f samples/sec\n",res->samples/res->seconds);
+    fprintf(stderr,"  settle: %lu starts, %lu iterations",
+        res->settles,res->settle_iters);
+    if (render_opts.settle_pool)
+        fprintf(stderr," (%ld saved by the pool)",res->settle_saved);
+    fprintf(stderr,"\n");
+    fprintf(stderr,"  bad values: %lu\n",res->bad_values);
+    if (res->bad_values)
+        fprintf(stderr,"  IFS may not be contractive on average\n");
+    if (res->stats_shift >= 0)
+    {
+        render_stats_t *st = &res->stats;
+        fprintf(stderr,"  sampled xform distribution");
+        for (uint32_t i = 0; i < flame->xforms_len; ++i)
+            fprintf(stderr," %lu",st->xfdist[i]);
+        fprintf(stderr,"\n");
+        fprintf(stderr,"  sampled x extremes %f %f\n",st->xmin,st->xmax);
+        fprintf(stderr,"  sampled y extremes %f %f\n",st->ymin,st->ymax);
+    }
+    if (render_opts.time_budget > 0.0)
+    {
+        fprintf(stderr,"  time budget %f sec, planned %lu samples, "
+            "did %lu\n",render_opts.time_budget,res->planned,res->samples);
+        fprintf(stderr,"  density %f samples/pixel\n",
+            res->samples / (double)(flame->size_x*flame->size_y));
+    }
+    if (render_opts.adaptive_target > 0.0)
+    {
+        fprintf(stderr,"  adaptive: noise %f (target %f) %s\n",res->noise,
+            render_opts.adaptive_target,
+            res->converged ? "converged" : "did not converge");
+        fprintf(stderr,"  adaptive: %lu samples of budget %lu, saved %f%%\n",
+            res->samples,flame->samples,
+            100.0*((double)flame->samples - res->samples) / flame->samples);
+    }
+    if (render_opts.perf)
+    {
+        report_perf_threads("settle",res->perf_settle,res->threads);
+        report_perf_threads("iterate",res->perf_iterate,res->threads);
+        report_perf(NULL,"reduce",&res->perf_reduce);
+    }
+    // record what the histogram actually contains
+    flame->samples = res->samples;
 }
 
-static inline num_t _scale_arctan(uint32_t n, num_t d)
+// render a flame larger than a tile as a poster and write its output
+static void poster_flame(flame_t *flame)
 {
-    return atan((num_t)(n)/d);
+    fprintf(stderr,"rendering flame: %s\n",flame->name);
+    jrand_t j;
+    jrand_init(&j);
+    if (bounds_mode != BOUNDS_NONE)
+        bounds_flame(flame,&j);
+    render_poster(flame,&j,&render_opts,poster_tile,&image_format);
+    destroy_flame(flame);
+    free(flame);
 }
 
-static inline num_t _scaleinv_recippow(uint32_t n, num_t p)
+// given a w x h histogram (buf), write the grayscale image (img, top down)
+// unless it is NULL and return the scaled maximum it is normalized with
+static num_t tonemap_image(const uint32_t *buf, size_t w, size_t h,
+                           uint8_t *img)
 {
-    return 1.0/pow((num_t)(n+1),p);
+    uint32_t max_sample = 0;
+    for (uint64_t i = 0; i < w*h; ++i)
+        if (buf[i] > max_sample)
+            max_sample = buf[i];
+    num_t log_max = SCALE(max_sample);
+    if (!img)
+        return log_max;
+    uint8_t lut[TONEMAP_LUT_LEN];
+    tonemap_lut(lut,log_max);
+    for (size_t r = h; r--;)
+        tonemap_row(lut,buf+r*w,w,log_max,img+(h-1-r)*w);
+    return log_max;
 }
 
-static inline num_t _scaleinv_reciplog(uint32_t n)
+// the 8 bit image of the histogram if the image format has 8 bit levels,
+// 16 bit levels are tone mapped as the image is written
+static uint8_t *image_8bit(uint8_t *img)
 {
-    return 1.0/_scale_log(n);
+    return image_format.bits == 8 ? img : NULL;
 }
 
-#define SCALE(n) _scale_log(n)
+// write a live preview of a flame being rendered to <name>.preview.pgm,
+// through a temporary file renamed over the last preview
+static void preview_flame(const flame_t *flame, const uint32_t *hist,
+                          double seconds, void *arg)
+{
+    size_t w = flame->size_x, h = flame->size_y;
+    uint8_t *img = malloc(w*h);
+    assert(img);
+    tonemap_image(hist,w,h,img);
+    size_t name_len = strlen(flame->name);
+    char *fname = malloc(name_len+17);
+    char *tmp_name = malloc(name_len+21);
+    assert(fname && tmp_name);
+    sprintf(fname,"%s.preview.pgm",flame->name);
+    sprintf(tmp_name,"%s.tmp",fname);
+    // always 8 bit PGM, which is quick to write
+    image_format_t pgm = {IMAGE_PNM, 8, 1, 0};
+    image_writer_t *im = image_open(tmp_name,&pgm,w,h,1);
+    assert(im);
+    image_write_rows(im,img,h);
+    bool ok = image_close(im);
+    assert(ok);
+    int ret = rename(tmp_name,fname);
+    assert(!ret);
+    fprintf(stderr,"  preview at %f sec\n",seconds);
+    free(tmp_name);
+    free(fname);
+    free(img);
+}
 
-// given a flame, write the histogram (buf) and grayscale image (img)
-void render_flame(flame_t *flame, uint32_t *buf, uint8_t *img)
+// given a flame histogram (buf), write the grayscale image (img) if it has
+// 8 bit levels and return the scaled maximum
+num_t tonemap_flame(flame_t *flame, uint32_t *buf, uint8_t *img)
 {
-    fprintf(stderr,"rendering flame: %s\n",flame->name);
-    jrand_t j;
-    jrand_init(&j);
-    fprintf(stderr,"  starting...\n");
-    memset(buf,0,flame->size_x*flame->size_y*sizeof(*buf));
-    clock_t r_start = clock();
-    render_basic(flame,buf,&j);
-    clock_t r_end = clock();
-    float r_secs = (r_end-r_start)/(float)CLOCKS_PER_SEC;
-    fprintf(stderr,"  done (%f sec)\n",r_secs);
-    fprintf(stderr,"  %f samples/sec\n",flame->samples/r_secs);
     uint64_t sample_count = 0;
     uint32_t max_sample = 0;
     for (uint64_t i = 0; i < flame->size_x*flame->size_y; ++i)
@@ -84,78 +379,329 @@ void render_flame(flame_t *flame, uint32_t *buf, uint8_t *img)
             max_sample = buf[i];
     }
     float percent = ((float) sample_count / (float) flame->samples) * 100.0;
-    fprintf(stderr,"  samples in rectangle: %lu (%f%%)\n",sample_count,percent);
-    fprintf(stderr,"  max sample value = %u\n",max_sample);
-    num_t log_max = 0.0;
-    for (uint64_t i = 0; i < flame->size_x*flame->size_y; ++i)
+    fprintf(stderr,"%s: samples in rectangle: %lu (%f%%)\n",
+        flame->name,sample_count,percent);
+    fprintf(stderr,"%s: max sample value = %u\n",flame->name,max_sample);
+    num_t log_max = tonemap_image(buf,flame->size_x,flame->size_y,
+        image_8bit(img));
+    fprintf(stderr,"%s: log max for scaling = %f\n",flame->name,log_max);
+    return log_max;
+}
+
+// write the w x h image and histogram (buf) to <base>.pgm (or the extension
+// of the image format) and .buf (or .sbuf). the image is img with 8 bit
+// levels, 16 bit levels are tone mapped from buf with scale_max
+static void write_files(const char *base, const uint8_t *img,
+                        const uint32_t *buf, size_t w, size_t h,
+                        num_t scale_max)
+{
+    size_t name_len = strlen(base);
+    char *fname = malloc(name_len+6);
+    memcpy(fname,base,name_len);
+    strcpy(fname+name_len,image_extension(&image_format,1));
+    image_writer_t *im = image_open(fname,&image_format,w,h,1);
+    assert(im);
+    if (img)
+        image_write_rows(im,img,h);
+    else
     {
-        num_t log_val = SCALE(buf[i]);
-        if (log_val > log_max)
-            log_max = log_val;
-    }
-    fprintf(stderr,"  log max for scaling = %f\n",log_max);
-    uint8_t *img_ptr = img;
-    for (size_t r = flame->size_y; r--;)
-        for (size_t c = 0; c < flame->size_x; ++c)
+        uint16_t lut[TONEMAP_LUT_LEN];
+        tonemap_lut16(lut,scale_max);
+        uint16_t *row = malloc(w*sizeof(*row));
+        assert(row);
+        for (size_t r = h; r--;)
         {
-            num_t log_scale = SCALE(buf[r*flame->size_x+c]);
-            *(img_ptr++) = (uint8_t)(log_scale*255.5/log_max);
+            tonemap_row16(lut,buf+r*w,w,scale_max,row);
+            image_write_rows(im,row,1);
         }
-    fprintf(stderr,"  wrote image buffer\n");
+        free(row);
+    }
+    bool ok = image_close(im);
+    assert(ok);
+    fprintf(stderr,"wrote %s\n",fname);
+    if (sparse_hist)
+    {
+        memcpy(fname+name_len,".sbuf\0",6);
+        double t_start = wall_time();
+        size_t bytes = sparse_write(fname,buf,w,h,true,
+            render_opts.threads);
+        assert(bytes);
+        fprintf(stderr,"wrote %s: %lu bytes, %.2f%% of raw in %f s\n",
+            fname,bytes,100.0*bytes/(w*h*sizeof(*buf)),
+            wall_time()-t_start);
+        free(fname);
+        return;
+    }
+    memcpy(fname+name_len,".buf\0",5);
+    FILE *out_file = fopen(fname,"wb");
+    assert(out_file);
+    fwrite(buf,sizeof(*buf),w*h,out_file);
+    fclose(out_file);
+    fprintf(stderr,"wrote %s\n",fname);
+    free(fname);
+}
+
+// sum the smaller levels from the flame histogram (buf) and write each,
+// the image buffer (img) is reused for them
+static void write_levels(const flame_t *flame, const uint32_t *buf,
+                         uint8_t *img)
+{
+    uint32_t *levels = malloc(pyramid_len(flame->size_x,flame->size_y,
+        pyramid_levels)*sizeof(*levels));
+    assert(levels);
+    pyramid_build(buf,flame->size_x,flame->size_y,pyramid_levels,levels);
+    char *base = malloc(strlen(flame->name)+48);
+    assert(base);
+    uint32_t *level = levels;
+    for (uint32_t l = 1; l <= pyramid_levels; ++l)
+    {
+        size_t w, h;
+        pyramid_size(flame->size_x,flame->size_y,l,&w,&h);
+        num_t log_max = tonemap_image(level,w,h,image_8bit(img));
+        sprintf(base,"%s-%lux%lu",flame->name,w,h);
+        write_files(base,image_8bit(img),level,w,h,log_max);
+        level += w*h;
+    }
+    free(base);
+    free(levels);
+}
+
+// output stage, tone map and write the .pgm image and .buf histogram
+static void write_flame(pipeline_slot_t *slot)
+{
+    flame_t *flame = slot->flame;
+    perf_ctr_t pc;
+    double t_start = wall_time();
+    if (render_opts.perf)
+        perf_begin(&pc);
+    num_t log_max = tonemap_flame(flame,slot->buf,slot->img);
+    if (render_opts.perf)
+    {
+        perf_end(&pc,&slot->result.perf_tonemap);
+        perf_begin(&pc);
+    }
+    double w_start = wall_time();
+    slot->result.time_tonemap = w_start - t_start;
+    write_files(flame->name,image_8bit(slot->img),slot->buf,flame->size_x,
+        flame->size_y,log_max);
+    if (pyramid_levels)
+        write_levels(flame,slot->buf,slot->img);
+    slot->result.time_write = wall_time() - w_start;
+    if (render_opts.perf)
+    {
+        perf_end(&pc,&slot->result.perf_write);
+        report_perf(flame->name,"tonemap",&slot->result.perf_tonemap);
+        report_perf(flame->name,"write",&slot->result.perf_write);
+    }
+    if (stats_file)
+        stats_write_json(stats_file,flame,&slot->result);
+    render_result_destroy(&slot->result);
+    // flames come from the loader one at a time and end here
+    destroy_flame(flame);
+    free(flame);
 }
 
+static const struct option _long_opts[] =
+{
+    {"pipeline", required_argument, NULL, 'p'},
+    {"threads", required_argument, NULL, 't'},
+    {"time-budget", required_argument, NULL, 'T'},
+    {"adaptive", required_argument, NULL, 'a'},
+    {"adaptive-max", required_argument, NULL, 'A'},
+    {"bounds", required_argument, NULL, 'b'},
+    {"settle-pool", no_argument, NULL, 's'},
+    {"stats", required_argument, NULL, 'S'},
+    {"stats-shift", required_argument, NULL, 'k'},
+    {"perf", no_argument, NULL, 'P'},
+    {"precision", required_argument, NULL, 'F'},
+    {"math", required_argument, NULL, 'M'},
+    {"numa", no_argument, NULL, 'N'},
+    {"huge-pages", required_argument, NULL, 'H'},
+    {"poster", required_argument, NULL, 'G'},
+    {"levels", required_argument, NULL, 'L'},
+    {"preview", required_argument, NULL, 'V'},
+    {"record", no_argument, NULL, 'R'},
+    {"sparse", no_argument, NULL, 'Z'},
+    {"image", required_argument, NULL, 'I'},
+    {"detect-symmetry", no_argument, NULL, 'Y'},
+    {NULL, 0, NULL, 0}
+};
+
 int main(int argc, char **argv)
 {
-    assert(argc > 1);
-    char *filedata = read_text_file(argv[1]);
-    assert(filedata);
-    json_value jsondata = json_load(filedata);
-    assert(jsondata);
-    free(filedata);
-    flame_list flames = flames_from_json(jsondata);
-    json_destroy(jsondata);
-    assert(flames);
-    // buffer
-    size_t size_x_max = 0;
-    size_t size_y_max = 0;
-    flame_list flame_ptr = flames;
-    while (flame_ptr) // find max size for buffer
-    {
-        if (flame_ptr->value.size_x > size_x_max)
-            size_x_max = flame_ptr->value.size_x;
-        if (flame_ptr->value.size_y > size_y_max)
-            size_y_max = flame_ptr->value.size_y;
-        flame_ptr = flame_ptr->next;
-    }
-    uint32_t *buf = malloc(size_x_max*size_y_max*sizeof(*buf));
-    uint8_t *img = malloc(size_x_max*size_y_max*sizeof(*img));
-    // render flames
-    flame_ptr = flames;
-    while (flame_ptr)
-    {
-        flame_t *flame = &flame_ptr->value;
-        render_flame(flame,buf,img);
-        size_t name_len = strlen(flame->name);
-        char *fname = malloc(name_len+5);
-        memcpy(fname,flame->name,name_len);
-        memcpy(fname+name_len,".pgm\0",5);
-        FILE *out_file = fopen(fname,"wb");
-        assert(out_file);
-        fprintf(out_file,"P5\n%lu %lu\n255\n",flame->size_x,flame->size_y);
-        fwrite(img,sizeof(*img),flame->size_x*flame->size_y,out_file);
-        fclose(out_file);
-        fprintf(stderr,"wrote %s\n",fname);
-        memcpy(fname+name_len,".buf\0",5);
-        out_file = fopen(fname,"wb");
-        assert(out_file);
-        fwrite(buf,sizeof(*buf),flame->size_x*flame->size_y,out_file);
-        fclose(out_file);
-        fprintf(stderr,"wrote %s\n",fname);
-        free(fname);
-        flame_ptr = flame_ptr->next;
+    size_t pipeline_depth = 0;
+    int opt;
+    while ((opt = getopt_long(argc,argv,"p:t:T:a:A:b:sS:k:PF:M:NH:G:L:V:RZI:Y",
+        _long_opts,NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            pipeline_depth = strtoul(optarg,NULL,10);
+            break;
+        case 't':
+            render_opts.threads = strtoul(optarg,NULL,10);
+            break;
+        case 'T':
+            render_opts.time_budget = atof(optarg);
+            assert(render_opts.time_budget > 0.0);
+            break;
+        case 'a':
+            render_opts.adaptive_target = atof(optarg);
+            assert(render_opts.adaptive_target > 0.0);
+            break;
+        case 'A':
+            render_opts.adaptive_max = atof(optarg);
+            assert(render_opts.adaptive_max > 0.0);
+            break;
+        case 's':
+            render_opts.settle_pool = true;
+            break;
+        case 'S':
+            render_opts.stats = true;
+            stats_file = strcmp(optarg,"-") ? fopen(optarg,"w") : stdout;
+            assert(stats_file);
+            break;
+        case 'k':
+            render_opts.stats_shift = strtoul(optarg,NULL,10);
+            assert(0 < render_opts.stats_shift
+                && render_opts.stats_shift < 32);
+            break;
+        case 'P':
+            render_opts.perf = true;
+            break;
+        case 'F':
+            if (!precision_from_name(optarg,&render_opts.precision))
+            {
+                fprintf(stderr,"unknown precision: %s\n",optarg);
+                return 1;
+            }
+            break;
+        case 'M':
+            if (!math_from_name(optarg,&render_opts.math))
+            {
+                fprintf(stderr,"unknown math tier: %s\n",optarg);
+                return 1;
+            }
+            break;
+        case 'N':
+            render_opts.numa = true;
+            break;
+        case 'H':
+            if (!hugepages_from_name(optarg,&render_opts.hugepages))
+            {
+                fprintf(stderr,"unknown huge page mode: %s\n",optarg);
+                return 1;
+            }
+            break;
+        case 'G':
+            poster_tile = strtoul(optarg,NULL,10);
+            assert(poster_tile > 0);
+            break;
+        case 'L':
+            pyramid_levels = strtoul(optarg,NULL,10);
+            assert(pyramid_levels < 32);
+            break;
+        case 'V':
+            render_opts.preview_interval = atof(optarg);
+            assert(render_opts.preview_interval > 0.0);
+            render_opts.preview = &preview_flame;
+            break;
+        case 'R':
+            record_orbits = true;
+            break;
+        case 'Z':
+            sparse_hist = true;
+            break;
+        case 'I':
+            if (!image_format_from_name(optarg,&image_format))
+            {
+                fprintf(stderr,"unknown image format: %s\n",optarg);
+                return 1;
+            }
+            break;
+        case 'Y':
+            detect_symmetry = true;
+            break;
+        case 'b':
+            if (!strcmp(optarg,"suggest"))
+                bounds_mode = BOUNDS_SUGGEST;
+            else if (!strcmp(optarg,"apply"))
+                bounds_mode = BOUNDS_APPLY;
+            else
+            {
+                fprintf(stderr,"unknown bounds mode: %s\n",optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr,"usage: %s [-p <n>] [-t <n>] [-T <sec>] "
+                "[-a <noise> [-A <mult>]] [-b <suggest|apply>] [-s] "
+                "[-S <file> [-k <shift>]] [-P] [-F <precision>] [-M <tier>] "
+                "[-N] [-H <mode>] [-G <n>] [-L <n>] [-V <sec>] [-R] [-Z] "
+                "[-I <format>] [-Y] <flames.json>\n",argv[0]);
+            return 1;
+        }
     }
-    free(buf);
-    free(img);
-    destroy_flame_list(flames);
+    if (render_opts.time_budget > 0.0 && render_opts.adaptive_target > 0.0)
+    {
+        fprintf(stderr,"a time budget can not be combined with adaptive "
+            "rendering, which has its own stopping rule\n");
+        return 1;
+    }
+    if (poster_tile && (render_opts.time_budget > 0.0
+        || render_opts.adaptive_target > 0.0 || stats_file
+        || render_opts.perf || render_opts.preview_interval > 0.0))
+    {
+        fprintf(stderr,"poster rendering can not be combined with a time "
+            "budget, adaptive rendering, statistics, hardware counters or "
+            "previews\n");
+        return 1;
+    }
+    if (poster_tile && (pyramid_levels || record_orbits || sparse_hist))
+    {
+        fprintf(stderr,"poster rendering does not write smaller levels, "
+            "record orbits or sparse histograms\n");
+        return 1;
+    }
+    // output runs after rendering (or beside it with the pipeline)
+    image_format.threads = render_opts.threads;
+    assert(optind < argc);
+    flame_loader_t *loader = loader_open(argv[optind]);
+    if (!loader)
+    {
+        fprintf(stderr,"can not open %s\n",argv[optind]);
+        return 1;
+    }
+    // render flames as they are read, output is done by the pipeline
+    pipeline_t *pipeline = pipeline_create(pipeline_depth,&write_flame);
+    for (;;)
+    {
+        flame_t *flame = malloc(sizeof(*flame));
+        assert(flame);
+        if (!loader_next(loader,flame))
+        {
+            free(flame);
+            break;
+        }
+        if (detect_symmetry)
+            symmetry_flame(flame);
+        if (poster_tile
+            && flame->size_x*flame->size_y > poster_tile*poster_tile)
+        {
+            poster_flame(flame);
+            continue;
+        }
+        pipeline_slot_t *slot = pipeline_acquire(pipeline,
+            flame->size_x*flame->size_y);
+        slot->flame = flame;
+        render_flame(flame,slot->buf,&slot->result);
+        pipeline_submit(pipeline,slot);
+    }
+    pipeline_destroy(pipeline);
+    assert(loader_count(loader));
+    loader_close(loader);
+    if (stats_file && stats_file != stdout)
+        fclose(stats_file);
     return 0;
 }
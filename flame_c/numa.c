@@ -0,0 +1,184 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "numa.h"
+
+#define _NODE_DIR "/sys/devices/system/node"
+#define _MAX_NODES 64
+#define _HUGE_PAGE (1ul << 21)
+
+static const char *const _HUGEPAGES_NAMES[] = {"thp","off","explicit"};
+
+// CPUs of each node the process may use, nodes without any are left out
+static struct
+{
+    pthread_once_t once;
+    uint32_t len;
+    cpu_set_t cpus[_MAX_NODES];
+}
+_topology = {PTHREAD_ONCE_INIT, 0, {}};
+
+// wrapper for fprintf(stderr,..)
+static void _write_error(const char *f, ...)
+{
+    va_list args;
+    va_start(args,f);
+    vfprintf(stderr,f,args);
+    va_end(args);
+}
+
+// read a cpulist file ("0-3,8,10-11") into set, false if it can not be read
+static bool _read_cpulist(const char *fname, cpu_set_t *set)
+{
+    FILE *f = fopen(fname,"r");
+    if (!f)
+        return false;
+    CPU_ZERO(set);
+    unsigned a, b;
+    int n;
+    while ((n = fscanf(f,"%u-%u",&a,&b)) >= 1)
+    {
+        if (n == 1)
+            b = a;
+        for (unsigned c = a; c <= b && c < CPU_SETSIZE; ++c)
+            CPU_SET(c,set);
+        if (fgetc(f) != ',')
+            break;
+    }
+    fclose(f);
+    return true;
+}
+
+static void _read_topology()
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0,sizeof(allowed),&allowed))
+    {
+        CPU_ZERO(&allowed);
+        for (long c = 0; c < sysconf(_SC_NPROCESSORS_ONLN); ++c)
+            CPU_SET(c,&allowed);
+    }
+    DIR *dir = opendir(_NODE_DIR);
+    struct dirent *e;
+    while (dir && (e = readdir(dir)) && _topology.len < _MAX_NODES)
+    {
+        unsigned node;
+        char rest;
+        if (sscanf(e->d_name,"node%u%c",&node,&rest) != 1)
+            continue;
+        char fname[sizeof(_NODE_DIR) + 64];
+        snprintf(fname,sizeof(fname),_NODE_DIR "/node%u/cpulist",node);
+        cpu_set_t *set = _topology.cpus+_topology.len;
+        if (!_read_cpulist(fname,set))
+            continue;
+        CPU_AND(set,set,&allowed);
+        if (CPU_COUNT(set))
+            ++_topology.len;
+    }
+    if (dir)
+        closedir(dir);
+    if (!_topology.len)
+    {
+        _topology.cpus[0] = allowed;
+        _topology.len = 1;
+    }
+}
+
+uint32_t numa_nodes()
+{
+    pthread_once(&_topology.once,&_read_topology);
+    return _topology.len;
+}
+
+uint32_t numa_thread_node(uint32_t i, uint32_t threads)
+{
+    return (uint64_t)i*numa_nodes() / threads;
+}
+
+bool numa_pin(uint32_t node)
+{
+    assert(node < numa_nodes());
+    return !pthread_setaffinity_np(pthread_self(),sizeof(cpu_set_t),
+        _topology.cpus+node);
+}
+
+void numa_unpin()
+{
+    cpu_set_t all;
+    CPU_ZERO(&all);
+    for (uint32_t i = 0; i < numa_nodes(); ++i)
+        CPU_OR(&all,&all,_topology.cpus+i);
+    pthread_setaffinity_np(pthread_self(),sizeof(all),&all);
+}
+
+// mapped length, whole huge pages for histograms big enough to use them
+static size_t _map_len(size_t bytes)
+{
+    size_t page = bytes >= _HUGE_PAGE ? _HUGE_PAGE : sysconf(_SC_PAGESIZE);
+    return (bytes + page-1) & ~(page-1);
+}
+
+void *hist_alloc(size_t bytes, hugepages_t mode)
+{
+    size_t len = _map_len(bytes);
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (len < _HUGE_PAGE || mode == HUGEPAGES_OFF)
+    {
+        void *p = mmap(NULL,len,PROT_READ|PROT_WRITE,flags,-1,0);
+        assert(p != MAP_FAILED);
+        return p;
+    }
+    if (mode == HUGEPAGES_EXPLICIT)
+    {
+        void *p = mmap(NULL,len,PROT_READ|PROT_WRITE,flags|MAP_HUGETLB,
+            -1,0);
+        if (p != MAP_FAILED)
+            return p;
+        static bool warned = false;
+        if (!warned)
+            _write_error("no explicit huge pages available, using "
+                "transparent ones\n");
+        warned = true;
+    }
+    // map a huge page more than needed and trim it to huge page alignment
+    char *p = mmap(NULL,len+_HUGE_PAGE,PROT_READ|PROT_WRITE,flags,-1,0);
+    assert(p != MAP_FAILED);
+    size_t head = (_HUGE_PAGE - (uintptr_t)p % _HUGE_PAGE) % _HUGE_PAGE;
+    if (head)
+        munmap(p,head);
+    munmap(p+head+len,_HUGE_PAGE-head);
+    p += head;
+    madvise(p,len,MADV_HUGEPAGE);
+    return p;
+}
+
+void hist_free(void *p, size_t bytes)
+{
+    if (p)
+        munmap(p,_map_len(bytes));
+}
+
+bool hugepages_from_name(const char *name, hugepages_t *mode)
+{
+    for (int i = 0; i < 3; ++i)
+        if (!strcmp(name,_HUGEPAGES_NAMES[i]))
+        {
+            *mode = i;
+            return true;
+        }
+    return false;
+}
+
+const char *hugepages_name(hugepages_t mode)
+{
+    return _HUGEPAGES_NAMES[mode];
+}
@@ -0,0 +1,51 @@
+/*
+NUMA placement and huge pages
+Render threads are spread over the memory nodes of the machine in equal
+blocks and pinned to the CPUs of their node, so the histogram each thread
+allocates and first touches lives on its own node. The node layout comes
+from sysfs, limited to the CPUs the process may run on; without it the
+machine is one node.
+
+Histograms are mapped fresh (zero pages, so nothing is touched before the
+owning thread writes to them) and large ones are backed by huge pages to
+cut TLB misses on the random scatter, either transparent huge pages asked
+for with madvise or explicit ones from the hugetlb pool, falling back to
+transparent ones when the pool is empty.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+    HUGEPAGES_THP, // madvise(MADV_HUGEPAGE), the default
+    HUGEPAGES_OFF,
+    HUGEPAGES_EXPLICIT // MAP_HUGETLB
+}
+hugepages_t;
+
+// number of memory nodes with CPUs the process may use, at least 1
+uint32_t numa_nodes();
+
+// node for thread i of threads, in equal blocks of consecutive threads
+uint32_t numa_thread_node(uint32_t i, uint32_t threads);
+
+// pin the calling thread to the CPUs of a node, false if that failed
+bool numa_pin(uint32_t node);
+
+// let the calling thread run on the CPUs of every node again
+void numa_unpin();
+
+// zeroed memory for a histogram of the given size in bytes, not touched
+// until written. free with hist_free() and the same size
+void *hist_alloc(size_t bytes, hugepages_t mode);
+
+void hist_free(void *p, size_t bytes);
+
+// parse a huge page mode name (off, thp or explicit), false if unknown
+bool hugepages_from_name(const char *name, hugepages_t *mode);
+
+const char *hugepages_name(hugepages_t mode);
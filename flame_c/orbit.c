@@ -0,0 +1,307 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jrand.h"
+#include "orbit.h"
+#include "utils.h"
+
+// the xform index is the low byte of the values sorted in a chunk
+#define _XF_BITS 8
+
+// seed of the positions drawn in the cells, fixed so re-binning repeats
+#define _JITTER_SEED 0x6f72626974
+
+// digit size of the radix sort, 4 passes for the default ORBIT_BITS
+#define _RADIX_BITS 12
+#define _RADIX_PASSES 5
+
+// before the data of each chunk
+typedef struct
+{
+    uint32_t count; // points in the chunk
+    uint32_t bytes; // of data after this
+}
+_chunk_t;
+
+struct orbit_writer
+{
+    FILE *f;
+    pthread_mutex_t lock; // for the file and the counts
+    orbit_header_t h;
+    double qx_mul, qy_mul; // from the window to cells
+    uint64_t written, dropped, bytes;
+};
+
+struct orbit_reader
+{
+    const char *data;
+    size_t len;
+    orbit_header_t h;
+};
+
+// wrapper for fprintf(stderr,..)
+static void _write_error(const char *f, ...)
+{
+    va_list args;
+    va_start(args,f);
+    vfprintf(stderr,f,args);
+    va_end(args);
+}
+
+orbit_writer_t *orbit_create(const char *fname, const flame_t *flame)
+{
+    FILE *f = fopen(fname,"wb");
+    if (!f)
+        return NULL;
+    orbit_writer_t *o = calloc(1,sizeof(*o));
+    assert(o);
+    o->f = f;
+    pthread_mutex_init(&o->lock,NULL);
+    orbit_header_t *h = &o->h;
+    memcpy(h->magic,ORBIT_MAGIC,sizeof(h->magic));
+    h->version = ORBIT_VERSION;
+    h->bits = ORBIT_BITS;
+    h->xforms_len = flame->xforms_len <= 256 ? flame->xforms_len : 0;
+    num_t w = flame->xmax - flame->xmin, hh = flame->ymax - flame->ymin;
+    h->xmin = flame->xmin - ORBIT_MARGIN*w;
+    h->xmax = flame->xmax + ORBIT_MARGIN*w;
+    h->ymin = flame->ymin - ORBIT_MARGIN*hh;
+    h->ymax = flame->ymax + ORBIT_MARGIN*hh;
+    h->frame = (orbit_frame_t){flame->xmin,flame->xmax,flame->ymin,
+        flame->ymax,flame->size_x,flame->size_y};
+    o->qx_mul = (1ull << h->bits) / (h->xmax - h->xmin);
+    o->qy_mul = (1ull << h->bits) / (h->ymax - h->ymin);
+    size_t n = fwrite(h,sizeof(*h),1,f);
+    assert(n == 1);
+    o->bytes = sizeof(*h);
+    return o;
+}
+
+// sort values by bits [lo,hi) with tmp of the same size, returns a or tmp,
+// whichever holds the result. the digits are all counted in one pass
+static uint64_t *_radix_sort(uint64_t *a, uint64_t *tmp, size_t n,
+                             unsigned lo, unsigned hi)
+{
+    const uint64_t mask = (1u << _RADIX_BITS) - 1;
+    unsigned passes = (hi - lo + _RADIX_BITS-1) / _RADIX_BITS;
+    assert(passes <= _RADIX_PASSES);
+    static __thread uint32_t count[_RADIX_PASSES][1 << _RADIX_BITS];
+    memset(count,0,sizeof(count));
+    for (size_t i = 0; i < n; ++i)
+        for (unsigned p = 0; p < passes; ++p)
+            ++count[p][(a[i] >> (lo + p*_RADIX_BITS)) & mask];
+    for (unsigned p = 0; p < passes; ++p)
+    {
+        uint32_t sum = 0;
+        for (size_t d = 0; d <= mask; ++d)
+        {
+            uint32_t c = count[p][d];
+            count[p][d] = sum;
+            sum += c;
+        }
+        unsigned s = lo + p*_RADIX_BITS;
+        for (size_t i = 0; i < n; ++i)
+            tmp[count[p][(a[i] >> s) & mask]++] = a[i];
+        uint64_t *t = a;
+        a = tmp;
+        tmp = t;
+    }
+    return a;
+}
+
+static inline size_t _put_varint(uint8_t *p, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80)
+    {
+        p[n++] = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+// encode and append one chunk of at most ORBIT_CHUNK points
+static void _write_chunk(orbit_writer_t *o, const point_t *pts,
+                         const uint8_t *xf, size_t len, void *scratch)
+{
+    const orbit_header_t *h = &o->h;
+    const uint64_t cells = 1ull << h->bits;
+    uint64_t *v = scratch;
+    uint8_t *buf = (uint8_t*)(v + 2*ORBIT_CHUNK);
+    size_t n = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        point_t p = pts[i];
+        if (!(p.x >= h->xmin && p.x < h->xmax
+            && p.y >= h->ymin && p.y < h->ymax))
+            continue;
+        uint64_t qx = (p.x - h->xmin) * o->qx_mul;
+        uint64_t qy = (p.y - h->ymin) * o->qy_mul;
+        qx = qx < cells ? qx : cells-1;
+        qy = qy < cells ? qy : cells-1;
+        v[n++] = ((qy << h->bits | qx) << _XF_BITS) | (xf ? xf[i] : 0);
+    }
+    uint64_t *s = _radix_sort(v,v+ORBIT_CHUNK,n,_XF_BITS,_XF_BITS + 2*h->bits);
+    size_t bytes = 0;
+    uint64_t prev = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint64_t k = s[i] >> _XF_BITS;
+        bytes += _put_varint(buf+bytes,k - prev);
+        prev = k;
+    }
+    if (h->xforms_len)
+        for (size_t i = 0; i < n; ++i)
+            buf[bytes++] = (uint8_t)s[i];
+    _chunk_t c = {n,bytes};
+    pthread_mutex_lock(&o->lock);
+    if (n)
+    {
+        size_t w = fwrite(&c,sizeof(c),1,o->f);
+        w += fwrite(buf,bytes,1,o->f);
+        assert(w == 2);
+        o->bytes += sizeof(c) + bytes;
+    }
+    o->written += n;
+    o->dropped += len - n;
+    pthread_mutex_unlock(&o->lock);
+}
+
+void orbit_write(orbit_writer_t *o, const point_t *pts, const uint8_t *xf,
+                 size_t len, void *scratch)
+{
+    for (size_t i = 0; i < len; i += ORBIT_CHUNK)
+        _write_chunk(o,pts+i,xf ? xf+i : NULL,
+            len-i < ORBIT_CHUNK ? len-i : ORBIT_CHUNK,scratch);
+}
+
+void orbit_close(orbit_writer_t *o)
+{
+    fclose(o->f);
+    fprintf(stderr,"  orbit: %lu points in %lu bytes (%f bytes/point), "
+        "%lu outside the window dropped\n",o->written,o->bytes,
+        o->written ? (double)o->bytes / o->written : 0.0,o->dropped);
+    pthread_mutex_destroy(&o->lock);
+    free(o);
+}
+
+orbit_reader_t *orbit_open(const char *fname)
+{
+    size_t len;
+    const char *data = map_file(fname,&len);
+    if (!data)
+        return NULL;
+    orbit_reader_t *r = malloc(sizeof(*r));
+    assert(r);
+    r->data = data;
+    r->len = len;
+    bool ok = len >= sizeof(r->h);
+    if (ok)
+        memcpy(&r->h,data,sizeof(r->h));
+    ok = ok && !memcmp(r->h.magic,ORBIT_MAGIC,sizeof(r->h.magic))
+        && r->h.version == ORBIT_VERSION && r->h.bits <= 28;
+    if (!ok)
+        _write_error("%s is not an orbit stream\n",fname);
+    assert(ok);
+    return r;
+}
+
+const orbit_header_t *orbit_info(const orbit_reader_t *r)
+{
+    return &r->h;
+}
+
+// the chunk at *pos and its data, moves *pos past it, false at the end
+static bool _next_chunk(const orbit_reader_t *r, size_t *pos, _chunk_t *c,
+                        const uint8_t **data)
+{
+    if (*pos == r->len)
+        return false;
+    assert(*pos + sizeof(*c) <= r->len);
+    memcpy(c,r->data + *pos,sizeof(*c));
+    *pos += sizeof(*c);
+    bool ok = c->bytes <= r->len - *pos
+        && c->bytes >= (r->h.xforms_len ? 2*(size_t)c->count : c->count);
+    if (!ok)
+        _write_error("orbit stream is corrupt at byte %lu\n",*pos);
+    assert(ok);
+    *data = (const uint8_t*)r->data + *pos;
+    *pos += c->bytes;
+    return true;
+}
+
+uint64_t orbit_rebin(orbit_reader_t *r, const orbit_frame_t *frame,
+                     int32_t xform, uint32_t *hist)
+{
+    const orbit_header_t *h = &r->h;
+    assert(xform < 0 || (uint32_t)xform < h->xforms_len);
+    // bin coordinate of u in [0,1) across cell q is a + (q+u)*b. a point
+    // goes to a uniform random position in its cell, at the cell centers
+    // the bins would get alternately floor and ceil of the cells per bin
+    double cw = (h->xmax - h->xmin) / (1ull << h->bits);
+    double ch = (h->ymax - h->ymin) / (1ull << h->bits);
+    double xmul = frame->size_x / (frame->xmax - frame->xmin);
+    double ymul = frame->size_y / (frame->ymax - frame->ymin);
+    double ax = (h->xmin - frame->xmin)*xmul, bx = cw*xmul;
+    double ay = (h->ymin - frame->ymin)*ymul, by = ch*ymul;
+    jrand_t j;
+    jrand_init_seed(&j,_JITTER_SEED);
+    const uint64_t qmask = (1ull << h->bits) - 1;
+    uint64_t added = 0;
+    size_t pos = sizeof(*h);
+    _chunk_t c;
+    const uint8_t *p;
+    while (_next_chunk(r,&pos,&c,&p))
+    {
+        const uint8_t *end = p + c.bytes - (h->xforms_len ? c.count : 0);
+        const uint8_t *xf = end;
+        uint64_t k = 0;
+        for (uint32_t i = 0; i < c.count; ++i)
+        {
+            uint64_t d = 0;
+            for (unsigned s = 0; p < end; s += 7)
+            {
+                uint8_t b = *(p++);
+                d |= (uint64_t)(b & 0x7f) << s;
+                if (!(b & 0x80))
+                    break;
+            }
+            k += d;
+            if (xform >= 0 && xf[i] != xform)
+                continue;
+            double x = ax + ((k & qmask) + jrand_next_float(&j))*bx;
+            double y = ay + ((k >> h->bits) + jrand_next_float(&j))*by;
+            if (!(x >= 0.0 && x < frame->size_x
+                && y >= 0.0 && y < frame->size_y))
+                continue;
+            ++hist[frame->size_x*(uint64_t)y + (uint64_t)x];
+            ++added;
+        }
+        if (p != end)
+            _write_error("orbit stream chunk does not decode to its size\n");
+        assert(p == end);
+    }
+    return added;
+}
+
+uint64_t orbit_count(const orbit_reader_t *r)
+{
+    uint64_t n = 0;
+    size_t pos = sizeof(r->h);
+    _chunk_t c;
+    const uint8_t *p;
+    while (_next_chunk(r,&pos,&c,&p))
+        n += c.count;
+    return n;
+}
+
+void orbit_close_reader(orbit_reader_t *r)
+{
+    unmap_file(r->data,r->len);
+    free(r);
+}
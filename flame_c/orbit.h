@@ -0,0 +1,94 @@
+/*
+Orbit streams
+The plotted points of a render (after the final xform, in frame or not)
+recorded so they can be binned again into another rectangle or size
+without iterating the flame again. Points are quantized to ORBIT_BITS bits
+per axis in a window around the frame the flame was rendered with
+(ORBIT_MARGIN frames on each side, points outside it are dropped) with the
+index of the xform that produced each point, in the order of the rendered
+flame (see optimize_flame()).
+
+The file is a header followed by chunks of up to ORBIT_CHUNK points, each
+encoded by the render thread that recorded it. The order of points does
+not matter for binning, so a chunk is sorted by quantized position and
+stored as varint deltas of the position followed by the xform indices if
+they are recorded, about 4-5 bytes per point instead of 16 for two doubles
+(more for orbits spread thinly over the window). Binning puts each point at
+a random position in its quantization cell, so a re-binned histogram has
+the statistics of the original but detail smaller than a cell (1/2^20 of
+the window, a third of a pixel at 15360 pixels wide) is blurred.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "types.h"
+
+#define ORBIT_MAGIC "FLAMEORB"
+#define ORBIT_VERSION 1
+
+// quantization bits per axis
+#define ORBIT_BITS 20
+
+// size of the quantization window on each side of the frame, in frames
+#define ORBIT_MARGIN 1
+
+// points per chunk
+#define ORBIT_CHUNK (1 << 16)
+
+// bytes of scratch memory orbit_write() needs
+#define ORBIT_SCRATCH_SIZE (ORBIT_CHUNK*(2*sizeof(uint64_t) + 11))
+
+// rectangle and size to bin points into
+typedef struct
+{
+    double xmin, xmax, ymin, ymax;
+    uint64_t size_x, size_y;
+}
+orbit_frame_t;
+
+typedef struct
+{
+    char magic[8]; // ORBIT_MAGIC, without the null
+    uint32_t version;
+    uint32_t bits; // quantization bits per axis
+    uint32_t xforms_len; // xforms of the flame, 0 if indices are not stored
+    uint32_t reserved;
+    double xmin, xmax, ymin, ymax; // quantization window
+    orbit_frame_t frame; // frame the flame was rendered with
+}
+orbit_header_t;
+
+typedef struct orbit_writer orbit_writer_t;
+typedef struct orbit_reader orbit_reader_t;
+
+// create a stream for the plotted points of a flame, xform indices are
+// stored if the flame has at most 256 xforms. NULL if it can not be opened
+orbit_writer_t *orbit_create(const char *fname, const flame_t *flame);
+
+// encode points and their xform indices as chunks and append them, may be
+// called from several threads at once each with its own scratch memory of
+// ORBIT_SCRATCH_SIZE bytes
+void orbit_write(orbit_writer_t *o, const point_t *pts, const uint8_t *xf,
+                 size_t len, void *scratch);
+
+// finish the file, reports the points written and dropped on stderr
+void orbit_close(orbit_writer_t *o);
+
+// map a stream, NULL if it can not be opened, asserts it is one
+orbit_reader_t *orbit_open(const char *fname);
+
+const orbit_header_t *orbit_info(const orbit_reader_t *r);
+
+// add the points of the whole stream that fall in frame to hist (its size),
+// only those of one xform if xform >= 0, returns the number added
+uint64_t orbit_rebin(orbit_reader_t *r, const orbit_frame_t *frame,
+                     int32_t xform, uint32_t *hist);
+
+// points in the stream
+uint64_t orbit_count(const orbit_reader_t *r);
+
+void orbit_close_reader(orbit_reader_t *r);
@@ -4,7 +4,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "kernel.h"
 #include "parser.h"
+#include "symmetry.h"
 #include "types.h"
 #include "variations.h"
 
@@ -63,6 +65,65 @@ static void _set_num_from_index(json_array j, size_t i, num_t *dest)
     *dest = (num_t) tmp->value.as_float;
 }
 
+// fill in an xform from its JSON object
+static void _xform_from_json(json_object jxf, xform_t *xf)
+{
+    _set_num_from_key(jxf,"weight",&xf->weight,1.0);
+    json_value jvarsv = json_object_get(jxf,"variations");
+    assert(jvarsv);
+    assert(jvarsv->type == JSON_ARRAY);
+    json_array jvars = jvarsv->value.as_array;
+    xf->var_len = json_array_len(jvars);
+    assert(xf->var_len);
+    //_write_error("    has %u vars\n",xf->var_len);
+    xf->var_ids = malloc(sizeof(xf->var_ids[0])*xf->var_len);
+    xf->varw = malloc(sizeof(xf->varw[0])*xf->var_len);
+    uint32_t pc_flags = 0;
+    // variations loop
+    for (size_t j = 0; j < xf->var_len; ++j)
+    {
+        //_write_error("      var %u\n",j);
+        json_value jvarv = json_array_get(jvars,j);
+        assert(jvarv->type == JSON_OBJECT);
+        json_object jvar = jvarv->value.as_object;
+        _set_num_from_key(jvar,"weight",xf->varw+j,1.0);
+        // TODO support variation number as well as name
+        // TODO parse variation parameters
+        json_value jnamev = json_object_get(jvar,"name");
+        assert(jnamev);
+        assert(jnamev->type == JSON_STRING);
+        char *varname = jnamev->value.as_str;
+        //_write_error("      name %s\n",varname);
+        int32_t id = variation_id(varname);
+        if (id < 0)
+            _write_error("unknown variation \"%s\"\n",varname);
+        assert(id >= 0);
+        xf->var_ids[j] = id;
+        pc_flags |= VARIATIONS[id].flags;
+    }
+    xf->pc_flags = pc_flags;
+    json_value jafv = json_object_get(jxf,"pre_affine");
+    assert(jafv);
+    assert(jafv->type == JSON_ARRAY);
+    json_array jaf = jafv->value.as_array;
+    _set_num_from_index(jaf,0,&xf->pre_affine.a);
+    _set_num_from_index(jaf,1,&xf->pre_affine.b);
+    _set_num_from_index(jaf,2,&xf->pre_affine.c);
+    _set_num_from_index(jaf,3,&xf->pre_affine.d);
+    _set_num_from_index(jaf,4,&xf->pre_affine.e);
+    _set_num_from_index(jaf,5,&xf->pre_affine.f);
+    jafv = json_object_get(jxf,"post_affine");
+    assert(jafv);
+    assert(jafv->type == JSON_ARRAY);
+    jaf = jafv->value.as_array;
+    _set_num_from_index(jaf,0,&xf->post_affine.a);
+    _set_num_from_index(jaf,1,&xf->post_affine.b);
+    _set_num_from_index(jaf,2,&xf->post_affine.c);
+    _set_num_from_index(jaf,3,&xf->post_affine.d);
+    _set_num_from_index(jaf,4,&xf->post_affine.e);
+    _set_num_from_index(jaf,5,&xf->post_affine.f);
+}
+
 // defaults and some sanity checks
 #define SIZE_X_DEFAULT 512
 #define SIZE_Y_DEFAULT 512
@@ -72,6 +133,7 @@ static void _set_num_from_index(json_array j, size_t i, num_t *dest)
 #define Y_DIM 1.0
 #define DIM_MAX 1e5
 #define DENSITY 100
+#define OVERSAMPLE_MAX 16
 
 void flame_from_json(json_object jflame, flame_t *flame)
 {
@@ -96,6 +158,22 @@ void flame_from_json(json_object jflame, flame_t *flame)
     _set_num_from_key(jflame,"ymax",&flame->ymax,Y_DIM);
     assert(-DIM_MAX < flame->ymax && flame->ymax < DIM_MAX);
     assert(flame->ymin < flame->ymax);
+    uint64_t oversample;
+    _set_u64_from_key(jflame,"oversample",&oversample,1);
+    assert(0 < oversample && oversample <= OVERSAMPLE_MAX);
+    flame->oversample = oversample;
+    _set_num_from_key(jflame,"filter",&flame->filter,0.0);
+    assert(flame->filter >= 0.0);
+    flame->precision = PRECISION_AUTO;
+    tmp = json_object_get(jflame,"precision");
+    if (tmp)
+    {
+        assert(tmp->type == JSON_STRING);
+        bool ok = precision_from_name(tmp->value.as_str,&flame->precision);
+        if (!ok)
+            _write_error("unknown precision \"%s\"\n",tmp->value.as_str);
+        assert(ok);
+    }
     json_value jxfvv = json_object_get(jflame,"xforms");
     assert(jxfvv->type == JSON_ARRAY);
     json_array jxfv = jxfvv->value.as_array;
@@ -111,65 +189,31 @@ void flame_from_json(json_object jflame, flame_t *flame)
         json_value jxfe = json_array_get(jxfv,i);
         assert(jxfe);
         assert(jxfe->type == JSON_OBJECT);
-        json_object jxf = jxfe->value.as_object;
-        xform_t *xf = flame->xforms+i;
-        _set_num_from_key(jxf,"weight",&xf->weight,1.0);
-        json_value jvarsv = json_object_get(jxf,"variations");
-        assert(jvarsv);
-        assert(jvarsv->type == JSON_ARRAY);
-        json_array jvars = jvarsv->value.as_array;
-        xf->var_len = json_array_len(jvars);
-        assert(xf->var_len);
-        //_write_error("    has %u vars\n",xf->var_len);
-        xf->vars = malloc(sizeof(xf->vars[0])*xf->var_len);
-        xf->varw = malloc(sizeof(xf->varw[0])*xf->var_len);
-        uint32_t pc_flags = 0;
-        // variations loop
-        for (size_t j = 0; j < xf->var_len; ++j, jvars = jvars->next)
-        {
-            //_write_error("      var %u\n",j);
-            assert(jvars->value->type == JSON_OBJECT);
-            json_object jvar = jvars->value->value.as_object;
-            _set_num_from_key(jvar,"weight",xf->varw+j,1.0);
-            // TODO support variation number as well as name
-            // TODO parse variation parameters
-            json_value jnamev = json_object_get(jvar,"name");
-            assert(jnamev);
-            assert(jnamev->type == JSON_STRING);
-            char *varname = jnamev->value.as_str;
-            //_write_error("      name %s\n",varname);
-            xf->vars[j] = NULL; // find the variation function
-            for (size_t k = 0; VARIATIONS[k].name; ++k)
-                if (!strcmp(VARIATIONS[k].name,varname))
-                {
-                    xf->vars[j] = VARIATIONS[k].func;
-                    pc_flags |= VARIATIONS[k].flags;
-                    break;
-                }
-            assert(xf->vars[j]);
-        }
-        xf->pc_flags = pc_flags;
-        json_value jafv = json_object_get(jxf,"pre_affine");
-        assert(jafv);
-        assert(jafv->type == JSON_ARRAY);
-        json_array jaf = jafv->value.as_array;
-        _set_num_from_index(jaf,0,&xf->pre_affine.a);
-        _set_num_from_index(jaf,1,&xf->pre_affine.b);
-        _set_num_from_index(jaf,2,&xf->pre_affine.c);
-        _set_num_from_index(jaf,3,&xf->pre_affine.d);
-        _set_num_from_index(jaf,4,&xf->pre_affine.e);
-        _set_num_from_index(jaf,5,&xf->pre_affine.f);
-        jafv = json_object_get(jxf,"post_affine");
-        assert(jafv);
-        assert(jafv->type == JSON_ARRAY);
-        jaf = jafv->value.as_array;
-        _set_num_from_index(jaf,0,&xf->post_affine.a);
-        _set_num_from_index(jaf,1,&xf->post_affine.b);
-        _set_num_from_index(jaf,2,&xf->post_affine.c);
-        _set_num_from_index(jaf,3,&xf->post_affine.d);
-        _set_num_from_index(jaf,4,&xf->post_affine.e);
-        _set_num_from_index(jaf,5,&xf->post_affine.f);
+        _xform_from_json(jxfe->value.as_object,flame->xforms+i);
+    }
+    flame->final_xform = NULL;
+    tmp = json_object_get(jflame,"final_xform");
+    if (tmp)
+    {
+        assert(tmp->type == JSON_OBJECT);
+        flame->final_xform = malloc(sizeof(xform_t));
+        assert(flame->final_xform);
+        _xform_from_json(tmp->value.as_object,flame->final_xform);
     }
+    flame->symmetry = 0;
+    tmp = json_object_get(jflame,"symmetry");
+    if (tmp)
+    {
+        assert(tmp->type == JSON_NUMBER_INT);
+        flame->symmetry = tmp->value.as_int;
+        assert(-SYMMETRY_MAX <= flame->symmetry
+            && flame->symmetry <= SYMMETRY_MAX);
+    }
+    flame->palette = NULL;
+    flame->palette_len = 0;
+    flame->block = NULL;
+    flame->mapped = false;
+    pack_flame(flame);
 }
 
 flame_list flames_from_json(json_value data)
@@ -177,11 +221,10 @@ flame_list flames_from_json(json_value data)
     flame_list head = NULL;
     flame_list tail = NULL;
     assert(data->type == JSON_ARRAY);
-    json_array jptr = data->value.as_array;
-    size_t num_flames = 0;
-    while (jptr) // flame loop
+    json_array jflames = data->value.as_array;
+    size_t num_flames = json_array_len(jflames);
+    for (size_t i = 0; i < num_flames; ++i) // flame loop
     {
-        ++num_flames;
         if (!head)
         {
             head = malloc(sizeof(*head));
@@ -196,28 +239,107 @@ flame_list flames_from_json(json_value data)
             tail = tail->next;
             tail->next = NULL;
         }
-        assert(jptr->value->type == JSON_OBJECT);
-        flame_from_json(jptr->value->value.as_object,&tail->value);
-        jptr = jptr->next;
+        json_value jflame = json_array_get(jflames,i);
+        assert(jflame->type == JSON_OBJECT);
+        flame_from_json(jflame->value.as_object,&tail->value);
     }
     _write_error("parsed %lu flames\n",num_flames);
     return head;
 }
 
+// the parts of the flame before it is packed are allocated separately
+static void _free_parts(flame_t *flame)
+{
+    free(flame->name);
+    for (size_t i = 0; i < flame->xforms_len; ++i)
+    {
+        xform_t xf = flame->xforms[i];
+        free(xf.var_ids);
+        free(xf.varw);
+    }
+    free(flame->xforms);
+    if (flame->final_xform)
+    {
+        free(flame->final_xform->var_ids);
+        free(flame->final_xform->varw);
+        free(flame->final_xform);
+    }
+    free(flame->palette);
+}
+
+// parts of the packed block start at multiples of this
+#define _PACK_ALIGN 16
+#define _PACKED(n) (((n) + _PACK_ALIGN-1) & ~(size_t)(_PACK_ALIGN-1))
+
+// xform i of the flame, the final xform after the others
+static inline xform_t *_xform_at(const flame_t *flame, size_t i)
+{
+    return i < flame->xforms_len ? flame->xforms+i : flame->final_xform;
+}
+
+void pack_flame(flame_t *flame)
+{
+    size_t n = flame->xforms_len + (flame->final_xform != NULL);
+    size_t size = _PACKED(n*sizeof(xform_t));
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint32_t len = _xform_at(flame,i)->var_len;
+        size += _PACKED(len*sizeof(uint32_t)) + _PACKED(len*sizeof(num_t));
+    }
+    size += _PACKED(flame->palette_len*sizeof(rgb_t));
+    size += _PACKED(strlen(flame->name)+1);
+    char *block = malloc(size);
+    assert(block);
+    char *p = block;
+    xform_t *xforms = (xform_t*)p;
+    p += _PACKED(n*sizeof(xform_t));
+    for (size_t i = 0; i < n; ++i)
+    {
+        const xform_t *xf = _xform_at(flame,i);
+        size_t ids = xf->var_len*sizeof(uint32_t);
+        size_t ws = xf->var_len*sizeof(num_t);
+        xforms[i] = *xf;
+        xforms[i].var_ids = xf->var_len ? memcpy(p,xf->var_ids,ids) : NULL;
+        p += _PACKED(ids);
+        xforms[i].varw = xf->var_len ? memcpy(p,xf->varw,ws) : NULL;
+        p += _PACKED(ws);
+    }
+    rgb_t *palette = NULL;
+    if (flame->palette_len)
+        palette = memcpy(p,flame->palette,flame->palette_len*sizeof(rgb_t));
+    p += _PACKED(flame->palette_len*sizeof(rgb_t));
+    char *name = strcpy(p,flame->name);
+    if (flame->block && !flame->mapped)
+        free(flame->block);
+    else if (!flame->block)
+        _free_parts(flame);
+    flame->xforms = xforms;
+    flame->final_xform = n > flame->xforms_len ? xforms+flame->xforms_len
+        : NULL;
+    flame->palette = palette;
+    flame->name = name;
+    flame->block = block;
+    flame->block_size = size;
+    flame->mapped = false;
+}
+
+void destroy_flame(flame_t *flame)
+{
+    if (flame->mapped)
+        return;
+    if (flame->block)
+        free(flame->block);
+    else
+        _free_parts(flame);
+}
+
 void destroy_flame_list(flame_list f)
 {
     while (f)
     {
         flame_list f2 = f;
         f = f->next;
-        free(f2->value.name);
-        for (size_t i = 0; i < f2->value.xforms_len; ++i)
-        {
-            xform_t xf = f2->value.xforms[i];
-            free(xf.vars);
-            free(xf.varw);
-        }
-        free(f2->value.xforms);
+        destroy_flame(&f2->value);
         free(f2);
     }
 }
@@ -16,8 +16,21 @@ struct flame_list
     flame_list next;
 };
 
+// fill in a flame from its JSON object, all memory is newly allocated
+void flame_from_json(json_object jflame, flame_t *flame);
+
 // returns a flame list of entirely newly allocated memory
 flame_list flames_from_json(json_value data);
 
+// move all memory of a flame into one block, the xforms (final last), the
+// variation ids and weights of each in turn, the palette and the name.
+// the flames of the loaders are packed, this is needed again only after
+// changing the layout (see optimize_flame())
+void pack_flame(flame_t *flame);
+
+// deallocate the memory pointed to by a flame, not the flame itself, nothing
+// for a flame mapped from a compiled file
+void destroy_flame(flame_t *flame);
+
 // deallocate all memory pointed to by the flame list structures
 void destroy_flame_list(flame_list f);
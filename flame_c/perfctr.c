@@ -0,0 +1,140 @@
+#include <string.h>
+
+#include "perfctr.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char *const PERF_EVENT_NAMES[PERF_NUM_EVENTS] =
+{
+    "cycles",
+    "instructions",
+    "cache_misses",
+    "dtlb_misses",
+    "branch_misses"
+};
+
+void perf_add(perf_counts_t *acc, const perf_counts_t *src)
+{
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+        acc->count[i] += src->count[i];
+    acc->valid |= src->valid;
+}
+
+#ifdef __linux__
+
+// (type,config) for each event
+static const uint32_t _EVENT_TYPES[PERF_NUM_EVENTS] =
+{
+    PERF_TYPE_HARDWARE,
+    PERF_TYPE_HARDWARE,
+    PERF_TYPE_HARDWARE,
+    PERF_TYPE_HW_CACHE,
+    PERF_TYPE_HARDWARE
+};
+
+static const uint64_t _EVENT_CONFIGS[PERF_NUM_EVENTS] =
+{
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_CACHE_DTLB
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+// counter for the calling thread on any cpu, user space only, in the group
+// of leader (-1 to lead a new one, which starts disabled)
+static int _open_event(uint32_t type, uint64_t config, int leader)
+{
+    struct perf_event_attr attr;
+    memset(&attr,0,sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = leader < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+        | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open,&attr,0,-1,leader,0);
+}
+
+void perf_begin(perf_ctr_t *p)
+{
+    p->leader = -1;
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+    {
+        int leader_fd = p->leader < 0 ? -1 : p->fd[p->leader];
+        p->fd[i] = _open_event(_EVENT_TYPES[i],_EVENT_CONFIGS[i],leader_fd);
+        if (p->fd[i] >= 0 && p->leader < 0)
+            p->leader = i;
+    }
+    if (p->leader < 0)
+        return;
+    int fd = p->fd[p->leader];
+    if (ioctl(fd,PERF_EVENT_IOC_RESET,PERF_IOC_FLAG_GROUP) < 0
+        || ioctl(fd,PERF_EVENT_IOC_ENABLE,PERF_IOC_FLAG_GROUP) < 0)
+    {
+        for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+            if (p->fd[i] >= 0)
+                close(p->fd[i]);
+        p->leader = -1;
+    }
+}
+
+void perf_end(perf_ctr_t *p, perf_counts_t *acc)
+{
+    if (p->leader < 0)
+        return;
+    // nr, time enabled, time running, then the values in the order the
+    // events joined the group
+    uint64_t v[3 + PERF_NUM_EVENTS];
+    int fd = p->fd[p->leader];
+    ioctl(fd,PERF_EVENT_IOC_DISABLE,PERF_IOC_FLAG_GROUP);
+    ssize_t n = read(fd,v,sizeof(v));
+    // the group never ran if running is 0, then nothing was counted
+    if (n >= (ssize_t)(3*sizeof(*v)) && n == (ssize_t)((3 + v[0])*sizeof(*v))
+        && v[2] > 0)
+    {
+        double scale = (double)v[1] / v[2];
+        uint64_t k = 0;
+        for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+        {
+            if (p->fd[i] < 0)
+                continue;
+            if (k < v[0])
+            {
+                acc->count[i] += v[2] < v[1] ? v[3+k]*scale + 0.5 : v[3+k];
+                acc->valid |= 1u << i;
+            }
+            ++k;
+        }
+    }
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+        if (p->fd[i] >= 0)
+            close(p->fd[i]);
+    p->leader = -1;
+}
+
+#else
+
+void perf_begin(perf_ctr_t *p)
+{
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+        p->fd[i] = -1;
+    p->leader = -1;
+}
+
+void perf_end(perf_ctr_t *p, perf_counts_t *acc)
+{
+    (void) p;
+    (void) acc;
+}
+
+#endif
@@ -0,0 +1,45 @@
+/*
+Hardware performance counters
+Uses perf_event_open on Linux to count events for the calling thread over a
+phase of the render. The events are one group led by the first that opens,
+so they are counted over the same time even when the PMU multiplexes them
+with other events, and the counts are scaled up by the time the group was
+enabled over the time it was counting, as perf stat does. Counters that can
+not be opened (no permission, not supported, virtual machines, no room in
+the group) are left out, on other systems none are.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PERF_NUM_EVENTS 5
+
+// event names in the order of perf_counts_t.count
+extern const char *const PERF_EVENT_NAMES[PERF_NUM_EVENTS];
+
+// event counts, bit i of valid is set if count[i] was measured
+typedef struct
+{
+    uint64_t count[PERF_NUM_EVENTS];
+    uint32_t valid;
+}
+perf_counts_t;
+
+// open counters for one phase
+typedef struct
+{
+    int fd[PERF_NUM_EVENTS]; // -1 if the event is not counted
+    int leader; // index of the group leader, -1 if none is open
+}
+perf_ctr_t;
+
+// open the counters for the calling thread and start counting
+void perf_begin(perf_ctr_t *p);
+
+// add the counts since perf_begin() to acc and close the counters
+void perf_end(perf_ctr_t *p, perf_counts_t *acc);
+
+// add the counts of src to acc, an event stays valid if it is in either
+void perf_add(perf_counts_t *acc, const perf_counts_t *src);
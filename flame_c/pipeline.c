@@ -0,0 +1,146 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "numa.h"
+#include "pipeline.h"
+
+struct pipeline_t
+{
+    pipeline_func_t func;
+    size_t depth; // number of slots (at least 1)
+    pipeline_slot_t *slots;
+    pipeline_slot_t **free_slots; // stack of slots available for rendering
+    size_t free_len;
+    pipeline_slot_t **queue; // ring buffer of slots waiting for output
+    size_t queue_head, queue_len;
+    bool threaded;
+    bool done; // no more slots will be submitted
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond_free; // signaled when a slot is returned
+    pthread_cond_t cond_queue; // signaled when a slot is submitted
+};
+
+// make sure the slot buffers can hold size pixels, the histogram is not
+// touched so the render threads place its pages
+static void _slot_reserve(pipeline_slot_t *slot, size_t size)
+{
+    if (slot->cap >= size)
+        return;
+    hist_free(slot->buf,slot->cap*sizeof(*slot->buf));
+    free(slot->img);
+    slot->buf = hist_alloc(size*sizeof(*slot->buf),HUGEPAGES_THP);
+    slot->img = malloc(size*sizeof(*slot->img));
+    assert(slot->img);
+    slot->cap = size;
+}
+
+// output stage thread, runs until the queue is empty and done is set
+static void *_output_thread(void *arg)
+{
+    pipeline_t *p = arg;
+    for (;;)
+    {
+        pthread_mutex_lock(&p->lock);
+        while (!p->queue_len && !p->done)
+            pthread_cond_wait(&p->cond_queue,&p->lock);
+        if (!p->queue_len)
+        {
+            pthread_mutex_unlock(&p->lock);
+            break;
+        }
+        pipeline_slot_t *slot = p->queue[p->queue_head];
+        p->queue_head = (p->queue_head + 1) % p->depth;
+        --p->queue_len;
+        pthread_mutex_unlock(&p->lock);
+        p->func(slot);
+        pthread_mutex_lock(&p->lock);
+        p->free_slots[p->free_len++] = slot;
+        pthread_cond_signal(&p->cond_free);
+        pthread_mutex_unlock(&p->lock);
+    }
+    return NULL;
+}
+
+pipeline_t *pipeline_create(size_t depth, pipeline_func_t func)
+{
+    pipeline_t *p = malloc(sizeof(*p));
+    assert(p);
+    p->func = func;
+    p->threaded = depth > 0;
+    p->depth = p->threaded ? depth : 1;
+    p->slots = calloc(p->depth,sizeof(*p->slots));
+    p->free_slots = malloc(p->depth*sizeof(*p->free_slots));
+    p->queue = malloc(p->depth*sizeof(*p->queue));
+    assert(p->slots);
+    assert(p->free_slots);
+    assert(p->queue);
+    for (size_t i = 0; i < p->depth; ++i)
+        p->free_slots[i] = p->slots+i;
+    p->free_len = p->depth;
+    p->queue_head = 0;
+    p->queue_len = 0;
+    p->done = false;
+    pthread_mutex_init(&p->lock,NULL);
+    pthread_cond_init(&p->cond_free,NULL);
+    pthread_cond_init(&p->cond_queue,NULL);
+    if (p->threaded)
+    {
+        int ret = pthread_create(&p->thread,NULL,&_output_thread,p);
+        assert(!ret);
+    }
+    return p;
+}
+
+pipeline_slot_t *pipeline_acquire(pipeline_t *p, size_t size)
+{
+    pthread_mutex_lock(&p->lock);
+    while (!p->free_len)
+        pthread_cond_wait(&p->cond_free,&p->lock);
+    pipeline_slot_t *slot = p->free_slots[--p->free_len];
+    pthread_mutex_unlock(&p->lock);
+    _slot_reserve(slot,size);
+    return slot;
+}
+
+void pipeline_submit(pipeline_t *p, pipeline_slot_t *slot)
+{
+    if (!p->threaded) // run output stage now and return the slot
+    {
+        p->func(slot);
+        p->free_slots[p->free_len++] = slot;
+        return;
+    }
+    pthread_mutex_lock(&p->lock);
+    assert(p->queue_len < p->depth);
+    p->queue[(p->queue_head + p->queue_len) % p->depth] = slot;
+    ++p->queue_len;
+    pthread_cond_signal(&p->cond_queue);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pipeline_destroy(pipeline_t *p)
+{
+    if (p->threaded)
+    {
+        pthread_mutex_lock(&p->lock);
+        p->done = true;
+        pthread_cond_signal(&p->cond_queue);
+        pthread_mutex_unlock(&p->lock);
+        pthread_join(p->thread,NULL);
+    }
+    for (size_t i = 0; i < p->depth; ++i)
+    {
+        hist_free(p->slots[i].buf,p->slots[i].cap*sizeof(*p->slots[i].buf));
+        free(p->slots[i].img);
+    }
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->cond_free);
+    pthread_cond_destroy(&p->cond_queue);
+    free(p->slots);
+    free(p->free_slots);
+    free(p->queue);
+    free(p);
+}
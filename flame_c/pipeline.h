@@ -0,0 +1,42 @@
+/*
+Output pipeline
+Finished histograms are handed to a background thread which does the tone
+mapping and file writing while the next flame renders. A fixed number of
+buffer slots is shared between the stages so memory use stays bounded.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "renderer.h"
+#include "types.h"
+
+// a set of buffers for one flame moving through the pipeline
+typedef struct
+{
+    flame_t *flame; // flame the buffers belong to
+    render_result_t result; // information from rendering
+    uint32_t *buf; // histogram
+    uint8_t *img; // grayscale image
+    size_t cap; // number of pixels the buffers can hold
+}
+pipeline_slot_t;
+
+// called on the output stage for each submitted slot
+typedef void (*pipeline_func_t)(pipeline_slot_t *slot);
+
+typedef struct pipeline_t pipeline_t;
+
+// depth is the number of buffer slots, 0 runs the output stage synchronously
+pipeline_t *pipeline_create(size_t depth, pipeline_func_t func);
+
+// get a free slot with room for size pixels, blocks until one is available
+pipeline_slot_t *pipeline_acquire(pipeline_t *p, size_t size);
+
+// queue a filled slot for the output stage
+void pipeline_submit(pipeline_t *p, pipeline_slot_t *slot);
+
+// finish all queued work and deallocate
+void pipeline_destroy(pipeline_t *p);
@@ -0,0 +1,182 @@
+#define _FILE_OFFSET_BITS 64
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "numa.h"
+#include "poster.h"
+#include "tonemap.h"
+
+// wrapper for fprintf(stderr,..)
+static void _write_error(const char *f, ...)
+{
+    va_list args;
+    va_start(args,f);
+    vfprintf(stderr,f,args);
+    va_end(args);
+}
+
+// name with an extension, free after use
+static char *_file_name(const char *name, const char *ext)
+{
+    size_t name_len = strlen(name);
+    size_t ext_len = strlen(ext);
+    char *fname = malloc(name_len+ext_len+1);
+    assert(fname);
+    memcpy(fname,name,name_len);
+    memcpy(fname+name_len,ext,ext_len+1);
+    return fname;
+}
+
+// flame for the pixels [x0,x1) x [y0,y1) of the image, sharing the xforms
+static flame_t _tile_flame(const flame_t *flame, size_t x0, size_t x1,
+                           size_t y0, size_t y1)
+{
+    num_t px = (flame->xmax - flame->xmin) / flame->size_x;
+    num_t py = (flame->ymax - flame->ymin) / flame->size_y;
+    flame_t t = *flame;
+    t.size_x = x1 - x0;
+    t.size_y = y1 - y0;
+    t.xmin = flame->xmin + x0*px;
+    t.xmax = flame->xmin + x1*px;
+    t.ymin = flame->ymin + y0*py;
+    t.ymax = flame->ymin + y1*py;
+    return t;
+}
+
+// write the tile histogram rows to their place in the histogram file
+static void _write_tile(FILE *f, const flame_t *flame, const uint32_t *hist,
+                        size_t x0, size_t y0, const flame_t *tile)
+{
+    for (size_t r = 0; r < tile->size_y; ++r)
+    {
+        off_t pos = ((off_t)(y0+r)*flame->size_x + x0) * sizeof(*hist);
+        int e = fseeko(f,pos,SEEK_SET);
+        assert(!e);
+        size_t w = fwrite(hist+r*tile->size_x,sizeof(*hist),tile->size_x,f);
+        assert(w == tile->size_x);
+    }
+}
+
+// tone map the histogram file into the image, rows top down in stripes of
+// at most stripe rows
+static void _write_image(FILE *hf, image_writer_t *img, const flame_t *flame,
+                         const image_format_t *format, num_t scale_max,
+                         size_t stripe)
+{
+    size_t w = flame->size_x;
+    uint32_t *rows = malloc(stripe*w*sizeof(*rows));
+    uint8_t *gray = malloc(stripe*w*format->bits/8);
+    assert(rows && gray);
+    uint8_t lut[TONEMAP_LUT_LEN];
+    uint16_t lut16[TONEMAP_LUT_LEN];
+    if (format->bits == 8)
+        tonemap_lut(lut,scale_max);
+    else
+        tonemap_lut16(lut16,scale_max);
+    for (size_t hi = flame->size_y; hi > 0;)
+    {
+        size_t lo = hi > stripe ? hi - stripe : 0;
+        int e = fseeko(hf,(off_t)lo*w*sizeof(*rows),SEEK_SET);
+        assert(!e);
+        size_t n = fread(rows,sizeof(*rows),(hi-lo)*w,hf);
+        assert(n == (hi-lo)*w);
+        for (size_t r = hi-lo; r--;)
+        {
+            size_t k = hi-lo-1 - r;
+            if (format->bits == 8)
+                tonemap_row(lut,rows+r*w,w,scale_max,gray+k*w);
+            else
+                tonemap_row16(lut16,rows+r*w,w,scale_max,
+                    (uint16_t*)gray+k*w);
+        }
+        image_write_rows(img,gray,hi-lo);
+        hi = lo;
+    }
+    free(rows);
+    free(gray);
+}
+
+void render_poster(flame_t *flame, jrand_t *jrand, const render_opts_t *opts,
+                   size_t tile, const image_format_t *format)
+{
+    assert(tile > 0);
+    assert(opts->time_budget <= 0.0 && opts->adaptive_target <= 0.0);
+    assert(!opts->perf && opts->preview_interval <= 0.0);
+    size_t tiles_x = (flame->size_x + tile-1) / tile;
+    size_t tiles_y = (flame->size_y + tile-1) / tile;
+    size_t tw = flame->size_x < tile ? flame->size_x : tile;
+    size_t th = flame->size_y < tile ? flame->size_y : tile;
+    size_t hist_bytes = tw*th*sizeof(uint32_t);
+    fprintf(stderr,"  poster: %lu x %lu tiles of at most %lu x %lu pixels\n",
+        tiles_x,tiles_y,tw,th);
+
+    char *buf_name = _file_name(flame->name,".buf");
+    FILE *hf = fopen(buf_name,"w+b");
+    if (!hf)
+        _write_error("can not open %s\n",buf_name);
+    assert(hf);
+    uint32_t *hist = hist_alloc(hist_bytes,opts->hugepages);
+    uint64_t samples = 0, sample_count = 0, bad_values = 0;
+    uint32_t max_sample = 0;
+    double seconds = 0.0;
+    for (size_t ty = 0; ty < tiles_y; ++ty)
+        for (size_t tx = 0; tx < tiles_x; ++tx)
+        {
+            size_t x0 = tx*tile, y0 = ty*tile;
+            size_t x1 = x0+tile < flame->size_x ? x0+tile : flame->size_x;
+            size_t y1 = y0+tile < flame->size_y ? y0+tile : flame->size_y;
+            flame_t t = _tile_flame(flame,x0,x1,y0,y1);
+            size_t len = t.size_x*t.size_y;
+            // with NUMA placement the reduce overwrites it
+            if (!opts->numa || opts->threads < 2)
+                memset(hist,0,len*sizeof(*hist));
+            render_result_t res;
+            render_threads(&t,hist,jrand,opts,&res);
+            for (size_t i = 0; i < len; ++i)
+            {
+                sample_count += hist[i];
+                if (hist[i] > max_sample)
+                    max_sample = hist[i];
+            }
+            samples += res.samples;
+            bad_values += res.bad_values;
+            seconds += res.seconds;
+            fprintf(stderr,"  poster: tile %lu,%lu done (%f sec)\n",tx,ty,
+                res.seconds);
+            render_result_destroy(&res);
+            _write_tile(hf,flame,hist,x0,y0,&t);
+        }
+    hist_free(hist,hist_bytes);
+    fprintf(stderr,"  done (%f sec, %lu samples in %lu tiles)\n",seconds,
+        samples,tiles_x*tiles_y);
+    fprintf(stderr,"  %f samples/sec\n",samples/seconds);
+    fprintf(stderr,"  bad values: %lu\n",bad_values);
+    // the tiles cover the rectangle once, so this compares with a render of
+    // the whole image
+    fprintf(stderr,"%s: samples in rectangle: %lu (%f%%)\n",flame->name,
+        sample_count,100.0*sample_count / flame->samples);
+    fprintf(stderr,"%s: max sample value = %u\n",flame->name,max_sample);
+    num_t log_max = SCALE(max_sample);
+    fprintf(stderr,"%s: log max for scaling = %f\n",flame->name,log_max);
+
+    char *img_name = _file_name(flame->name,image_extension(format,1));
+    image_writer_t *img = image_open(img_name,format,flame->size_x,
+        flame->size_y,1);
+    assert(img);
+    // stripes use no more memory than a tile
+    size_t stripe = tw*th / flame->size_x;
+    _write_image(hf,img,flame,format,log_max,stripe ? stripe : 1);
+    bool ok = image_close(img);
+    if (!ok)
+        _write_error("can not write %s\n",img_name);
+    assert(ok);
+    fprintf(stderr,"wrote %s\n",img_name);
+    fclose(hf);
+    fprintf(stderr,"wrote %s\n",buf_name);
+    free(img_name);
+    free(buf_name);
+}
@@ -0,0 +1,31 @@
+/*
+Tiled poster rendering
+Images whose histogram does not fit in memory are rendered in tiles of at
+most tile x tile pixels. Each tile is rendered as a flame of its own, with
+the tile's part of the rectangle as bounds (so points outside it are not
+plotted) and the full sample count, which keeps the density per pixel that
+of a render of the whole image. Memory is bounded by the tile size, at the
+cost of iterating the sample count once per tile.
+
+Tile histograms are written to their place in the .buf file as they are
+done while the maximum over all of them is kept, then a second pass reads
+the .buf file back in stripes of rows and streams the image top down.
+The pass only does I/O and the tone mapping uses the exact maximum of the
+whole image, so both files are what a render of the whole image at once
+would give.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#include "image.h"
+#include "renderer.h"
+#include "types.h"
+
+// render flame in tiles of at most tile x tile pixels and write the
+// <name>.pgm (or the extension of format) image and <name>.buf histogram,
+// with progress on stderr. opts apply to each tile, time budget, adaptive
+// rendering, hardware counters and previews are not supported
+void render_poster(flame_t *flame, jrand_t *jrand, const render_opts_t *opts,
+                   size_t tile, const image_format_t *format);
@@ -0,0 +1,59 @@
+#include "pyramid.h"
+
+void pyramid_size(size_t w, size_t h, uint32_t level, size_t *lw, size_t *lh)
+{
+    for (uint32_t l = 0; l < level; ++l)
+    {
+        w = (w+1) / 2;
+        h = (h+1) / 2;
+    }
+    *lw = w;
+    *lh = h;
+}
+
+size_t pyramid_len(size_t w, size_t h, uint32_t levels)
+{
+    size_t len = 0;
+    for (uint32_t l = 1; l <= levels; ++l)
+    {
+        size_t lw, lh;
+        pyramid_size(w,h,l,&lw,&lh);
+        len += lw*lh;
+    }
+    return len;
+}
+
+void pyramid_reduce(const uint32_t *src, size_t w, size_t h, uint32_t *dst)
+{
+    size_t dw = (w+1) / 2;
+    for (size_t r = 0; r < h; r += 2)
+    {
+        const uint32_t *a = src + r*w;
+        // NULL for the last row of an odd height
+        const uint32_t *b = r+1 < h ? a + w : NULL;
+        uint32_t *d = dst + (r/2)*dw;
+        size_t c = 0;
+        if (b)
+            for (; c+1 < w; c += 2)
+                *(d++) = a[c] + a[c+1] + b[c] + b[c+1];
+        else
+            for (; c+1 < w; c += 2)
+                *(d++) = a[c] + a[c+1];
+        if (c < w)
+            *d = a[c] + (b ? b[c] : 0);
+    }
+}
+
+void pyramid_build(const uint32_t *hist, size_t w, size_t h, uint32_t levels,
+                   uint32_t *dst)
+{
+    const uint32_t *src = hist;
+    for (uint32_t l = 0; l < levels; ++l)
+    {
+        pyramid_reduce(src,w,h,dst);
+        src = dst;
+        w = (w+1) / 2;
+        h = (h+1) / 2;
+        dst += w*h;
+    }
+}
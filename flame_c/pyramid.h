@@ -0,0 +1,30 @@
+/*
+Histogram pyramid
+Smaller images of a flame are derived from its full histogram instead of
+rendered again. A point in bin (x,y) of a histogram falls in bin (x/2,y/2)
+of one with half the size over the same rectangle, so each level is the
+sum of 2x2 blocks of the level before and holds exactly the counts the
+same orbit would have plotted at that size. The reduction reads each bin
+once after the render, which is much cheaper than scattering every point
+into each level in the iteration loop. Levels of an odd size round up, the
+last column or row then sums only one column or row of the level before.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// size of level (0 is the histogram itself) of a w x h histogram
+void pyramid_size(size_t w, size_t h, uint32_t level, size_t *lw, size_t *lh);
+
+// number of bins in levels 1 to levels together
+size_t pyramid_len(size_t w, size_t h, uint32_t levels);
+
+// sum the 2x2 blocks of src (w x h) into dst (the size of the next level)
+void pyramid_reduce(const uint32_t *src, size_t w, size_t h, uint32_t *dst);
+
+// reduce hist into levels 1 to levels one after another, stored in order
+// in dst which has pyramid_len() bins
+void pyramid_build(const uint32_t *hist, size_t w, size_t h, uint32_t levels,
+                   uint32_t *dst);
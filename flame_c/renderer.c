@@ -1,38 +1,19 @@
 #include <assert.h>
+#include <errno.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "jrand.h"
+#include "kernel.h"
+#include "numa.h"
+#include "perfctr.h"
+#include "renderer.h"
 #include "types.h"
-
-// iterations from the start that are not plotted for the IFS to "settle"
-// the papers suggest using 20 for this value
-#define SETTLE_ITERS 50
-
-// write extra stats to stderr
-#define STDERR_RENDER_STATS
-
-// whether to run the post affine transform
-// this may make sense to disable when it is not used
-//#define DISABLE_POST_AFFINE
-
-// maximum number of bad value messages to output
-// only applies if STDERR_RENDER_STATS is enabled
-#define BAD_VALUE_LIMIT 10
-
-// absolute value of numbers to trigger bad value (non contractive system)
-#define BAD_VALUE_THRESHOLD 1e10
-
-// force equal probability selection for all xforms, regardless of input
-//#define FORCE_EQUAL_XFORM_SELECTION
-
-// check for NaN and very large/small values
-// TODO make this faster by checking only for +-inf and NaN
-static inline bool bad_value(num_t n)
-{
-    return (fabs(n) > BAD_VALUE_THRESHOLD) || isnan(n);
-}
+#include "utils.h"
 
 // adjustments that may help increase performance
 void optimize_flame(flame_t *flame)
@@ -50,197 +31,917 @@ void optimize_flame(flame_t *flame)
             --j;
         }
     }
-    // remove variations with weight 0
+    // remove variations with weight 0, in place so a packed flame stays in
+    // its block (see pack_flame())
     for (size_t i = 0; i < flame->xforms_len; ++i)
     {
         xform_t *xf = flame->xforms+i;
-        size_t var_count = 0;
-        for (size_t j = 0; j < xf->var_len; ++j)
-            if (xf->varw[j] != 0.0)
-                ++var_count;
-        // reallocate and store nonzero variations
-        // if var_count == 0, leave memory allocated
-        if (var_count > 0 && var_count < xf->var_len)
+        uint32_t k = 0;
+        for (uint32_t j = 0; j < xf->var_len; ++j)
         {
-            num_t *varw = malloc(var_count*sizeof(*varw));
-            var_func_t *vars = malloc(var_count*sizeof(*vars));
-            assert(varw);
-            assert(vars);
-            size_t k = 0;
-            for (size_t j = 0; j < xf->var_len; ++j)
-            {
-                if (xf->varw[j] == 0.0)
-                    continue;
-                varw[k] = xf->varw[j];
-                vars[k] = xf->vars[j];
-                ++k;
-            }
-            free(xf->vars);
-            free(xf->varw);
-            xf->vars = vars;
-            xf->varw = varw;
+            if (xf->varw[j] == 0.0)
+                continue;
+            xf->varw[k] = xf->varw[j];
+            xf->var_ids[k] = xf->var_ids[j];
+            ++k;
         }
-        xf->var_len = var_count;
+        xf->var_len = k;
     }
 }
 
-// random point in [-s,s]x[-s,s]
-static inline void _biunit_rand(num_t s, jrand_t *j, num_t *x, num_t *y)
+// number of points in a settle pool
+#define SETTLE_POOL_SIZE 256
+
+static void _stats_init(render_stats_t *stats, uint32_t xforms_len)
 {
-    *x = s*(jrand_next_float(j)*2.0 - 1.0);
-    *y = s*(jrand_next_float(j)*2.0 - 1.0);
+    stats->sampled = 0;
+    stats->in_frame = 0;
+    stats->xfdist = calloc(xforms_len,sizeof(*stats->xfdist));
+    assert(stats->xfdist);
+    stats->xmin = INFINITY;
+    stats->xmax = -INFINITY;
+    stats->ymin = INFINITY;
+    stats->ymax = -INFINITY;
+    stats->bad_len = 0;
 }
 
-// (x,y) -> (*xn,*yn)
-static inline void _apply_affine(affine_params *af, num_t *xn, num_t *yn,
-                                num_t x, num_t y)
+// add the stats from src into dest
+static void _stats_merge(render_stats_t *dest, const render_stats_t *src,
+                        uint32_t xforms_len)
 {
-    *xn = af->a*x + af->b*y + af->c;
-    *yn = af->d*x + af->e*y + af->f;
+    dest->sampled += src->sampled;
+    dest->in_frame += src->in_frame;
+    for (uint32_t i = 0; i < xforms_len; ++i)
+        dest->xfdist[i] += src->xfdist[i];
+    dest->xmin = fmin(dest->xmin,src->xmin);
+    dest->xmax = fmax(dest->xmax,src->xmax);
+    dest->ymin = fmin(dest->ymin,src->ymin);
+    dest->ymax = fmax(dest->ymax,src->ymax);
+    for (uint32_t i = 0; i < src->bad_len
+            && dest->bad_len < RENDER_STATS_BAD_MAX; ++i)
+        dest->bad[dest->bad_len++] = src->bad[i];
 }
 
-// transforms the state with a chosen xform
-static inline void _apply_xform_basic(iter_state_t *state, xform_t *xf)
+// stats_shift < 0 to disable stats
+static void _walker_init(walker_t *w, const kernel_t *kernel, flame_t *flame,
+                        settle_pool_t *pool, uint32_t *histogram,
+                        jrand_t *jrand, int32_t stats_shift)
 {
-    // transform point
-    _apply_affine(&(xf->pre_affine),&(state->tx),&(state->ty),
-                    state->x,state->y);
-    state->vx = 0.0;
-    state->vy = 0.0;
-    state->xf = xf;
-    for (uint32_t i = 0; i < xf->var_len; ++i) // sum variations
-        (xf->vars[i])(state,xf->varw[i]);
-    // update point
-#ifndef DISABLE_POST_AFFINE
-    _apply_affine(&(xf->post_affine),&(state->x),&(state->y),
-                    state->vx,state->vy);
-#else
-    state->x = state->vx;
-    state->y = state->vy;
-#endif
+    w->kernel = kernel;
+    w->flame = flame;
+    w->pool = pool;
+    w->histogram = histogram;
+    w->samples = 0;
+    w->bad_value_count = 0;
+    w->settles = 0;
+    w->settle_iters = 0;
+    w->stats_on = stats_shift >= 0;
+    w->stats_mask = w->stats_on ? (1u << stats_shift) - 1 : 0;
+    w->stats_counter = 0;
+    w->stats.xfdist = NULL;
+    if (w->stats_on)
+        _stats_init(&w->stats,flame->xforms_len);
+    w->record = NULL;
+    w->rec = NULL;
+    w->rec_xf = NULL;
+    w->rec_len = 0;
+    w->rec_scratch = NULL;
+    kernel->init(w,jrand);
 }
 
-#ifndef FORCE_EQUAL_XFORM_SELECTION
-// normalize weights to sum to 1 for probability selection algorithm
-static void _normalize_xform_weights(xform_t *xforms, uint32_t len)
+// record the plotted points of an initialized walker to a stream
+static void _walker_record(walker_t *w, orbit_writer_t *record)
 {
-    assert(len > 0);
-    num_t wsum = 0.0;
-    xform_t *xf, *xf2;
-    for (xf = xforms; len--; ++xf)
-        wsum += xf->weight;
-    for (xf2 = xforms; xf2 != xf; ++xf2)
-        xf2->weight /= wsum;
+    w->record = record;
+    w->rec = malloc(ORBIT_CHUNK*sizeof(*w->rec));
+    w->rec_xf = malloc(ORBIT_CHUNK*sizeof(*w->rec_xf));
+    w->rec_scratch = malloc(ORBIT_SCRATCH_SIZE);
+    assert(w->rec && w->rec_xf && w->rec_scratch);
 }
-#endif
 
-// randomly select flame based on cumulative weights
-// TODO support doing this with binary search for better efficiency
-static inline uint32_t _pick_xform(num_t *cw, jrand_t *jrand, uint32_t xflen)
+// write out the points recorded so far
+static void _walker_flush(walker_t *w)
 {
-#ifndef FORCE_EQUAL_XFORM_SELECTION
-    uint32_t ret = 0;
-    num_t rand = jrand_next_float(jrand);
-    while (cw[ret] < rand)
-        ++ret;
-    return ret;
-#else
-    return jrand_next_int_mod(jrand,xflen);
-#endif
+    orbit_write(w->record,w->rec,w->rec_xf,w->rec_len,w->rec_scratch);
+    w->rec_len = 0;
+}
+
+static void _walker_destroy(walker_t *w)
+{
+    if (w->rec)
+    {
+        _walker_flush(w);
+        free(w->rec);
+        free(w->rec_xf);
+        free(w->rec_scratch);
+    }
+    w->kernel->destroy(w);
+    free(w->stats.xfdist);
+}
+
+// when recording, run in pieces that fill the record buffer
+static void _walker_run(walker_t *w, uint64_t samples)
+{
+    if (!w->rec)
+    {
+        w->kernel->run(w,samples);
+        return;
+    }
+    while (samples)
+    {
+        uint64_t n = ORBIT_CHUNK - w->rec_len;
+        n = n < samples ? n : samples;
+        w->kernel->run(w,n);
+        samples -= n;
+        if (w->rec_len == ORBIT_CHUNK)
+            _walker_flush(w);
+    }
 }
 
 // histogram length == flame->size_x * flame->size_y
 // histogram indexed by (flame->size_x * y_pos) + x_pos
-// TODO support final xform
 void render_basic(flame_t *flame, uint32_t *histogram, jrand_t *jrand)
 {
-    uint64_t bad_value_count = 0;
-    num_t xmul = (float) flame->size_x / (flame->xmax - flame->xmin);
-    num_t ymul = (float) flame->size_y / (flame->ymax - flame->ymin);
-    num_t *cw = NULL;
-#ifndef FORCE_EQUAL_XFORM_SELECTION
-    _normalize_xform_weights(flame->xforms,flame->xforms_len);
-    // form cumulative weights array for random xform selection
-    cw = malloc(sizeof(*cw)*flame->xforms_len);
-    assert(cw);
-    num_t s = 0.0;
-    for (uint32_t i = 0; i < flame->xforms_len; ++i)
-    {
-        s += flame->xforms[i].weight;
-        cw[i] = s;
-    }
-    cw[flame->xforms_len-1] = 1.0; // to correct for rounding error
-#endif
-    iter_state_t state;
-    state.rand = *jrand;
-    _biunit_rand(1.0,jrand,&(state.x),&(state.y));
-    for (uint32_t i = 0; i < SETTLE_ITERS; ++i)
-        _apply_xform_basic(&state,
-            flame->xforms+_pick_xform(cw,jrand,flame->xforms_len));
-#ifdef STDERR_RENDER_STATS
-    uint32_t *xfdist = calloc(flame->xforms_len,sizeof(*xfdist));
-    assert(xfdist);
-    num_t xmin=INFINITY,xmax=-INFINITY,ymin=INFINITY,ymax=-INFINITY;
-#endif
-    uint64_t samples = flame->samples;
-    while (samples--)
-    {
-        uint32_t xf_i = _pick_xform(cw,jrand,flame->xforms_len);
-        _apply_xform_basic(&state,flame->xforms+xf_i);
-#ifdef STDERR_RENDER_STATS
-        ++xfdist[xf_i];
-#endif
-        if (bad_value(state.x) || bad_value(state.y))
+    walker_t w;
+    _walker_init(&w,kernel_get(kernel_precision(flame,PRECISION_AUTO),
+        MATH_EXACT),flame,NULL,histogram,jrand,-1);
+    _walker_run(&w,flame->samples);
+    _walker_destroy(&w);
+}
+
+static size_t _orbit_points(const kernel_t *kernel, flame_t *flame,
+                            jrand_t *jrand, point_t *pts, size_t len,
+                            bool plotted)
+{
+    walker_t w;
+    _walker_init(&w,kernel,flame,NULL,NULL,jrand,-1);
+    size_t ret = kernel->orbit(&w,pts,len,plotted);
+    _walker_destroy(&w);
+    return ret;
+}
+
+// fills pts with consecutive points of a settled orbit, bad values restart
+// the orbit and are not stored (nor are bad final values, which are never
+// plotted). returns the number of points stored, which is less than len
+// only if the orbit reached more than len bad values.
+size_t render_orbit_points(flame_t *flame, jrand_t *jrand, point_t *pts,
+                        size_t len, bool plotted)
+{
+    return _orbit_points(kernel_get(kernel_precision(flame,PRECISION_AUTO),
+        MATH_EXACT),flame,jrand,pts,len,plotted);
+}
+
+// samples per walker between checks of the clock in time budget mode
+#define TIME_CHECK_SAMPLES (1 << 16)
+
+// fraction of the time budget used for measuring the sample rate
+#define WARMUP_FRACTION 0.05
+
+// upper limit on the warm up time in seconds
+#define WARMUP_MAX 0.5
+
+// work for one render thread
+typedef struct
+{
+    walker_t *walker;
+    bool ready; // walker is initialized
+    // live previews (see _preview_snapshot()), preview_epoch is NULL without
+    // them. the walker then scatters to one of two delta histograms and at
+    // the first chunk boundary after the preview thread moves *preview_epoch
+    // it switches to the other one, leaving the first in frozen, and
+    // publishes the epoch it saw in epoch (atomic). the preview thread adds
+    // the frozen delta to target, the histogram of the thread
+    const uint32_t *preview_epoch;
+    uint32_t epoch;
+    uint32_t *delta[2];
+    uint32_t *frozen;
+    uint32_t *target;
+    orbit_writer_t *record; // NULL to not record
+    // walker parameters, the thread initializes its own walker on the first
+    // run so the settling is done in parallel. histogram is NULL for the
+    // thread to allocate its own, so the memory is first touched by it
+    const kernel_t *kernel;
+    flame_t *flame;
+    settle_pool_t *pool;
+    uint32_t *histogram;
+    hugepages_t hugepages; // for its own histogram
+    int32_t node; // NUMA node to pin to on every run, -1 to not pin
+    jrand_t jrand;
+    int32_t stats_shift;
+    uint64_t samples; // samples to do if there is no time budget
+    double start, deadline; // wall clock times, deadline 0 for no budget
+    uint64_t planned; // sample count chosen after the warm up
+    bool perf; // count hardware events for the settle and iterate phases
+    perf_counts_t *perf_settle, *perf_iterate;
+}
+render_thread_t;
+
+// with previews, switch delta histograms if the preview thread asked for a
+// new epoch. only the thread itself writes the walker and frozen, the epoch
+// store publishes frozen to the preview thread
+static void _preview_publish(render_thread_t *t)
+{
+    if (!t->preview_epoch)
+        return;
+    uint32_t e = __atomic_load_n(t->preview_epoch,__ATOMIC_ACQUIRE);
+    if (e == t->epoch)
+        return;
+    walker_t *w = t->walker;
+    t->frozen = w->histogram;
+    w->histogram = t->frozen == t->delta[0] ? t->delta[1] : t->delta[0];
+    __atomic_store_n(&t->epoch,e,__ATOMIC_RELEASE);
+}
+
+// run the walker for n samples, then publish for previews
+static void _render_thread_chunk(render_thread_t *t, uint64_t n)
+{
+    _walker_run(t->walker,n);
+    _preview_publish(t);
+}
+
+// render with a fixed sample count or until the deadline
+static void _render_thread_run(render_thread_t *t)
+{
+    walker_t *w = t->walker;
+    if (!t->deadline)
+    {
+        // in chunks only to switch deltas for previews
+        uint64_t n = t->samples;
+        uint64_t chunk = t->preview_epoch ? TIME_CHECK_SAMPLES : n;
+        while (n)
+        {
+            uint64_t k = n < chunk ? n : chunk;
+            _render_thread_chunk(t,k);
+            n -= k;
+        }
+        return;
+    }
+    // measure the sample rate during the warm up then extrapolate it for the
+    // remaining time, the clock is still checked so all threads stop together
+    // the first chunk is not included in the rate since it runs cold
+    double warmup = fmin((t->deadline - t->start)*WARMUP_FRACTION,WARMUP_MAX);
+    _render_thread_chunk(t,TIME_CHECK_SAMPLES);
+    double now = wall_time();
+    double rate_start = now;
+    uint64_t rate_samples = w->samples;
+    while (now < t->start + warmup || now == rate_start)
+    {
+        _render_thread_chunk(t,TIME_CHECK_SAMPLES);
+        now = wall_time();
+    }
+    double rate = (w->samples - rate_samples) / (now - rate_start);
+    t->planned = now < t->deadline
+        ? w->samples + (uint64_t)(rate * (t->deadline - now)) : w->samples;
+    while (w->samples < t->planned && now < t->deadline)
+    {
+        uint64_t n = t->planned - w->samples;
+        _render_thread_chunk(t,n < TIME_CHECK_SAMPLES ? n
+            : TIME_CHECK_SAMPLES);
+        now = wall_time();
+    }
+}
+
+static void *_render_thread(void *arg)
+{
+    render_thread_t *t = arg;
+    perf_ctr_t pc;
+    if (t->node >= 0)
+        numa_pin(t->node);
+    if (!t->ready)
+    {
+        if (t->perf)
+            perf_begin(&pc);
+        size_t bytes = t->flame->size_x*t->flame->size_y*sizeof(uint32_t);
+        uint32_t *h = t->histogram;
+        if (!h)
+            h = hist_alloc(bytes,t->hugepages);
+        if (t->preview_epoch)
+        {
+            t->target = h;
+            t->delta[0] = hist_alloc(bytes,t->hugepages);
+            t->delta[1] = hist_alloc(bytes,t->hugepages);
+            t->frozen = t->delta[1];
+            h = t->delta[0];
+        }
+        _walker_init(t->walker,t->kernel,t->flame,t->pool,h,&t->jrand,
+            t->stats_shift);
+        if (t->record)
+            _walker_record(t->walker,t->record);
+        t->ready = true;
+        if (t->perf)
+            perf_end(&pc,t->perf_settle);
+    }
+    if (t->perf)
+        perf_begin(&pc);
+    _render_thread_run(t);
+    if (t->perf)
+        perf_end(&pc,t->perf_iterate);
+    return NULL;
+}
+
+// start the render threads, the calling thread does the work of the first
+static void _run_threads(render_thread_t *t, pthread_t *tids, uint32_t threads)
+{
+    for (uint32_t i = 1; i < threads; ++i)
+    {
+        int ret = pthread_create(tids+i,NULL,&_render_thread,t+i);
+        assert(!ret);
+    }
+    _render_thread(t);
+    for (uint32_t i = 1; i < threads; ++i)
+        pthread_join(tids[i],NULL);
+}
+
+// live preview thread and what it reads
+typedef struct
+{
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t cond; // signaled when the render is done
+    bool done; // atomic, also read without the lock
+    // held while deltas are added to the thread histograms and while the
+    // renderer uses those between runs (see _preview_hold())
+    pthread_mutex_t fold_lock;
+    uint32_t epoch; // atomic, moved to ask the threads for a snapshot
+    flame_t *flame;
+    render_thread_t *t;
+    uint32_t threads;
+    uint32_t *extra; // also in the snapshot, NULL if none
+    const render_opts_t *opts;
+    double start;
+    uint32_t *snapshot;
+}
+preview_t;
+
+// add a delta histogram to the thread histogram and clear it
+static void _preview_fold(preview_t *p, render_thread_t *t, uint32_t *delta)
+{
+    size_t hist_len = p->flame->size_x*p->flame->size_y;
+    uint32_t *h = t->target;
+    for (size_t k = 0; k < hist_len; ++k)
+        h[k] += delta[k];
+    memset(delta,0,hist_len*sizeof(*delta));
+}
+
+// the samples of every thread up to the same epoch, without stopping them.
+// the threads are asked to switch deltas, the ones they leave are added to
+// their histograms, which only the preview thread and the renderer between
+// runs write, and the histograms are summed. a thread that is not running
+// (before its first run, between adaptive rounds) switches when it runs
+// again. false if the render ended first
+static bool _preview_snapshot(preview_t *p)
+{
+    uint32_t e = p->epoch + 1;
+    __atomic_store_n(&p->epoch,e,__ATOMIC_RELEASE);
+    for (uint32_t i = 0; i < p->threads; ++i)
+        while (__atomic_load_n(&p->t[i].epoch,__ATOMIC_ACQUIRE) != e)
         {
-            ++bad_value_count;
-            if (bad_value_count <= BAD_VALUE_LIMIT)
-            {
-                fprintf(stderr,"renderer_basic(): bad_value (x,y) = (%f,%f)\n",
-                    state.x,state.y);
-                if (bad_value_count == BAD_VALUE_LIMIT)
-                {
-                    fprintf(stderr,"renderer_basic(): not showing more "
-                        "bad value errors\n");
-                    fprintf(stderr,"IFS may not be contractive on average\n");
-                }
-            }
-            _biunit_rand(1.0,jrand,&(state.x),&(state.y));
-            // get the new point to settle before adding to histogram again
-            for (uint32_t i = 0; i < SETTLE_ITERS; ++i)
-                _apply_xform_basic(&state,
-                    flame->xforms+_pick_xform(cw,jrand,flame->xforms_len));
-            // count re-settling against sample count so rendering does not
-            // hang when rendering a system reaching bad values frequently
-            if (samples >= SETTLE_ITERS)
-                samples -= SETTLE_ITERS;
-            else
-                samples = 0;
+            if (__atomic_load_n(&p->done,__ATOMIC_ACQUIRE))
+                return false;
+            struct timespec ts = {0,1000000};
+            nanosleep(&ts,NULL);
+        }
+    size_t hist_len = p->flame->size_x*p->flame->size_y;
+    pthread_mutex_lock(&p->fold_lock);
+    if (p->extra)
+        memcpy(p->snapshot,p->extra,hist_len*sizeof(*p->snapshot));
+    else
+        memset(p->snapshot,0,hist_len*sizeof(*p->snapshot));
+    for (uint32_t i = 0; i < p->threads; ++i)
+    {
+        render_thread_t *t = p->t+i;
+        _preview_fold(p,t,t->frozen);
+        for (size_t k = 0; k < hist_len; ++k)
+            p->snapshot[k] += t->target[k];
+    }
+    pthread_mutex_unlock(&p->fold_lock);
+    return true;
+}
+
+static void *_preview_thread(void *arg)
+{
+    preview_t *p = arg;
+    pthread_mutex_lock(&p->lock);
+    while (!p->done)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME,&ts);
+        double at = ts.tv_sec + ts.tv_nsec*1e-9 + p->opts->preview_interval;
+        ts.tv_sec = (time_t)at;
+        ts.tv_nsec = (long)((at - ts.tv_sec)*1e9);
+        int ret = 0;
+        while (!p->done && ret != ETIMEDOUT)
+            ret = pthread_cond_timedwait(&p->cond,&p->lock,&ts);
+        if (p->done)
+            break;
+        pthread_mutex_unlock(&p->lock);
+        if (_preview_snapshot(p))
+            p->opts->preview(p->flame,p->snapshot,wall_time() - p->start,
+                p->opts->preview_arg);
+        pthread_mutex_lock(&p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+// start the preview thread, before the render threads
+static void _preview_start(preview_t *p, flame_t *flame, render_thread_t *t,
+                           uint32_t threads, const render_opts_t *opts,
+                           double start)
+{
+    pthread_mutex_init(&p->lock,NULL);
+    pthread_cond_init(&p->cond,NULL);
+    pthread_mutex_init(&p->fold_lock,NULL);
+    p->done = false;
+    p->epoch = 0;
+    p->flame = flame;
+    p->t = t;
+    p->threads = threads;
+    p->extra = NULL;
+    p->opts = opts;
+    p->start = start;
+    p->snapshot = malloc(flame->size_x*flame->size_y*sizeof(*p->snapshot));
+    assert(p->snapshot);
+    for (uint32_t i = 0; i < threads; ++i)
+    {
+        t[i].preview_epoch = &p->epoch;
+        t[i].epoch = 0;
+    }
+    int ret = pthread_create(&p->tid,NULL,&_preview_thread,p);
+    assert(!ret);
+}
+
+// with the render threads stopped, keep the preview thread out of the
+// thread histograms and add both deltas of every thread to them, so the
+// renderer can use and change them (p NULL without previews)
+static void _preview_hold(preview_t *p)
+{
+    if (!p)
+        return;
+    pthread_mutex_lock(&p->fold_lock);
+    for (uint32_t i = 0; i < p->threads; ++i)
+        if (p->t[i].ready)
+        {
+            _preview_fold(p,p->t+i,p->t[i].delta[0]);
+            _preview_fold(p,p->t+i,p->t[i].delta[1]);
+        }
+}
+
+static void _preview_release(preview_t *p)
+{
+    if (p)
+        pthread_mutex_unlock(&p->fold_lock);
+}
+
+// the histogram the samples of a thread end up in
+static uint32_t *_thread_histogram(render_thread_t *t)
+{
+    return t->preview_epoch ? t->target : t->walker->histogram;
+}
+
+// change it, with previews only while they are held
+static void _thread_set_histogram(render_thread_t *t, uint32_t *h)
+{
+    if (t->preview_epoch)
+        t->target = h;
+    else
+        t->walker->histogram = h;
+}
+
+// stop the preview thread after the render threads, the walkers then
+// scatter to the thread histograms again with every sample in them
+static void _preview_stop(preview_t *p)
+{
+    pthread_mutex_lock(&p->lock);
+    __atomic_store_n(&p->done,true,__ATOMIC_RELEASE);
+    pthread_cond_signal(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->tid,NULL);
+    _preview_hold(p);
+    _preview_release(p);
+    size_t bytes = p->flame->size_x*p->flame->size_y*sizeof(uint32_t);
+    for (uint32_t i = 0; i < p->threads; ++i)
+    {
+        render_thread_t *t = p->t+i;
+        if (!t->ready)
             continue;
+        t->walker->histogram = t->target;
+        t->preview_epoch = NULL;
+        hist_free(t->delta[0],bytes);
+        hist_free(t->delta[1],bytes);
+    }
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->fold_lock);
+    free(p->snapshot);
+}
+
+// number of rounds the sample budget is divided into for adaptive rendering
+#define ADAPTIVE_ROUNDS 16
+
+// rounds done before the first convergence check
+#define ADAPTIVE_MIN_ROUNDS 2
+
+// default limit on the samples as a multiple of flame->samples
+#define ADAPTIVE_MAX_DEFAULT 4.0
+
+// width and height of the tiles used for the noise estimate
+#define NOISE_TILE 32
+
+// fraction of nonempty tiles that must be within the target
+#define NOISE_PERCENTILE 0.95
+
+// noise of one tile with its weight for the percentile
+typedef struct { double err, weight; } tile_noise_t;
+
+static int _cmp_tile_noise(const void *a, const void *b)
+{
+    double x = ((const tile_noise_t*)a)->err;
+    double y = ((const tile_noise_t*)b)->err;
+    return (x > y) - (x < y);
+}
+
+// estimates noise by comparing two independent half histograms, the sum of
+// hists[i] with group[i] == 0 against those with group[i] == 1, each scaled
+// to the same sample count. each tile gets the relative difference
+// sum(|a-b|)/sum(a+b) which behaves like 1/sqrt(hits per pixel). tiles are
+// weighted by their log scale intensity so faint stray hits count for little.
+// returns the error that NOISE_PERCENTILE of the weight is within.
+static double _noise_estimate(flame_t *flame, uint32_t **hists,
+                        const uint8_t *group, uint64_t *group_samples,
+                        uint32_t len)
+{
+    size_t tiles_x = (flame->size_x + NOISE_TILE - 1) / NOISE_TILE;
+    size_t tiles_y = (flame->size_y + NOISE_TILE - 1) / NOISE_TILE;
+    size_t tiles = tiles_x*tiles_y;
+    tile_noise_t *tn = calloc(tiles,sizeof(*tn));
+    double *tile_sum = calloc(tiles,sizeof(*tile_sum));
+    assert(tn);
+    assert(tile_sum);
+    uint64_t total = group_samples[0] + group_samples[1];
+    double ka = total / (2.0*group_samples[0]);
+    double kb = total / (2.0*group_samples[1]);
+    for (size_t y = 0; y < flame->size_y; ++y)
+        for (size_t x = 0; x < flame->size_x; ++x)
+        {
+            size_t k = flame->size_x*y + x;
+            uint64_t ab[2] = {0,0};
+            for (uint32_t i = 0; i < len; ++i)
+                ab[group[i]] += hists[i][k];
+            if (!ab[0] && !ab[1])
+                continue;
+            double a = ka*ab[0], b = kb*ab[1];
+            size_t t = tiles_x*(y/NOISE_TILE) + x/NOISE_TILE;
+            tn[t].err += fabs(a-b);
+            tile_sum[t] += a+b;
+            tn[t].weight += log1p(a+b);
+        }
+    // compact nonempty tiles and find the weighted percentile
+    size_t n = 0;
+    double weight = 0.0;
+    for (size_t t = 0; t < tiles; ++t)
+        if (tile_sum[t] > 0.0)
+        {
+            tn[n].err = tn[t].err / tile_sum[t];
+            tn[n].weight = tn[t].weight;
+            weight += tn[n++].weight;
+        }
+    double ret = 0.0;
+    qsort(tn,n,sizeof(*tn),&_cmp_tile_noise);
+    double w = 0.0;
+    for (size_t t = 0; t < n; ++t)
+    {
+        ret = tn[t].err;
+        w += tn[t].weight;
+        if (w >= NOISE_PERCENTILE*weight)
+            break;
+    }
+    free(tn);
+    free(tile_sum);
+    return ret;
+}
+
+// render in rounds until the noise estimate reaches the target or the sample
+// limit is reached. with one thread the walker alternates between the output
+// histogram and an extra one so there are two halves to compare, otherwise
+// threads are split into halves by index parity.
+static void _render_adaptive(flame_t *flame, uint32_t *histogram,
+                        render_thread_t *t, pthread_t *tids,
+                        uint32_t threads, const render_opts_t *opts,
+                        preview_t *preview, render_result_t *res)
+{
+    size_t hist_len = flame->size_x*flame->size_y;
+    uint32_t len = threads > 1 ? threads : 2;
+    uint32_t **hists = malloc(len*sizeof(*hists));
+    uint8_t *group = malloc(len);
+    assert(hists);
+    assert(group);
+    for (uint32_t i = 0; i < threads; ++i)
+        group[i] = i % 2;
+    if (threads == 1)
+    {
+        hists[1] = hist_alloc(hist_len*sizeof(*hists[1]),opts->hugepages);
+        group[1] = 1;
+        // previews include the half that is not rendered to
+        if (preview)
+        {
+            _preview_hold(preview);
+            preview->extra = hists[1];
+            _preview_release(preview);
+        }
+    }
+    double max_mult = opts->adaptive_max > 0.0
+        ? opts->adaptive_max : ADAPTIVE_MAX_DEFAULT;
+    uint64_t max_samples = max_mult * flame->samples;
+    uint64_t round = flame->samples / ADAPTIVE_ROUNDS;
+    if (round < threads)
+        round = threads;
+    uint64_t group_samples[2] = {0,0};
+    uint64_t done = 0;
+    res->noise = 1.0;
+    res->converged = false;
+    for (uint32_t r = 0; done < max_samples; ++r)
+    {
+        for (uint32_t i = 0; i < threads; ++i)
+            t[i].samples = round/threads + (i < round % threads);
+        if (threads == 1 && r) // walker is initialized after the first round
+        {
+            _preview_hold(preview);
+            _thread_set_histogram(t,hists[r % 2]);
+            if (preview)
+                preview->extra = hists[(r+1) % 2];
+            _preview_release(preview);
         }
-#ifdef STDERR_RENDER_STATS
-        xmin = fmin(xmin,state.x);
-        xmax = fmax(xmax,state.x);
-        ymin = fmin(ymin,state.y);
-        ymax = fmax(ymax,state.y);
-#endif
-        if (state.x < flame->xmin || state.x >= flame->xmax
-            || state.y < flame->ymin || state.y >= flame->ymax)
+        _run_threads(t,tids,threads);
+        _preview_hold(preview);
+        if (!r)
+            for (uint32_t i = 0; i < threads; ++i)
+                hists[i] = _thread_histogram(t+i);
+        for (uint32_t i = 0; i < threads; ++i)
+            group_samples[threads > 1 ? group[i] : r % 2] += t[i].samples;
+        done += round;
+        if (r+1 >= ADAPTIVE_MIN_ROUNDS)
+            res->noise = _noise_estimate(flame,hists,group,group_samples,
+                len);
+        _preview_release(preview);
+        if (r+1 < ADAPTIVE_MIN_ROUNDS)
             continue;
-        uint32_t x = (state.x - flame->xmin) * xmul;
-        uint32_t y = (state.y - flame->ymin) * ymul;
-        ++histogram[(flame->size_x*y)+x];
-    }
-#ifdef STDERR_RENDER_STATS
-    fprintf(stderr,"  xform distribution");
-    for (uint32_t i = 0; i < flame->xforms_len; ++i)
-        fprintf(stderr," %u",xfdist[i]);
-    fprintf(stderr,"\n");
-    fprintf(stderr,"  x extremes %f %f\n",xmin,xmax);
-    fprintf(stderr,"  y extremes %f %f\n",ymin,ymax);
-    fprintf(stderr,"  bad values: %lu\n",bad_value_count);
-    free(xfdist);
-#endif
-#ifndef FORCE_EQUAL_XFORM_SELECTION
-    free(cw);
-#endif
+        if (res->noise <= opts->adaptive_target)
+        {
+            res->converged = true;
+            break;
+        }
+    }
+    if (threads == 1)
+    {
+        _preview_hold(preview);
+        _thread_set_histogram(t,histogram);
+        for (size_t k = 0; k < hist_len; ++k)
+            histogram[k] += hists[1][k];
+        if (preview)
+            preview->extra = NULL;
+        _preview_release(preview);
+        hist_free(hists[1],hist_len*sizeof(*hists[1]));
+    }
+    free(hists);
+    free(group);
+}
+
+// work for one reduce thread, a range of pixels of every thread histogram
+// summed into the output
+typedef struct
+{
+    uint32_t *out;
+    uint32_t **hists;
+    uint32_t len;
+    bool add; // add to the output, otherwise overwrite it
+    size_t from, to;
+    int32_t node; // NUMA node to pin to, -1 to not pin
+    bool perf;
+    perf_counts_t counts;
+}
+reduce_thread_t;
+
+// pixels summed per pass over the histograms, small enough that the
+// partial sums stay in L1
+#define REDUCE_CHUNK 2048
+
+static void *_reduce_thread(void *arg)
+{
+    reduce_thread_t *r = arg;
+    perf_ctr_t pc;
+    if (r->node >= 0)
+        numa_pin(r->node);
+    if (r->perf)
+        perf_begin(&pc);
+    for (size_t k0 = r->from; k0 < r->to; k0 += REDUCE_CHUNK)
+    {
+        size_t k1 = k0 + REDUCE_CHUNK < r->to ? k0 + REDUCE_CHUNK : r->to;
+        uint32_t *out = r->out;
+        if (!r->add)
+            memcpy(out+k0,r->hists[0]+k0,(k1-k0)*sizeof(*out));
+        for (uint32_t i = !r->add; i < r->len; ++i)
+        {
+            const uint32_t *h = r->hists[i];
+            for (size_t k = k0; k < k1; ++k)
+                out[k] += h[k];
+        }
+    }
+    if (r->perf)
+        perf_end(&pc,&r->counts);
+    return NULL;
+}
+
+// sum len histograms into out (overwriting it unless add) with one thread
+// per range of pixels, each placed as the render thread of the same index
+static void _reduce(uint32_t *out, uint32_t **hists, uint32_t len, bool add,
+                    size_t hist_len, uint32_t threads, bool numa,
+                    bool perf, perf_counts_t *counts)
+{
+    reduce_thread_t *r = calloc(threads,sizeof(*r));
+    pthread_t *tids = malloc(threads*sizeof(*tids));
+    assert(r);
+    assert(tids);
+    // ranges start on cache lines
+    size_t align = 64 / sizeof(*out);
+    for (uint32_t i = 0; i < threads; ++i)
+    {
+        r[i].out = out;
+        r[i].hists = hists;
+        r[i].len = len;
+        r[i].add = add;
+        r[i].from = hist_len*i/threads / align * align;
+        r[i].to = i+1 < threads ? hist_len*(i+1)/threads / align * align
+            : hist_len;
+        r[i].node = numa ? (int32_t)numa_thread_node(i,threads) : -1;
+        r[i].perf = perf;
+    }
+    for (uint32_t i = 1; i < threads; ++i)
+    {
+        int ret = pthread_create(tids+i,NULL,&_reduce_thread,r+i);
+        assert(!ret);
+    }
+    _reduce_thread(r);
+    for (uint32_t i = 1; i < threads; ++i)
+        pthread_join(tids[i],NULL);
+    for (uint32_t i = 0; i < threads; ++i)
+        perf_add(counts,&r[i].counts);
+    free(r);
+    free(tids);
+}
+
+void render_threads(flame_t *flame, uint32_t *histogram, jrand_t *jrand,
+                    const render_opts_t *opts, render_result_t *res)
+{
+    double start = wall_time();
+    uint32_t threads = opts->threads ? opts->threads : 1;
+    int32_t stats_shift = -1;
+    if (opts->stats)
+        stats_shift = opts->stats_shift ? opts->stats_shift
+            : RENDER_STATS_SHIFT_DEFAULT;
+    // adaptive rendering has its own stopping rule
+    assert(!(opts->adaptive_target > 0.0 && opts->time_budget > 0.0));
+    size_t hist_len = flame->size_x*flame->size_y;
+    // with NUMA placement every thread scatters to its own node local
+    // histogram, the output is only written by the reduce
+    bool numa = opts->numa && threads > 1;
+    res->precision = kernel_precision(flame,opts->precision);
+    res->math = opts->math;
+    const kernel_t *kernel = kernel_get(res->precision,opts->math);
+    walker_t *w = malloc(threads*sizeof(*w));
+    // one settled orbit provides the starting points for every walker
+    settle_pool_t pool_data;
+    settle_pool_t *pool = NULL;
+    uint64_t pool_iters = 0;
+    if (opts->settle_pool)
+    {
+        pool_data.pts = malloc(SETTLE_POOL_SIZE*sizeof(*pool_data.pts));
+        assert(pool_data.pts);
+        // the walkers start from points of the orbit, before the final xform
+        pool_data.len = _orbit_points(kernel,flame,jrand,pool_data.pts,
+            SETTLE_POOL_SIZE,false);
+        pool_iters = SETTLE_ITERS + pool_data.len;
+        if (pool_data.len)
+            pool = &pool_data;
+        else
+            free(pool_data.pts);
+    }
+    render_thread_t *t = calloc(threads,sizeof(*t));
+    pthread_t *tids = malloc(threads*sizeof(*tids));
+    assert(w);
+    assert(t);
+    assert(tids);
+    res->threads = threads;
+    res->perf_settle = NULL;
+    res->perf_iterate = NULL;
+    if (opts->perf)
+    {
+        res->perf_settle = calloc(threads,sizeof(*res->perf_settle));
+        res->perf_iterate = calloc(threads,sizeof(*res->perf_iterate));
+        assert(res->perf_settle);
+        assert(res->perf_iterate);
+    }
+    for (uint32_t i = 0; i < threads; ++i)
+    {
+        t[i].walker = w+i;
+        t[i].ready = false;
+        t[i].kernel = kernel;
+        t[i].flame = flame;
+        t[i].pool = pool;
+        // first thread renders directly to the output histogram
+        t[i].histogram = i || numa ? NULL : histogram;
+        t[i].hugepages = opts->hugepages;
+        t[i].record = opts->record;
+        t[i].node = numa ? (int32_t)numa_thread_node(i,threads) : -1;
+        jrand_init_seed(&t[i].jrand,jrand_next_long(jrand));
+        t[i].stats_shift = stats_shift;
+        t[i].samples = flame->samples/threads
+            + (i < flame->samples % threads);
+        t[i].perf = opts->perf;
+        if (opts->perf)
+        {
+            t[i].perf_settle = res->perf_settle+i;
+            t[i].perf_iterate = res->perf_iterate+i;
+        }
+    }
+    double iter_start = wall_time();
+    res->time_prepass = iter_start - start;
+    for (uint32_t i = 0; i < threads; ++i)
+    {
+        t[i].start = iter_start;
+        t[i].deadline = opts->time_budget > 0.0
+            ? start + opts->time_budget : 0.0;
+    }
+    preview_t preview;
+    bool previews = opts->preview_interval > 0.0 && opts->preview;
+    if (previews)
+        _preview_start(&preview,flame,t,threads,opts,start);
+    if (opts->adaptive_target > 0.0)
+        _render_adaptive(flame,histogram,t,tids,threads,opts,
+            previews ? &preview : NULL,res);
+    else
+        _run_threads(t,tids,threads);
+    if (previews)
+        _preview_stop(&preview);
+    double reduce_start = wall_time();
+    res->time_iterate = reduce_start - iter_start;
+    // sum thread histograms into the output
+    memset(&res->perf_reduce,0,sizeof(res->perf_reduce));
+    memset(&res->perf_tonemap,0,sizeof(res->perf_tonemap));
+    memset(&res->perf_write,0,sizeof(res->perf_write));
+    uint32_t **hists = malloc(threads*sizeof(*hists));
+    assert(hists);
+    for (uint32_t i = 0; i < threads; ++i)
+        hists[i] = w[i].histogram;
+    if (threads > 1)
+        _reduce(histogram,hists+!numa,threads-!numa,!numa,hist_len,threads,
+            numa,opts->perf,&res->perf_reduce);
+    for (uint32_t i = !numa; i < threads; ++i)
+        hist_free(hists[i],hist_len*sizeof(*hists[i]));
+    free(hists);
+    if (numa)
+        numa_unpin();
+    res->time_reduce = wall_time() - reduce_start;
+    res->samples = 0;
+    res->planned = 0;
+    res->bad_values = 0;
+    res->settles = 0;
+    res->settle_iters = pool ? pool_iters : 0;
+    for (uint32_t i = 0; i < threads; ++i)
+    {
+        res->settles += w[i].settles;
+        res->settle_iters += w[i].settle_iters;
+        res->samples += w[i].samples;
+        res->planned += t[i].planned;
+        res->bad_values += w[i].bad_value_count;
+    }
+    // without a pool every start costs SETTLE_ITERS
+    res->settle_saved = (int64_t)(res->settles*SETTLE_ITERS)
+        - (int64_t)res->settle_iters;
+    res->stats_shift = stats_shift;
+    res->stats.xfdist = NULL;
+    if (opts->stats)
+    {
+        _stats_init(&res->stats,flame->xforms_len);
+        for (uint32_t i = 0; i < threads; ++i)
+            _stats_merge(&res->stats,&w[i].stats,flame->xforms_len);
+    }
+    for (uint32_t i = 0; i < threads; ++i)
+        _walker_destroy(w+i);
+    free(w);
+    free(t);
+    free(tids);
+    if (pool)
+        free(pool->pts);
+    res->seconds = wall_time() - start;
+}
+
+void render_result_destroy(render_result_t *res)
+{
+    free(res->stats.xfdist);
+    free(res->perf_settle);
+    free(res->perf_iterate);
+    res->stats.xfdist = NULL;
+    res->perf_settle = NULL;
+    res->perf_iterate = NULL;
 }
@@ -4,6 +4,9 @@ Renderer
 
 #pragma once
 
+#include "numa.h"
+#include "orbit.h"
+#include "perfctr.h"
 #include "types.h"
 
 // makes some changes for better performance
@@ -12,3 +15,111 @@ void optimize_flame(flame_t *flame);
 // renders histogram frequency data only
 void render_basic(flame_t *flame, uint32_t *histogram, jrand_t *jrand);
 
+
+// sample len points from the orbit of a settled walker, with plotted set
+// through the final xform as they are plotted, otherwise the points the
+// orbit goes on from
+size_t render_orbit_points(flame_t *flame, jrand_t *jrand, point_t *pts,
+                        size_t len, bool plotted);
+
+// maximum number of bad values kept in the statistics
+#define RENDER_STATS_BAD_MAX 10
+
+// default for render_opts_t.stats_shift
+#define RENDER_STATS_SHIFT_DEFAULT 10
+
+// statistics sampled from 1 in 2^stats_shift iterations, collected per walker
+// and merged when the render is done (bad values are all counted)
+typedef struct
+{
+    uint64_t sampled; // iterations sampled (not counting bad values)
+    uint64_t in_frame; // sampled points inside the flame rectangle
+    uint64_t *xfdist; // sampled count for each xform
+    num_t xmin, xmax, ymin, ymax; // extremes of the sampled points
+    point_t bad[RENDER_STATS_BAD_MAX]; // first few bad values
+    uint32_t bad_len;
+}
+render_stats_t;
+
+// receives live previews (see render_opts_t.preview_interval), hist is the
+// sum of the thread histograms seconds into the render, valid during the call
+typedef void (*render_preview_t)(const flame_t *flame, const uint32_t *hist,
+                                 double seconds, void *arg);
+
+// options for render_threads(), zero initialize for the defaults
+typedef struct
+{
+    uint32_t threads; // number of render threads, 0 is the same as 1
+    double time_budget; // seconds to render for instead of flame->samples
+    // adaptive sampling, render until the estimated noise is at most
+    // adaptive_target or adaptive_max*flame->samples samples are done
+    double adaptive_target; // 0 to disable
+    double adaptive_max; // 0 for the default
+    // start walkers from a pool of points sampled from one settled orbit
+    // instead of settling each start and bad value restart separately
+    bool settle_pool;
+    // collect render_stats_t, with stats off there is no cost in the loop
+    bool stats;
+    uint32_t stats_shift; // 0 for the default
+    // count hardware events with perf_event_open for each phase and thread
+    bool perf;
+    // iteration precision for every flame, auto to use the flame's own
+    precision_t precision;
+    // accuracy of the transcendental functions, exact (libm) by default
+    math_tier_t math;
+    // pin threads to NUMA nodes in blocks, each scatters to a histogram on
+    // its own node and the reduce is split between them. the output
+    // histogram is then overwritten instead of added to, so with more
+    // than one thread it does not need to be cleared
+    bool numa;
+    // backing of the thread histograms, transparent huge pages by default
+    hugepages_t hugepages;
+    // every preview_interval seconds (0 for none) a background thread passes
+    // the sum of the samples of every thread up to a chunk boundary to
+    // preview, without stopping or locking the threads. each thread then
+    // scatters to one of two extra histograms and switches to the other
+    // when the preview thread asks for a snapshot, see _preview_snapshot()
+    double preview_interval;
+    render_preview_t preview;
+    void *preview_arg;
+    // stream to record the plotted points of every thread to (see orbit.h),
+    // NULL to not record
+    orbit_writer_t *record;
+}
+render_opts_t;
+
+// information about a finished render
+typedef struct
+{
+    uint64_t samples; // iterations done, including unplotted ones
+    uint64_t planned; // samples chosen after warm up in time budget mode
+    uint64_t bad_values;
+    uint64_t settles; // walker starts and restarts
+    uint64_t settle_iters; // unplotted iterations for settling (and pool)
+    int64_t settle_saved; // settle iterations saved by the pool
+    precision_t precision; // of the iteration kernel used
+    math_tier_t math;
+    double seconds; // wall clock time
+    // wall clock time per phase, tone mapping and writing are for the caller
+    double time_prepass, time_iterate, time_reduce, time_tonemap, time_write;
+    double noise; // final noise estimate in adaptive mode
+    bool converged; // adaptive mode reached the target
+    int32_t stats_shift; // -1 if stats were not collected
+    render_stats_t stats;
+    // hardware event counts if enabled, the settle and iterate phases have
+    // one entry per thread (NULL if not enabled), tone mapping and writing
+    // are for the caller to fill in
+    uint32_t threads;
+    perf_counts_t *perf_settle, *perf_iterate;
+    perf_counts_t perf_reduce, perf_tonemap, perf_write;
+}
+render_result_t;
+
+// renders histogram frequency data with multiple threads, each thread uses
+// its own histogram and they are summed into histogram at the end by all
+// threads, each taking a range of pixels
+void render_threads(flame_t *flame, uint32_t *histogram, jrand_t *jrand,
+                    const render_opts_t *opts, render_result_t *res);
+
+// deallocate memory held by a result
+void render_result_destroy(render_result_t *res);
@@ -0,0 +1,399 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lzblock.h"
+#include "sparse.h"
+#include "utils.h"
+
+#define _TILE_BINS (SPARSE_TILE*SPARSE_TILE)
+
+// largest encoded tile, every bin a 5 byte varint with a run before it
+#define _TILE_CAP (_TILE_BINS*10 + 16)
+
+// index entry of a tile
+typedef struct
+{
+    uint64_t offset; // from the start of the file
+    uint32_t bytes; // stored, 0 for an empty tile
+    uint32_t raw; // before compression, 0 if not compressed
+}
+_tile_t;
+
+struct sparse_file
+{
+    const char *data;
+    size_t len;
+    sparse_header_t h;
+    const _tile_t *index;
+    size_t tiles_x, tiles_y;
+};
+
+// work for one thread, every threads-th tile from first
+typedef struct
+{
+    uint32_t first, threads;
+    const uint32_t *hist; // encoding
+    uint32_t *out; // decoding
+    size_t w, h, tiles_x, tiles_y;
+    bool compress, add;
+    _tile_t *index; // encoding, with the data of each tile in data
+    uint8_t **data;
+    const sparse_file_t *f; // decoding
+    uint64_t sum;
+    uint32_t max;
+}
+_work_t;
+
+// wrapper for fprintf(stderr,..)
+static void _write_error(const char *f, ...)
+{
+    va_list args;
+    va_start(args,f);
+    vfprintf(stderr,f,args);
+    va_end(args);
+}
+
+static inline size_t _put_varint(uint8_t *p, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80)
+    {
+        p[n++] = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+// read a varint, false if it runs past end
+static inline bool _get_varint(const uint8_t **p, const uint8_t *end,
+                               uint64_t *v)
+{
+    *v = 0;
+    for (unsigned s = 0; *p < end && s < 64; s += 7)
+    {
+        uint8_t b = *((*p)++);
+        *v |= (uint64_t)(b & 0x7f) << s;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// bins of a tile clipped to the histogram, x0 y0 its first bin
+static void _tile_rect(size_t tx, size_t ty, size_t w, size_t h, size_t *x0,
+                       size_t *y0, size_t *tw, size_t *th)
+{
+    *x0 = tx*SPARSE_TILE;
+    *y0 = ty*SPARSE_TILE;
+    *tw = w - *x0 < SPARSE_TILE ? w - *x0 : SPARSE_TILE;
+    *th = h - *y0 < SPARSE_TILE ? h - *y0 : SPARSE_TILE;
+}
+
+static size_t _encode_tile(const uint32_t *v, size_t n, uint8_t *out)
+{
+    size_t b = 0, i = 0;
+    uint32_t prev = 0;
+    while (i < n)
+    {
+        size_t e = i;
+        while (e < n && !v[e])
+            ++e;
+        b += _put_varint(out+b,e-i);
+        i = e;
+        if (i == n)
+            break;
+        while (e < n && v[e])
+            ++e;
+        b += _put_varint(out+b,e-i);
+        for (; i < e; ++i)
+        {
+            int64_t d = (int64_t)v[i] - prev;
+            b += _put_varint(out+b,((uint64_t)d << 1) ^ (uint64_t)(d >> 63));
+            prev = v[i];
+        }
+    }
+    return b;
+}
+
+// decode n bins, false if the data is not a tile of that size
+static bool _decode_tile(const uint8_t *p, size_t len, uint32_t *v, size_t n)
+{
+    const uint8_t *end = p + len;
+    size_t i = 0;
+    uint32_t prev = 0;
+    while (i < n)
+    {
+        uint64_t run;
+        if (!_get_varint(&p,end,&run) || run > n-i)
+            return false;
+        memset(v+i,0,run*sizeof(*v));
+        i += run;
+        if (i == n)
+            break;
+        if (!_get_varint(&p,end,&run) || run > n-i)
+            return false;
+        for (size_t e = i + run; i < e; ++i)
+        {
+            uint64_t z;
+            if (!_get_varint(&p,end,&z))
+                return false;
+            prev += (uint32_t)((z >> 1) ^ -(z & 1));
+            v[i] = prev;
+        }
+    }
+    return p == end;
+}
+
+static void *_encode_thread(void *arg)
+{
+    _work_t *wk = arg;
+    uint32_t *bins = malloc(_TILE_BINS*sizeof(*bins));
+    uint8_t *enc = malloc(_TILE_CAP);
+    uint8_t *lz = malloc(_TILE_CAP);
+    assert(bins && enc && lz);
+    size_t tiles = wk->tiles_x*wk->tiles_y;
+    for (size_t t = wk->first; t < tiles; t += wk->threads)
+    {
+        size_t x0, y0, tw, th;
+        _tile_rect(t % wk->tiles_x,t / wk->tiles_x,wk->w,wk->h,&x0,&y0,
+            &tw,&th);
+        bool empty = true;
+        for (size_t r = 0; r < th; ++r)
+        {
+            const uint32_t *row = wk->hist + (y0+r)*wk->w + x0;
+            memcpy(bins+r*tw,row,tw*sizeof(*bins));
+            for (size_t c = 0; c < tw; ++c)
+            {
+                wk->sum += row[c];
+                wk->max = row[c] > wk->max ? row[c] : wk->max;
+                empty &= !row[c];
+            }
+        }
+        wk->index[t].bytes = 0;
+        wk->index[t].raw = 0;
+        wk->data[t] = NULL;
+        if (empty)
+            continue;
+        size_t b = _encode_tile(bins,tw*th,enc);
+        const uint8_t *stored = enc;
+        size_t z = wk->compress ? lz_compress(enc,b,lz,b-1) : 0;
+        if (z)
+        {
+            wk->index[t].raw = b;
+            stored = lz;
+            b = z;
+        }
+        wk->index[t].bytes = b;
+        wk->data[t] = malloc(b);
+        assert(wk->data[t]);
+        memcpy(wk->data[t],stored,b);
+    }
+    free(bins);
+    free(enc);
+    free(lz);
+    return NULL;
+}
+
+static void *_decode_thread(void *arg)
+{
+    _work_t *wk = arg;
+    const sparse_file_t *f = wk->f;
+    uint32_t *bins = malloc(_TILE_BINS*sizeof(*bins));
+    uint8_t *raw = malloc(_TILE_CAP);
+    assert(bins && raw);
+    size_t tiles = f->tiles_x*f->tiles_y;
+    for (size_t t = wk->first; t < tiles; t += wk->threads)
+    {
+        const _tile_t *e = f->index+t;
+        size_t x0, y0, tw, th;
+        _tile_rect(t % f->tiles_x,t / f->tiles_x,f->h.size_x,f->h.size_y,
+            &x0,&y0,&tw,&th);
+        if (!e->bytes)
+        {
+            if (!wk->add)
+                for (size_t r = 0; r < th; ++r)
+                    memset(wk->out + (y0+r)*f->h.size_x + x0,0,
+                        tw*sizeof(*bins));
+            continue;
+        }
+        const uint8_t *p = (const uint8_t*)f->data + e->offset;
+        size_t len = e->bytes;
+        bool ok = true;
+        if (e->raw)
+        {
+            ok = e->raw <= _TILE_CAP && lz_decompress(p,len,raw,e->raw);
+            p = raw;
+            len = e->raw;
+        }
+        ok = ok && _decode_tile(p,len,bins,tw*th);
+        if (!ok)
+            _write_error("sparse histogram tile %lu is corrupt\n",t);
+        assert(ok);
+        for (size_t r = 0; r < th; ++r)
+        {
+            uint32_t *row = wk->out + (y0+r)*f->h.size_x + x0;
+            if (wk->add)
+                for (size_t c = 0; c < tw; ++c)
+                    row[c] += bins[r*tw+c];
+            else
+                memcpy(row,bins+r*tw,tw*sizeof(*bins));
+        }
+    }
+    free(bins);
+    free(raw);
+    return NULL;
+}
+
+// run func on threads work items, the calling thread takes the first
+static void _run(void *(*func)(void*), _work_t *wk, uint32_t threads)
+{
+    pthread_t *tids = malloc(threads*sizeof(*tids));
+    assert(tids);
+    for (uint32_t i = 1; i < threads; ++i)
+    {
+        int ret = pthread_create(tids+i,NULL,func,wk+i);
+        assert(!ret);
+    }
+    func(wk);
+    for (uint32_t i = 1; i < threads; ++i)
+        pthread_join(tids[i],NULL);
+    free(tids);
+}
+
+size_t sparse_write(const char *fname, const uint32_t *hist, size_t w,
+                    size_t h, bool compress, uint32_t threads)
+{
+    threads = threads ? threads : 1;
+    size_t tiles_x = (w + SPARSE_TILE-1) / SPARSE_TILE;
+    size_t tiles_y = (h + SPARSE_TILE-1) / SPARSE_TILE;
+    size_t tiles = tiles_x*tiles_y;
+    _tile_t *index = malloc(tiles*sizeof(*index));
+    uint8_t **data = malloc(tiles*sizeof(*data));
+    _work_t *wk = calloc(threads,sizeof(*wk));
+    assert(index && data && wk);
+    for (uint32_t i = 0; i < threads; ++i)
+    {
+        wk[i].first = i;
+        wk[i].threads = threads;
+        wk[i].hist = hist;
+        wk[i].w = w;
+        wk[i].h = h;
+        wk[i].tiles_x = tiles_x;
+        wk[i].tiles_y = tiles_y;
+        wk[i].compress = compress;
+        wk[i].index = index;
+        wk[i].data = data;
+    }
+    _run(&_encode_thread,wk,threads);
+
+    sparse_header_t hd;
+    memset(&hd,0,sizeof(hd));
+    memcpy(hd.magic,SPARSE_MAGIC,sizeof(hd.magic));
+    hd.version = SPARSE_VERSION;
+    hd.tile = SPARSE_TILE;
+    hd.size_x = w;
+    hd.size_y = h;
+    for (uint32_t i = 0; i < threads; ++i)
+    {
+        hd.sum += wk[i].sum;
+        hd.max = wk[i].max > hd.max ? wk[i].max : hd.max;
+    }
+    uint64_t offset = sizeof(hd) + tiles*sizeof(*index);
+    for (size_t t = 0; t < tiles; ++t)
+    {
+        index[t].offset = index[t].bytes ? offset : 0;
+        offset += index[t].bytes;
+        hd.tiles += index[t].bytes != 0;
+    }
+    FILE *f = fopen(fname,"wb");
+    size_t ret = 0;
+    if (f)
+    {
+        size_t n = fwrite(&hd,sizeof(hd),1,f);
+        n += fwrite(index,sizeof(*index)*tiles,1,f);
+        for (size_t t = 0; t < tiles; ++t)
+            if (data[t])
+                n += fwrite(data[t],index[t].bytes,1,f);
+        assert(n == 2 + hd.tiles);
+        fclose(f);
+        ret = offset;
+    }
+    for (size_t t = 0; t < tiles; ++t)
+        free(data[t]);
+    free(data);
+    free(index);
+    free(wk);
+    return ret;
+}
+
+bool sparse_is(const char *data, size_t len)
+{
+    return len >= sizeof(sparse_header_t)
+        && !memcmp(data,SPARSE_MAGIC,strlen(SPARSE_MAGIC));
+}
+
+sparse_file_t *sparse_open(const char *fname)
+{
+    size_t len;
+    const char *data = map_file(fname,&len);
+    if (!data)
+        return NULL;
+    sparse_file_t *f = malloc(sizeof(*f));
+    assert(f);
+    f->data = data;
+    f->len = len;
+    bool ok = sparse_is(data,len);
+    if (ok)
+        memcpy(&f->h,data,sizeof(f->h));
+    ok = ok && f->h.version == SPARSE_VERSION && f->h.tile == SPARSE_TILE
+        && f->h.size_x && f->h.size_y;
+    if (ok)
+    {
+        f->tiles_x = (f->h.size_x + SPARSE_TILE-1) / SPARSE_TILE;
+        f->tiles_y = (f->h.size_y + SPARSE_TILE-1) / SPARSE_TILE;
+        size_t tiles = f->tiles_x*f->tiles_y;
+        f->index = (const _tile_t*)(data + sizeof(f->h));
+        ok = tiles <= (len - sizeof(f->h)) / sizeof(*f->index);
+        for (size_t t = 0; ok && t < tiles; ++t)
+            ok = f->index[t].offset <= len
+                && f->index[t].bytes <= len - f->index[t].offset;
+    }
+    if (!ok)
+        _write_error("%s is not a valid sparse histogram\n",fname);
+    assert(ok);
+    return f;
+}
+
+const sparse_header_t *sparse_info(const sparse_file_t *f)
+{
+    return &f->h;
+}
+
+void sparse_read(const sparse_file_t *f, uint32_t *hist, bool add,
+                 uint32_t threads)
+{
+    threads = threads ? threads : 1;
+    _work_t *wk = calloc(threads,sizeof(*wk));
+    assert(wk);
+    for (uint32_t i = 0; i < threads; ++i)
+    {
+        wk[i].first = i;
+        wk[i].threads = threads;
+        wk[i].out = hist;
+        wk[i].add = add;
+        wk[i].f = f;
+    }
+    _run(&_decode_thread,wk,threads);
+    free(wk);
+}
+
+void sparse_close(sparse_file_t *f)
+{
+    unmap_file(f->data,f->len);
+    free(f);
+}
@@ -0,0 +1,62 @@
+/*
+Sparse histogram files
+Histograms stored in tiles of SPARSE_TILE x SPARSE_TILE bins, for flames
+that light up a small part of the frame where most of a raw .buf is zeros.
+Tiles with no counts are left out. The bins of a tile, row by row, are
+coded as alternating runs: a varint count of zeros, then a varint count of
+nonzero bins followed by each as a zigzag varint difference from the
+nonzero bin before it. Tiles can also be compressed with lzblock.h, which
+is kept only where it makes the tile smaller.
+
+An index of the tiles follows the header, so tiles are encoded and decoded
+by several threads at once and each can be read on its own. The header
+also has the sum and maximum of the counts, enough to tone map without a
+pass over the bins.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPARSE_MAGIC "FLAMESPH"
+#define SPARSE_VERSION 1
+
+// width and height of the tiles
+#define SPARSE_TILE 64
+
+typedef struct
+{
+    char magic[8]; // SPARSE_MAGIC, without the null
+    uint32_t version;
+    uint32_t tile; // SPARSE_TILE when written
+    uint64_t size_x, size_y;
+    uint64_t sum; // of all counts
+    uint32_t max; // largest count
+    uint32_t tiles; // tiles stored, the others are empty
+}
+sparse_header_t;
+
+typedef struct sparse_file sparse_file_t;
+
+// write a w x h histogram to fname, compressing tiles if compress, with
+// threads encoding tiles. returns the file size, 0 if it can not be written
+size_t sparse_write(const char *fname, const uint32_t *hist, size_t w,
+                    size_t h, bool compress, uint32_t threads);
+
+// whether data starts like a sparse histogram file (only the magic)
+bool sparse_is(const char *data, size_t len);
+
+// map a sparse histogram file, NULL if it can not be opened, asserts the
+// header and index are valid
+sparse_file_t *sparse_open(const char *fname);
+
+const sparse_header_t *sparse_info(const sparse_file_t *f);
+
+// decode into hist (size_x x size_y of the header) with threads decoding
+// tiles, adding to it if add, otherwise overwriting it
+void sparse_read(const sparse_file_t *f, uint32_t *hist, bool add,
+                 uint32_t threads);
+
+void sparse_close(sparse_file_t *f);
@@ -0,0 +1,133 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "kernel.h"
+#include "renderer.h"
+#include "stats.h"
+#include "types.h"
+
+// JSON has no infinity or NaN so write those as null
+static void _write_num(FILE *f, double n)
+{
+    if (isfinite(n))
+        fprintf(f,"%.9g",n);
+    else
+        fprintf(f,"null");
+}
+
+// flame names are plain so only quotes and backslashes are escaped
+static void _write_str(FILE *f, const char *s)
+{
+    fputc('"',f);
+    for (; *s; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+            fputc('\\',f);
+        fputc(*s,f);
+    }
+    fputc('"',f);
+}
+
+// event counts as an object, null for events that were not counted
+static void _write_perf(FILE *f, const perf_counts_t *pc)
+{
+    fputc('{',f);
+    for (int i = 0; i < PERF_NUM_EVENTS; ++i)
+    {
+        fprintf(f,"%s\"%s\":",i ? "," : "",PERF_EVENT_NAMES[i]);
+        if (pc->valid & (1u << i))
+            fprintf(f,"%lu",pc->count[i]);
+        else
+            fprintf(f,"null");
+    }
+    fputc('}',f);
+}
+
+// per thread event counts as an array
+static void _write_perf_threads(FILE *f, const perf_counts_t *pc,
+                            uint32_t threads)
+{
+    fputc('[',f);
+    for (uint32_t i = 0; i < threads; ++i)
+    {
+        if (i)
+            fputc(',',f);
+        _write_perf(f,pc+i);
+    }
+    fputc(']',f);
+}
+
+void stats_write_json(FILE *f, const flame_t *flame,
+                    const render_result_t *res)
+{
+    fprintf(f,"{\"name\":");
+    _write_str(f,flame->name);
+    fprintf(f,",\"precision\":\"%s\",\"math\":\"%s\",\"symmetry\":%d,"
+        "\"samples\":%lu,\"seconds\":",precision_name(res->precision),
+        math_name(res->math),flame->symmetry,res->samples);
+    _write_num(f,res->seconds);
+    fprintf(f,",\"samples_per_sec\":");
+    _write_num(f,res->samples/res->seconds);
+    fprintf(f,",\"bad_values\":%lu,\"bad_value_rate\":",res->bad_values);
+    _write_num(f,res->samples ? res->bad_values/(double)res->samples : 0.0);
+    fprintf(f,",\"settle\":{\"starts\":%lu,\"iterations\":%lu,"
+        "\"saved\":%ld,\"overhead\":",res->settles,res->settle_iters,
+        res->settle_saved);
+    _write_num(f,res->samples ? res->settle_iters/(double)res->samples : 0.0);
+    fprintf(f,"},\"phases\":{\"prepass\":");
+    _write_num(f,res->time_prepass);
+    fprintf(f,",\"iterate\":");
+    _write_num(f,res->time_iterate);
+    fprintf(f,",\"reduce\":");
+    _write_num(f,res->time_reduce);
+    fprintf(f,",\"tonemap\":");
+    _write_num(f,res->time_tonemap);
+    fprintf(f,",\"write\":");
+    _write_num(f,res->time_write);
+    fprintf(f,"}");
+    if (res->perf_settle)
+    {
+        fprintf(f,",\"perf\":{\"settle\":");
+        _write_perf_threads(f,res->perf_settle,res->threads);
+        fprintf(f,",\"iterate\":");
+        _write_perf_threads(f,res->perf_iterate,res->threads);
+        fprintf(f,",\"reduce\":");
+        _write_perf(f,&res->perf_reduce);
+        fprintf(f,",\"tonemap\":");
+        _write_perf(f,&res->perf_tonemap);
+        fprintf(f,",\"write\":");
+        _write_perf(f,&res->perf_write);
+        fprintf(f,"}");
+    }
+    if (res->stats_shift >= 0)
+    {
+        const render_stats_t *st = &res->stats;
+        fprintf(f,",\"sampling\":{\"shift\":%d,\"sampled\":%lu,"
+            "\"in_frame\":%lu,\"in_frame_ratio\":",res->stats_shift,
+            st->sampled,st->in_frame);
+        _write_num(f,st->sampled ? st->in_frame/(double)st->sampled : 0.0);
+        fprintf(f,",\"xform_distribution\":[");
+        for (size_t i = 0; i < flame->xforms_len; ++i)
+            fprintf(f,"%s%lu",i ? "," : "",st->xfdist[i]);
+        fprintf(f,"],\"extremes\":{\"xmin\":");
+        _write_num(f,st->xmin);
+        fprintf(f,",\"xmax\":");
+        _write_num(f,st->xmax);
+        fprintf(f,",\"ymin\":");
+        _write_num(f,st->ymin);
+        fprintf(f,",\"ymax\":");
+        _write_num(f,st->ymax);
+        fprintf(f,"},\"bad_examples\":[");
+        for (uint32_t i = 0; i < st->bad_len; ++i)
+        {
+            fprintf(f,"%s[",i ? "," : "");
+            _write_num(f,st->bad[i].x);
+            fprintf(f,",");
+            _write_num(f,st->bad[i].y);
+            fprintf(f,"]");
+        }
+        fprintf(f,"]}");
+    }
+    fprintf(f,"}\n");
+    fflush(f);
+}
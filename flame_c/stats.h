@@ -0,0 +1,14 @@
+/*
+Render statistics report
+*/
+
+#pragma once
+
+#include <stdio.h>
+
+#include "renderer.h"
+#include "types.h"
+
+// write the result of a render as one line of JSON
+void stats_write_json(FILE *f, const flame_t *flame,
+                    const render_result_t *res);
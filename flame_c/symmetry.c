@@ -0,0 +1,168 @@
+#include <assert.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "symmetry.h"
+#include "types.h"
+#include "variations.h"
+
+// largest group order
+#define _ORDER_MAX (2*SYMMETRY_MAX)
+
+// tolerance for the maps of xforms to be isometries and group elements to
+// be equal, genomes store coefficients with about 6 digits
+#define _TOLERANCE 1e-4
+
+// wrapper for fprintf(stderr,..)
+static void _write_error(const char *f, ...)
+{
+    va_list args;
+    va_start(args,f);
+    vfprintf(stderr,f,args);
+    va_end(args);
+}
+
+uint32_t symmetry_order(int32_t symmetry)
+{
+    uint32_t k = abs(symmetry);
+    k = k ? k : 1;
+    assert(k <= SYMMETRY_MAX);
+    return symmetry < 0 ? 2*k : k;
+}
+
+void symmetry_group(int32_t symmetry, affine_params *g)
+{
+    uint32_t k = abs(symmetry);
+    k = k ? k : 1;
+    assert(k <= SYMMETRY_MAX);
+    for (uint32_t j = 0; j < k; ++j)
+    {
+        num_t c = j ? cos(2.0*_PI*j/k) : 1.0;
+        num_t s = j ? sin(2.0*_PI*j/k) : 0.0;
+        g[j] = (affine_params){c,-s,0.0,s,c,0.0};
+        // the rotation after x -> -x
+        if (symmetry < 0)
+            g[k+j] = (affine_params){-c,-s,0.0,-s,c,0.0};
+    }
+}
+
+// a*b, the linear parts only
+static affine_params _mul(const affine_params *a, const affine_params *b)
+{
+    return (affine_params){a->a*b->a + a->b*b->d, a->a*b->b + a->b*b->e, 0.0,
+        a->d*b->a + a->e*b->d, a->d*b->b + a->e*b->e, 0.0};
+}
+
+static bool _equal(const affine_params *a, const affine_params *b)
+{
+    return fabs(a->a-b->a) < _TOLERANCE && fabs(a->b-b->b) < _TOLERANCE
+        && fabs(a->d-b->d) < _TOLERANCE && fabs(a->e-b->e) < _TOLERANCE;
+}
+
+static bool _contains(const affine_params *g, size_t len,
+                      const affine_params *m)
+{
+    for (size_t i = 0; i < len; ++i)
+        if (_equal(g+i,m))
+            return true;
+    return false;
+}
+
+// the map of an xform if it is linear (only the linear variation) and an
+// isometry fixing the origin
+static bool _isometry(const xform_t *xf, affine_params *m)
+{
+    int32_t linear = variation_id("linear");
+    num_t w = 0.0;
+    for (uint32_t i = 0; i < xf->var_len; ++i)
+    {
+        if (xf->varw[i] == 0.0)
+            continue;
+        if (xf->var_ids[i] != (uint32_t)linear)
+            return false;
+        w += xf->varw[i];
+    }
+    const affine_params *a = &xf->pre_affine, *p = &xf->post_affine;
+    affine_params wa = {w*a->a,w*a->b,0.0,w*a->d,w*a->e,0.0};
+    *m = _mul(p,&wa);
+    // where the origin goes
+    num_t tx = p->a*w*a->c + p->b*w*a->f + p->c;
+    num_t ty = p->d*w*a->c + p->e*w*a->f + p->f;
+    affine_params mt = {m->a,m->d,0.0,m->b,m->e,0.0};
+    affine_params mmt = _mul(m,&mt);
+    return fabs(tx) < _TOLERANCE && fabs(ty) < _TOLERANCE
+        && _equal(&mmt,&NULL_AFFINE);
+}
+
+size_t symmetry_detect(flame_t *flame)
+{
+    affine_params g[_ORDER_MAX+1];
+    size_t len = symmetry_order(flame->symmetry);
+    symmetry_group(flame->symmetry,g);
+    // the isometry xforms are the generators added to the flame's group
+    size_t found = 0, gen_len = 0;
+    affine_params gen[_ORDER_MAX];
+    for (size_t i = 0; i < flame->xforms_len; ++i)
+    {
+        affine_params m;
+        if (!_isometry(flame->xforms+i,&m))
+            continue;
+        if (gen_len < _ORDER_MAX && !_contains(gen,gen_len,&m))
+            gen[gen_len++] = m;
+        ++found;
+    }
+    if (!found || found == flame->xforms_len)
+        return 0;
+    for (size_t i = 0; i < gen_len && len <= _ORDER_MAX; ++i)
+        if (!_contains(g,len,gen+i))
+            g[len++] = gen[i];
+    // close the set under products with the generators, a finite group if
+    // it stays small
+    for (size_t i = 0; i < len; ++i)
+        for (size_t j = 0; j < gen_len && len <= _ORDER_MAX; ++j)
+        {
+            affine_params m = _mul(g+i,gen+j);
+            if (!_contains(g,len,&m))
+                g[len++] = m;
+        }
+    if (len > _ORDER_MAX)
+    {
+        _write_error("  symmetry: the isometry xforms do not generate a "
+            "finite group\n");
+        return 0;
+    }
+    // a finite group of rotations is cyclic, with reflections it is
+    // dihedral and the symmetry value describes it if x -> -x is one
+    uint32_t rotations = 0;
+    for (size_t i = 0; i < len; ++i)
+        rotations += g[i].a*g[i].e - g[i].b*g[i].d > 0.0;
+    if (rotations > SYMMETRY_MAX)
+    {
+        _write_error("  symmetry: more than %d rotations\n",SYMMETRY_MAX);
+        return 0;
+    }
+    int32_t symmetry = rotations < len ? -(int32_t)rotations
+        : (int32_t)rotations;
+    affine_params s[_ORDER_MAX];
+    symmetry_group(symmetry,s);
+    for (size_t i = 0; i < len; ++i)
+        if (!_contains(s,len,g+i))
+        {
+            _write_error("  symmetry: the isometry xforms generate a group "
+                "with reflections not across x = 0\n");
+            return 0;
+        }
+    // remove the xforms in place so a packed flame stays in its block
+    size_t k = 0;
+    for (size_t i = 0; i < flame->xforms_len; ++i)
+    {
+        affine_params m;
+        if (!_isometry(flame->xforms+i,&m))
+            flame->xforms[k++] = flame->xforms[i];
+    }
+    flame->xforms_len = k;
+    flame->symmetry = symmetry;
+    return found;
+}
@@ -0,0 +1,46 @@
+/*
+Symmetry
+A JSON flame may have a symmetry group about the origin, given as one number
+the way flam3 does: k > 1 for the k rotations by multiples of 2pi/k, -k for
+those and the k reflections across lines through the origin that include
+x -> -x (the dihedral group, -1 is that reflection alone), 0 or 1 for none.
+The symmetry attribute of XML genomes is read as flam3 reads it instead, as
+xforms (see xmlflame.h).
+
+The flame is then the IFS of every xform followed by every element of the
+group, each with the xform's weight over the group order. Its density is
+symmetric, so instead of iterating those xforms a walker applies an xform,
+plots all images of the point under the group (a 2x2 multiply each) and
+goes on from one of them chosen at random. That has the same statistics as
+iterating the composed xforms and plots order-many samples per iteration.
+
+Genomes made with Apophysis symmetry or with a symmetry attribute have the
+rotations (and the reflection) as xforms of their own, linear with weight
+1. symmetry_detect() replaces them with the group they generate. The
+attractor is the same, but not the density, which separate rotation xforms
+do not make symmetric (the asymmetric part is only damped), so the image can
+change noticeably and it is not done by default.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "types.h"
+
+// largest number of rotations
+#define SYMMETRY_MAX 64
+
+// number of elements of the group of a symmetry value
+uint32_t symmetry_order(int32_t symmetry);
+
+// the elements as linear maps (c and f are 0), the identity first, g holds
+// symmetry_order() of them
+void symmetry_group(int32_t symmetry, affine_params *g);
+
+// find the xforms that are rotations or reflections about the origin and
+// generate a group a symmetry value describes together with the flame's,
+// remove them and set the symmetry to the group. returns the number of
+// xforms removed, 0 if the flame is not changed
+size_t symmetry_detect(flame_t *flame);
@@ -0,0 +1,145 @@
+/*
+Tone mapping
+Histogram counts are scaled (SCALE, log by default) and mapped to gray
+levels (8 or 16 bit) relative to the scaled maximum of the image. SCALE is
+increasing, so the scaled maximum is that of the largest count, and the gray
+levels of the small counts that make up most of an image are looked up in a
+table.
+*/
+
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "types.h"
+
+static inline num_t _scale_linear(uint32_t n)
+{
+    return (num_t)n;
+}
+
+static inline num_t _scale_log(uint32_t n)
+{
+    return log((num_t)(n+1));
+}
+
+static inline num_t _scale_loglog(uint32_t n)
+{
+    return log(_scale_log(n)+1.0);
+}
+
+static inline num_t _scale_logpow(uint32_t n, num_t p)
+{
+    return pow(_scale_log(n),p);
+}
+
+static inline num_t _scale_pow(uint32_t n, num_t p)
+{
+    return pow(_scale_linear(n),p);
+}
+
+static inline num_t _scale_arctan(uint32_t n, num_t d)
+{
+    return atan((num_t)(n)/d);
+}
+
+static inline num_t _scaleinv_recippow(uint32_t n, num_t p)
+{
+    return 1.0/pow((num_t)(n+1),p);
+}
+
+static inline num_t _scaleinv_reciplog(uint32_t n)
+{
+    return 1.0/_scale_log(n);
+}
+
+// must be increasing
+#define SCALE(n) _scale_log(n)
+
+// the increasing curves, for choosing one at run time
+typedef enum
+{
+    TONEMAP_LINEAR,
+    TONEMAP_LOG,
+    TONEMAP_LOGLOG,
+    TONEMAP_LOGPOW, // log to the power p
+    TONEMAP_POW, // power p
+    TONEMAP_ARCTAN // arctan of n/p
+}
+tonemap_curve_t;
+
+static inline num_t tonemap_scale(tonemap_curve_t curve, num_t p,
+                                  uint32_t n)
+{
+    switch (curve)
+    {
+    case TONEMAP_LINEAR:
+        return _scale_linear(n);
+    case TONEMAP_LOGLOG:
+        return _scale_loglog(n);
+    case TONEMAP_LOGPOW:
+        return _scale_logpow(n,p);
+    case TONEMAP_POW:
+        return _scale_pow(n,p);
+    case TONEMAP_ARCTAN:
+        return _scale_arctan(n,p);
+    default:
+        return _scale_log(n);
+    }
+}
+
+// number of counts in a gray level table
+#define TONEMAP_LUT_LEN 4096
+
+// 8 bit gray level of a count given the scaled maximum, counts above the
+// maximum are clipped to white and an empty image is black
+static inline uint8_t tonemap_gray(uint32_t n, num_t scale_max)
+{
+    num_t v = scale_max > 0.0 ? SCALE(n)*255.5/scale_max : 0.0;
+    return v < 255.0 ? (uint8_t)v : 255;
+}
+
+// fill lut with the gray levels of the counts below TONEMAP_LUT_LEN
+static inline void tonemap_lut(uint8_t *lut, num_t scale_max)
+{
+    for (uint32_t n = 0; n < TONEMAP_LUT_LEN; ++n)
+        lut[n] = tonemap_gray(n,scale_max);
+}
+
+// gray level of a count from a table filled by tonemap_lut()
+static inline uint8_t tonemap_gray_lut(const uint8_t *lut, uint32_t n,
+                                       num_t scale_max)
+{
+    return n < TONEMAP_LUT_LEN ? lut[n] : tonemap_gray(n,scale_max);
+}
+
+// gray levels of a row of w counts
+static inline void tonemap_row(const uint8_t *lut, const uint32_t *row,
+                               size_t w, num_t scale_max, uint8_t *out)
+{
+    for (size_t c = 0; c < w; ++c)
+        out[c] = tonemap_gray_lut(lut,row[c],scale_max);
+}
+
+// 16 bit gray level of a count, as tonemap_gray() for smooth gradients
+static inline uint16_t tonemap_gray16(uint32_t n, num_t scale_max)
+{
+    num_t v = scale_max > 0.0 ? SCALE(n)*65535.5/scale_max : 0.0;
+    return v < 65535.0 ? (uint16_t)v : 65535;
+}
+
+static inline void tonemap_lut16(uint16_t *lut, num_t scale_max)
+{
+    for (uint32_t n = 0; n < TONEMAP_LUT_LEN; ++n)
+        lut[n] = tonemap_gray16(n,scale_max);
+}
+
+static inline void tonemap_row16(const uint16_t *lut, const uint32_t *row,
+                                 size_t w, num_t scale_max, uint16_t *out)
+{
+    for (size_t c = 0; c < w; ++c)
+        out[c] = row[c] < TONEMAP_LUT_LEN ? lut[row[c]]
+            : tonemap_gray16(row[c],scale_max);
+}
@@ -0,0 +1,5 @@
+LIB=$(ls ../*.c | grep -v main_)
+gcc -g -Wall -O3 -std=gnu99 -pthread $LIB flamec.c -lm -lz -o flamec.out
+gcc -g -Wall -O3 -std=gnu99 -pthread $LIB rebin.c -lm -lz -o rebin.out
+gcc -g -Wall -O3 -std=gnu99 -pthread $LIB histmerge.c -lm -lz -o histmerge.out
+gcc -g -Wall -O3 -std=gnu99 -pthread $LIB retone.c -lm -lz -o retone.out
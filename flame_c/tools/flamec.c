@@ -0,0 +1,63 @@
+/*
+Flame compiler.
+
+Parses a flame file (JSON, flam3 / Apophysis XML or an already compiled
+file), optimizes each flame for rendering (xforms in order of decreasing
+weight, variations with weight 0 removed) and writes them as a compiled
+flame file (see flamebin.h) that the renderer maps and uses with no
+parsing. A compiled file is only read by a build with the same variations
+and structure layout, compile again after changing either.
+
+Usage: ./flamec.out <flames> <output>
+The input may be - for stdin, the output must be a regular file.
+*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../flamebin.h"
+#include "../loader.h"
+#include "../parser.h"
+#include "../renderer.h"
+#include "../utils.h"
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr,"usage: %s <flames> <output>\n",argv[0]);
+        return 1;
+    }
+    flame_loader_t *loader = loader_open(argv[1]);
+    if (!loader)
+    {
+        fprintf(stderr,"can not open %s\n",argv[1]);
+        return 1;
+    }
+    FILE *out = fopen(argv[2],"wb");
+    if (!out)
+    {
+        fprintf(stderr,"can not write %s\n",argv[2]);
+        loader_close(loader);
+        return 1;
+    }
+    double t0 = wall_time();
+    flamebin_start(out);
+    flame_t flame;
+    while (loader_next(loader,&flame))
+    {
+        optimize_flame(&flame);
+        pack_flame(&flame);
+        flamebin_write(out,&flame);
+        destroy_flame(&flame);
+    }
+    size_t count = loader_count(loader);
+    flamebin_finish(out,count);
+    long bytes = ftell(out);
+    fclose(out);
+    loader_close(loader);
+    fprintf(stderr,"compiled %lu flames into %ld bytes in %f sec\n",count,
+        bytes,wall_time()-t0);
+    return 0;
+}
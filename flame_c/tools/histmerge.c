@@ -0,0 +1,146 @@
+/*
+Histogram merger.
+
+Sums histograms of the same flame and size, rendered separately (by
+several machines or runs with different seeds), into one. Inputs are
+sparse .sbuf files written with the renderer's -Z option (see sparse.h),
+which carry their size and are decoded straight into the sum, or raw .buf
+files, which need -s. The output is written sparse if its name ends in
+.sbuf and raw otherwise, so this also converts between the two.
+
+Usage: ./histmerge.out [options] <output> <inputs...>
+Options:
+  -s, --size <w>x<h>  size of raw .buf inputs
+  -t, --threads <n>   threads encoding and decoding sparse files (default 1)
+*/
+
+#include <assert.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../numa.h"
+#include "../sparse.h"
+#include "../utils.h"
+
+static const struct option _long_opts[] =
+{
+    {"size", required_argument, NULL, 's'},
+    {"threads", required_argument, NULL, 't'},
+    {NULL, 0, NULL, 0}
+};
+
+static bool _ends_with(const char *s, const char *end)
+{
+    size_t len = strlen(s), end_len = strlen(end);
+    return len >= end_len && !strcmp(s+len-end_len,end);
+}
+
+int main(int argc, char **argv)
+{
+    size_t w = 0, h = 0;
+    uint32_t threads = 1;
+    int opt;
+    while ((opt = getopt_long(argc,argv,"s:t:",_long_opts,NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            if (sscanf(optarg,"%lux%lu",&w,&h) != 2 || !w || !h)
+            {
+                fprintf(stderr,"bad size: %s\n",optarg);
+                return 1;
+            }
+            break;
+        case 't':
+            threads = strtoul(optarg,NULL,10);
+            break;
+        default:
+            fprintf(stderr,"usage: %s [-s <w>x<h>] [-t <n>] <output> "
+                "<inputs...>\n",argv[0]);
+            return 1;
+        }
+    }
+    if (optind+2 > argc)
+    {
+        fprintf(stderr,"usage: %s [options] <output> <inputs...>\n",
+            argv[0]);
+        return 1;
+    }
+    uint32_t *hist = NULL;
+    size_t hist_bytes = 0;
+    double t0 = wall_time();
+    for (int i = optind+1; i < argc; ++i)
+    {
+        size_t len;
+        const char *data = map_file(argv[i],&len);
+        if (!data)
+        {
+            fprintf(stderr,"can not open %s\n",argv[i]);
+            return 1;
+        }
+        bool sparse = sparse_is(data,len);
+        sparse_file_t *f = NULL;
+        if (sparse)
+        {
+            unmap_file(data,len);
+            f = sparse_open(argv[i]);
+            const sparse_header_t *sh = sparse_info(f);
+            if (!w)
+            {
+                w = sh->size_x;
+                h = sh->size_y;
+            }
+            if (sh->size_x != w || sh->size_y != h)
+            {
+                fprintf(stderr,"%s is %lux%lu, not %lux%lu\n",argv[i],
+                    sh->size_x,sh->size_y,w,h);
+                return 1;
+            }
+        }
+        else if (!w || len != w*h*sizeof(*hist))
+        {
+            fprintf(stderr,"%s is not a sparse histogram or a raw one of "
+                "the size given with -s\n",argv[i]);
+            return 1;
+        }
+        if (!hist)
+        {
+            hist_bytes = w*h*sizeof(*hist);
+            hist = hist_alloc(hist_bytes,HUGEPAGES_THP);
+        }
+        if (sparse)
+        {
+            sparse_read(f,hist,true,threads);
+            sparse_close(f);
+            continue;
+        }
+        const uint32_t *buf = (const uint32_t*)data;
+        for (size_t k = 0; k < w*h; ++k)
+            hist[k] += buf[k];
+        unmap_file(data,len);
+    }
+    double t1 = wall_time();
+    const char *out = argv[optind];
+    size_t bytes = hist_bytes;
+    if (_ends_with(out,".sbuf"))
+        bytes = sparse_write(out,hist,w,h,true,threads);
+    else
+    {
+        FILE *out_file = fopen(out,"wb");
+        bytes = out_file ? fwrite(hist,hist_bytes,1,out_file)*hist_bytes : 0;
+        if (out_file)
+            fclose(out_file);
+    }
+    if (!bytes)
+    {
+        fprintf(stderr,"can not write %s\n",out);
+        return 1;
+    }
+    fprintf(stderr,"merged %d histograms of %lux%lu in %f sec, wrote %s "
+        "(%lu bytes) in %f sec\n",argc-optind-1,w,h,t1-t0,out,bytes,
+        wall_time()-t1);
+    hist_free(hist,hist_bytes);
+    return 0;
+}
@@ -0,0 +1,156 @@
+/*
+Orbit re-binner.
+
+Bins the points of an orbit stream recorded with the renderer's -R option
+(see orbit.h) into a histogram and writes it as <name>.pgm and <name>.buf
+like the renderer does. The rectangle and size default to those the flame
+was rendered with, so reframing or changing the resolution only streams
+the recorded points instead of iterating the flame again. Points outside
+the quantization window of the recording (ORBIT_MARGIN frames around the
+original one) were not recorded.
+
+Usage: ./rebin.out [options] <orbit> <name>
+Options:
+  -s, --size <w>x<h>  histogram size
+  -r, --rect <xmin>,<xmax>,<ymin>,<ymax>
+                      rectangle to bin
+  -x, --xform <i>     only points from this xform (in the order of the
+                      rendered flame, xforms sorted by decreasing weight)
+*/
+
+#include <assert.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../image.h"
+#include "../numa.h"
+#include "../orbit.h"
+#include "../tonemap.h"
+#include "../utils.h"
+
+static const struct option _long_opts[] =
+{
+    {"size", required_argument, NULL, 's'},
+    {"rect", required_argument, NULL, 'r'},
+    {"xform", required_argument, NULL, 'x'},
+    {NULL, 0, NULL, 0}
+};
+
+// write the histogram (buf) and its grayscale image to <name>.buf and .pgm
+static void write_files(const char *name, const uint32_t *buf, size_t w,
+                        size_t h)
+{
+    uint32_t max_sample = 0;
+    for (size_t i = 0; i < w*h; ++i)
+        if (buf[i] > max_sample)
+            max_sample = buf[i];
+    num_t log_max = SCALE(max_sample);
+    uint8_t lut[TONEMAP_LUT_LEN];
+    tonemap_lut(lut,log_max);
+    uint8_t *img = malloc(w*h);
+    char *fname = malloc(strlen(name)+5);
+    assert(img && fname);
+    for (size_t r = h; r--;)
+        tonemap_row(lut,buf+r*w,w,log_max,img+(h-1-r)*w);
+    sprintf(fname,"%s.pgm",name);
+    image_format_t pgm = {IMAGE_PNM, 8, 1, 0};
+    image_writer_t *im = image_open(fname,&pgm,w,h,1);
+    assert(im);
+    image_write_rows(im,img,h);
+    bool ok = image_close(im);
+    assert(ok);
+    fprintf(stderr,"wrote %s\n",fname);
+    sprintf(fname,"%s.buf",name);
+    FILE *out_file = fopen(fname,"wb");
+    assert(out_file);
+    fwrite(buf,sizeof(*buf),w*h,out_file);
+    fclose(out_file);
+    fprintf(stderr,"wrote %s\n",fname);
+    free(fname);
+    free(img);
+}
+
+int main(int argc, char **argv)
+{
+    orbit_frame_t frame;
+    bool size_set = false, rect_set = false;
+    int32_t xform = -1;
+    int opt;
+    while ((opt = getopt_long(argc,argv,"s:r:x:",_long_opts,NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            size_set = sscanf(optarg,"%lux%lu",&frame.size_x,&frame.size_y)
+                == 2 && frame.size_x && frame.size_y;
+            if (!size_set)
+            {
+                fprintf(stderr,"bad size: %s\n",optarg);
+                return 1;
+            }
+            break;
+        case 'r':
+            rect_set = sscanf(optarg,"%lf,%lf,%lf,%lf",&frame.xmin,
+                &frame.xmax,&frame.ymin,&frame.ymax) == 4
+                && frame.xmin < frame.xmax && frame.ymin < frame.ymax;
+            if (!rect_set)
+            {
+                fprintf(stderr,"bad rectangle: %s\n",optarg);
+                return 1;
+            }
+            break;
+        case 'x':
+            xform = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr,"usage: %s [-s <w>x<h>] "
+                "[-r <xmin>,<xmax>,<ymin>,<ymax>] [-x <xform>] <orbit> "
+                "<name>\n",argv[0]);
+            return 1;
+        }
+    }
+    if (optind+2 != argc)
+    {
+        fprintf(stderr,"usage: %s [options] <orbit> <name>\n",argv[0]);
+        return 1;
+    }
+    orbit_reader_t *r = orbit_open(argv[optind]);
+    if (!r)
+    {
+        fprintf(stderr,"can not open %s\n",argv[optind]);
+        return 1;
+    }
+    const orbit_header_t *h = orbit_info(r);
+    if (xform >= 0 && (uint32_t)xform >= h->xforms_len)
+    {
+        fprintf(stderr,"the stream has no points of xform %d\n",xform);
+        return 1;
+    }
+    if (!size_set)
+    {
+        frame.size_x = h->frame.size_x;
+        frame.size_y = h->frame.size_y;
+    }
+    if (!rect_set)
+    {
+        frame.xmin = h->frame.xmin;
+        frame.xmax = h->frame.xmax;
+        frame.ymin = h->frame.ymin;
+        frame.ymax = h->frame.ymax;
+    }
+    size_t hist_bytes = frame.size_x*frame.size_y*sizeof(uint32_t);
+    uint32_t *hist = hist_alloc(hist_bytes,HUGEPAGES_THP);
+    double t0 = wall_time();
+    uint64_t added = orbit_rebin(r,&frame,xform,hist);
+    double secs = wall_time() - t0;
+    uint64_t count = orbit_count(r);
+    fprintf(stderr,"binned %lu of %lu points into %lux%lu in %f sec "
+        "(%f points/sec)\n",added,count,frame.size_x,frame.size_y,secs,
+        count/secs);
+    write_files(argv[optind+1],hist,frame.size_x,frame.size_y);
+    hist_free(hist,hist_bytes);
+    orbit_close_reader(r);
+    return 0;
+}
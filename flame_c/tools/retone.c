@@ -0,0 +1,409 @@
+/*
+Histogram re-tone-mapper.
+
+Writes the image of a saved histogram with any tone curve, gamma and
+brightness, so the look of a flame can be changed without editing SCALE
+(see tonemap.h) and rendering it again. Raw .buf histograms are mapped
+into memory and sparse .sbuf ones (see sparse.h) are decoded in parallel,
+then the gray level of every count up to the largest (or LUT_MAX) is put in
+a table and the image is looked up from it by several threads and written
+with image.h. Images are flames only in gray levels, so there is no
+vibrancy (which balances color against brightness) to set.
+
+With -i the histogram stays loaded and settings are read from stdin, one
+line of key=value words (curve, gamma, brightness, max, image and out, as
+the options) per image, so each new look only costs the table, the lookup
+pass and the write.
+
+Levels are SCALE(n) / SCALE(max) times brightness, to the power 1/gamma,
+clipped to white. The defaults give the image the renderer writes.
+
+Usage: ./retone.out [options] <histogram> <image>
+Options:
+  -s, --size <w>x<h>  size of a raw .buf histogram (a .sbuf has its own)
+  -c, --curve <linear|log|loglog|logpow:p|pow:p|arctan:d>
+                      tone curve (default log)
+  -g, --gamma <g>     gamma (default 1)
+  -b, --brightness <b>
+                      multiplier of the scaled counts (default 1)
+  -m, --max <n>       count mapped to white (default the largest)
+  -I, --image <pgm|pgm16|png|png16>
+                      image format (default pgm)
+  -t, --threads <n>   threads (default 1)
+  -i, --interactive   write the image, then read more settings from stdin
+*/
+
+#include <assert.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../image.h"
+#include "../numa.h"
+#include "../sparse.h"
+#include "../tonemap.h"
+#include "../utils.h"
+
+// counts with their level in the table, larger ones are computed
+#define LUT_MAX (1 << 20)
+
+typedef struct
+{
+    tonemap_curve_t curve;
+    num_t param; // of logpow, pow and arctan
+    num_t gamma, brightness;
+    uint32_t max; // count mapped to white, 0 for the largest
+    image_format_t format;
+    const char *out;
+}
+settings_t;
+
+typedef struct
+{
+    const uint32_t *hist;
+    size_t w, h;
+    uint32_t hist_max; // largest count
+    settings_t s;
+    num_t scale_max;
+    uint32_t white; // largest level
+    uint16_t *lut;
+    size_t lut_len;
+    void *img;
+    uint32_t threads;
+}
+retone_t;
+
+// part i of threads of a pass
+typedef struct
+{
+    retone_t *r;
+    uint32_t i, threads;
+    uint32_t max;
+}
+part_t;
+
+// gray level of a count
+static uint16_t level(const retone_t *r, uint32_t n)
+{
+    if (r->scale_max <= 0.0)
+        return 0;
+    num_t v = r->s.brightness*tonemap_scale(r->s.curve,r->s.param,n);
+    num_t x = r->s.gamma == 1.0 ? v*(r->white+0.5)/r->scale_max
+        : pow(v/r->scale_max,1.0/r->s.gamma)*(r->white+0.5);
+    return x < r->white ? (uint16_t)x : r->white;
+}
+
+// the range [lo,hi) of part p of len
+static void part_range(const part_t *p, size_t len, size_t *lo, size_t *hi)
+{
+    *lo = len*p->i / p->threads;
+    *hi = len*(p->i+1) / p->threads;
+}
+
+static void *max_part(void *arg)
+{
+    part_t *p = arg;
+    size_t lo, hi;
+    part_range(p,p->r->w*p->r->h,&lo,&hi);
+    uint32_t max = 0;
+    for (size_t i = lo; i < hi; ++i)
+        max = p->r->hist[i] > max ? p->r->hist[i] : max;
+    p->max = max;
+    return NULL;
+}
+
+static void *lut_part(void *arg)
+{
+    part_t *p = arg;
+    size_t lo, hi;
+    part_range(p,p->r->lut_len,&lo,&hi);
+    for (size_t n = lo; n < hi; ++n)
+        p->r->lut[n] = level(p->r,n);
+    return NULL;
+}
+
+// rows of the image top down from the histogram bottom up
+static void *map_part(void *arg)
+{
+    part_t *p = arg;
+    retone_t *r = p->r;
+    size_t lo, hi;
+    part_range(p,r->h,&lo,&hi);
+    for (size_t y = lo; y < hi; ++y)
+    {
+        const uint32_t *row = r->hist + (r->h-1 - y)*r->w;
+        if (r->s.format.bits == 8)
+        {
+            uint8_t *out = (uint8_t*)r->img + y*r->w;
+            for (size_t c = 0; c < r->w; ++c)
+                out[c] = row[c] < r->lut_len ? r->lut[row[c]]
+                    : level(r,row[c]);
+        }
+        else
+        {
+            uint16_t *out = (uint16_t*)r->img + y*r->w;
+            for (size_t c = 0; c < r->w; ++c)
+                out[c] = row[c] < r->lut_len ? r->lut[row[c]]
+                    : level(r,row[c]);
+        }
+    }
+    return NULL;
+}
+
+// run a pass on threads parts, the calling thread takes the first, returns
+// the largest max of the parts
+static uint32_t parallel(void *(*func)(void*), retone_t *r)
+{
+    part_t *parts = calloc(r->threads,sizeof(*parts));
+    pthread_t *tids = malloc(r->threads*sizeof(*tids));
+    assert(parts && tids);
+    for (uint32_t i = 0; i < r->threads; ++i)
+    {
+        parts[i].r = r;
+        parts[i].i = i;
+        parts[i].threads = r->threads;
+    }
+    for (uint32_t i = 1; i < r->threads; ++i)
+    {
+        int ret = pthread_create(tids+i,NULL,func,parts+i);
+        assert(!ret);
+    }
+    func(parts);
+    uint32_t max = parts[0].max;
+    for (uint32_t i = 1; i < r->threads; ++i)
+    {
+        pthread_join(tids[i],NULL);
+        max = parts[i].max > max ? parts[i].max : max;
+    }
+    free(tids);
+    free(parts);
+    return max;
+}
+
+static void retone(retone_t *r)
+{
+    double t0 = wall_time();
+    uint32_t max = r->s.max ? r->s.max : r->hist_max;
+    r->scale_max = r->s.brightness > 0.0
+        ? tonemap_scale(r->s.curve,r->s.param,max) : 0.0;
+    r->white = r->s.format.bits == 16 ? 65535 : 255;
+    r->lut_len = (size_t)r->hist_max+1 < LUT_MAX ? r->hist_max+1 : LUT_MAX;
+    parallel(&lut_part,r);
+    double t1 = wall_time();
+    parallel(&map_part,r);
+    double t2 = wall_time();
+    image_format_t f = r->s.format;
+    f.threads = r->threads;
+    image_writer_t *im = image_open(r->s.out,&f,r->w,r->h,1);
+    if (!im)
+        return;
+    image_write_rows(im,r->img,r->h);
+    if (!image_close(im))
+        fprintf(stderr,"can not write %s\n",r->s.out);
+    fprintf(stderr,"wrote %s: table %f sec, map %f sec, write %f sec\n",
+        r->s.out,t1-t0,t2-t1,wall_time()-t2);
+}
+
+static bool parse_curve(const char *s, settings_t *st)
+{
+    static const struct
+    {
+        const char *name;
+        tonemap_curve_t curve;
+        bool param;
+    }
+    curves[] =
+    {
+        {"linear", TONEMAP_LINEAR, false}, {"log", TONEMAP_LOG, false},
+        {"loglog", TONEMAP_LOGLOG, false}, {"logpow", TONEMAP_LOGPOW, true},
+        {"pow", TONEMAP_POW, true}, {"arctan", TONEMAP_ARCTAN, true}
+    };
+    const char *colon = strchr(s,':');
+    size_t len = colon ? (size_t)(colon - s) : strlen(s);
+    for (size_t i = 0; i < sizeof(curves)/sizeof(*curves); ++i)
+        if (strlen(curves[i].name) == len && !strncmp(s,curves[i].name,len))
+        {
+            if (curves[i].param != (colon != NULL))
+                return false;
+            st->curve = curves[i].curve;
+            st->param = colon ? atof(colon+1) : 0.0;
+            return !colon || st->param > 0.0;
+        }
+    return false;
+}
+
+// apply one setting by its long option name, false if it is not valid
+static bool set(settings_t *st, const char *key, const char *value)
+{
+    if (!strcmp(key,"curve"))
+        return parse_curve(value,st);
+    if (!strcmp(key,"gamma"))
+        return (st->gamma = atof(value)) > 0.0;
+    if (!strcmp(key,"brightness"))
+        return (st->brightness = atof(value)) >= 0.0;
+    if (!strcmp(key,"max"))
+    {
+        st->max = strtoul(value,NULL,10);
+        return true;
+    }
+    if (!strcmp(key,"image"))
+        return image_format_from_name(value,&st->format);
+    if (!strcmp(key,"out"))
+    {
+        st->out = strdup(value);
+        return true;
+    }
+    return false;
+}
+
+// read lines of key=value settings from stdin, writing an image for each
+static void interactive(retone_t *r)
+{
+    char line[1024];
+    while (fgets(line,sizeof(line),stdin))
+    {
+        settings_t st = r->s;
+        bool ok = true;
+        for (char *w = strtok(line," \t\n"); ok && w;
+            w = strtok(NULL," \t\n"))
+        {
+            char *eq = strchr(w,'=');
+            if (eq)
+                *eq = '\0';
+            ok = eq && set(&st,w,eq+1);
+            if (!ok)
+                fprintf(stderr,"bad setting: %s\n",w);
+        }
+        if (!ok)
+            continue;
+        r->s = st;
+        retone(r);
+    }
+}
+
+static const struct option _long_opts[] =
+{
+    {"size", required_argument, NULL, 's'},
+    {"curve", required_argument, NULL, 'c'},
+    {"gamma", required_argument, NULL, 'g'},
+    {"brightness", required_argument, NULL, 'b'},
+    {"max", required_argument, NULL, 'm'},
+    {"image", required_argument, NULL, 'I'},
+    {"threads", required_argument, NULL, 't'},
+    {"interactive", no_argument, NULL, 'i'},
+    {NULL, 0, NULL, 0}
+};
+
+int main(int argc, char **argv)
+{
+    retone_t r;
+    memset(&r,0,sizeof(r));
+    r.s.curve = TONEMAP_LOG;
+    r.s.gamma = r.s.brightness = 1.0;
+    r.s.format.container = IMAGE_PNM;
+    r.s.format.bits = 8;
+    r.threads = 1;
+    bool inter = false;
+    int opt;
+    while ((opt = getopt_long(argc,argv,"s:c:g:b:m:I:t:i",_long_opts,NULL))
+        != -1)
+    {
+        bool ok = true;
+        switch (opt)
+        {
+        case 's':
+            ok = sscanf(optarg,"%lux%lu",&r.w,&r.h) == 2 && r.w && r.h;
+            break;
+        case 'c':
+            ok = set(&r.s,"curve",optarg);
+            break;
+        case 'g':
+            ok = set(&r.s,"gamma",optarg);
+            break;
+        case 'b':
+            ok = set(&r.s,"brightness",optarg);
+            break;
+        case 'm':
+            ok = set(&r.s,"max",optarg);
+            break;
+        case 'I':
+            ok = set(&r.s,"image",optarg);
+            break;
+        case 't':
+            r.threads = strtoul(optarg,NULL,10);
+            r.threads = r.threads ? r.threads : 1;
+            break;
+        case 'i':
+            inter = true;
+            break;
+        default:
+            ok = false;
+        }
+        if (!ok)
+        {
+            fprintf(stderr,"usage: %s [-s <w>x<h>] [-c <curve>] [-g <gamma>] "
+                "[-b <brightness>] [-m <max>] [-I <format>] [-t <n>] [-i] "
+                "<histogram> <image>\n",argv[0]);
+            return 1;
+        }
+    }
+    if (optind+2 != argc)
+    {
+        fprintf(stderr,"usage: %s [options] <histogram> <image>\n",argv[0]);
+        return 1;
+    }
+    r.s.out = argv[optind+1];
+
+    double t0 = wall_time();
+    const char *name = argv[optind];
+    size_t len;
+    const char *data = map_file(name,&len);
+    if (!data)
+    {
+        fprintf(stderr,"can not open %s\n",name);
+        return 1;
+    }
+    uint32_t *decoded = NULL;
+    if (sparse_is(data,len))
+    {
+        unmap_file(data,len);
+        data = NULL;
+        sparse_file_t *f = sparse_open(name);
+        const sparse_header_t *sh = sparse_info(f);
+        r.w = sh->size_x;
+        r.h = sh->size_y;
+        r.hist_max = sh->max;
+        decoded = hist_alloc(r.w*r.h*sizeof(*decoded),HUGEPAGES_THP);
+        sparse_read(f,decoded,false,r.threads);
+        sparse_close(f);
+        r.hist = decoded;
+    }
+    else
+    {
+        if (!r.w || len != r.w*r.h*sizeof(*r.hist))
+        {
+            fprintf(stderr,"%s is not a sparse histogram or a raw one of "
+                "the size given with -s\n",name);
+            return 1;
+        }
+        r.hist = (const uint32_t*)data;
+        r.hist_max = parallel(&max_part,&r);
+    }
+    fprintf(stderr,"loaded %lux%lu histogram, max count %u, in %f sec\n",
+        r.w,r.h,r.hist_max,wall_time()-t0);
+    r.lut = malloc(LUT_MAX*sizeof(*r.lut));
+    r.img = malloc(r.w*r.h*sizeof(uint16_t));
+    assert(r.lut && r.img);
+    retone(&r);
+    if (inter)
+        interactive(&r);
+    free(r.img);
+    free(r.lut);
+    if (decoded)
+        hist_free(decoded,r.w*r.h*sizeof(*decoded));
+    else
+        unmap_file(data,len);
+    return 0;
+}
@@ -4,41 +4,64 @@ Types
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "jrand.h"
 
-typedef float num_t;
+// floating point type for flame parameters and results, the iteration
+// itself runs in the precision chosen for each flame (see kernel.h)
+typedef double num_t;
+
+// precision of the iteration kernel
+typedef enum
+{
+    PRECISION_AUTO, // from the bounds and image size
+    PRECISION_FLOAT,
+    PRECISION_DOUBLE
+}
+precision_t;
+
+// accuracy of the transcendental functions in the iteration (see fastmath.h)
+typedef enum
+{
+    MATH_EXACT, // libm
+    MATH_PRECISE, // about 1e-6
+    MATH_FAST // about 1e-3
+}
+math_tier_t;
 
 // machine epsilon
 #define _EMACH32 (1.0F / (float)(1  << 23)) // 1.1920928955078125e-07
 #define _EMACH64 (1.0 / (double)(1L << 52)) // 2.220446049250313e-16
 
+// constants are long double literals so they are exact in any precision
+
 // pi based constants
-#define _PI    ((num_t) 3.141592653589793)
-#define _2PI   ((num_t) 6.283185307179586)
-#define _1_PI  ((num_t) 0.3183098861837907)
-#define _2_PI  ((num_t) 0.6366197723675814)
-#define _PI_2  ((num_t) 1.5707963267948966)
-#define _PI_3  ((num_t) 1.0471975511965976)
-#define _PI_4  ((num_t) 0.7853981633974483)
-#define _PI_6  ((num_t) 0.5235987755982988)
-#define _PI_12 ((num_t) 0.2617993877991494)
+#define _PI    ((num_t) 3.14159265358979323846L)
+#define _2PI   ((num_t) 6.28318530717958647693L)
+#define _1_PI  ((num_t) 0.31830988618379067154L)
+#define _2_PI  ((num_t) 0.63661977236758134308L)
+#define _PI_2  ((num_t) 1.57079632679489661923L)
+#define _PI_3  ((num_t) 1.04719755119659774615L)
+#define _PI_4  ((num_t) 0.78539816339744830962L)
+#define _PI_6  ((num_t) 0.52359877559829887308L)
+#define _PI_12 ((num_t) 0.26179938779914943654L)
 
 // e based constants
-#define _E    ((num_t) 2.718281828459045)
-#define _1_E  ((num_t) 0.36787944117144233)
-#define _LOG2 ((num_t) 0.6931471805599453)
+#define _E    ((num_t) 2.71828182845904523536L)
+#define _1_E  ((num_t) 0.36787944117144232160L)
+#define _LOG2 ((num_t) 0.69314718055994530942L)
 
 // sqrt based constants
-#define _SQRT2   ((num_t) 1.4142135623730951)
-#define _SQRT3   ((num_t) 1.7320508075688772)
-#define _SQRT5   ((num_t) 2.23606797749979)
-#define _1_SQRT2 ((num_t) 0.7071067811865475)
-#define _1_SQRT3 ((num_t) 0.5773502691896258)
-#define _1_SQRT5 ((num_t) 0.4472135954999579)
-#define _PHI     ((num_t) 1.618033988749895)
-#define _1_PHI   ((num_t) 0.6180339887498948)
+#define _SQRT2   ((num_t) 1.41421356237309504880L)
+#define _SQRT3   ((num_t) 1.73205080756887729353L)
+#define _SQRT5   ((num_t) 2.23606797749978969641L)
+#define _1_SQRT2 ((num_t) 0.70710678118654752440L)
+#define _1_SQRT3 ((num_t) 0.57735026918962576451L)
+#define _1_SQRT5 ((num_t) 0.44721359549995793928L)
+#define _PHI     ((num_t) 1.61803398874989484820L)
+#define _1_PHI   ((num_t) 0.61803398874989484820L)
 
 // small number for avoiding division by zero
 #define _EPS ((num_t) 1e-10)
@@ -57,7 +80,7 @@ affine_params;
 // affine identity transformation (x,y) -> (x,y)
 extern const affine_params null_affine;
 
-// some helper types, currently unused
+// some helper types, rgba_t currently unused
 typedef struct { uint8_t r, g, b; } rgb_t;
 typedef struct { uint8_t r, g, b, a; } rgba_t;
 typedef struct { num_t x, y; } point_t;
@@ -73,16 +96,11 @@ typedef struct
 }
 var_params_t;
 
-typedef struct iter_state_t iter_state_t; // forward declare
-
-// variation function type
-typedef void (*var_func_t)(iter_state_t*,num_t);
-
 // xform
 typedef struct
 {
     num_t weight; // probability to select (will be normalized)
-    var_func_t *vars; // function pointers to variations
+    uint32_t *var_ids; // indices into VARIATIONS
     num_t *varw; // variation wewights
     uint32_t var_len; // number of variations
     affine_params pre_affine;
@@ -101,19 +119,15 @@ typedef struct
     num_t xmin, xmax, ymin, ymax; // bounds for rectangle to render
     xform_t *xforms;
     size_t xforms_len;
+    xform_t *final_xform; // applied to plotted points only, NULL if none
+    int32_t symmetry; // of the plotted points (see symmetry.h), 0 if none
+    precision_t precision; // for the iteration
+    uint32_t oversample; // supersampling of the source genome, recorded only
+    num_t filter; // its spatial filter radius in pixels, recorded only
+    rgb_t *palette; // NULL if none, the renderer is grayscale
+    uint32_t palette_len;
+    void *block; // holds all the memory above (see pack_flame())
+    size_t block_size;
+    bool mapped; // block is in a compiled flame file (see flamebin.h)
 }
 flame_t;
-
-// iteration state variables
-struct iter_state_t
-{
-    num_t x, y; // current point
-    num_t tx, ty; // pre affine transform applied
-    num_t vx, vy; // variation sum
-    jrand_t rand; // RNG state
-    xform_t *xf; // xform selected (contains params)
-    // precalculated variables (TODO enable)
-    // num_t pc_theta, pc_phi;
-    // num_t pc_sint, pc_cost;
-    // num_t pc_r, pc_r2;
-};
@@ -1,7 +1,12 @@
 #include "utils.h"
 #include <assert.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 // read entire file contents into newly allocated null terminated string
 char *read_text_file(const char *fname)
@@ -56,3 +61,33 @@ size_t read_binary_file(const char *fname, void **buf)
     fclose(f);
     return read_length;
 }
+
+// map a whole file read only, NULL if it can not be opened or is empty
+const char *map_file(const char *fname, size_t *len)
+{
+    int fd = open(fname,O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    void *ret = MAP_FAILED;
+    if (!fstat(fd,&st) && st.st_size > 0)
+        ret = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if (ret == MAP_FAILED)
+        return NULL;
+    *len = st.st_size;
+    return ret;
+}
+
+void unmap_file(const char *data, size_t len)
+{
+    munmap((void*)data,len);
+}
+
+// monotonic wall clock time in seconds
+double wall_time()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC,&t);
+    return t.tv_sec + t.tv_nsec*1e-9;
+}
@@ -7,3 +7,9 @@ char *read_text_file(const char *fname);
 char *read_stdin_text();
 
 size_t read_binary_file(const char *fname, void **buf);
+
+const char *map_file(const char *fname, size_t *len);
+
+void unmap_file(const char *data, size_t len);
+
+double wall_time();
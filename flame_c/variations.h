@@ -1,21 +1,30 @@
 /*
 Variations
+The functions are in variations_impl.h, compiled for each kernel precision
 */
 
 #pragma once
 
+#include <stdint.h>
+
 #include "types.h"
 
 typedef struct
 {
     const char *name;
-    const var_func_t func;
     const uint32_t flags;
 }
 var_info_t;
 
+// number of variations in VARIATIONS (not counting the end marker)
+#define VARIATIONS_LEN 23
+
+// indexed by variation id, ends with a NULL name
 extern const var_info_t VARIATIONS[];
 
+// id of the variation with the given name, -1 if there is none
+int32_t variation_id(const char *name);
+
 // precalc flags
 #define PC_THETA (1 << 0)
 #define PC_PHI   (1 << 1)
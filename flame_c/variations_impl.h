@@ -0,0 +1,416 @@
+/*
+Variation functions in the kernel precision
+Included once by each kernel (see kernel_impl.h), there is no include guard.
+The including file defines
+  KNUM     floating point type of the kernel
+  KSINCOS  sincos function for KNUM
+and for a fast math tier (see fastmath.h) instead of libm
+  KMATH    the math_tier_t
+  KFM(f)   fastmath.h function f for KNUM
+*/
+
+#include <math.h>
+
+#include "fastmath.h"
+#include "jrand.h"
+#include "types.h"
+#include "variations.h"
+
+typedef KNUM knum_t;
+
+// constants in the kernel precision
+#define _K(c) ((knum_t)(c))
+
+// transcendental functions from fastmath.h at the tier of the kernel, or
+// libm (type generic in the long double reference through tgmath.h)
+#ifdef KFM
+#define _SIN(x) KFM(sin)(x,KMATH)
+#define _COS(x) KFM(cos)(x,KMATH)
+#define _TAN(x) KFM(tan)(x,KMATH)
+#define _EXP(x) KFM(exp)(x,KMATH)
+#define _POW(x,y) KFM(pow)(x,y,KMATH)
+#define _ATAN2(y,x) KFM(atan2)(y,x,KMATH)
+#define _HYPOT(x,y) KFM(hypot)(x,y,KMATH)
+#define _SINCOS(x,s,c) KFM(sincos)(x,s,c,KMATH)
+#define _SINHCOSH(x,s,c) KFM(sinhcosh)(x,s,c,KMATH)
+#else
+#define _SIN(x) sin(x)
+#define _COS(x) cos(x)
+#define _TAN(x) tan(x)
+#define _EXP(x) exp(x)
+#define _POW(x,y) pow(x,y)
+#define _ATAN2(y,x) atan2(y,x)
+#define _HYPOT(x,y) hypot(x,y)
+// define this since the sincos depends on the type of knum_t
+#define _SINCOS(x,s,c) KSINCOS(x,s,c)
+#define _SINHCOSH(x,s,c) (*(s) = sinh(x), *(c) = cosh(x))
+#endif
+
+// affine parameters in the kernel precision
+typedef struct
+{
+    knum_t a, b, c, d, e, f;
+}
+kaffine_t;
+
+typedef struct kstate_t kstate_t; // forward declare
+
+// variation function type
+typedef void (*kvar_func_t)(kstate_t*,knum_t);
+
+// xform converted to the kernel precision
+typedef struct
+{
+    kvar_func_t *vars; // variation functions
+    knum_t *varw; // variation weights
+    uint32_t var_len;
+    kaffine_t pre_affine;
+    kaffine_t post_affine;
+    var_params_t var_params; // other variation parameters
+}
+kxform_t;
+
+// iteration state variables
+struct kstate_t
+{
+    knum_t x, y; // current point
+    knum_t tx, ty; // pre affine transform applied
+    knum_t vx, vy; // variation sum
+    jrand_t rand; // RNG state
+    kxform_t *xf; // xform selected (contains params)
+    // precalculated variables (TODO enable)
+    // knum_t pc_theta, pc_phi;
+    // knum_t pc_sint, pc_cost;
+    // knum_t pc_r, pc_r2;
+};
+
+// squared 2-norm (precalc_sumsq)
+static inline knum_t _r2(knum_t x, knum_t y)
+{
+    return x*x + y*y;
+}
+
+// 2-norm (precalc_sqrt)
+static inline knum_t _r(knum_t x, knum_t y)
+{
+    return _HYPOT(x,y);
+}
+
+// angles
+
+// atan2(x,y) (precalc_atan)
+static inline knum_t _theta(knum_t x, knum_t y)
+{
+    return _ATAN2(x,y);
+}
+
+// atan2(y,x) (precalc_atanyx)
+static inline knum_t _phi(knum_t x, knum_t y)
+{
+    return _ATAN2(y,x);
+}
+
+// tables for random variables
+static const knum_t _OMEGA_TABLE[2] = { 0, _K(_PI) };
+static const knum_t _LAMBDA_TABLE[2] = { 1.0, -1.0 };
+
+// random variables
+
+// random in [0,1)
+static inline knum_t _psi(jrand_t *j)
+{
+    return jrand_next_float(j);
+}
+
+// 0 or pi
+static inline knum_t _omega(jrand_t *j)
+{
+    return _OMEGA_TABLE[jrand_next_bool(j)];
+}
+
+// 1 or -1
+static inline knum_t _lambda(jrand_t *j)
+{
+    return _LAMBDA_TABLE[jrand_next_bool(j)];
+}
+
+// helper macros (prefix _C_ for compute)
+#define _X (S->tx)
+#define _Y (S->ty)
+#define _C_R2 _r2(S->tx,S->ty)
+#define _C_R _r(S->tx,S->ty)
+#define _C_ATAN _theta(S->tx,S->ty)
+#define _C_ATANYX _phi(S->tx,S->ty)
+#define _PARAMS (S->xf->var_params)
+// random values
+#define _R_UNIF _psi(&S->rand)
+#define _R_0_PI _omega(&S->rand)
+#define _R_1_NEG1 _lambda(&S->rand)
+// pre affine constants
+#define _PRE_A (S->xf->pre_affine.a)
+#define _PRE_B (S->xf->pre_affine.b)
+#define _PRE_C (S->xf->pre_affine.c)
+#define _PRE_D (S->xf->pre_affine.d)
+#define _PRE_E (S->xf->pre_affine.e)
+#define _PRE_F (S->xf->pre_affine.f)
+
+// TODO for efficiency, some of the following should be precalculated
+// more values may be good to precalculate, and some variation specific ones
+// all these depend on tx,ty but some may only depend on the xform
+// atan2(x,y) (theta)
+// atan2(y,x) (phi)
+// sin(theta), cos(theta)
+// r = sqrt(x*x + y*y) (and r^2)
+// sin(x), sin(y), cos(x), cos(y), sin(r), cos(r)
+
+static void var0_linear(kstate_t *S, knum_t W)
+{
+    S->vx += W * _X;
+    S->vy += W * _Y;
+}
+
+static void var1_sinusoidal(kstate_t *S, knum_t W)
+{
+    S->vx += W * _SIN(_X);
+    S->vy += W * _SIN(_Y);
+}
+
+static void var2_spherical(kstate_t *S, knum_t W)
+{
+    knum_t r = W / (_C_R2 + _K(_EPS));
+    S->vx += r * _X;
+    S->vy += r * _Y;
+}
+
+static void var3_swirl(kstate_t *S, knum_t W)
+{
+    knum_t sr,cr;
+    _SINCOS(_C_R2,&sr,&cr);
+    S->vx += W * (sr*_X - cr*_Y);
+    S->vy += W * (cr*_X + sr*_Y);
+}
+
+static void var4_horseshoe(kstate_t *S, knum_t W)
+{
+    knum_t r = W / (_C_R + _K(_EPS));
+    S->vx += (_X-_Y) * (_X+_Y) * r;
+    S->vy += 2.0*_X*_Y * r;
+}
+
+static void var5_polar(kstate_t *S, knum_t W)
+{
+    S->vx += W * _C_ATAN * _K(_1_PI);
+    S->vy += W * (_C_R - 1.0);
+}
+
+static void var6_handkerchief(kstate_t *S, knum_t W)
+{
+    knum_t a = _C_ATAN;
+    knum_t r = _C_R;
+    knum_t rw = W * r;
+    S->vx += rw * _SIN(a+r);
+    S->vy += rw * _COS(a-r);
+}
+
+static void var7_heart(kstate_t *S, knum_t W)
+{
+    knum_t r = _C_R;
+    knum_t sin_a,cos_a;
+    _SINCOS(r*_C_ATAN,&sin_a,&cos_a);
+    r *= W;
+    S->vx += r * sin_a;
+    S->vy += (-r) * cos_a;
+}
+
+static void var8_disc(kstate_t *S, knum_t W)
+{
+    knum_t a = _C_ATAN * _K(_1_PI) * W;
+    knum_t sr,cr;
+    _SINCOS(_K(_PI)*_C_R,&sr,&cr);
+    S->vx += sr * a;
+    S->vy += cr * a;
+}
+
+static void var9_spiral(kstate_t *S, knum_t W)
+{
+    knum_t a = _C_ATAN;
+    knum_t r = _C_R + _K(_EPS);
+    knum_t sr,cr;
+    _SINCOS(r,&sr,&cr);
+    knum_t r1 = W/r;
+    S->vx += r1 * (_COS(a) + sr);
+    S->vy += r1 * (_SIN(a) - cr);
+}
+
+static void var10_hyperbolic(kstate_t *S, knum_t W)
+{
+    knum_t r = _C_R + _K(_EPS);
+    knum_t a = _C_ATAN;
+    S->vx += W * _SIN(a) / r;
+    S->vy += W * _COS(a) * r;
+}
+
+static void var11_diamond(kstate_t *S, knum_t W)
+{
+    knum_t a = _C_ATAN;
+    knum_t sr,cr;
+    _SINCOS(_C_R,&sr,&cr);
+    S->vx += W * _SIN(a) * cr;
+    S->vy += W * _COS(a) * sr;
+}
+
+static void var12_ex(kstate_t *S, knum_t W)
+{
+    knum_t a = _C_ATAN;
+    knum_t r = _C_R;
+    knum_t n0 = _SIN(a+r);
+    knum_t n1 = _COS(a-r);
+    knum_t m0 = n0*n0*n0 * r;
+    knum_t m1 = n1*n1*n1 * r;
+    S->vx += W * (m0 + m1);
+    S->vy += W * (m0 - m1);
+}
+
+static void var13_julia(kstate_t *S, knum_t W)
+{
+    knum_t r = _C_R * W;
+    knum_t sa,ca;
+    _SINCOS(0.5*_C_ATAN + _R_0_PI,&sa,&ca);
+    S->vx += r * ca;
+    S->vy += r * sa;
+}
+
+static void var14_bent(kstate_t *S, knum_t W)
+{
+    knum_t x = _X;
+    knum_t y = _Y;
+    // operations without branching
+    x *= (knum_t[]){1.0,2.0}[x < 0.0];
+    y *= (knum_t[]){1.0,0.5}[y < 0.0];
+    S->vx += W * x;
+    S->vy += W * y;
+}
+
+static void var15_waves(kstate_t *S, knum_t W)
+{
+    // TODO precalculate dx2,dy2 for efficiency (dependent only on xform)
+    knum_t dx2 = 1.0 / (_PRE_C*_PRE_C + _K(_EPS));
+    knum_t dy2 = 1.0 / (_PRE_F*_PRE_F + _K(_EPS));
+    knum_t x = _X * _PRE_B * _SIN(_Y * dx2);
+    knum_t y = _Y * _PRE_E * _SIN(_X * dy2);
+    S->vx += W * x;
+    S->vy += W * y;
+}
+
+static void var16_fisheye(kstate_t *S, knum_t W)
+{
+    knum_t r = 2.0 * W / (_C_R + 1.0);
+    S->vx += r * _Y;
+    S->vy += r * _X;
+}
+
+static void var17_popcorn(kstate_t *S, knum_t W)
+{
+    S->vx += W * (_X + _PRE_C * _SIN(_TAN(3*_Y)));
+    S->vy += W * (_Y + _PRE_F * _SIN(_TAN(3*_X)));
+}
+
+static void var18_exponential(kstate_t *S, knum_t W)
+{
+    knum_t dx = W * _EXP(_X - 1.0);
+    knum_t sdy,cdy;
+    _SINCOS(_K(_PI)*_Y,&sdy,&cdy);
+    S->vx += dx * cdy;
+    S->vy += dx * sdy;
+}
+
+static void var19_power(kstate_t *S, knum_t W)
+{
+    knum_t a = _C_ATAN;
+    knum_t sina = _SIN(a);
+    knum_t r = W * _POW(_C_R,sina);
+    S->vx += r * _COS(a);
+    S->vy += r * sina;
+}
+
+static void var20_cosine(kstate_t *S, knum_t W)
+{
+    knum_t a = _X * _K(_PI);
+    knum_t sa,ca,sh,ch;
+    _SINCOS(a,&sa,&ca);
+    _SINHCOSH(_Y,&sh,&ch);
+    S->vx += W * (ca * ch);
+    S->vy += W * ((-sa) * sh);
+}
+
+static void var21_rings(kstate_t *S, knum_t W)
+{
+    // TODO precalculate dx (only depends on xform)
+    knum_t dx = _PRE_C*_PRE_C + _K(_EPS);
+    knum_t r = _C_R;
+    r = W * (fmod(r+dx,2.0*dx) - dx + r * (1.0 - dx));
+    knum_t a = _C_ATAN;
+    S->vx += r * _COS(a);
+    S->vy += r * _SIN(a);
+}
+
+static void var22_fan(kstate_t *S, knum_t W)
+{
+    // TODO precalculate dx,dy (only depends on xform)
+    knum_t dx = _K(_PI) * (_PRE_C*_PRE_C + _K(_EPS));
+    knum_t dy = _PRE_F;
+    knum_t dx2 = dx * 0.5;
+    knum_t a = _C_ATAN;
+    knum_t r = W * _C_R;
+    knum_t sa,ca;
+    // add to a without branching
+    knum_t m = (knum_t[]){1.0,-1.0}[fmod(a+dy,dx) > dx2];
+    a += m * dx2;
+    _SINCOS(a,&sa,&ca);
+    S->vx += r * ca;
+    S->vy += r * sa;
+}
+
+// not in the table until the blob parameters are parsed
+__attribute__((unused))
+static void var23_blob(kstate_t *S, knum_t W)
+{
+    knum_t r = _C_R * W;
+    knum_t a = _C_ATAN;
+    // TODO precalculate bdiff
+    //knum_t bdiff = _PARAMS.blob_high - _PARAMS.blob_low;
+    //r *= _PARAMS.blob_low + bdiff*(0.5 + 0.5*_SIN(_PARAMS.blob_waves*a));
+    S->vx += r * _SIN(a);
+    S->vy += r * _COS(a);
+}
+
+// indexed by variation id, same order as VARIATIONS[]
+static const kvar_func_t VAR_FUNCS[] =
+{
+    &var0_linear,
+    &var1_sinusoidal,
+    &var2_spherical,
+    &var3_swirl,
+    &var4_horseshoe,
+    &var5_polar,
+    &var6_handkerchief,
+    &var7_heart,
+    &var8_disc,
+    &var9_spiral,
+    &var10_hyperbolic,
+    &var11_diamond,
+    &var12_ex,
+    &var13_julia,
+    &var14_bent,
+    &var15_waves,
+    &var16_fisheye,
+    &var17_popcorn,
+    &var18_exponential,
+    &var19_power,
+    &var20_cosine,
+    &var21_rings,
+    &var22_fan
+};
+
+_Static_assert(sizeof(VAR_FUNCS)/sizeof(VAR_FUNCS[0]) == VARIATIONS_LEN,
+    "VAR_FUNCS does not match VARIATIONS");
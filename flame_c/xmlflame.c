@@ -0,0 +1,571 @@
+#define _GNU_SOURCE // memmem
+
+#include <assert.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parser.h"
+#include "variations.h"
+#include "xmlflame.h"
+
+// limits for one tag and for the unknown variation warnings of one flame
+#define _MAX_ATTRS 256
+#define _MAX_WARNED 32
+#define _MAX_NAME 64
+
+// defaults and sanity checks, as for JSON flames (see parser.c)
+#define SIZE_DEFAULT 512
+#define SIZE_LIMIT 100000
+#define QUALITY_DEFAULT 100
+#define OVERSAMPLE_MAX 16
+
+// largest flame symmetry expanded to xforms, flam3 has no limit
+#define _SYMMETRY_LIMIT 1000
+
+typedef struct
+{
+    const char *s;
+    size_t len;
+}
+_span_t;
+
+typedef struct
+{
+    _span_t name, value;
+}
+_xattr_t;
+
+typedef struct
+{
+    _span_t name;
+    _xattr_t attrs[_MAX_ATTRS];
+    size_t attrs_len;
+    bool closing; // </name>
+    bool empty; // <name .../>
+}
+_xtag_t;
+
+// names of unknown variations already reported for a flame
+typedef struct
+{
+    _span_t names[_MAX_WARNED];
+    size_t len;
+}
+_warned_t;
+
+// xform attributes that are not variations
+static const char *const _XFORM_ATTRS[] =
+{
+    "weight", "color", "symmetry", "color_speed", "opacity", "coefs", "post",
+    "chaos", "name", "animate", "var_color", "plotmode", "motion_frequency",
+    "motion_function", NULL
+};
+
+// value+1 of hex digits, 0 for everything else
+static const unsigned char _HEX[256] =
+{
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16
+};
+
+// wrapper for fprintf(stderr,..)
+static void _write_error(const char *f, ...)
+{
+    va_list args;
+    va_start(args,f);
+    vfprintf(stderr,f,args);
+    va_end(args);
+}
+
+static inline bool _is_space(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static bool _span_is(_span_t s, const char *lit)
+{
+    size_t n = strlen(lit);
+    return s.len == n && !memcmp(s.s,lit,n);
+}
+
+// read the next tag at or after *pos and move past it, skipping text,
+// comments, declarations and processing instructions. false at the end.
+static bool _next_tag(const char **pos, const char *end, _xtag_t *tag)
+{
+    const char *p = *pos;
+    for (;;)
+    {
+        p = memchr(p,'<',end-p);
+        if (!p)
+            return false;
+        if (end-p >= 4 && !memcmp(p,"<!--",4))
+        {
+            p = memmem(p+4,end-p-4,"-->",3);
+            if (!p)
+                return false;
+            p += 3;
+        }
+        else if (end-p >= 2 && (p[1] == '?' || p[1] == '!'))
+        {
+            p = memchr(p,'>',end-p);
+            if (!p)
+                return false;
+            ++p;
+        }
+        else
+            break;
+    }
+    ++p;
+    tag->closing = p < end && *p == '/';
+    if (tag->closing)
+        ++p;
+    tag->name.s = p;
+    while (p < end && !_is_space(*p) && *p != '>' && *p != '/')
+        ++p;
+    tag->name.len = p - tag->name.s;
+    tag->attrs_len = 0;
+    tag->empty = false;
+    for (;;)
+    {
+        while (p < end && _is_space(*p))
+            ++p;
+        if (p == end)
+        {
+            _write_error("xml: unterminated tag <%.*s\n",
+                (int)tag->name.len,tag->name.s);
+            assert(0);
+        }
+        if (*p == '>')
+        {
+            ++p;
+            break;
+        }
+        if (*p == '/')
+        {
+            ++p;
+            assert(p < end && *p == '>');
+            ++p;
+            tag->empty = true;
+            break;
+        }
+        if (tag->attrs_len == _MAX_ATTRS)
+        {
+            _write_error("xml: more than %u attributes in <%.*s>\n",
+                _MAX_ATTRS,(int)tag->name.len,tag->name.s);
+            assert(0);
+        }
+        _xattr_t *a = tag->attrs + tag->attrs_len++;
+        a->name.s = p;
+        while (p < end && *p != '=' && !_is_space(*p) && *p != '>')
+            ++p;
+        a->name.len = p - a->name.s;
+        while (p < end && _is_space(*p))
+            ++p;
+        assert(p < end && *p == '=');
+        ++p;
+        while (p < end && _is_space(*p))
+            ++p;
+        assert(p < end && (*p == '"' || *p == '\''));
+        const char *q = memchr(p+1,*p,end-p-1);
+        assert(q);
+        a->value.s = p+1;
+        a->value.len = q - (p+1);
+        p = q+1;
+    }
+    *pos = p;
+    return true;
+}
+
+static const _span_t *_attr(const _xtag_t *tag, const char *name)
+{
+    for (size_t i = 0; i < tag->attrs_len; ++i)
+        if (_span_is(tag->attrs[i].name,name))
+            return &tag->attrs[i].value;
+    return NULL;
+}
+
+// parse up to max numbers from an attribute value, returns how many. the
+// value is followed by its closing quote, which stops strtod.
+static size_t _parse_nums(_span_t v, num_t *out, size_t max)
+{
+    const char *p = v.s, *e = v.s + v.len;
+    size_t n = 0;
+    while (n < max)
+    {
+        while (p < e && _is_space(*p))
+            ++p;
+        if (p == e)
+            break;
+        char *q;
+        double d = strtod(p,&q);
+        if (q == p || q > e)
+            break;
+        out[n++] = d;
+        p = q;
+    }
+    return n;
+}
+
+static num_t _num_attr(const _xtag_t *tag, const char *name, num_t def)
+{
+    const _span_t *v = _attr(tag,name);
+    num_t ret;
+    if (!v || _parse_nums(*v,&ret,1) != 1)
+        return def;
+    return ret;
+}
+
+// coefs="a d b e c f", the order of flam3
+static void _affine_attr(const _xtag_t *tag, const char *name,
+                        affine_params *af)
+{
+    *af = NULL_AFFINE;
+    const _span_t *v = _attr(tag,name);
+    if (!v)
+        return;
+    num_t c[6];
+    if (_parse_nums(*v,c,6) != 6)
+    {
+        _write_error("  bad %s=\"%.*s\", using the identity\n",name,
+            (int)v->len,v->s);
+        return;
+    }
+    af->a = c[0];
+    af->d = c[1];
+    af->b = c[2];
+    af->e = c[3];
+    af->c = c[4];
+    af->f = c[5];
+}
+
+// whether an attribute is a parameter of another one, like julian_power
+static bool _is_param(const _xtag_t *tag, _span_t name)
+{
+    for (size_t i = 0; i < tag->attrs_len; ++i)
+    {
+        _span_t v = tag->attrs[i].name;
+        if (v.len < name.len && name.s[v.len] == '_'
+            && !memcmp(v.s,name.s,v.len))
+            return true;
+    }
+    return false;
+}
+
+static void _warn_variation(_warned_t *warned, _span_t name)
+{
+    for (size_t i = 0; i < warned->len; ++i)
+        if (warned->names[i].len == name.len
+            && !memcmp(warned->names[i].s,name.s,name.len))
+            return;
+    if (warned->len < _MAX_WARNED)
+        warned->names[warned->len++] = name;
+    _write_error("  variation \"%.*s\" is not implemented, left out\n",
+        (int)name.len,name.s);
+}
+
+static bool _is_xform_attr(_span_t name)
+{
+    for (size_t i = 0; _XFORM_ATTRS[i]; ++i)
+        if (_span_is(name,_XFORM_ATTRS[i]))
+            return true;
+    return false;
+}
+
+static void _read_xform(const _xtag_t *tag, xform_t *xf, _warned_t *warned)
+{
+    xf->weight = _num_attr(tag,"weight",1.0);
+    _affine_attr(tag,"coefs",&xf->pre_affine);
+    _affine_attr(tag,"post",&xf->post_affine);
+    xf->var_params.blob_high = _num_attr(tag,"blob_high",1.0);
+    xf->var_params.blob_low = _num_attr(tag,"blob_low",0.0);
+    xf->var_params.blob_waves = _num_attr(tag,"blob_waves",1.0);
+    xf->var_ids = malloc((tag->attrs_len+1)*sizeof(*xf->var_ids));
+    xf->varw = malloc((tag->attrs_len+1)*sizeof(*xf->varw));
+    assert(xf->var_ids && xf->varw);
+    xf->var_len = 0;
+    xf->pc_flags = 0;
+    for (size_t i = 0; i < tag->attrs_len; ++i)
+    {
+        _span_t name = tag->attrs[i].name;
+        if (_is_xform_attr(name) || name.len >= _MAX_NAME)
+            continue;
+        char buf[_MAX_NAME];
+        memcpy(buf,name.s,name.len);
+        buf[name.len] = '\0';
+        int32_t id = variation_id(buf);
+        if (id < 0)
+        {
+            if (!_is_param(tag,name))
+                _warn_variation(warned,name);
+            continue;
+        }
+        num_t w;
+        if (_parse_nums(tag->attrs[i].value,&w,1) != 1 || w == 0.0)
+            continue;
+        xf->var_ids[xf->var_len] = id;
+        xf->varw[xf->var_len++] = w;
+        xf->pc_flags |= VARIATIONS[id].flags;
+    }
+}
+
+// hex colors, 2 digits per channel and format channels per color (RGB or
+// RGBA, alpha is dropped). whitespace can only come between colors.
+static void _read_palette(const char *p, const char *end, const _xtag_t *tag,
+                        flame_t *flame)
+{
+    uint32_t count = _num_attr(tag,"count",256);
+    const _span_t *fmt = _attr(tag,"format");
+    size_t digits = fmt && _span_is(*fmt,"RGBA") ? 8 : 6;
+    free(flame->palette);
+    flame->palette = malloc(count*sizeof(*flame->palette));
+    assert(flame->palette || !count);
+    uint32_t n = 0;
+    while (n < count)
+    {
+        while (p < end && _is_space(*p))
+            ++p;
+        if ((size_t)(end-p) < digits)
+            break;
+        unsigned char h[8];
+        unsigned char ok = 1;
+        for (size_t k = 0; k < digits; ++k)
+        {
+            h[k] = _HEX[(unsigned char)p[k]];
+            ok &= h[k] != 0;
+        }
+        if (!ok)
+            break;
+        rgb_t *c = flame->palette+n++;
+        c->r = (h[0]-1) << 4 | (h[1]-1);
+        c->g = (h[2]-1) << 4 | (h[3]-1);
+        c->b = (h[4]-1) << 4 | (h[5]-1);
+        p += digits;
+    }
+    if (n < count)
+        _write_error("  palette has %u of %u colors\n",n,count);
+    flame->palette_len = n;
+}
+
+// <color index="i" rgb="r g b"/>, the older palette format
+static void _read_color(const _xtag_t *tag, flame_t *flame)
+{
+    num_t i = _num_attr(tag,"index",-1.0);
+    num_t rgb[3];
+    const _span_t *v = _attr(tag,"rgb");
+    if (i < 0.0 || i >= 256.0 || !v || _parse_nums(*v,rgb,3) != 3)
+        return;
+    if (!flame->palette)
+    {
+        flame->palette = calloc(256,sizeof(*flame->palette));
+        assert(flame->palette);
+        flame->palette_len = 256;
+    }
+    if ((uint32_t)i >= flame->palette_len)
+        return;
+    rgb_t *c = flame->palette+(uint32_t)i;
+    c->r = fmin(fmax(rgb[0],0.0),255.0);
+    c->g = fmin(fmax(rgb[1],0.0),255.0);
+    c->b = fmin(fmax(rgb[2],0.0),255.0);
+}
+
+// rotation by angle (radians) about (cx,cy) after the final xform, which is
+// added as a plain linear one if there is none
+static void _add_rotation(flame_t *flame, num_t angle, num_t cx, num_t cy)
+{
+    num_t c = cos(angle), s = sin(angle);
+    affine_params r = {c,-s,cx - c*cx + s*cy,s,c,cy - s*cx - c*cy};
+    xform_t *fx = flame->final_xform;
+    if (!fx)
+    {
+        fx = flame->final_xform = malloc(sizeof(*fx));
+        assert(fx);
+        fx->weight = 0.0;
+        fx->var_ids = malloc(sizeof(*fx->var_ids));
+        fx->varw = malloc(sizeof(*fx->varw));
+        assert(fx->var_ids && fx->varw);
+        fx->var_ids[0] = variation_id("linear");
+        fx->varw[0] = 1.0;
+        fx->var_len = 1;
+        fx->pc_flags = VARIATIONS[fx->var_ids[0]].flags;
+        fx->pre_affine = NULL_AFFINE;
+        fx->post_affine = NULL_AFFINE;
+        memset(&fx->var_params,0,sizeof(fx->var_params));
+    }
+    affine_params p = fx->post_affine;
+    fx->post_affine.a = r.a*p.a + r.b*p.d;
+    fx->post_affine.b = r.a*p.b + r.b*p.e;
+    fx->post_affine.c = r.a*p.c + r.b*p.f + r.c;
+    fx->post_affine.d = r.d*p.a + r.e*p.d;
+    fx->post_affine.e = r.d*p.b + r.e*p.e;
+    fx->post_affine.f = r.d*p.c + r.e*p.f + r.f;
+}
+
+// a linear xform of weight 1 with the pre affine a b d e
+static void _add_linear(flame_t *flame, size_t *cap, num_t a, num_t b,
+                        num_t d, num_t e)
+{
+    if (flame->xforms_len == *cap)
+    {
+        *cap = *cap ? 2 * *cap : 8;
+        flame->xforms = realloc(flame->xforms,*cap*sizeof(*flame->xforms));
+        assert(flame->xforms);
+    }
+    xform_t *xf = flame->xforms + flame->xforms_len++;
+    xf->weight = 1.0;
+    xf->var_ids = malloc(sizeof(*xf->var_ids));
+    xf->varw = malloc(sizeof(*xf->varw));
+    assert(xf->var_ids && xf->varw);
+    xf->var_ids[0] = variation_id("linear");
+    xf->varw[0] = 1.0;
+    xf->var_len = 1;
+    xf->pc_flags = VARIATIONS[xf->var_ids[0]].flags;
+    xf->pre_affine = (affine_params){a,b,0.0,d,e,0.0};
+    xf->post_affine = NULL_AFFINE;
+    memset(&xf->var_params,0,sizeof(xf->var_params));
+}
+
+// the xforms flam3 adds for a flame symmetry: x -> -x if it is negative and
+// the rotations by multiples of 2pi/|symmetry| about the origin, with
+// coefficients rounded to 6 digits. returns the number added
+static size_t _add_symmetry(flame_t *flame, int32_t symmetry, size_t *cap)
+{
+    size_t len = flame->xforms_len;
+    if (symmetry < 0)
+    {
+        _add_linear(flame,cap,-1.0,0.0,0.0,1.0);
+        symmetry = -symmetry;
+    }
+    for (int32_t k = 1; k < symmetry; ++k)
+    {
+        num_t c = round(cos(k*2.0*_PI/symmetry)*1e6)/1e6;
+        num_t s = round(sin(k*2.0*_PI/symmetry)*1e6)/1e6;
+        _add_linear(flame,cap,c,-s,s,c);
+    }
+    return flame->xforms_len - len;
+}
+
+bool xml_next_flame(const char **pos, const char *end, size_t index,
+                    flame_t *flame)
+{
+    _xtag_t tag;
+    do
+        if (!_next_tag(pos,end,&tag))
+            return false;
+    while (tag.closing || !_span_is(tag.name,"flame"));
+    const _span_t *v = _attr(&tag,"name");
+    if (v)
+    {
+        flame->name = malloc(v->len+1);
+        assert(flame->name);
+        memcpy(flame->name,v->s,v->len);
+        flame->name[v->len] = '\0';
+    }
+    else
+    {
+        flame->name = malloc(32);
+        assert(flame->name);
+        snprintf(flame->name,32,"flame_%lu",index);
+    }
+    _write_error("parsing flame \"%s\"\n",flame->name);
+    num_t size[2] = {SIZE_DEFAULT,SIZE_DEFAULT};
+    num_t center[2] = {0.0,0.0};
+    if ((v = _attr(&tag,"size")))
+        _parse_nums(*v,size,2);
+    if ((v = _attr(&tag,"center")))
+        _parse_nums(*v,center,2);
+    assert(0 < size[0] && size[0] < SIZE_LIMIT);
+    assert(0 < size[1] && size[1] < SIZE_LIMIT);
+    flame->size_x = size[0];
+    flame->size_y = size[1];
+    num_t ppu = _num_attr(&tag,"scale",size[0]/2.0)
+        * pow(2.0,_num_attr(&tag,"zoom",0.0));
+    assert(ppu > 0.0);
+    flame->xmin = center[0] - size[0]/(2.0*ppu);
+    flame->xmax = center[0] + size[0]/(2.0*ppu);
+    flame->ymin = center[1] - size[1]/(2.0*ppu);
+    flame->ymax = center[1] + size[1]/(2.0*ppu);
+    num_t quality = _num_attr(&tag,"quality",QUALITY_DEFAULT);
+    flame->samples = fmax(quality*size[0]*size[1],1.0);
+    num_t oversample = _num_attr(&tag,"oversample",1.0);
+    assert(1.0 <= oversample && oversample <= OVERSAMPLE_MAX);
+    flame->oversample = oversample;
+    flame->filter = fmax(_num_attr(&tag,"filter",0.0),0.0);
+    flame->precision = PRECISION_AUTO;
+    num_t rotate = _num_attr(&tag,"rotate",0.0);
+    num_t symmetry = _num_attr(&tag,"symmetry",0.0);
+    if (!(fabs(symmetry) <= _SYMMETRY_LIMIT)
+        || symmetry != (int32_t)symmetry)
+    {
+        _write_error("  symmetry %g is not an integer of at most %d, "
+            "ignored\n",symmetry,_SYMMETRY_LIMIT);
+        symmetry = 0.0;
+    }
+    flame->symmetry = 0;
+    flame->xforms = NULL;
+    flame->xforms_len = 0;
+    flame->final_xform = NULL;
+    flame->palette = NULL;
+    flame->palette_len = 0;
+    flame->block = NULL;
+    flame->mapped = false;
+    size_t xforms_cap = 0;
+    _warned_t warned = {.len = 0};
+    bool open = !tag.empty;
+    while (open)
+    {
+        if (!_next_tag(pos,end,&tag))
+        {
+            _write_error("xml: flame \"%s\" is not closed\n",flame->name);
+            assert(0);
+        }
+        if (tag.closing)
+        {
+            if (_span_is(tag.name,"flame"))
+                break;
+            continue;
+        }
+        if (_span_is(tag.name,"xform"))
+        {
+            if (flame->xforms_len == xforms_cap)
+            {
+                xforms_cap = xforms_cap ? 2*xforms_cap : 8;
+                flame->xforms = realloc(flame->xforms,
+                    xforms_cap*sizeof(*flame->xforms));
+                assert(flame->xforms);
+            }
+            _read_xform(&tag,flame->xforms+flame->xforms_len++,&warned);
+        }
+        else if (_span_is(tag.name,"finalxform") && !flame->final_xform)
+        {
+            flame->final_xform = malloc(sizeof(*flame->final_xform));
+            assert(flame->final_xform);
+            _read_xform(&tag,flame->final_xform,&warned);
+        }
+        else if (_span_is(tag.name,"palette") && !tag.empty)
+        {
+            const char *text_end = memchr(*pos,'<',end-*pos);
+            _read_palette(*pos,text_end ? text_end : end,&tag,flame);
+        }
+        else if (_span_is(tag.name,"color"))
+            _read_color(&tag,flame);
+    }
+    if (!flame->xforms_len)
+        _write_error("xml: flame \"%s\" has no xforms\n",flame->name);
+    assert(flame->xforms_len);
+    size_t added = _add_symmetry(flame,symmetry,&xforms_cap);
+    _write_error("  has %lu xforms%s\n",flame->xforms_len,
+        flame->final_xform ? " and a final xform" : "");
+    if (added)
+        _write_error("  %lu of them added for symmetry %d\n",added,
+            (int32_t)symmetry);
+    // flam3 turns the camera by -rotate degrees
+    if (rotate != 0.0)
+        _add_rotation(flame,-rotate*_PI/180.0,center[0],center[1]);
+    pack_flame(flame);
+    return true;
+}
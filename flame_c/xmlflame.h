@@ -0,0 +1,34 @@
+/*
+flam3 / Apophysis XML genomes
+Reads <flame> elements straight from the file text, nothing is copied but
+the flame name. A genome maps to a flame as
+  size="w h"            size_x, size_y
+  center, scale, zoom   the frame, w/(scale*2^zoom) wide around the center
+  rotate                a rotation about the center after the final xform
+  quality               samples = quality*w*h
+  symmetry              xforms added as flam3 does, k > 1 adds the
+                        rotations by multiples of 2pi/k about the origin and
+                        -k also x -> -x, linear with weight 1 (the -Y option
+                        of the renderer can turn them into the symmetry of
+                        symmetry.h, which does not match flam3's output)
+  oversample, filter    recorded as they are
+  <xform>               weight, coefs and post (a d b e c f order) and one
+                        attribute per variation with its weight
+  <finalxform>          the same, the weight is not used
+  <palette>             hex colors, or <color index rgb> elements
+Variations that are not implemented are left out with a warning, other
+attributes (color, opacity, variation parameters..) are ignored.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "types.h"
+
+// parse the next <flame> element in [*pos,end) into newly allocated memory
+// (see destroy_flame()) and move *pos past it, false if there is none.
+// a flame without a name is called flame_<index>
+bool xml_next_flame(const char **pos, const char *end, size_t index,
+                    flame_t *flame);
@@ -1,2 +1,3 @@
-g++ -g -Wall -Werror -std=c++11 -O3 --fast-math -DFP64 mandelbrot_iterator.cpp -o mdb_double.out
-g++ -g -Wall -Werror -std=c++11 -O3 --fast-math -DFP128 mandelbrot_iterator.cpp -o mdb_quad.out -lquadmath
+gcc -g -Wall -Werror -std=gnu99 -O3 -c ../flame_c/image.c -o image.o
+g++ -g -Wall -Werror -std=c++11 -O3 --fast-math -DFP64 mandelbrot_iterator.cpp image.o -o mdb_double.out -pthread -lz
+g++ -g -Wall -Werror -std=c++11 -O3 --fast-math -DFP128 mandelbrot_iterator.cpp image.o -o mdb_quad.out -lquadmath -pthread -lz
@@ -4,8 +4,12 @@
 #include <assert.h>
 #include <math.h>
 #include <quadmath.h>
+#include <string.h>
 #include <chrono>
 #include <iostream>
+#include <thread>
+
+#include "../flame_c/image.h"
 
 // require defining FP64 or FP128 for floating point precision
 
@@ -35,20 +39,20 @@ uint32_t xpix, ypix;
 // number of iterations to render
 uint32_t iterlim;
 
-// array for PPM image output
-uint8_t *img_bytes = nullptr;
+// image output, rows are written as they are rendered
+image_writer_t *img_out = nullptr;
 
 // forward declarations
 void render_ST();
-void output_data();
 
 int main(int argc, char **argv)
 {
     // expect arguments in this order for now
-    // ./a.out <file> <xpix> <ypix> <x1> <y1> <xwidth> <ywidth> <iter>
-    if (argc != 8)
+    // ./a.out <xpix> <ypix> <x1> <y1> <xwidth> <ywidth> <iter> [<out>]
+    // the image is PNG if out ends in .png, otherwise PPM, stdout by default
+    if (argc != 8 && argc != 9)
     {
-        printf("Usage: ./a.out <xpix> <ypix> <xcenter> <ycenter> <xwidth> <ywidth> <iter>\n");
+        printf("Usage: ./a.out <xpix> <ypix> <xcenter> <ycenter> <xwidth> <ywidth> <iter> [<out.ppm|out.png>]\n");
         return 1;
     }
 
@@ -89,10 +93,20 @@ int main(int argc, char **argv)
 
     auto time_start = std::chrono::high_resolution_clock::now();
 
-    img_bytes = (uint8_t*) malloc(3 * xpix * ypix * sizeof(*img_bytes));
+    const char *out_name = argc == 9 ? argv[8] : "-";
+    size_t out_len = strlen(out_name);
+    image_format_t format = { IMAGE_PNM, 8, 1, 0 };
+    if (out_len >= 4 && !strcmp(out_name+out_len-4,".png"))
+    {
+        // PNG blocks are deflated by other threads while rendering
+        format.container = IMAGE_PNG;
+        format.threads = std::thread::hardware_concurrency();
+    }
+    img_out = image_open(out_name,&format,xpix,ypix,3);
+    assert(img_out);
     render_ST(); // single threaded renderer
-    output_data();
-    free(img_bytes);
+    bool written = image_close(img_out);
+    assert(written);
 
     auto time_end = std::chrono::high_resolution_clock::now();
     uint64_t time_nano = std::chrono::duration_cast<std::chrono::nanoseconds>(time_end-time_start).count();
@@ -108,8 +122,10 @@ uint8_t cB[6] = {0x00,0x00,0x00,0x00,0xFF,0xFF};
 
 void render_ST() // single threaded renderer
 {
-    uint8_t *pix_ptr = img_bytes; // current pixel pointer
+    uint8_t *row = (uint8_t*) malloc(3 * xpix * sizeof(*row));
     for (uint32_t y = ypix; y--;)
+    {
+        uint8_t *pix_ptr = row; // current pixel pointer
         for (uint32_t x = 0; x < xpix; ++x)
         {
             complex_t point = { xmin + (x * xwidth) / (xpix - 1), ymin + (y * ywidth) / (ypix - 1) };
@@ -141,13 +157,7 @@ void render_ST() // single threaded renderer
             *(pix_ptr++) = g;
             *(pix_ptr++) = b;
         }
-}
-
-void output_data() // write PPM binary image (P6)
-{
-    printf("P6\n");
-    printf("%u %u\n",xpix,ypix);
-    printf("255\n");
-    // write binary data from img_bytes array
-    fwrite(img_bytes,sizeof(*img_bytes),3*xpix*ypix,stdout);
+        image_write_rows(img_out,row,1);
+    }
+    free(row);
 }